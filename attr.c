@@ -176,6 +176,22 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 	}
 }
 
+/*
+ * Whether check->all_attrs has been set up and has room for all the
+ * attributes in check->items.
+ */
+static int all_attrs_cover(const struct attr_check *check)
+{
+	int i;
+
+	if (!check->all_attrs)
+		return 0;
+	for (i = 0; i < check->nr; i++)
+		if (check->items[i].attr->attr_nr >= check->all_attrs_nr)
+			return 0;
+	return 1;
+}
+
 static int attr_name_valid(const char *name, size_t namelen)
 {
 	/*
@@ -447,12 +463,219 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+
+	/* index of the rules by basename, see compile_attr_stack() */
+	struct attr_matcher *matcher;
+};
+
+/*
+ * Frames with fewer rules than this are scanned linearly; indexing
+ * them would cost more than it saves.
+ */
+#define ATTR_MATCHER_MIN_RULES 16
+
+/* The rules whose literal is "key", in ascending order. */
+struct attr_matcher_entry {
+	struct hashmap_entry ent;
+	const char *key; /* points into the pattern of the first rule */
+	int keylen;
+	int nr, alloc;
+	int *pos;
+};
+
+/*
+ * Most rules in large .gitattributes files are either a file name
+ * ("Makefile") or an extension ("*.png"), which only look at the
+ * basename of a path. Those are indexed by the name or by the literal
+ * after "*", so that fill() only needs to try the rules that can match
+ * and all the others ("rest"), instead of every rule in the frame.
+ *
+ * Each attr_check has its own attr_stack, so this needs no locking.
+ */
+struct attr_matcher {
+	int ignore_case;
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	/* the distinct lengths of the keys in "suffixes" */
+	int nr_suffix_lens, alloc_suffix_lens;
+	int *suffix_lens;
+	int nr_rest, alloc_rest;
+	int *rest;
+	/* scratch space for fill() */
+	int nr_candidates, alloc_candidates;
+	int *candidates;
 };
 
+static unsigned int attr_matcher_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static int attr_matcher_entry_cmp(const void *unused_cmp_data,
+				  const struct hashmap_entry *eptr,
+				  const struct hashmap_entry *entry_or_key,
+				  const void *unused_keydata)
+{
+	const struct attr_matcher_entry *a, *b;
+
+	a = container_of(eptr, const struct attr_matcher_entry, ent);
+	b = container_of(entry_or_key, const struct attr_matcher_entry, ent);
+	return (a->keylen != b->keylen) || fspathncmp(a->key, b->key, a->keylen);
+}
+
+static struct attr_matcher_entry *attr_matcher_get(struct hashmap *map,
+						   const char *key, int keylen)
+{
+	struct attr_matcher_entry k;
+
+	hashmap_entry_init(&k.ent, attr_matcher_hash(key, keylen));
+	k.key = key;
+	k.keylen = keylen;
+	return hashmap_get_entry(map, &k, ent, NULL);
+}
+
+/* Returns 1 if "key" was not in "map" yet. */
+static int attr_matcher_add(struct hashmap *map,
+			    const char *key, int keylen, int pos)
+{
+	struct attr_matcher_entry *e = attr_matcher_get(map, key, keylen);
+	int added = 0;
+
+	if (!e) {
+		CALLOC_ARRAY(e, 1);
+		hashmap_entry_init(&e->ent, attr_matcher_hash(key, keylen));
+		e->key = key;
+		e->keylen = keylen;
+		hashmap_add(map, &e->ent);
+		added = 1;
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+	return added;
+}
+
+static void attr_matcher_clear_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct attr_matcher_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent)
+		free(e->pos);
+	hashmap_clear_and_free(map, struct attr_matcher_entry, ent);
+}
+
+static void attr_matcher_free(struct attr_matcher *m)
+{
+	if (!m)
+		return;
+	attr_matcher_clear_map(&m->basenames);
+	attr_matcher_clear_map(&m->suffixes);
+	free(m->suffix_lens);
+	free(m->rest);
+	free(m->candidates);
+	free(m);
+}
+
+static void compile_attr_stack(struct attr_stack *e)
+{
+	struct attr_matcher *m;
+	int i;
+
+	if (e->matcher || e->num_matches < ATTR_MATCHER_MIN_RULES)
+		return;
+
+	CALLOC_ARRAY(m, 1);
+	m->ignore_case = ignore_case;
+	hashmap_init(&m->basenames, attr_matcher_entry_cmp, NULL, 0);
+	hashmap_init(&m->suffixes, attr_matcher_entry_cmp, NULL, 0);
+
+	for (i = 0; i < e->num_matches; i++) {
+		const struct match_attr *a = e->attrs[i];
+		const struct pattern *pat = &a->u.pat;
+
+		if (a->is_macro)
+			continue;
+
+		if (!(pat->flags & PATTERN_FLAG_NODIR)) {
+			ALLOC_GROW(m->rest, m->nr_rest + 1, m->alloc_rest);
+			m->rest[m->nr_rest++] = i;
+		} else if (pat->nowildcardlen == pat->patternlen) {
+			attr_matcher_add(&m->basenames, pat->pattern,
+					 pat->patternlen, i);
+		} else if (pat->flags & PATTERN_FLAG_ENDSWITH) {
+			int len = pat->patternlen - 1;
+
+			if (attr_matcher_add(&m->suffixes, pat->pattern + 1,
+					     len, i)) {
+				int j;
+
+				for (j = 0; j < m->nr_suffix_lens; j++)
+					if (m->suffix_lens[j] == len)
+						break;
+				if (j == m->nr_suffix_lens) {
+					ALLOC_GROW(m->suffix_lens,
+						   m->nr_suffix_lens + 1,
+						   m->alloc_suffix_lens);
+					m->suffix_lens[m->nr_suffix_lens++] = len;
+				}
+			}
+		} else {
+			ALLOC_GROW(m->rest, m->nr_rest + 1, m->alloc_rest);
+			m->rest[m->nr_rest++] = i;
+		}
+	}
+	e->matcher = m;
+}
+
+static void add_candidates(struct attr_matcher *m,
+			   const struct attr_matcher_entry *e)
+{
+	if (!e)
+		return;
+	ALLOC_GROW(m->candidates, m->nr_candidates + e->nr,
+		   m->alloc_candidates);
+	COPY_ARRAY(m->candidates + m->nr_candidates, e->pos, e->nr);
+	m->nr_candidates += e->nr;
+}
+
+static int candidate_cmp(const void *a_, const void *b_)
+{
+	int a = *(const int *)a_, b = *(const int *)b_;
+
+	/* last rule first */
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+/*
+ * Collect in m->candidates the indexed rules of the frame that may
+ * match a path with the given basename, last one first. The rules in
+ * m->rest have to be tried as well.
+ */
+static void find_candidates(struct attr_matcher *m,
+			    const char *basename, int basenamelen)
+{
+	int i;
+
+	m->nr_candidates = 0;
+	add_candidates(m, attr_matcher_get(&m->basenames,
+					   basename, basenamelen));
+	for (i = 0; i < m->nr_suffix_lens; i++) {
+		int len = m->suffix_lens[i];
+
+		if (len > basenamelen)
+			continue;
+		add_candidates(m, attr_matcher_get(&m->suffixes,
+						   basename + basenamelen - len,
+						   len));
+	}
+	QSORT(m->candidates, m->nr_candidates, candidate_cmp);
+}
+
 static void attr_stack_free(struct attr_stack *e)
 {
 	int i;
 	free(e->origin);
+	attr_matcher_free(e->matcher);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
 		int j;
@@ -543,6 +766,7 @@ static void drop_all_attr_stacks(void)
 
 	for (i = 0; i < check_vector.nr; i++) {
 		drop_attr_stack(&check_vector.checks[i]->stack);
+		drop_attr_stack(&check_vector.checks[i]->popped);
 	}
 
 	vector_unlock();
@@ -635,6 +859,7 @@ void attr_check_clear(struct attr_check *check)
 	check->all_attrs_nr = 0;
 
 	drop_attr_stack(&check->stack);
+	drop_attr_stack(&check->popped);
 }
 
 void attr_check_free(struct attr_check *check)
@@ -852,6 +1077,7 @@ static void push_stack(struct attr_stack **attr_stack_p,
 			elem->originlen = originlen;
 		elem->prev = *attr_stack_p;
 		*attr_stack_p = elem;
+		compile_attr_stack(elem);
 	}
 }
 
@@ -894,12 +1120,20 @@ static void bootstrap_attr_stack(struct index_state *istate,
 	push_stack(stack, e, NULL, 0);
 }
 
-static void prepare_attr_stack(struct index_state *istate,
-			       const char *path, int dirlen,
-			       struct attr_stack **stack)
+/*
+ * Returns 1 if frames other than the "info" one had to be popped from
+ * or pushed to the stack, i.e. if the rules that apply may have changed
+ * since the last call. The popped frames are freed, or moved to
+ * "popped" if it is not NULL.
+ */
+static int prepare_attr_stack(struct index_state *istate,
+			      const char *path, int dirlen,
+			      struct attr_stack **stack,
+			      struct attr_stack **popped)
 {
 	struct attr_stack *info;
 	struct strbuf pathbuf = STRBUF_INIT;
+	int changed = !*stack;
 
 	/*
 	 * At the bottom of the attribute stack is the built-in
@@ -942,7 +1176,13 @@ static void prepare_attr_stack(struct index_state *istate,
 
 		debug_pop(elem);
 		*stack = elem->prev;
-		attr_stack_free(elem);
+		if (popped) {
+			elem->prev = *popped;
+			*popped = elem;
+		} else {
+			attr_stack_free(elem);
+		}
+		changed = 1;
 	}
 
 	/*
@@ -979,6 +1219,7 @@ static void prepare_attr_stack(struct index_state *istate,
 
 		origin = xstrdup(pathbuf.buf);
 		push_stack(stack, next, origin, len);
+		changed = 1;
 	}
 
 	/*
@@ -987,6 +1228,7 @@ static void prepare_attr_stack(struct index_state *istate,
 	push_stack(stack, info, NULL, 0);
 
 	strbuf_release(&pathbuf);
+	return changed;
 }
 
 static int path_matches(const char *pathname, int pathlen,
@@ -1043,11 +1285,37 @@ static int fill(const char *path, int pathlen, int basename_offset,
 	for (; rem > 0 && stack; stack = stack->prev) {
 		int i;
 		const char *base = stack->origin ? stack->origin : "";
+		struct attr_matcher *m = stack->matcher;
+		int c, r;
+
+		if (!m || m->ignore_case != ignore_case) {
+			for (i = stack->num_matches - 1; 0 < rem && 0 <= i; i--) {
+				const struct match_attr *a = stack->attrs[i];
+				if (a->is_macro)
+					continue;
+				if (path_matches(path, pathlen, basename_offset,
+						 &a->u.pat, base, stack->originlen))
+					rem = fill_one("fill", all_attrs, a, rem);
+			}
+			continue;
+		}
+
+		find_candidates(m, path + basename_offset,
+				pathlen - basename_offset -
+				(pathlen && path[pathlen - 1] == '/'));
 
-		for (i = stack->num_matches - 1; 0 < rem && 0 <= i; i--) {
-			const struct match_attr *a = stack->attrs[i];
-			if (a->is_macro)
-				continue;
+		/* merge the candidates and the rest, last rule first */
+		c = 0;
+		r = m->nr_rest - 1;
+		while (0 < rem && (c < m->nr_candidates || 0 <= r)) {
+			const struct match_attr *a;
+
+			if (c < m->nr_candidates &&
+			    (r < 0 || m->candidates[c] > m->rest[r]))
+				i = m->candidates[c++];
+			else
+				i = m->rest[r--];
+			a = stack->attrs[i];
 			if (path_matches(path, pathlen, basename_offset,
 					 &a->u.pat, base, stack->originlen))
 				rem = fill_one("fill", all_attrs, a, rem);
@@ -1096,9 +1364,10 @@ static void determine_macros(struct all_attrs_item *all_attrs,
  */
 static void collect_some_attrs(struct index_state *istate,
 			       const char *path,
-			       struct attr_check *check)
+			       struct attr_check *check,
+			       struct attr_stack **popped)
 {
-	int pathlen, rem, dirlen;
+	int pathlen, rem, dirlen, i;
 	const char *cp, *last_slash = NULL;
 	int basename_offset;
 
@@ -1115,9 +1384,19 @@ static void collect_some_attrs(struct index_state *istate,
 		dirlen = 0;
 	}
 
-	prepare_attr_stack(istate, path, dirlen, &check->stack);
-	all_attrs_init(&g_attr_hashmap, check);
-	determine_macros(check->all_attrs, check->stack);
+	/*
+	 * Consecutive paths in the same directory see the same stack, so
+	 * they can keep the macros found in it and only need their values
+	 * reset, unless "check" asks about attributes interned since.
+	 */
+	if (prepare_attr_stack(istate, path, dirlen, &check->stack, popped) ||
+	    !all_attrs_cover(check)) {
+		all_attrs_init(&g_attr_hashmap, check);
+		determine_macros(check->all_attrs, check->stack);
+	} else {
+		for (i = 0; i < check->all_attrs_nr; i++)
+			check->all_attrs[i].value = ATTR__UNKNOWN;
+	}
 
 	rem = check->all_attrs_nr;
 	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
@@ -1129,7 +1408,7 @@ void git_check_attr(struct index_state *istate,
 {
 	int i;
 
-	collect_some_attrs(istate, path, check);
+	collect_some_attrs(istate, path, check, NULL);
 
 	for (i = 0; i < check->nr; i++) {
 		size_t n = check->items[i].attr->attr_nr;
@@ -1140,13 +1419,55 @@ void git_check_attr(struct index_state *istate,
 	}
 }
 
+static int path_order_cmp(const void *a_, const void *b_, void *paths_)
+{
+	const char **paths = paths_;
+
+	return strcmp(paths[*(const int *)a_], paths[*(const int *)b_]);
+}
+
+void git_check_attr_batch(struct index_state *istate,
+			  int nr, const char **paths,
+			  struct attr_check *check, const char **values)
+{
+	struct attr_stack *popped = NULL;
+	int *order;
+	int i, j;
+
+	ALLOC_ARRAY(order, nr);
+	for (i = 0; i < nr; i++)
+		order[i] = i;
+	QSORT_S(order, nr, path_order_cmp, paths);
+
+	for (i = 0; i < nr; i++) {
+		const char **v = values + (size_t)order[i] * check->nr;
+
+		collect_some_attrs(istate, paths[order[i]], check, &popped);
+		for (j = 0; j < check->nr; j++) {
+			size_t n = check->items[j].attr->attr_nr;
+			const char *value = check->all_attrs[n].value;
+			if (value == ATTR__UNKNOWN)
+				value = ATTR__UNSET;
+			v[j] = value;
+		}
+	}
+
+	/*
+	 * The values of earlier paths may point into frames that later
+	 * paths did not need; keep them until "check" is used again.
+	 */
+	drop_attr_stack(&check->popped);
+	check->popped = popped;
+	free(order);
+}
+
 void git_all_attrs(struct index_state *istate,
 		   const char *path, struct attr_check *check)
 {
 	int i;
 
 	attr_check_reset(check);
-	collect_some_attrs(istate, path, check);
+	collect_some_attrs(istate, path, check, NULL);
 
 	for (i = 0; i < check->all_attrs_nr; i++) {
 		const char *name = check->all_attrs[i].attr->name;
@@ -15,7 +15,8 @@
  *   prepared by calling `attr_check_alloc()` function and then attributes you
  *   want to ask about can be added to it with `attr_check_append()` function.
  *
- * - Call `git_check_attr()` to check the attributes for the path.
+ * - Call `git_check_attr()` to check the attributes for the path, or
+ *   `git_check_attr_batch()` to check them for many paths at once.
  *
  * - Inspect `attr_check` structure to see how each of the attribute in the
  *   array is defined for the path.
@@ -170,6 +171,14 @@ struct attr_check {
 	int all_attrs_nr;
 	struct all_attrs_item *all_attrs;
 	struct attr_stack *stack;
+	/*
+	 * Frames popped by the last git_check_attr_batch(), which the
+	 * values it returned may point into. They are freed by the next
+	 * git_check_attr_batch() or attr_check_clear(). The values may
+	 * also point into "stack", whose frames any git_check_attr*()
+	 * call may pop and free.
+	 */
+	struct attr_stack *popped;
 };
 
 struct attr_check *attr_check_alloc(void);
@@ -193,6 +202,21 @@ const char *git_attr_name(const struct git_attr *);
 void git_check_attr(struct index_state *istate,
 		    const char *path, struct attr_check *check);
 
+/*
+ * Like git_check_attr(), for "nr" paths at once. The values for
+ * paths[i] are stored in values[i * check->nr] and the following
+ * check->nr - 1 slots, in the order of check->items[]; the values in
+ * check->items[] themselves are not updated. The paths are visited in
+ * sorted order, so that the ones in the same directory share the
+ * attribute stack and the macros found in it. String values remain
+ * valid until "check" is passed to any git_check_attr*() function
+ * again, or cleared: git_check_attr() pops and frees the frames of the
+ * attribute stack the values may point into, too.
+ */
+void git_check_attr_batch(struct index_state *istate,
+			  int nr, const char **paths,
+			  struct attr_check *check, const char **values);
+
 /*
  * Retrieve all attributes that apply to the specified path.
  * check holds the attributes and their values.
@@ -1259,10 +1259,18 @@ struct blame_bloom_data {
 	struct bloom_key **keys;
 	int nr;
 	int alloc;
+
+	/*
+	 * Whether the commit-graph has exact lists of changed paths,
+	 * which answer for origin->path alone without false positives.
+	 */
+	int use_changed_path_lists;
 };
 
 static int bloom_count_queries = 0;
 static int bloom_count_no = 0;
+static int changed_path_list_count_queries = 0;
+static int changed_path_list_count_no = 0;
 static int maybe_changed_path(struct repository *r,
 			      struct blame_origin *origin,
 			      struct blame_bloom_data *bd)
@@ -1276,6 +1284,21 @@ static int maybe_changed_path(struct repository *r,
 	if (commit_graph_generation(origin->commit) == GENERATION_NUMBER_INFINITY)
 		return 1;
 
+	if (bd->use_changed_path_lists) {
+		int changed = commit_graph_changed_path(r, origin->commit,
+							origin->path);
+
+		if (changed >= 0) {
+			changed_path_list_count_queries++;
+			if (!changed)
+				changed_path_list_count_no++;
+			return changed;
+		}
+	}
+
+	if (!bd->settings)
+		return 1;
+
 	filter = get_bloom_filter(r, origin->commit);
 
 	if (!filter)
@@ -1296,7 +1319,7 @@ static int maybe_changed_path(struct repository *r,
 static void add_bloom_key(struct blame_bloom_data *bd,
 			  const char *path)
 {
-	if (!bd)
+	if (!bd || !bd->settings)
 		return;
 
 	if (bd->nr >= bd->alloc) {
@@ -2890,17 +2913,20 @@ void setup_blame_bloom_data(struct blame_scoreboard *sb)
 {
 	struct blame_bloom_data *bd;
 	struct bloom_filter_settings *bs;
+	int use_changed_path_lists;
 
 	if (!sb->repo->objects->commit_graph)
 		return;
 
 	bs = get_bloom_filter_settings(sb->repo);
-	if (!bs)
+	use_changed_path_lists = commit_graph_has_changed_path_lists(sb->repo);
+	if (!bs && !use_changed_path_lists)
 		return;
 
 	bd = xmalloc(sizeof(struct blame_bloom_data));
 
 	bd->settings = bs;
+	bd->use_changed_path_lists = use_changed_path_lists;
 
 	bd->alloc = 4;
 	bd->nr = 0;
@@ -2926,5 +2952,11 @@ void cleanup_scoreboard(struct blame_scoreboard *sb)
 				   "bloom/queries", bloom_count_queries);
 		trace2_data_intmax("blame", sb->repo,
 				   "bloom/response-no", bloom_count_no);
+		trace2_data_intmax("blame", sb->repo,
+				   "changed-path-lists/queries",
+				   changed_path_list_count_queries);
+		trace2_data_intmax("blame", sb->repo,
+				   "changed-path-lists/response-no",
+				   changed_path_list_count_no);
 	}
 }
@@ -1,11 +1,10 @@
 #include "git-compat-util.h"
 #include "bloom.h"
-#include "diff.h"
-#include "diffcore.h"
-#include "revision.h"
 #include "hashmap.h"
+#include "tree-walk.h"
 #include "commit-graph.h"
 #include "commit.h"
+#include "string-list.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -184,6 +183,176 @@ static void init_truncated_large_filter(struct bloom_filter *filter)
 	filter->len = 1;
 }
 
+/*
+ * Add "path" and each of its leading directories to "pathmap", i.e. for
+ * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so the Bloom
+ * filter could be used to speed up commands like 'git log dir/subdir',
+ * too.
+ *
+ * Note that directories are added without the trailing '/'.
+ */
+static void add_changed_path(struct hashmap *pathmap, const struct strbuf *path)
+{
+	size_t len = path->len;
+
+	while (len) {
+		struct pathmap_hash_entry *e;
+
+		FLEX_ALLOC_MEM(e, path, path->buf, len);
+		hashmap_entry_init(&e->entry, strhash(e->path));
+		if (hashmap_get(pathmap, &e->entry, NULL)) {
+			/* so are all of its leading directories */
+			free(e);
+			break;
+		}
+		hashmap_add(pathmap, &e->entry);
+
+		while (len && path->buf[len - 1] != '/')
+			len--;
+		if (len)
+			len--;
+	}
+}
+
+/*
+ * Add the paths that differ between the trees "old_oid" and "new_oid"
+ * (either can be NULL for an empty tree, or a commit to use its tree)
+ * under "base" to "pathmap", like a recursive diff without rename
+ * detection would find them. Returns -1 as soon as there are more than
+ * "max" paths.
+ *
+ * This only reads objects and does not use the diff machinery or the
+ * object hash table, so that several threads can run it at once when
+ * the object read lock is enabled.
+ */
+static int collect_changed_paths(struct repository *r,
+				 const struct object_id *old_oid,
+				 const struct object_id *new_oid,
+				 struct strbuf *base, struct hashmap *pathmap,
+				 size_t max)
+{
+	struct tree_desc t1, t2;
+	void *buf1 = fill_tree_descriptor(r, &t1, old_oid);
+	void *buf2 = fill_tree_descriptor(r, &t2, new_oid);
+	size_t baselen = base->len;
+	int ret = 0;
+
+	while (!ret && (t1.size || t2.size)) {
+		const struct name_entry *e;
+		int cmp;
+
+		if (!t1.size)
+			cmp = 1;
+		else if (!t2.size)
+			cmp = -1;
+		else
+			cmp = base_name_compare(t1.entry.path,
+						tree_entry_len(&t1.entry),
+						t1.entry.mode,
+						t2.entry.path,
+						tree_entry_len(&t2.entry),
+						t2.entry.mode);
+
+		if (!cmp && t1.entry.mode == t2.entry.mode &&
+		    oideq(&t1.entry.oid, &t2.entry.oid)) {
+			update_tree_entry(&t1);
+			update_tree_entry(&t2);
+			continue;
+		}
+
+		e = cmp <= 0 ? &t1.entry : &t2.entry;
+		strbuf_add(base, e->path, tree_entry_len(e));
+		if (S_ISDIR(e->mode)) {
+			strbuf_addch(base, '/');
+			ret = collect_changed_paths(r,
+						    cmp <= 0 ? &t1.entry.oid : NULL,
+						    cmp >= 0 ? &t2.entry.oid : NULL,
+						    base, pathmap, max);
+		} else {
+			add_changed_path(pathmap, base);
+			if (hashmap_get_size(pathmap) > max)
+				ret = -1;
+		}
+		strbuf_setlen(base, baselen);
+
+		if (cmp <= 0)
+			update_tree_entry(&t1);
+		if (cmp >= 0)
+			update_tree_entry(&t2);
+	}
+
+	free(buf1);
+	free(buf2);
+	return ret;
+}
+
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct bloom_filter *filter,
+						const struct object_id *parent,
+						const struct object_id *commit,
+						const struct bloom_filter_settings *settings)
+{
+	struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
+	struct strbuf base = STRBUF_INIT;
+	enum bloom_filter_computed computed = BLOOM_COMPUTED;
+
+	if (collect_changed_paths(r, parent, commit, &base, &pathmap,
+				  settings->max_changed_paths)) {
+		init_truncated_large_filter(filter);
+		computed |= BLOOM_TRUNC_LARGE;
+		goto cleanup;
+	}
+
+	filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	if (!filter->len) {
+		computed |= BLOOM_TRUNC_EMPTY;
+		filter->len = 1;
+	}
+	CALLOC_ARRAY(filter->data, filter->len);
+
+	hashmap_for_each_entry(&pathmap, &iter, e, entry) {
+		struct bloom_key key;
+		fill_bloom_key(e->path, strlen(e->path), &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+
+cleanup:
+	hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
+	strbuf_release(&base);
+	return computed;
+}
+
+int collect_changed_path_list(struct repository *r,
+			      const struct object_id *parent,
+			      const struct object_id *commit,
+			      size_t max, struct string_list *paths)
+{
+	struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
+	struct strbuf base = STRBUF_INIT;
+	int ret;
+
+	ret = collect_changed_paths(r, parent, commit, &base, &pathmap, max);
+	if (!ret) {
+		hashmap_for_each_entry(&pathmap, &iter, e, entry)
+			string_list_append(paths, e->path);
+		string_list_sort(paths);
+	}
+
+	hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
+	strbuf_release(&base);
+	return ret;
+}
+
+struct bloom_filter *bloom_filter_at(struct commit *c)
+{
+	return bloom_filter_slab_at(&bloom_filters, c);
+}
+
 struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 struct commit *c,
 						 int compute_if_not_present,
@@ -191,8 +360,7 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 enum bloom_filter_computed *computed)
 {
 	struct bloom_filter *filter;
-	int i;
-	struct diff_options diffopt;
+	enum bloom_filter_computed result;
 
 	if (computed)
 		*computed = BLOOM_NOT_COMPUTED;
@@ -213,95 +381,14 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	if (!compute_if_not_present)
 		return NULL;
 
-	repo_diff_setup(r, &diffopt);
-	diffopt.flags.recursive = 1;
-	diffopt.detect_rename = 0;
-	diffopt.max_changes = settings->max_changed_paths;
-	diff_setup_done(&diffopt);
-
 	/* ensure commit is parsed so we have parent information */
 	repo_parse_commit(r, c);
 
-	if (c->parents)
-		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
-	else
-		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
-
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
-		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
-		struct pathmap_hash_entry *e;
-		struct hashmap_iter iter;
-
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
-
-			/*
-			 * Add each leading directory of the changed file, i.e. for
-			 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
-			 * the Bloom filter could be used to speed up commands like
-			 * 'git log dir/subdir', too.
-			 *
-			 * Note that directories are added without the trailing '/'.
-			 */
-			do {
-				char *last_slash = strrchr(path, '/');
-
-				FLEX_ALLOC_STR(e, path, path);
-				hashmap_entry_init(&e->entry, strhash(path));
-
-				if (!hashmap_get(&pathmap, &e->entry, NULL))
-					hashmap_add(&pathmap, &e->entry);
-				else
-					free(e);
-
-				if (!last_slash)
-					last_slash = (char*)path;
-				*last_slash = '\0';
-
-			} while (*path);
-
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		}
-
-		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
-			init_truncated_large_filter(filter);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
-			goto cleanup;
-		}
-
-		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
-		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
-			filter->len = 1;
-		}
-		CALLOC_ARRAY(filter->data, filter->len);
-
-		hashmap_for_each_entry(&pathmap, &iter, e, entry) {
-			struct bloom_key key;
-			fill_bloom_key(e->path, strlen(e->path), &key, settings);
-			add_key_to_filter(&key, filter, settings);
-			clear_bloom_key(&key);
-		}
-
-	cleanup:
-		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
-	} else {
-		for (i = 0; i < diff_queued_diff.nr; i++)
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		init_truncated_large_filter(filter);
-
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
-	}
-
+	result = compute_bloom_filter(r, filter,
+				      c->parents ? &c->parents->item->object.oid : NULL,
+				      &c->object.oid, settings);
 	if (computed)
-		*computed |= BLOOM_COMPUTED;
-
-	free(diff_queued_diff.queue);
-	DIFF_QUEUE_CLEAR(&diff_queued_diff);
+		*computed = result;
 
 	return filter;
 }
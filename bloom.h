@@ -2,7 +2,9 @@
 #define BLOOM_H
 
 struct commit;
+struct object_id;
 struct repository;
+struct string_list;
 
 struct bloom_filter_settings {
 	/*
@@ -96,6 +98,42 @@ enum bloom_filter_computed {
 	BLOOM_TRUNC_EMPTY  = (1 << 3),
 };
 
+/*
+ * Compute the Bloom filter of the paths changed between "parent" (NULL
+ * for a root commit) and "commit" into "filter", which must be empty.
+ * Either oid may name a commit or a tree.
+ *
+ * Unlike get_or_compute_bloom_filter(), this only reads objects, so it
+ * can be called from several threads at once as long as the object
+ * read lock is enabled and each thread fills its own filter.
+ */
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct bloom_filter *filter,
+						const struct object_id *parent,
+						const struct object_id *commit,
+						const struct bloom_filter_settings *settings);
+
+/*
+ * Fill the empty "paths" with the paths compute_bloom_filter() would
+ * put into the filter of "commit", i.e. the changed paths and all their
+ * leading directories, in sorted order. If there are more than "max" of
+ * them, leave "paths" empty and return -1.
+ *
+ * Like compute_bloom_filter(), this is safe to call from several
+ * threads when the object read lock is enabled.
+ */
+int collect_changed_path_list(struct repository *r,
+			      const struct object_id *parent,
+			      const struct object_id *commit,
+			      size_t max, struct string_list *paths);
+
+/*
+ * Return where the Bloom filter of "c" is kept; its data is NULL until
+ * the filter is loaded or computed. Not safe to call from several
+ * threads.
+ */
+struct bloom_filter *bloom_filter_at(struct commit *c);
+
 struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 struct commit *c,
 						 int compute_if_not_present,
@@ -73,6 +73,32 @@ static void check_attr(const char *prefix,
 	free(full_path);
 }
 
+static void check_attr_batch(const char *prefix,
+			     struct attr_check *check,
+			     int nr, const char **files)
+{
+	const char **full_paths, **values;
+	int i, j;
+
+	ALLOC_ARRAY(full_paths, nr);
+	ALLOC_ARRAY(values, st_mult(nr, check->nr));
+	for (i = 0; i < nr; i++)
+		full_paths[i] = prefix_path(prefix, prefix ? strlen(prefix) : 0,
+					    files[i]);
+
+	git_check_attr_batch(&the_index, nr, full_paths, check, values);
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < check->nr; j++)
+			check->items[j].value = values[i * check->nr + j];
+		output_attr(check, files[i]);
+		free((char *)full_paths[i]);
+	}
+
+	free(full_paths);
+	free(values);
+}
+
 static void check_attr_stdin_paths(const char *prefix,
 				   struct attr_check *check,
 				   int collect_all)
@@ -179,8 +205,12 @@ int cmd_check_attr(int argc, const char **argv, const char *prefix)
 	if (stdin_paths)
 		check_attr_stdin_paths(prefix, check, all_attrs);
 	else {
-		for (i = filei; i < argc; i++)
-			check_attr(prefix, check, all_attrs, argv[i]);
+		if (all_attrs)
+			for (i = filei; i < argc; i++)
+				check_attr(prefix, check, all_attrs, argv[i]);
+		else
+			check_attr_batch(prefix, check, argc - filei,
+					 argv + filei);
 		maybe_flush_or_die(stdout, "attribute to stdout");
 	}
 
@@ -617,6 +617,8 @@ static void show_local_changes(struct object *head,
 	/* I think we want full paths, even if we're in a subdirectory. */
 	repo_init_revisions(the_repository, &rev, NULL);
 	rev.diffopt.flags = opts->flags;
+	/* show the files within the sparse directories of a sparse index */
+	rev.diffopt.flags.recursive = 1;
 	rev.diffopt.output_format |= DIFF_FORMAT_NAME_STATUS;
 	diff_setup_done(&rev.diffopt);
 	add_pending_object(&rev, head, NULL);
@@ -1593,6 +1595,9 @@ static int checkout_main(int argc, const char **argv, const char *prefix,
 
 	git_config(git_checkout_config, opts);
 
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
+
 	opts->track = BRANCH_TRACK_UNSPECIFIED;
 
 	if (!opts->accept_pathspec && !opts->accept_ref)
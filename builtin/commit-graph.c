@@ -13,7 +13,9 @@ static char const * const builtin_commit_graph_usage[] = {
 	N_("git commit-graph verify [--object-dir <objdir>] [--shallow] [--[no-]progress]"),
 	N_("git commit-graph write [--object-dir <objdir>] [--append] "
 	   "[--split[=<strategy>]] [--reachable|--stdin-packs|--stdin-commits] "
-	   "[--changed-paths] [--[no-]max-new-filters <n>] [--[no-]progress] "
+	   "[--changed-paths] [--[no-]max-new-filters <n>] "
+	   "[--[no-]reachability-labels] [--[no-]commit-metadata] "
+	   "[--[no-]changed-path-lists] [--[no-]progress] "
 	   "<split options>"),
 	NULL
 };
@@ -26,7 +28,9 @@ static const char * const builtin_commit_graph_verify_usage[] = {
 static const char * const builtin_commit_graph_write_usage[] = {
 	N_("git commit-graph write [--object-dir <objdir>] [--append] "
 	   "[--split[=<strategy>]] [--reachable|--stdin-packs|--stdin-commits] "
-	   "[--changed-paths] [--[no-]max-new-filters <n>] [--[no-]progress] "
+	   "[--changed-paths] [--[no-]max-new-filters <n>] "
+	   "[--[no-]reachability-labels] [--[no-]commit-metadata] "
+	   "[--[no-]changed-path-lists] [--[no-]progress] "
 	   "<split options>"),
 	NULL
 };
@@ -41,6 +45,9 @@ static struct opts_commit_graph {
 	int shallow;
 	int progress;
 	int enable_changed_paths;
+	int enable_reachability_labels;
+	int enable_commit_metadata;
+	int enable_changed_path_lists;
 } opts;
 
 static struct object_directory *find_odb(struct repository *r,
@@ -219,6 +226,12 @@ static int graph_write(int argc, const char **argv)
 			N_("include all commits already in the commit-graph file")),
 		OPT_BOOL(0, "changed-paths", &opts.enable_changed_paths,
 			N_("enable computation for changed paths")),
+		OPT_BOOL(0, "reachability-labels", &opts.enable_reachability_labels,
+			N_("enable computation for reachability labels")),
+		OPT_BOOL(0, "commit-metadata", &opts.enable_commit_metadata,
+			N_("enable storing commit idents, dates and subjects")),
+		OPT_BOOL(0, "changed-path-lists", &opts.enable_changed_path_lists,
+			N_("enable computation for exact lists of changed paths")),
 		OPT_BOOL(0, "progress", &opts.progress, N_("force progress reporting")),
 		OPT_CALLBACK_F(0, "split", &write_opts.split_flags, NULL,
 			N_("allow writing an incremental commit-graph file"),
@@ -238,6 +251,9 @@ static int graph_write(int argc, const char **argv)
 
 	opts.progress = isatty(2);
 	opts.enable_changed_paths = -1;
+	opts.enable_reachability_labels = -1;
+	opts.enable_commit_metadata = -1;
+	opts.enable_changed_path_lists = -1;
 	write_opts.size_multiple = 2;
 	write_opts.max_commits = 0;
 	write_opts.expire_time = 0;
@@ -266,6 +282,21 @@ static int graph_write(int argc, const char **argv)
 	if (opts.enable_changed_paths == 1 ||
 	    git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS, 0))
 		flags |= COMMIT_GRAPH_WRITE_BLOOM_FILTERS;
+	if (!opts.enable_reachability_labels)
+		flags |= COMMIT_GRAPH_NO_WRITE_REACHABILITY_LABELS;
+	if (opts.enable_reachability_labels == 1 ||
+	    git_env_bool(GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS, 0))
+		flags |= COMMIT_GRAPH_WRITE_REACHABILITY_LABELS;
+	if (!opts.enable_commit_metadata)
+		flags |= COMMIT_GRAPH_NO_WRITE_COMMIT_METADATA;
+	if (opts.enable_commit_metadata == 1 ||
+	    git_env_bool(GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA, 0))
+		flags |= COMMIT_GRAPH_WRITE_COMMIT_METADATA;
+	if (!opts.enable_changed_path_lists)
+		flags |= COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS;
+	if (opts.enable_changed_path_lists == 1 ||
+	    git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS, 0))
+		flags |= COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS;
 
 	read_replace_refs = 0;
 	odb = find_odb(the_repository, opts.obj_dir);
@@ -0,0 +1,539 @@
+#include "builtin.h"
+#include "config.h"
+#include "parse-options.h"
+#include "fsmonitor.h"
+#include "fsmonitor-ipc.h"
+#include "compat/fsmonitor/fsm-listen.h"
+#include "fsmonitor--daemon.h"
+#include "simple-ipc.h"
+#include "run-command.h"
+#include "sigchain.h"
+#include "strmap.h"
+#include "trace2.h"
+
+static const char * const builtin_fsmonitor__daemon_usage[] = {
+	N_("git fsmonitor--daemon start [<options>]"),
+	N_("git fsmonitor--daemon run [<options>]"),
+	N_("git fsmonitor--daemon stop"),
+	N_("git fsmonitor--daemon status"),
+	NULL
+};
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+/*
+ * Global state loaded from config.
+ */
+#define FSMONITOR__IPC_THREADS "fsmonitor.ipcthreads"
+static int fsmonitor__ipc_threads = 8;
+
+#define FSMONITOR__START_TIMEOUT "fsmonitor.starttimeout"
+static int fsmonitor__start_timeout_sec = 60;
+
+/*
+ * Once this many distinct paths have changed, we forget all of them
+ * and let clients rescan, instead of growing without bound.
+ */
+#define FSMONITOR__MAX_CHANGED_PATHS "fsmonitor.maxchangedpaths"
+static int fsmonitor__max_changed_paths = 1000000;
+
+/*
+ * How long a query waits for the listener to see its cookie file
+ * before giving up and sending a trivial response.
+ */
+#define COOKIE_TIMEOUT_SEC 1
+
+static int fsmonitor_config(const char *var, const char *value, void *cb)
+{
+	if (!strcmp(var, FSMONITOR__IPC_THREADS)) {
+		int i = git_config_int(var, value);
+		if (i < 1)
+			return error(_("value of '%s' out of range: %d"),
+				     FSMONITOR__IPC_THREADS, i);
+		fsmonitor__ipc_threads = i;
+		return 0;
+	}
+
+	if (!strcmp(var, FSMONITOR__START_TIMEOUT)) {
+		int i = git_config_int(var, value);
+		if (i < 0)
+			return error(_("value of '%s' out of range: %d"),
+				     FSMONITOR__START_TIMEOUT, i);
+		fsmonitor__start_timeout_sec = i;
+		return 0;
+	}
+
+	if (!strcmp(var, FSMONITOR__MAX_CHANGED_PATHS)) {
+		int i = git_config_int(var, value);
+		if (i < 1)
+			return error(_("value of '%s' out of range: %d"),
+				     FSMONITOR__MAX_CHANGED_PATHS, i);
+		fsmonitor__max_changed_paths = i;
+		return 0;
+	}
+
+	return git_default_config(var, value, cb);
+}
+
+/*
+ * Start a new token namespace. Tokens from earlier namespaces, from
+ * an earlier run of the daemon or from a hook, are not understood
+ * and get a trivial response.
+ */
+static void new_token_id(struct fsmonitor_daemon_state *state)
+{
+	static int generation;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	strbuf_reset(&state->token_id);
+	strbuf_addf(&state->token_id, "%"PRIuMAX".%"PRIuMAX".%06ld.%d",
+		    (uintmax_t)getpid(), (uintmax_t)tv.tv_sec,
+		    (long)tv.tv_usec, generation++);
+}
+
+/* Must be called with main_lock held. */
+static void do_force_resync(struct fsmonitor_daemon_state *state)
+{
+	new_token_id(state);
+	strmap_partial_clear(&state->changed, 0);
+	state->min_seq = state->seq;
+}
+
+void fsmonitor_force_resync(struct fsmonitor_daemon_state *state)
+{
+	pthread_mutex_lock(&state->main_lock);
+	do_force_resync(state);
+	pthread_mutex_unlock(&state->main_lock);
+}
+
+void fsmonitor_publish(struct fsmonitor_daemon_state *state,
+		       const struct string_list *paths,
+		       const struct string_list *cookie_names)
+{
+	int i;
+
+	pthread_mutex_lock(&state->main_lock);
+
+	if (paths->nr) {
+		uintptr_t seq = ++state->seq;
+
+		for (i = 0; i < paths->nr; i++)
+			strmap_put(&state->changed, paths->items[i].string,
+				   (void *)seq);
+
+		if (strmap_get_size(&state->changed) >
+		    fsmonitor__max_changed_paths) {
+			trace2_data_intmax("fsm_daemon", NULL, "resync/paths",
+					   strmap_get_size(&state->changed));
+			do_force_resync(state);
+		}
+	}
+
+	if (cookie_names->nr) {
+		for (i = 0; i < cookie_names->nr; i++)
+			strset_remove(&state->pending_cookies,
+				      cookie_names->items[i].string);
+		pthread_cond_broadcast(&state->cookies_cond);
+	}
+
+	pthread_mutex_unlock(&state->main_lock);
+}
+
+/*
+ * Create a cookie file and wait for the listener to report it. Since
+ * inotify delivers events in order, every change that happened before
+ * the client sent its query has been published once it does.
+ *
+ * Returns 0 if the cookie was seen.
+ */
+static int wait_for_cookie(struct fsmonitor_daemon_state *state)
+{
+	struct strbuf name = STRBUF_INIT;
+	struct strbuf path = STRBUF_INIT;
+	struct timeval now;
+	struct timespec deadline;
+	int fd, ret = -1;
+
+	pthread_mutex_lock(&state->main_lock);
+	strbuf_addf(&name, "%"PRIuMAX"-%d",
+		    (uintmax_t)getpid(), state->cookie_seq++);
+	strset_add(&state->pending_cookies, name.buf);
+	pthread_mutex_unlock(&state->main_lock);
+
+	strbuf_addf(&path, "%s%s", state->path_cookie_prefix.buf, name.buf);
+	fd = open(path.buf, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0)
+		error_errno(_("could not create fsmonitor cookie '%s'"),
+			    path.buf);
+	else
+		close(fd);
+
+	gettimeofday(&now, NULL);
+	deadline.tv_sec = now.tv_sec + COOKIE_TIMEOUT_SEC;
+	deadline.tv_nsec = now.tv_usec * 1000;
+
+	pthread_mutex_lock(&state->main_lock);
+	while (fd >= 0 && strset_contains(&state->pending_cookies, name.buf))
+		if (pthread_cond_timedwait(&state->cookies_cond,
+					   &state->main_lock,
+					   &deadline) == ETIMEDOUT)
+			break;
+	if (fd >= 0 && !strset_contains(&state->pending_cookies, name.buf))
+		ret = 0;
+	strset_remove(&state->pending_cookies, name.buf);
+	pthread_mutex_unlock(&state->main_lock);
+
+	if (fd >= 0)
+		unlink_or_warn(path.buf);
+
+	strbuf_release(&name);
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Parse a "builtin:<token_id>:<seq>" token from our current namespace.
+ * Must be called with main_lock held.
+ */
+static int parse_token(struct fsmonitor_daemon_state *state,
+		       const char *token, uint64_t *seq)
+{
+	const char *p;
+	char *end;
+
+	if (!skip_prefix(token, "builtin:", &p) ||
+	    !skip_prefix(p, state->token_id.buf, &p) ||
+	    *p++ != ':')
+		return -1;
+
+	errno = 0;
+	*seq = strtoumax(p, &end, 10);
+	if (errno || end == p || *end)
+		return -1;
+	return 0;
+}
+
+static int handle_client(void *data,
+			 const char *command,
+			 ipc_server_reply_cb *reply,
+			 struct ipc_server_reply_data *reply_data)
+{
+	struct fsmonitor_daemon_state *state = data;
+	struct strbuf response = STRBUF_INIT;
+	int synced, trivial = 1;
+	uint64_t since;
+	intmax_t count = 0;
+
+	if (!strcmp(command, "quit"))
+		return SIMPLE_IPC_QUIT;
+
+	trace2_region_enter("fsm_daemon", "handle_client", NULL);
+	trace2_data_string("fsm_daemon", NULL, "request", command);
+
+	synced = !wait_for_cookie(state);
+
+	pthread_mutex_lock(&state->main_lock);
+
+	strbuf_addf(&response, "builtin:%s:%"PRIuMAX,
+		    state->token_id.buf, (uintmax_t)state->seq);
+	strbuf_addch(&response, '\0');
+
+	if (synced && !parse_token(state, command, &since) &&
+	    since >= state->min_seq && since <= state->seq) {
+		struct hashmap_iter iter;
+		struct strmap_entry *e;
+
+		trivial = 0;
+		strmap_for_each_entry(&state->changed, &iter, e) {
+			if ((uintptr_t)e->value <= since)
+				continue;
+			strbuf_addstr(&response, e->key);
+			strbuf_addch(&response, '\0');
+			count++;
+		}
+	}
+
+	pthread_mutex_unlock(&state->main_lock);
+
+	if (trivial) {
+		strbuf_addch(&response, '/');
+		strbuf_addch(&response, '\0');
+	}
+
+	reply(reply_data, response.buf, response.len);
+
+	trace2_data_intmax("fsm_daemon", NULL, "response/trivial", trivial);
+	trace2_data_intmax("fsm_daemon", NULL, "response/count", count);
+	trace2_region_leave("fsm_daemon", "handle_client", NULL);
+
+	strbuf_release(&response);
+	return 0;
+}
+
+static void *fsm_listen__thread_proc(void *_state)
+{
+	struct fsmonitor_daemon_state *state = _state;
+
+	trace2_thread_start("fsm-listen");
+	fsm_listen__loop(state);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static int mkdir_if_missing(const char *path)
+{
+	if (!mkdir(path, 0777) || errno == EEXIST)
+		return 0;
+	return error_errno(_("could not create directory '%s'"), path);
+}
+
+static int fsmonitor_run_daemon(void)
+{
+	struct fsmonitor_daemon_state state;
+	struct ipc_server_opts ipc_opts = {
+		.nr_threads = fsmonitor__ipc_threads,
+		/*
+		 * We know that there are no other active threads yet,
+		 * so it is safe to chdir() to create a long socket path.
+		 */
+		.uds_disallow_chdir = 0,
+	};
+	int err = 0;
+
+	memset(&state, 0, sizeof(state));
+	pthread_mutex_init(&state.main_lock, NULL);
+	pthread_cond_init(&state.cookies_cond, NULL);
+	strbuf_init(&state.path_worktree_watch, 0);
+	strbuf_init(&state.path_cookie_prefix, 0);
+	strbuf_init(&state.token_id, 0);
+	strmap_init(&state.changed);
+	strset_init(&state.pending_cookies);
+	new_token_id(&state);
+
+	strbuf_addstr(&state.path_worktree_watch,
+		      absolute_path(get_git_work_tree()));
+
+	strbuf_addstr(&state.path_cookie_prefix,
+		      absolute_path(git_path("fsmonitor--daemon")));
+	if (mkdir_if_missing(state.path_cookie_prefix.buf)) {
+		err = -1;
+		goto done;
+	}
+	strbuf_addstr(&state.path_cookie_prefix, "/cookies");
+	if (mkdir_if_missing(state.path_cookie_prefix.buf)) {
+		err = -1;
+		goto done;
+	}
+	strbuf_addch(&state.path_cookie_prefix, '/');
+
+	if (fsm_listen__ctor(&state)) {
+		err = error(_("could not initialize listener thread"));
+		goto done;
+	}
+
+	err = ipc_server_run_async(&state.ipc_server_data,
+				   fsmonitor_ipc__get_path(), &ipc_opts,
+				   handle_client, &state);
+	if (err) {
+		if (err == -2)
+			error(_("fsmonitor--daemon is already running '%s'"),
+			      state.path_worktree_watch.buf);
+		else
+			error_errno(_("could not start IPC thread pool on '%s'"),
+				    fsmonitor_ipc__get_path());
+		err = -1;
+		goto done;
+	}
+
+	if (pthread_create(&state.listener_thread, NULL,
+			   fsm_listen__thread_proc, &state) < 0) {
+		ipc_server_stop_async(state.ipc_server_data);
+		ipc_server_await(state.ipc_server_data);
+		err = error(_("could not start fsmonitor listener thread"));
+		goto done;
+	}
+
+	trace2_region_enter("fsm_daemon", "run", NULL);
+
+	/*
+	 * The IPC server runs until a client sends "quit", or until
+	 * the listener stops it because the worktree went away.
+	 */
+	ipc_server_await(state.ipc_server_data);
+
+	fsm_listen__stop_async(&state);
+	pthread_join(state.listener_thread, NULL);
+
+	trace2_region_leave("fsm_daemon", "run", NULL);
+
+	err = state.error_code;
+
+done:
+	fsm_listen__dtor(&state);
+	ipc_server_free(state.ipc_server_data);
+	pthread_cond_destroy(&state.cookies_cond);
+	pthread_mutex_destroy(&state.main_lock);
+	strbuf_release(&state.path_worktree_watch);
+	strbuf_release(&state.path_cookie_prefix);
+	strbuf_release(&state.token_id);
+	strmap_clear(&state.changed, 0);
+	strset_clear(&state.pending_cookies);
+
+	return err;
+}
+
+static int try_to_run_foreground_daemon(int detach)
+{
+	/*
+	 * Technically, we don't need to probe for an existing daemon
+	 * process, since we could just call `fsmonitor_run_daemon()`
+	 * and let it fail if the pipe/socket is busy.
+	 *
+	 * However, this method gives us a nicer error message for a
+	 * common error case.
+	 */
+	if (fsmonitor_ipc__get_state() == IPC_STATE__LISTENING)
+		die(_("fsmonitor--daemon is already running '%s'"),
+		    the_repository->worktree);
+
+	if (detach && setsid() < 0)
+		warning_errno(_("setsid failed"));
+
+	/* clients hanging up must not take the daemon down */
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	return !!fsmonitor_run_daemon();
+}
+
+static int try_to_start_background_daemon(void)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+	uint64_t deadline;
+
+	if (fsmonitor_ipc__get_state() == IPC_STATE__LISTENING)
+		die(_("fsmonitor--daemon is already running '%s'"),
+		    the_repository->worktree);
+
+	cp.git_cmd = 1;
+	strvec_pushl(&cp.args, "fsmonitor--daemon", "run", "--detach", NULL);
+	cp.no_stdin = 1;
+	cp.no_stdout = 1;
+	cp.no_stderr = 1;
+
+	if (start_command(&cp))
+		return error(_("could not spawn fsmonitor--daemon in the background"));
+
+	/*
+	 * Wait for the daemon to start listening, or to die trying. We
+	 * do not reap it once it is up; it outlives us on purpose.
+	 */
+	deadline = getnanotime() +
+		(uint64_t)fsmonitor__start_timeout_sec * 1000000000;
+	for (;;) {
+		int status;
+		pid_t pid = waitpid(cp.pid, &status, WNOHANG);
+
+		if (pid == cp.pid)
+			return error(_("fsmonitor--daemon failed to start"));
+		if (fsmonitor_ipc__get_state() == IPC_STATE__LISTENING)
+			return 0;
+		if (getnanotime() > deadline)
+			return error(_("fsmonitor--daemon not online yet"));
+		sleep_millisec(50);
+	}
+}
+
+static int do_as_client__send_stop(void)
+{
+	struct strbuf answer = STRBUF_INIT;
+	int ret;
+
+	ret = fsmonitor_ipc__send_command("quit", &answer);
+	strbuf_release(&answer);
+	if (ret)
+		return ret;
+
+	/* wait for the daemon to release the socket */
+	while (fsmonitor_ipc__get_state() == IPC_STATE__LISTENING)
+		sleep_millisec(50);
+
+	return 0;
+}
+
+static int do_as_client__status(void)
+{
+	enum ipc_active_state state = fsmonitor_ipc__get_state();
+
+	switch (state) {
+	case IPC_STATE__LISTENING:
+		printf(_("fsmonitor-daemon is watching '%s'\n"),
+		       the_repository->worktree);
+		return 0;
+
+	default:
+		printf(_("fsmonitor-daemon is not watching '%s'\n"),
+		       the_repository->worktree);
+		return 1;
+	}
+}
+
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	const char *subcmd;
+	int detach = 0;
+
+	struct option options[] = {
+		OPT_INTEGER(0, "ipc-threads",
+			    &fsmonitor__ipc_threads,
+			    N_("use <n> ipc worker threads")),
+		OPT_INTEGER(0, "start-timeout",
+			    &fsmonitor__start_timeout_sec,
+			    N_("max seconds to wait for background daemon startup")),
+		OPT_HIDDEN_BOOL(0, "detach", &detach,
+				N_("detach from the terminal")),
+		OPT_END()
+	};
+
+	git_config(fsmonitor_config, NULL);
+
+	argc = parse_options(argc, argv, prefix, options,
+			     builtin_fsmonitor__daemon_usage, 0);
+	if (argc != 1)
+		usage_with_options(builtin_fsmonitor__daemon_usage, options);
+	subcmd = argv[0];
+
+	if (fsmonitor__ipc_threads < 1)
+		die(_("invalid 'ipc-threads' value (%d)"),
+		    fsmonitor__ipc_threads);
+
+	if (!the_repository->worktree)
+		die(_("fsmonitor--daemon requires a worktree"));
+
+	if (!strcmp(subcmd, "start"))
+		return !!try_to_start_background_daemon();
+
+	if (!strcmp(subcmd, "run"))
+		return !!try_to_run_foreground_daemon(detach);
+
+	if (!strcmp(subcmd, "stop"))
+		return !!do_as_client__send_stop();
+
+	if (!strcmp(subcmd, "status"))
+		return !!do_as_client__status();
+
+	die(_("Unhandled subcommand '%s'"), subcmd);
+}
+
+#else
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct option options[] = {
+		OPT_END()
+	};
+
+	if (argc == 2 && !strcmp(argv[1], "-h"))
+		usage_with_options(builtin_fsmonitor__daemon_usage, options);
+
+	die(_("fsmonitor--daemon not supported on this platform"));
+}
+#endif
@@ -444,8 +444,15 @@ static int is_delta_type(enum object_type type)
 	return (type == OBJ_REF_DELTA || type == OBJ_OFS_DELTA);
 }
 
+/*
+ * Inflate the next object from the input stream. The object name of
+ * non-delta objects is computed on the fly, unless "defer_hash" is set,
+ * in which case the caller hashes the returned buffer itself. Large
+ * blobs are not kept in memory and are therefore always hashed here.
+ */
 static void *unpack_entry_data(off_t offset, unsigned long size,
-			       enum object_type type, struct object_id *oid)
+			       enum object_type type, struct object_id *oid,
+			       int defer_hash)
 {
 	static char fixed_buf[8192];
 	int status;
@@ -455,18 +462,20 @@ static void *unpack_entry_data(off_t offset, unsigned long size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
-		hdrlen = xsnprintf(hdr, sizeof(hdr), "%s %"PRIuMAX,
-				   type_name(type),(uintmax_t)size) + 1;
-		the_hash_algo->init_fn(&c);
-		the_hash_algo->update_fn(&c, hdr, hdrlen);
-	} else
-		oid = NULL;
 	if (type == OBJ_BLOB && size > big_file_threshold)
 		buf = fixed_buf;
 	else
 		buf = xmallocz(size);
 
+	if (is_delta_type(type) || (defer_hash && buf != fixed_buf))
+		oid = NULL;
+	if (oid) {
+		hdrlen = xsnprintf(hdr, sizeof(hdr), "%s %"PRIuMAX,
+				   type_name(type),(uintmax_t)size) + 1;
+		the_hash_algo->init_fn(&c);
+		the_hash_algo->update_fn(&c, hdr, hdrlen);
+	}
+
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
 	stream.next_out = buf;
@@ -496,7 +505,8 @@ static void *unpack_entry_data(off_t offset, unsigned long size,
 static void *unpack_raw_entry(struct object_entry *obj,
 			      off_t *ofs_offset,
 			      struct object_id *ref_oid,
-			      struct object_id *oid)
+			      struct object_id *oid,
+			      int defer_hash)
 {
 	unsigned char *p;
 	unsigned long size, c;
@@ -555,7 +565,8 @@ static void *unpack_raw_entry(struct object_entry *obj,
 	}
 	obj->hdr_size = consumed_bytes - obj->idx.offset;
 
-	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type, oid);
+	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type, oid,
+				 defer_hash);
 	obj->idx.crc32 = input_crc32;
 	return data;
 }
@@ -1144,11 +1155,116 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/*
+ * Queue of inflated non-delta objects handed from the stream reader in
+ * parse_pack_objects() to threaded_first_pass(), which hashes and
+ * checks them.
+ *
+ * Guarded by work_mutex.
+ */
+struct first_pass_job {
+	struct object_entry *obj;
+	void *data;
+};
+#define FIRST_PASS_QUEUE_SIZE 1024
+static struct first_pass_job first_pass_queue[FIRST_PASS_QUEUE_SIZE];
+static unsigned int first_pass_head, first_pass_nr;
+static size_t first_pass_bytes;
+static int first_pass_done;
+static pthread_cond_t first_pass_work_cond;
+static pthread_cond_t first_pass_space_cond;
+
+static void first_pass_object(struct object_entry *obj, void *data)
+{
+	hash_object_file(the_hash_algo, data, obj->size,
+			 type_name(obj->type), &obj->idx.oid);
+	sha1_object(data, NULL, obj->size, obj->type, &obj->idx.oid);
+	free(data);
+}
+
+static void *threaded_first_pass(void *data)
+{
+	set_thread_data(data);
+	for (;;) {
+		struct first_pass_job job;
+
+		work_lock();
+		while (!first_pass_nr && !first_pass_done)
+			pthread_cond_wait(&first_pass_work_cond, &work_mutex);
+		if (!first_pass_nr) {
+			work_unlock();
+			break;
+		}
+		job = first_pass_queue[first_pass_head];
+		first_pass_head = (first_pass_head + 1) % FIRST_PASS_QUEUE_SIZE;
+		first_pass_nr--;
+		first_pass_bytes -= job.obj->size;
+		pthread_cond_signal(&first_pass_space_cond);
+		work_unlock();
+
+		first_pass_object(job.obj, job.data);
+	}
+	return NULL;
+}
+
+/*
+ * Hand an inflated object to the first-pass threads, waiting while the
+ * queue is full or holds more than delta_base_cache_limit bytes.
+ */
+static void queue_first_pass_object(struct object_entry *obj, void *data)
+{
+	work_lock();
+	while (first_pass_nr == FIRST_PASS_QUEUE_SIZE ||
+	       (first_pass_nr && first_pass_bytes + obj->size > delta_base_cache_limit))
+		pthread_cond_wait(&first_pass_space_cond, &work_mutex);
+	first_pass_queue[(first_pass_head + first_pass_nr) % FIRST_PASS_QUEUE_SIZE] =
+		(struct first_pass_job){ obj, data };
+	first_pass_nr++;
+	first_pass_bytes += obj->size;
+	pthread_cond_signal(&first_pass_work_cond);
+	work_unlock();
+}
+
+static void start_first_pass_threads(void)
+{
+	int i;
+
+	init_thread();
+	pthread_cond_init(&first_pass_work_cond, NULL);
+	pthread_cond_init(&first_pass_space_cond, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&thread_data[i].thread, NULL,
+					 threaded_first_pass, thread_data + i);
+		if (ret)
+			die(_("unable to create thread: %s"),
+			    strerror(ret));
+	}
+}
+
+static void finish_first_pass_threads(void)
+{
+	int i;
+
+	work_lock();
+	first_pass_done = 1;
+	pthread_cond_broadcast(&first_pass_work_cond);
+	work_unlock();
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(thread_data[i].thread, NULL);
+	pthread_cond_destroy(&first_pass_work_cond);
+	pthread_cond_destroy(&first_pass_space_cond);
+	cleanup_thread();
+}
+
 /*
  * First pass:
  * - find locations of all objects;
  * - calculate SHA1 of all non-delta objects;
  * - remember base (SHA1 or offset) for all deltas.
+ *
+ * Only reading and inflating the stream is inherently serial. When
+ * running threaded, hashing and checking non-delta objects is left to
+ * threaded_first_pass().
  */
 static void parse_pack_objects(unsigned char *hash)
 {
@@ -1156,6 +1272,10 @@ static void parse_pack_objects(unsigned char *hash)
 	struct ofs_delta_entry *ofs_delta = ofs_deltas;
 	struct object_id ref_delta_oid;
 	struct stat st;
+	int threaded = nr_threads > 1 || getenv("GIT_FORCE_THREADS");
+
+	if (threaded)
+		start_first_pass_threads();
 
 	if (verbose)
 		progress = start_progress(
@@ -1165,7 +1285,7 @@ static void parse_pack_objects(unsigned char *hash)
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
 					      &ref_delta_oid,
-					      &obj->idx.oid);
+					      &obj->idx.oid, threaded);
 		obj->real_type = obj->type;
 		if (obj->type == OBJ_OFS_DELTA) {
 			nr_ofs_deltas++;
@@ -1180,6 +1300,9 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+		} else if (threaded) {
+			queue_first_pass_object(obj, data);
+			data = NULL;
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
@@ -1189,6 +1312,9 @@ static void parse_pack_objects(unsigned char *hash)
 	objects[i].idx.offset = consumed_bytes;
 	stop_progress(&progress);
 
+	if (threaded)
+		finish_first_pass_threads();
+
 	/* Check pack integrity */
 	flush();
 	the_hash_algo->final_fn(hash, &input_ctx);
@@ -25,6 +25,7 @@
 #include "thread-utils.h"
 #include "pack-bitmap.h"
 #include "delta-islands.h"
+#include "delta-hints.h"
 #include "reachable.h"
 #include "oid-array.h"
 #include "strvec.h"
@@ -231,6 +232,9 @@ static int exclude_promisor_objects;
 
 static int use_delta_islands;
 
+static int write_delta_hints;
+static int use_delta_hints = 1;
+
 static unsigned long delta_cache_size = 0;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
 static unsigned long cache_max_small_delta_size = 1000;
@@ -281,34 +285,53 @@ static void index_commit_for_bitmap(struct commit *commit)
 	indexed_commits[indexed_commits_nr++] = commit;
 }
 
-static void *get_delta(struct object_entry *entry)
+/*
+ * Recompute the delta of "entry" against "base", which is normally
+ * DELTA(entry), but the delta base as it was seen by a compress-ahead
+ * worker (see below) may have been dropped by write_one() since.
+ */
+static void *get_delta_against(struct object_entry *entry,
+			       struct object_entry *base,
+			       unsigned long *delta_size_p)
 {
 	unsigned long size, base_size, delta_size;
 	void *buf, *base_buf, *delta_buf;
 	enum object_type type;
 
+	packing_data_lock(&to_pack);
 	buf = read_object_file(&entry->idx.oid, &type, &size);
 	if (!buf)
 		die(_("unable to read %s"), oid_to_hex(&entry->idx.oid));
-	base_buf = read_object_file(&DELTA(entry)->idx.oid, &type,
-				    &base_size);
+	base_buf = read_object_file(&base->idx.oid, &type, &base_size);
+	packing_data_unlock(&to_pack);
 	if (!base_buf)
-		die("unable to read %s",
-		    oid_to_hex(&DELTA(entry)->idx.oid));
+		die("unable to read %s", oid_to_hex(&base->idx.oid));
 	delta_buf = diff_delta(base_buf, base_size,
 			       buf, size, &delta_size, 0);
 	/*
 	 * We successfully computed this delta once but dropped it for
 	 * memory reasons. Something is very wrong if this time we
-	 * recompute and create a different delta.
+	 * recompute and create a different delta. The size of a delta
+	 * taken from a hints file was only recorded by whichever git
+	 * wrote it, though, so trust what we computed for those.
 	 */
-	if (!delta_buf || delta_size != DELTA_SIZE(entry))
+	if (entry->hinted_delta && !delta_buf)
+		die(_("unable to compute delta for %s"),
+		    oid_to_hex(&entry->idx.oid));
+	if (!delta_buf ||
+	    (delta_size != DELTA_SIZE(entry) && !entry->hinted_delta))
 		BUG("delta size changed");
 	free(buf);
 	free(base_buf);
+	*delta_size_p = delta_size;
 	return delta_buf;
 }
 
+static void *get_delta(struct object_entry *entry, unsigned long *delta_size_p)
+{
+	return get_delta_against(entry, DELTA(entry), delta_size_p);
+}
+
 static unsigned long do_compress(void **pptr, unsigned long size)
 {
 	git_zstream stream;
@@ -433,6 +456,303 @@ static inline int oe_size_greater_than(struct packing_data *pack,
 	return oe_get_size_slow(pack, lhs) > rhs;
 }
 
+/*
+ * Decide whether write_object() can copy the entry's data verbatim
+ * from the pack it was found in, or has to (re)compress it.
+ */
+static int can_reuse_object_data(struct object_entry *entry, int usable_delta)
+{
+	if (!reuse_object)
+		return 0;	/* explicit */
+	else if (!IN_PACK(entry))
+		return 0;	/* can't reuse what we don't have */
+	else if (oe_type(entry) == OBJ_REF_DELTA ||
+		 oe_type(entry) == OBJ_OFS_DELTA)
+				/* check_object() decided it for us ... */
+		return usable_delta;
+				/* ... but pack split may override that */
+	else if (oe_type(entry) != entry->in_pack_type)
+		return 0;	/* pack has delta which is unusable */
+	else if (DELTA(entry))
+		return 0;	/* we want to pack afresh */
+	else
+		return 1;	/* we have it in-pack undeltified,
+				 * and we do not need to deltify it.
+				 */
+}
+
+/*
+ * When writing with more than one thread, objects that cannot be
+ * reused verbatim are deflated by a pool of worker threads that run
+ * ahead of write_one() in write order.  The writer picks up the
+ * compressed buffers as it reaches each object, and deflates by
+ * itself anything the workers have not claimed yet, so the resulting
+ * pack is byte-for-byte identical to a single-threaded write.
+ *
+ * Whether an object is written as a delta may depend on where its
+ * base ended up when packs are split, so we only run ahead when there
+ * is no pack size limit.
+ *
+ * write_one() may still drop the delta base of an entry to break a
+ * delta cycle.  It does so under the mutex, and a worker looks at the
+ * delta base only under the mutex when it claims the entry; the
+ * writer throws away what a worker compressed against a dropped base.
+ */
+enum compress_ahead_state {
+	COMPRESS_AHEAD_UNCLAIMED = 0,
+	COMPRESS_AHEAD_RUNNING,
+	COMPRESS_AHEAD_DONE,
+	COMPRESS_AHEAD_SKIPPED
+};
+
+struct compress_ahead_slot {
+	void *buf;
+	unsigned long size;
+	unsigned long datalen;
+	enum object_type type;
+	unsigned is_delta:1;
+	enum compress_ahead_state state;
+};
+
+/* Upper bound on compressed data held for the writer by the workers. */
+#define COMPRESS_AHEAD_MEMORY (64 * 1024 * 1024)
+
+static struct compress_ahead {
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	struct object_entry **write_order;
+	uint32_t nr;
+	uint32_t next;
+	unsigned long in_flight;
+	int stop;
+
+	/* indexed by position in to_pack.objects */
+	struct compress_ahead_slot *slots;
+
+	uint64_t compress_ns;
+	uint64_t wait_ns;
+} compress_ahead;
+
+/* Time spent deflating in write_pack_file(), summed over all threads. */
+static uint64_t write_compress_ns;
+
+static struct compress_ahead_slot *compress_ahead_slot(struct object_entry *e)
+{
+	return &compress_ahead.slots[e - to_pack.objects];
+}
+
+static int compress_ahead_one(struct object_entry *e,
+			      struct object_entry *base,
+			      struct compress_ahead_slot *slot,
+			      uint64_t *compress_ns)
+{
+	uint64_t start;
+
+	if (!base) {
+		/* large blobs are streamed by the writer */
+		if (oe_type(e) == OBJ_BLOB &&
+		    oe_size_greater_than(&to_pack, e, big_file_threshold))
+			return 0;
+		packing_data_lock(&to_pack);
+		slot->buf = read_object_file(&e->idx.oid, &slot->type,
+					     &slot->size);
+		packing_data_unlock(&to_pack);
+		/* let the writer complain about unreadable objects */
+		if (!slot->buf)
+			return 0;
+	} else if (e->delta_data) {
+		if (e->z_delta_size)
+			return 0; /* already deflated during delta search */
+		slot->size = DELTA_SIZE(e);
+		slot->buf = e->delta_data;
+		e->delta_data = NULL;
+	} else {
+		slot->buf = get_delta_against(e, base, &slot->size);
+	}
+	slot->is_delta = !!base;
+
+	start = getnanotime();
+	slot->datalen = do_compress(&slot->buf, slot->size);
+	*compress_ns = getnanotime() - start;
+	return 1;
+}
+
+static void *compress_ahead_worker(void *data)
+{
+	struct compress_ahead *ca = data;
+
+	pthread_mutex_lock(&ca->mutex);
+	for (;;) {
+		struct object_entry *e, *base;
+		struct compress_ahead_slot *slot;
+		uint64_t compress_ns = 0;
+		int ok;
+
+		while (!ca->stop && ca->next < ca->nr &&
+		       ca->in_flight >= COMPRESS_AHEAD_MEMORY)
+			pthread_cond_wait(&ca->work_cond, &ca->mutex);
+		if (ca->stop || ca->next >= ca->nr)
+			break;
+
+		e = ca->write_order[ca->next++];
+		slot = compress_ahead_slot(e);
+		if (slot->state != COMPRESS_AHEAD_UNCLAIMED)
+			continue; /* the writer got there first */
+		base = DELTA(e);
+		if (e->preferred_base || can_reuse_object_data(e, !!base)) {
+			slot->state = COMPRESS_AHEAD_SKIPPED;
+			continue;
+		}
+		slot->state = COMPRESS_AHEAD_RUNNING;
+
+		pthread_mutex_unlock(&ca->mutex);
+		ok = compress_ahead_one(e, base, slot, &compress_ns);
+		pthread_mutex_lock(&ca->mutex);
+
+		ca->compress_ns += compress_ns;
+
+		if (ok) {
+			slot->state = COMPRESS_AHEAD_DONE;
+			ca->in_flight += slot->datalen;
+		} else {
+			slot->state = COMPRESS_AHEAD_SKIPPED;
+		}
+		pthread_cond_broadcast(&ca->done_cond);
+	}
+	pthread_mutex_unlock(&ca->mutex);
+	return NULL;
+}
+
+static void start_compress_ahead(struct object_entry **write_order)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	int i;
+
+	if (delta_search_threads <= 1 || pack_size_limit ||
+	    to_pack.nr_objects < 2)
+		return;
+
+	ca->nr_threads = delta_search_threads;
+	ca->write_order = write_order;
+	ca->nr = to_pack.nr_objects;
+	ca->next = 0;
+	ca->in_flight = 0;
+	ca->stop = 0;
+	CALLOC_ARRAY(ca->slots, to_pack.nr_objects);
+
+	pthread_mutex_init(&ca->mutex, NULL);
+	pthread_cond_init(&ca->work_cond, NULL);
+	pthread_cond_init(&ca->done_cond, NULL);
+
+	CALLOC_ARRAY(ca->threads, ca->nr_threads);
+	for (i = 0; i < ca->nr_threads; i++) {
+		int ret = pthread_create(&ca->threads[i], NULL,
+					 compress_ahead_worker, ca);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+}
+
+/*
+ * Hand the writer the deflated data for "entry", waiting for a worker
+ * that is busy with it.  Returns 0 if the caller has to read and
+ * compress the object by itself.
+ */
+static int compress_ahead_take(struct object_entry *entry, int usable_delta,
+			       void **buf, unsigned long *size,
+			       unsigned long *datalen, enum object_type *type)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	struct compress_ahead_slot *slot;
+	int ret = 0;
+
+	if (!ca->threads)
+		return 0;
+
+	slot = compress_ahead_slot(entry);
+	pthread_mutex_lock(&ca->mutex);
+	if (slot->state == COMPRESS_AHEAD_RUNNING) {
+		uint64_t start = getnanotime();
+		while (slot->state == COMPRESS_AHEAD_RUNNING)
+			pthread_cond_wait(&ca->done_cond, &ca->mutex);
+		ca->wait_ns += getnanotime() - start;
+	}
+	if (slot->state == COMPRESS_AHEAD_DONE) {
+		ca->in_flight -= slot->datalen;
+		pthread_cond_broadcast(&ca->work_cond);
+		/*
+		 * write_one() may have dropped a recursive delta after
+		 * the worker claimed the entry; throw such a result away.
+		 */
+		if (slot->is_delta == !!usable_delta) {
+			*buf = slot->buf;
+			*size = slot->size;
+			*datalen = slot->datalen;
+			*type = slot->type;
+			ret = 1;
+		} else {
+			free(slot->buf);
+		}
+		slot->buf = NULL;
+	}
+	slot->state = COMPRESS_AHEAD_SKIPPED;
+	pthread_mutex_unlock(&ca->mutex);
+	return ret;
+}
+
+/*
+ * Drop the delta base of "e", which a compress-ahead worker may be
+ * looking at.
+ */
+static void compress_ahead_drop_delta(struct object_entry *e)
+{
+	struct compress_ahead *ca = &compress_ahead;
+
+	if (!ca->threads) {
+		SET_DELTA(e, NULL);
+		return;
+	}
+	pthread_mutex_lock(&ca->mutex);
+	SET_DELTA(e, NULL);
+	pthread_mutex_unlock(&ca->mutex);
+}
+
+static void stop_compress_ahead(void)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	uint32_t i;
+
+	if (!ca->threads)
+		return;
+
+	pthread_mutex_lock(&ca->mutex);
+	ca->stop = 1;
+	pthread_cond_broadcast(&ca->work_cond);
+	pthread_mutex_unlock(&ca->mutex);
+
+	for (i = 0; i < ca->nr_threads; i++)
+		pthread_join(ca->threads[i], NULL);
+	FREE_AND_NULL(ca->threads);
+
+	for (i = 0; i < to_pack.nr_objects; i++)
+		free(ca->slots[i].buf);
+	FREE_AND_NULL(ca->slots);
+
+	pthread_cond_destroy(&ca->done_cond);
+	pthread_cond_destroy(&ca->work_cond);
+	pthread_mutex_destroy(&ca->mutex);
+
+	write_compress_ns += ca->compress_ns;
+	trace2_data_intmax("pack-objects", the_repository,
+			   "write_pack_file/compress_threads", ca->nr_threads);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "write_pack_file/wait_ns", ca->wait_ns);
+}
+
 /* Return 0 if we will bust the pack-size limit */
 static unsigned long write_no_reuse_object(struct hashfile *f, struct object_entry *entry,
 					   unsigned long limit, int usable_delta)
@@ -446,6 +766,15 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 	struct git_istream *st = NULL;
 	const unsigned hashsz = the_hash_algo->rawsz;
 
+	if (compress_ahead_take(entry, usable_delta,
+				&buf, &size, &datalen, &type)) {
+		if (usable_delta)
+			type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
+				OBJ_OFS_DELTA : OBJ_REF_DELTA;
+		goto compressed;
+	}
+
+	packing_data_lock(&to_pack);
 	if (!usable_delta) {
 		if (oe_type(entry) == OBJ_BLOB &&
 		    oe_size_greater_than(&to_pack, entry, big_file_threshold) &&
@@ -471,19 +800,23 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	} else {
-		buf = get_delta(entry);
-		size = DELTA_SIZE(entry);
+		buf = get_delta(entry, &size);
 		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	}
+	packing_data_unlock(&to_pack);
 
 	if (st)	/* large blob case, just assume we don't compress well */
 		datalen = size;
 	else if (entry->z_delta_size)
 		datalen = entry->z_delta_size;
-	else
+	else {
+		uint64_t start = getnanotime();
 		datalen = do_compress(&buf, size);
+		write_compress_ns += getnanotime() - start;
+	}
 
+compressed:
 	/*
 	 * The object header is a byte of 'type' followed by zero or
 	 * more bytes of length.
@@ -535,8 +868,10 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 		hashwrite(f, header, hdrlen);
 	}
 	if (st) {
+		packing_data_lock(&to_pack);
 		datalen = write_large_blob_data(st, f, &entry->idx.oid);
 		close_istream(st);
+		packing_data_unlock(&to_pack);
 	} else {
 		hashwrite(f, buf, datalen);
 		free(buf);
@@ -665,28 +1000,15 @@ static off_t write_object(struct hashfile *f,
 	else
 		usable_delta = 0;	/* base could end up in another pack */
 
-	if (!reuse_object)
-		to_reuse = 0;	/* explicit */
-	else if (!IN_PACK(entry))
-		to_reuse = 0;	/* can't reuse what we don't have */
-	else if (oe_type(entry) == OBJ_REF_DELTA ||
-		 oe_type(entry) == OBJ_OFS_DELTA)
-				/* check_object() decided it for us ... */
-		to_reuse = usable_delta;
-				/* ... but pack split may override that */
-	else if (oe_type(entry) != entry->in_pack_type)
-		to_reuse = 0;	/* pack has delta which is unusable */
-	else if (DELTA(entry))
-		to_reuse = 0;	/* we want to pack afresh */
-	else
-		to_reuse = 1;	/* we have it in-pack undeltified,
-				 * and we do not need to deltify it.
-				 */
+	to_reuse = can_reuse_object_data(entry, usable_delta);
 
 	if (!to_reuse)
 		len = write_no_reuse_object(f, entry, limit, usable_delta);
-	else
+	else {
+		packing_data_lock(&to_pack);
 		len = write_reuse_object(f, entry, limit, usable_delta);
+		packing_data_unlock(&to_pack);
+	}
 	if (!len)
 		return 0;
 
@@ -733,7 +1055,7 @@ static enum write_one_status write_one(struct hashfile *f,
 		switch (write_one(f, DELTA(e), offset)) {
 		case WRITE_ONE_RECURSIVE:
 			/* we cannot depend on this one */
-			SET_DELTA(e, NULL);
+			compress_ahead_drop_delta(e);
 			break;
 		default:
 			break;
@@ -1155,6 +1477,33 @@ static const char no_split_warning[] = N_(
 "disabling bitmap writing, packs are split due to pack.packSizeLimit"
 );
 
+static void write_pack_delta_hints(const char *filename,
+				   const unsigned char *hash)
+{
+	struct delta_hint *hints;
+	uint32_t i, nr = 0;
+
+	ALLOC_ARRAY(hints, nr_written);
+	for (i = 0; i < nr_written; i++) {
+		struct object_entry *e = (struct object_entry *)written_list[i];
+		unsigned long delta_size;
+
+		if (!DELTA(e))
+			continue;
+		delta_size = DELTA_SIZE(e);
+		if (delta_size != (uint32_t)delta_size)
+			continue;
+		oidcpy(&hints[nr].target, &e->idx.oid);
+		oidcpy(&hints[nr].base, &DELTA(e)->idx.oid);
+		hints[nr].delta_size = delta_size;
+		nr++;
+	}
+	write_delta_hints_file(filename, hints, nr, hash);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta_hints/written", nr);
+	free(hints);
+}
+
 static void write_pack_file(void)
 {
 	uint32_t i = 0, j;
@@ -1163,15 +1512,18 @@ static void write_pack_file(void)
 	uint32_t nr_remaining = nr_result;
 	time_t last_mtime = 0;
 	struct object_entry **write_order;
+	uint64_t write_ns = 0;
 
 	if (progress > pack_to_stdout)
 		progress_state = start_progress(_("Writing objects"), nr_result);
 	ALLOC_ARRAY(written_list, to_pack.nr_objects);
 	write_order = compute_write_order();
+	start_compress_ahead(write_order);
 
 	do {
 		unsigned char hash[GIT_MAX_RAWSZ];
 		char *pack_tmp_name = NULL;
+		uint64_t start = getnanotime();
 
 		if (pack_to_stdout)
 			f = hashfd_throughput(1, "<stdout>", progress_state);
@@ -1182,7 +1534,9 @@ static void write_pack_file(void)
 
 		if (reuse_packfile) {
 			assert(pack_to_stdout);
+			packing_data_lock(&to_pack);
 			write_reused_pack(f);
+			packing_data_unlock(&to_pack);
 			offset = hashfile_total(f);
 		}
 
@@ -1193,6 +1547,8 @@ static void write_pack_file(void)
 				break;
 			display_progress(progress_state, written);
 		}
+		stop_compress_ahead();
+		write_ns += getnanotime() - start;
 
 		/*
 		 * Did we write the wrong # entries in the header?
@@ -1249,6 +1605,14 @@ static void write_pack_file(void)
 					    written_list, nr_written,
 					    &pack_idx_opts, hash);
 
+			if (write_delta_hints) {
+				size_t len = tmpname.len;
+
+				strbuf_addf(&tmpname, "%s.hints", hash_to_hex(hash));
+				write_pack_delta_hints(tmpname.buf, hash);
+				strbuf_setlen(&tmpname, len);
+			}
+
 			if (write_bitmap_index) {
 				strbuf_addf(&tmpname, "%s.bitmap", hash_to_hex(hash));
 
@@ -1282,6 +1646,10 @@ static void write_pack_file(void)
 		    written, nr_result);
 	trace2_data_intmax("pack-objects", the_repository,
 			   "write_pack_file/wrote", nr_result);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "write_pack_file/compress_ns", write_compress_ns);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "write_pack_file/write_ns", write_ns);
 }
 
 static int no_try_delta(const char *path)
@@ -2111,6 +2479,12 @@ static void drop_reused_delta(struct object_entry *entry)
 	SET_DELTA(entry, NULL);
 	entry->depth = 0;
 
+	if (entry->hinted_delta) {
+		/* type and size already describe the whole object */
+		entry->hinted_delta = 0;
+		return;
+	}
+
 	oi.sizep = &size;
 	oi.typep = &type;
 	if (packed_object_info(the_repository, IN_PACK(entry), entry->in_pack_offset, &oi) < 0) {
@@ -2252,6 +2626,75 @@ static void break_delta_chains(struct object_entry *entry)
 	}
 }
 
+/*
+ * Seed deltas from the hints files written alongside the packs we
+ * have, for objects that check_object() found no delta to reuse for.
+ * Like reused deltas, these objects are left out of the delta search,
+ * and break_delta_chains() cuts them down to --depth.
+ */
+static void apply_delta_hints(void)
+{
+	struct packed_git *p;
+	struct delta_hints **hints = NULL;
+	size_t i, nr = 0, alloc = 0;
+	uint32_t nr_hinted = 0;
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		struct delta_hints *h;
+
+		if (!p->pack_local)
+			continue;
+		h = load_delta_hints(p);
+		if (!h)
+			continue;
+		ALLOC_GROW(hints, nr + 1, alloc);
+		hints[nr++] = h;
+	}
+	if (!nr)
+		return;
+
+	for (i = 0; i < to_pack.nr_objects; i++) {
+		struct object_entry *entry = to_pack.objects + i, *base;
+		struct object_id base_oid;
+		unsigned long delta_size;
+		size_t j;
+
+		if (DELTA(entry) || entry->preferred_base ||
+		    entry->no_try_delta || !entry->type_valid)
+			continue;
+
+		for (j = 0; j < nr; j++)
+			if (delta_hints_lookup(hints[j], &entry->idx.oid,
+					       &base_oid, &delta_size))
+				break;
+		if (j == nr)
+			continue;
+
+		base = packlist_find(&to_pack, &base_oid);
+		if (!base || base == entry ||
+		    !base->type_valid || base->no_try_delta)
+			continue;
+		if (!delta_size || delta_size >= SIZE(entry))
+			continue;
+		if (!in_same_island(&entry->idx.oid, &base->idx.oid))
+			continue;
+
+		SET_DELTA(entry, base);
+		SET_DELTA_SIZE(entry, delta_size);
+		entry->delta_sibling_idx = base->delta_child_idx;
+		SET_DELTA_CHILD(base, entry);
+		entry->hinted_delta = 1;
+		nr_hinted++;
+	}
+
+	for (i = 0; i < nr; i++)
+		free_delta_hints(hints[i]);
+	free(hints);
+
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta_hints/seeded", nr_hinted);
+}
+
 static void get_object_details(void)
 {
 	uint32_t i;
@@ -2276,6 +2719,9 @@ static void get_object_details(void)
 	}
 	stop_progress(&progress_state);
 
+	if (use_delta_hints && !pack_to_stdout && window && depth)
+		apply_delta_hints();
+
 	/*
 	 * This must happen in a second pass, since we rely on the delta
 	 * information for the whole list being completed.
@@ -3112,6 +3558,20 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		else
 			write_bitmap_options &= ~BITMAP_OPT_HASH_CACHE;
 	}
+	if (!strcmp(k, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_LOOKUP_TABLE;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
+	}
+	if (!strcmp(k, "pack.writedeltahints")) {
+		write_delta_hints = git_config_bool(k, v);
+		return 0;
+	}
+	if (!strcmp(k, "pack.usedeltahints")) {
+		use_delta_hints = git_config_bool(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -212,6 +212,7 @@ static struct {
 	{".rev", 1},
 	{".bitmap", 1},
 	{".promisor", 1},
+	{".hints", 1},
 };
 
 static unsigned populate_pack_exts(char *name)
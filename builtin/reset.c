@@ -130,6 +130,7 @@ static void update_index_from_diff(struct diff_queue_struct *q,
 	int intent_to_add = *(int *)data;
 
 	for (i = 0; i < q->nr; i++) {
+		int pos;
 		struct diff_filespec *one = q->queue[i]->one;
 		int is_missing = !(one->mode && !is_null_oid(&one->oid));
 		struct cache_entry *ce;
@@ -144,6 +145,17 @@ static void update_index_from_diff(struct diff_queue_struct *q,
 		if (!ce)
 			die(_("make_cache_entry failed for path '%s'"),
 			    one->path);
+
+		/*
+		 * A path that is not checked out stays so, and a sparse
+		 * directory (which the diff only shows when the index is
+		 * sparse) is never checked out.
+		 */
+		pos = cache_name_pos(one->path, strlen(one->path));
+		if ((pos >= 0 && ce_skip_worktree(active_cache[pos])) ||
+		    S_ISSPARSEDIR(ce->ce_mode))
+			ce->ce_flags |= CE_SKIP_WORKTREE;
+
 		if (is_missing) {
 			ce->ce_flags |= CE_INTENT_TO_ADD;
 			set_object_name_for_intent_to_add_entry(ce);
@@ -158,6 +170,14 @@ static int read_from_tree(const struct pathspec *pathspec,
 {
 	struct diff_options opt;
 
+	/*
+	 * Without "-N", the sparse directories of a sparse index are
+	 * reset as a whole; the diff below only descends into them when
+	 * the pathspec reaches into one.
+	 */
+	if (intent_to_add || pathspec_needs_expanded_index(&the_index, pathspec))
+		ensure_full_index(&the_index);
+
 	memset(&opt, 0, sizeof(opt));
 	copy_pathspec(&opt.pathspec, pathspec);
 	opt.output_format = DIFF_FORMAT_CALLBACK;
@@ -316,6 +336,9 @@ int cmd_reset(int argc, const char **argv, const char *prefix)
 	git_config(git_reset_config, NULL);
 	git_config_get_bool("reset.quiet", &quiet);
 
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
+
 	argc = parse_options(argc, argv, prefix, options, git_reset_usage,
 						PARSE_OPT_KEEP_DASHDASH);
 	parse_args(&pathspec, argv, prefix, patch_mode, &rev);
@@ -13,6 +13,7 @@
 #include "progress.h"
 #include "decorate.h"
 #include "fsck.h"
+#include "bulk-checkin.h"
 
 static int dry_run, quiet, recover, has_errors, strict;
 static const char unpack_usage[] = "git unpack-objects [-n] [-q] [-r] [--strict]";
@@ -320,10 +321,110 @@ static void added_object(unsigned nr, enum object_type type,
 	}
 }
 
+struct input_zstream_data {
+	git_zstream *zstream;
+	unsigned char buf[8192];
+	int status;
+};
+
+static const void *feed_input_zstream(struct input_stream *in_stream,
+				      unsigned long *readlen)
+{
+	struct input_zstream_data *data = in_stream->data;
+	git_zstream *zstream = data->zstream;
+	void *in = fill(1);
+
+	zstream->next_out = data->buf;
+	zstream->avail_out = sizeof(data->buf);
+	zstream->next_in = in;
+	zstream->avail_in = len;
+
+	data->status = git_inflate(zstream, 0);
+
+	in_stream->is_finished = data->status != Z_OK;
+	use(len - zstream->avail_in);
+	*readlen = sizeof(data->buf) - zstream->avail_out;
+
+	return data->buf;
+}
+
+/*
+ * Is any queued delta waiting for the nr-th object as its base?
+ */
+static int has_delta_for(unsigned nr)
+{
+	struct delta_info *info;
+
+	for (info = delta_list; info; info = info->next)
+		if (oideq(&info->base_oid, &obj_list[nr].oid) ||
+		    info->base_offset == obj_list[nr].offset)
+			return 1;
+	return 0;
+}
+
+/*
+ * Write a blob above core.bigFileThreshold straight to a loose object
+ * as it is inflated, instead of holding all of it in memory.
+ */
+static void stream_blob(unsigned long size, unsigned nr)
+{
+	git_zstream zstream = { 0 };
+	struct input_zstream_data data = { 0 };
+	struct input_stream in_stream = {
+		.read = feed_input_zstream,
+		.data = &data,
+	};
+	struct obj_info *info = &obj_list[nr];
+
+	data.zstream = &zstream;
+	git_inflate_init(&zstream);
+
+	if (stream_loose_object(&in_stream, size, &info->oid))
+		die(_("failed to write object in stream"));
+
+	if (data.status != Z_STREAM_END)
+		die(_("inflate returned (%d)"), data.status);
+	git_inflate_end(&zstream);
+
+	if (strict) {
+		struct blob *blob = lookup_blob(the_repository, &info->oid);
+
+		if (!blob)
+			die(_("invalid blob object from stream"));
+		blob->object.flags |= FLAG_WRITTEN;
+	}
+	info->obj = NULL;
+
+	/*
+	 * A delta against this blob that came earlier in the pack has
+	 * to be resolved now, which means reading it back in full.
+	 * Later deltas find it in the object store by themselves.
+	 */
+	if (has_delta_for(nr)) {
+		enum object_type type;
+		unsigned long base_size;
+		void *base = read_object_file(&info->oid, &type, &base_size);
+
+		if (!base)
+			die(_("unable to read back streamed object %s"),
+			    oid_to_hex(&info->oid));
+		added_object(nr, type, base, base_size);
+		free(base);
+	}
+}
+
 static void unpack_non_delta_entry(enum object_type type, unsigned long size,
 				   unsigned nr)
 {
-	void *buf = get_data(size);
+	void *buf;
+
+	/* Write large blobs in stream without allocating full buffer. */
+	if (!dry_run && type == OBJ_BLOB && size > big_file_threshold) {
+		stream_blob(size, nr);
+		return;
+	}
+
+	buf = get_data(size);
 
 	if (!dry_run && buf)
 		write_object(nr, type, buf, size);
@@ -575,6 +676,7 @@ int cmd_unpack_objects(int argc, const char **argv, const char *prefix)
 		usage(unpack_usage);
 	}
 	the_hash_algo->init_fn(&ctx);
+	plug_bulk_checkin();
 	unpack_all();
 	the_hash_algo->update_fn(&ctx, buffer, offset);
 	the_hash_algo->final_oid_fn(&oid, &ctx);
@@ -586,6 +688,7 @@ int cmd_unpack_objects(int argc, const char **argv, const char *prefix)
 	if (!hasheq(fill(the_hash_algo->rawsz), oid.hash))
 		die("final sha1 did not match");
 	use(the_hash_algo->rawsz);
+	unplug_bulk_checkin();
 
 	/* Write the last part of the buffer to stdout */
 	while (len) {
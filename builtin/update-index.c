@@ -18,6 +18,7 @@
 #include "dir.h"
 #include "split-index.h"
 #include "fsmonitor.h"
+#include "bulk-checkin.h"
 
 /*
  * Default to not allowing changes to the list of files. The
@@ -1094,6 +1095,11 @@ int cmd_update_index(int argc, const char **argv, const char *prefix)
 	 * Custom copy of parse_options() because we want to handle
 	 * filename arguments as they come.
 	 */
+	/*
+	 * Objects for the paths given on the command line or on stdin
+	 * are only made durable, and visible, all at once at the end.
+	 */
+	plug_bulk_checkin();
 	parse_options_start(&ctx, argc, argv, prefix,
 			    options, PARSE_OPT_STOP_AT_NON_OPTION);
 	while (ctx.argc) {
@@ -1169,6 +1175,7 @@ int cmd_update_index(int argc, const char **argv, const char *prefix)
 		strbuf_release(&unquoted);
 		strbuf_release(&buf);
 	}
+	unplug_bulk_checkin();
 
 	if (split_index > 0) {
 		if (git_config_get_split_index() == 0)
@@ -9,10 +9,15 @@
 #include "strbuf.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "tempfile.h"
+#include "tmp-objdir.h"
 
-static struct bulk_checkin_state {
-	unsigned plugged:1;
+static int bulk_checkin_plugged;
+
+static struct tmp_objdir *bulk_fsync_objdir;
+static intmax_t bulk_fsync_objects;
 
+static struct bulk_checkin_state {
 	char *pack_tmp_name;
 	struct hashfile *f;
 	off_t offset;
@@ -62,6 +67,44 @@ static void finish_bulk_checkin(struct bulk_checkin_state *state)
 	reprepare_packed_git(the_repository);
 }
 
+/*
+ * Make the loose objects written since plug_bulk_checkin() durable with
+ * a single disk cache flush, and only then move them to their final
+ * names in the primary object store.
+ */
+static void do_batch_fsync(void)
+{
+	struct strbuf temp_path = STRBUF_INIT;
+	struct tempfile *temp;
+
+	if (!bulk_fsync_objdir)
+		return;
+
+	/*
+	 * Each object file has only been written back to the device by
+	 * fsync_loose_object_bulk_checkin(). An fsync() of any file on
+	 * the same filesystem flushes the device cache and commits the
+	 * filesystem journal, which makes all of them durable at once,
+	 * before any of them becomes reachable under its final name.
+	 */
+	strbuf_addf(&temp_path, "%s/bulk_fsync_XXXXXX", get_object_directory());
+	temp = xmks_tempfile(temp_path.buf);
+	fsync_or_die(get_tempfile_fd(temp), get_tempfile_path(temp));
+	delete_tempfile(&temp);
+	strbuf_release(&temp_path);
+
+	trace2_data_intmax("bulk-checkin", the_repository, "fsync/objects",
+			   bulk_fsync_objects);
+	bulk_fsync_objects = 0;
+
+	if (tmp_objdir_migrate(bulk_fsync_objdir))
+		die(_("unable to move new objects into the object database"));
+	bulk_fsync_objdir = NULL;
+
+	/* A bulk-checkin pack may have been among them */
+	reprepare_packed_git(the_repository);
+}
+
 static int already_written(struct bulk_checkin_state *state, struct object_id *oid)
 {
 	int i;
@@ -263,19 +306,52 @@ int index_bulk_checkin(struct object_id *oid,
 {
 	int status = deflate_to_pack(&state, oid, fd, size, type,
 				     path, flags);
-	if (!state.plugged)
+	if (!bulk_checkin_plugged)
 		finish_bulk_checkin(&state);
 	return status;
 }
 
+void prepare_loose_object_bulk_checkin(void)
+{
+	if (!bulk_checkin_plugged || bulk_fsync_objdir)
+		return;
+
+	/*
+	 * Loose objects written while plugged go to a temporary object
+	 * directory, so that none of them can be seen under its final
+	 * name before do_batch_fsync() has made it durable.
+	 */
+	bulk_fsync_objdir = tmp_objdir_create();
+	if (bulk_fsync_objdir)
+		tmp_objdir_replace_primary_odb(bulk_fsync_objdir);
+}
+
+void fsync_loose_object_bulk_checkin(int fd, const char *filename)
+{
+	/*
+	 * Outside of a plugged section, or if the platform cannot start
+	 * writeback without a full flush, fall back to a plain fsync().
+	 */
+	if (!bulk_fsync_objdir ||
+	    git_fsync(fd, FSYNC_WRITEOUT_ONLY) < 0)
+		fsync_or_die(fd, filename);
+	else
+		bulk_fsync_objects++;
+}
+
 void plug_bulk_checkin(void)
 {
-	state.plugged = 1;
+	bulk_checkin_plugged++;
 }
 
 void unplug_bulk_checkin(void)
 {
-	state.plugged = 0;
+	if (!bulk_checkin_plugged)
+		BUG("unbalanced unplug_bulk_checkin()");
+	if (--bulk_checkin_plugged)
+		return;
+
 	if (state.f)
 		finish_bulk_checkin(&state);
+	do_batch_fsync();
 }
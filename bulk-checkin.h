@@ -10,6 +10,21 @@ int index_bulk_checkin(struct object_id *oid,
 		       int fd, size_t size, enum object_type type,
 		       const char *path, unsigned flags);
 
+/*
+ * With core.fsyncObjectFiles=batch, loose objects written while bulk
+ * checkin is plugged are not fsync'd one by one. The first call to
+ * prepare_loose_object_bulk_checkin() redirects them to a temporary
+ * object directory, fsync_loose_object_bulk_checkin() only starts
+ * writeback of each one, and the final unplug_bulk_checkin() flushes
+ * them all to disk at once before moving them into place.
+ */
+void prepare_loose_object_bulk_checkin(void);
+void fsync_loose_object_bulk_checkin(int fd, const char *filename);
+
+/*
+ * Plugging may nest; objects are only finalized by the outermost
+ * unplug_bulk_checkin().
+ */
 void plug_bulk_checkin(void);
 void unplug_bulk_checkin(void);
 
@@ -7,6 +7,10 @@
 #include "replace-object.h"
 #include "promisor-remote.h"
 #include "sparse-index.h"
+#include "bulk-checkin.h"
+#include "config.h"
+#include "oidset.h"
+#include "thread-utils.h"
 
 #ifndef DEBUG_CACHE_TREE
 #define DEBUG_CACHE_TREE 0
@@ -237,13 +241,58 @@ int cache_tree_fully_valid(struct cache_tree *it)
 	return 1;
 }
 
+/*
+ * Tree objects built by a thread of update_cache_tree_threaded(), to be
+ * written by the main thread once all threads are done.
+ */
+struct deferred_trees {
+	struct deferred_tree {
+		struct object_id oid;
+		char *buf;
+		size_t len;
+	} *tree;
+	int nr, alloc;
+	struct oidset oids;
+};
+
+static void defer_tree(struct deferred_trees *deferred, struct strbuf *buffer,
+		       const struct object_id *oid)
+{
+	struct deferred_tree *tree;
+
+	if (oidset_insert(&deferred->oids, oid))
+		return;
+	ALLOC_GROW(deferred->tree, deferred->nr + 1, deferred->alloc);
+	tree = &deferred->tree[deferred->nr++];
+	oidcpy(&tree->oid, oid);
+	tree->len = buffer->len;
+	tree->buf = strbuf_detach(buffer, NULL);
+}
+
+static void clear_deferred_trees(struct deferred_trees *deferred)
+{
+	int i;
+
+	for (i = 0; i < deferred->nr; i++)
+		free(deferred->tree[i].buf);
+	FREE_AND_NULL(deferred->tree);
+	deferred->nr = deferred->alloc = 0;
+	oidset_clear(&deferred->oids);
+}
+
+/*
+ * With "deferred", the tree objects are not written but collected in
+ * it, and errors are not reported; the caller is expected to redo the
+ * update without it if this fails.
+ */
 static int update_one(struct cache_tree *it,
 		      struct cache_entry **cache,
 		      int entries,
 		      const char *base,
 		      int baselen,
 		      int *skip_count,
-		      int flags)
+		      int flags,
+		      struct deferred_trees *deferred)
 {
 	struct strbuf buffer;
 	int missing_ok = flags & WRITE_TREE_MISSING_OK;
@@ -319,7 +368,7 @@ static int update_one(struct cache_tree *it,
 				    path,
 				    baselen + sublen + 1,
 				    &subskip,
-				    flags);
+				    flags, deferred);
 		if (subcnt < 0)
 			return subcnt;
 		if (!subcnt)
@@ -381,9 +430,11 @@ static int update_one(struct cache_tree *it,
 			(has_promisor_remote() &&
 			 ce_skip_worktree(ce));
 		if (is_null_oid(oid) ||
-		    (!ce_missing_ok && !has_object_file(oid))) {
+		    (!ce_missing_ok &&
+		     !(deferred && oidset_contains(&deferred->oids, oid)) &&
+		     !has_object_file(oid))) {
 			strbuf_release(&buffer);
-			if (expected_missing)
+			if (expected_missing || deferred)
 				return -1;
 			return error("invalid object %06o %s for '%.*s'",
 				mode, oid_to_hex(oid), entlen+baselen, path);
@@ -436,6 +487,10 @@ static int update_one(struct cache_tree *it,
 	} else if (dryrun) {
 		hash_object_file(the_hash_algo, buffer.buf, buffer.len,
 				 tree_type, &it->oid);
+	} else if (deferred) {
+		hash_object_file(the_hash_algo, buffer.buf, buffer.len,
+				 tree_type, &it->oid);
+		defer_tree(deferred, &buffer, &it->oid);
 	} else if (write_object_file(buffer.buf, buffer.len, tree_type,
 				     &it->oid)) {
 		strbuf_release(&buffer);
@@ -452,6 +507,193 @@ static int update_one(struct cache_tree *it,
 	return i;
 }
 
+/*
+ * We want at least this many index entries below the invalid subtrees
+ * per thread for it to be worth starting threads, and split the work
+ * into a few more pieces than there are threads to balance it.
+ */
+#define THREAD_COST (10000)
+#define JOBS_PER_THREAD (4)
+
+struct cache_tree_job {
+	struct cache_tree *it;
+	struct cache_entry **cache;
+	int entries;
+	const char *base;
+	int baselen;
+	int ret;
+	struct deferred_trees deferred;
+};
+
+struct cache_tree_jobs {
+	struct cache_tree_job *job;
+	int nr, alloc;
+	int next;
+	int flags;
+	pthread_mutex_t mutex;
+};
+
+/*
+ * Queue the invalid subtrees of "it" that cover at most "chunk"
+ * entries as jobs, and look for smaller ones in the larger ones.
+ * update_one() later finds the jobs done and only has to build the
+ * trees above them.
+ */
+static void collect_cache_tree_jobs(struct cache_tree_jobs *jobs,
+				    struct cache_tree *it,
+				    struct cache_entry **cache, int entries,
+				    const char *base, int baselen, int chunk)
+{
+	int i = 0;
+
+	while (i < entries) {
+		const struct cache_entry *ce = cache[i];
+		struct cache_tree_sub *sub;
+		const char *path = ce->name, *slash;
+		int pathlen = ce_namelen(ce), sublen, subbaselen, end;
+
+		if (pathlen <= baselen || memcmp(base, path, baselen))
+			break; /* at the end of this level */
+
+		slash = strchr(path + baselen, '/');
+		if (!slash) {
+			i++;
+			continue;
+		}
+		sublen = slash - (path + baselen);
+		subbaselen = baselen + sublen + 1;
+		for (end = i + 1; end < entries; end++)
+			if (ce_namelen(cache[end]) <= subbaselen ||
+			    memcmp(cache[end]->name, path, subbaselen))
+				break;
+
+		sub = find_subtree(it, path + baselen, sublen, 1);
+		if (!sub->cache_tree)
+			sub->cache_tree = cache_tree();
+		if (sub->cache_tree->entry_count >= 0) {
+			; /* valid; update_one() checks that the tree exists */
+		} else if (end - i <= chunk) {
+			struct cache_tree_job *job;
+
+			ALLOC_GROW(jobs->job, jobs->nr + 1, jobs->alloc);
+			job = &jobs->job[jobs->nr++];
+			memset(job, 0, sizeof(*job));
+			job->it = sub->cache_tree;
+			job->cache = cache + i;
+			job->entries = end - i;
+			job->base = path;
+			job->baselen = subbaselen;
+			oidset_init(&job->deferred.oids, 0);
+		} else {
+			collect_cache_tree_jobs(jobs, sub->cache_tree,
+						cache + i, end - i,
+						path, subbaselen, chunk);
+		}
+		i = end;
+	}
+}
+
+static void *run_cache_tree_jobs(void *data)
+{
+	struct cache_tree_jobs *jobs = data;
+
+	for (;;) {
+		struct cache_tree_job *job;
+		int skip;
+
+		pthread_mutex_lock(&jobs->mutex);
+		job = jobs->next < jobs->nr ? &jobs->job[jobs->next++] : NULL;
+		pthread_mutex_unlock(&jobs->mutex);
+		if (!job)
+			return NULL;
+
+		job->ret = update_one(job->it, job->cache, job->entries,
+				      job->base, job->baselen, &skip,
+				      jobs->flags, &job->deferred);
+	}
+}
+
+/*
+ * Build the trees of independent invalid subtrees in parallel, and
+ * write them out from the main thread, as writing objects is not
+ * thread-safe. Subtrees for which this fails, e.g. because of a
+ * missing object, are left for the serial update_one() to redo and
+ * report.
+ */
+static int update_cache_tree_threaded(struct index_state *istate, int flags)
+{
+	struct cache_tree_jobs jobs = { 0 };
+	pthread_t *threads;
+	int nr_threads, i, j, ret = 0;
+
+	if (!HAVE_THREADS || (flags & (WRITE_TREE_DRY_RUN | WRITE_TREE_REPAIR)))
+		return 0;
+
+	if (git_config_get_index_threads(&nr_threads))
+		nr_threads = 0;
+	if (!nr_threads) {
+		nr_threads = istate->cache_nr / THREAD_COST;
+		if (nr_threads > online_cpus())
+			nr_threads = online_cpus();
+	}
+	if (nr_threads < 2)
+		return 0;
+
+	collect_cache_tree_jobs(&jobs, istate->cache_tree, istate->cache,
+				istate->cache_nr, "", 0,
+				DIV_ROUND_UP(istate->cache_nr,
+					     nr_threads * JOBS_PER_THREAD));
+	if (jobs.nr < 2)
+		goto out;
+	if (nr_threads > jobs.nr)
+		nr_threads = jobs.nr;
+
+	trace2_data_intmax("cache_tree", the_repository, "update/jobs", jobs.nr);
+	trace2_region_enter("cache_tree", "update/threaded", the_repository);
+
+	/* initialize lazily loaded state before starting the threads */
+	has_promisor_remote();
+
+	jobs.flags = flags;
+	pthread_mutex_init(&jobs.mutex, NULL);
+	enable_obj_read_lock();
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 run_cache_tree_jobs, &jobs);
+		if (err)
+			die(_("unable to create cache-tree thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die(_("unable to join cache-tree thread"));
+	free(threads);
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&jobs.mutex);
+
+	for (i = 0; i < jobs.nr && !ret; i++) {
+		struct deferred_trees *deferred = &jobs.job[i].deferred;
+
+		if (jobs.job[i].ret < 0)
+			continue;
+		for (j = 0; j < deferred->nr && !ret; j++) {
+			struct deferred_tree *tree = &deferred->tree[j];
+			struct object_id oid;
+
+			ret = write_object_file(tree->buf, tree->len,
+						tree_type, &oid);
+		}
+	}
+	trace2_region_leave("cache_tree", "update/threaded", the_repository);
+
+out:
+	for (i = 0; i < jobs.nr; i++)
+		clear_deferred_trees(&jobs.job[i].deferred);
+	free(jobs.job);
+	return ret;
+}
+
 int cache_tree_update(struct index_state *istate, int flags)
 {
 	int skip, i;
@@ -461,15 +703,17 @@ int cache_tree_update(struct index_state *istate, int flags)
 	if (i)
 		return i;
 
-	ensure_full_index(istate);
-
 	if (!istate->cache_tree)
 		istate->cache_tree = cache_tree();
 
 	trace_performance_enter();
 	trace2_region_enter("cache_tree", "update", the_repository);
-	i = update_one(istate->cache_tree, istate->cache, istate->cache_nr,
-		       "", 0, &skip, flags);
+	plug_bulk_checkin();
+	i = update_cache_tree_threaded(istate, flags);
+	if (!i)
+		i = update_one(istate->cache_tree, istate->cache,
+			       istate->cache_nr, "", 0, &skip, flags, NULL);
+	unplug_bulk_checkin();
 	trace2_region_leave("cache_tree", "update", the_repository);
 	trace_performance_leave("cache_tree_update");
 	if (i < 0)
@@ -735,13 +979,23 @@ int write_index_as_tree(struct object_id *oid, struct index_state *index_state,
 	return ret;
 }
 
+static void prime_cache_tree_sparse_dir(struct cache_tree *it,
+					struct tree *tree)
+{
+	oidcpy(&it->oid, &tree->object.oid);
+	it->entry_count = 1;
+}
+
 static void prime_cache_tree_rec(struct repository *r,
+				 struct index_state *istate,
 				 struct cache_tree *it,
-				 struct tree *tree)
+				 struct tree *tree,
+				 struct strbuf *tree_path)
 {
 	struct tree_desc desc;
 	struct name_entry entry;
 	int cnt;
+	size_t base_path_len = tree_path->len;
 
 	oidcpy(&it->oid, &tree->object.oid);
 	init_tree_desc(&desc, tree->buffer, tree->size);
@@ -756,10 +1010,26 @@ static void prime_cache_tree_rec(struct repository *r,
 				parse_tree(subtree);
 			sub = cache_tree_sub(it, entry.path);
 			sub->cache_tree = cache_tree();
-			prime_cache_tree_rec(r, sub->cache_tree, subtree);
+
+			/*
+			 * In a sparse index, a subtree that is a sparse
+			 * directory entry is a leaf of the cache-tree, and its
+			 * entries are not in the index to be counted.
+			 */
+			strbuf_setlen(tree_path, base_path_len);
+			strbuf_add(tree_path, entry.path, entry.pathlen);
+			strbuf_addch(tree_path, '/');
+			if (istate->sparse_index &&
+			    index_entry_exists(istate, tree_path->buf,
+					       tree_path->len))
+				prime_cache_tree_sparse_dir(sub->cache_tree, subtree);
+			else
+				prime_cache_tree_rec(r, istate, sub->cache_tree,
+						     subtree, tree_path);
 			cnt += sub->cache_tree->entry_count;
 		}
 	}
+	strbuf_setlen(tree_path, base_path_len);
 	it->entry_count = cnt;
 }
 
@@ -767,11 +1037,14 @@ void prime_cache_tree(struct repository *r,
 		      struct index_state *istate,
 		      struct tree *tree)
 {
+	struct strbuf tree_path = STRBUF_INIT;
+
 	trace2_region_enter("cache-tree", "prime_cache_tree", the_repository);
 	cache_tree_free(&istate->cache_tree);
 	istate->cache_tree = cache_tree();
 
-	prime_cache_tree_rec(r, istate->cache_tree, tree);
+	prime_cache_tree_rec(r, istate, istate->cache_tree, tree, &tree_path);
+	strbuf_release(&tree_path);
 	istate->cache_changed |= CACHE_TREE_CHANGED;
 	trace2_region_leave("cache-tree", "prime_cache_tree", the_repository);
 }
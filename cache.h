@@ -146,7 +146,7 @@ struct cache_entry {
 	unsigned int ce_flags;
 	unsigned int mem_pool_allocated;
 	unsigned int ce_namelen;
-	unsigned int index;	/* for link extension */
+	unsigned int index;	/* for link extension and index journal */
 	struct object_id oid;
 	char name[FLEX_ARRAY]; /* more */
 };
@@ -307,6 +307,7 @@ static inline unsigned int canon_mode(unsigned int mode)
 #define FSMONITOR_CHANGED	(1 << 8)
 
 struct split_index;
+struct index_journal;
 struct untracked_cache;
 struct progress;
 struct pattern_list;
@@ -318,6 +319,14 @@ struct index_state {
 	struct string_list *resolve_undo;
 	struct cache_tree *cache_tree;
 	struct split_index *split_index;
+	struct index_journal *journal;
+
+	/*
+	 * When set before the index is read, only the entries whose name
+	 * starts with this prefix are read, and the index must not be
+	 * written; see repo_read_index_prefix().
+	 */
+	char *partial_prefix;
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
 		 initialized : 1,
@@ -807,6 +816,20 @@ struct cache_entry *index_file_exists(struct index_state *istate, const char *na
  */
 int index_name_pos(struct index_state *, const char *name, int namelen);
 
+/*
+ * Like index_name_pos(), but does not expand a sparse index when "name"
+ * lies within a sparse directory entry; the position returned is then
+ * the one right after that sparse directory entry.
+ */
+int index_name_pos_sparse(struct index_state *, const char *name, int namelen);
+
+/*
+ * Determines whether an entry with the given name exists within the
+ * given index, without expanding a sparse index. Returns 1 if the entry
+ * exists, 0 otherwise.
+ */
+int index_entry_exists(struct index_state *, const char *name, int namelen);
+
 /*
  * Some functions return the negative complement of an insert position when a
  * precise match was not found but a position was found where the entry would
@@ -872,6 +895,8 @@ void *read_blob_data_from_index(struct index_state *, const char *, unsigned lon
 #define CE_MATCH_IGNORE_FSMONITOR 0X20
 int is_racy_timestamp(const struct index_state *istate,
 		      const struct cache_entry *ce);
+void ce_smudge_racily_clean_entry(struct index_state *istate,
+				  struct cache_entry *ce);
 int ie_match_stat(struct index_state *, const struct cache_entry *, struct stat *, unsigned int);
 int ie_modified(struct index_state *, const struct cache_entry *, struct stat *, unsigned int);
 
@@ -976,7 +1001,13 @@ void reset_shared_repository(void);
 extern int read_replace_refs;
 extern char *git_replace_ref_base;
 
-extern int fsync_object_files;
+enum fsync_object_files_mode {
+	FSYNC_OBJECT_FILES_OFF,
+	FSYNC_OBJECT_FILES_ON,
+	FSYNC_OBJECT_FILES_BATCH
+};
+
+extern enum fsync_object_files_mode fsync_object_files;
 extern int core_preload_index;
 extern int precomposed_unicode;
 extern int protect_hfs;
@@ -1659,10 +1690,23 @@ static inline void cache_def_clear(struct cache_def *cache)
 int has_symlink_leading_path(const char *name, int len);
 int threaded_has_symlink_leading_path(struct cache_def *, const char *, int);
 int check_leading_path(const char *name, int len, int warn_on_lstat_err);
+int threaded_check_leading_path(struct cache_def *cache, const char *name,
+				int len, int warn_on_lstat_err);
 int has_dirs_only_path(const char *name, int len, int prefix_len);
+int threaded_has_dirs_only_path(struct cache_def *cache, const char *name,
+				int len, int prefix_len);
 void invalidate_lstat_cache(void);
 void schedule_dir_for_removal(const char *name, int len);
 void remove_scheduled_dirs(void);
+/*
+ * The same, for a thread that removes the paths of its own part of
+ * the index with its own lstat cache and list of directories.
+ */
+void threaded_schedule_dir_for_removal(struct cache_def *cache,
+				       struct strbuf *removal,
+				       const char *name, int len);
+void threaded_remove_scheduled_dirs(struct cache_def *cache,
+				    struct strbuf *removal);
 
 struct pack_window {
 	struct pack_window *next;
@@ -20,6 +20,9 @@
 #include "json-writer.h"
 #include "trace2.h"
 #include "chunk-format.h"
+#include "thread-utils.h"
+#include "promisor-remote.h"
+#include "strmap.h"
 
 void git_test_write_commit_graph_or_die(void)
 {
@@ -28,7 +31,13 @@ void git_test_write_commit_graph_or_die(void)
 		return;
 
 	if (git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS, 0))
-		flags = COMMIT_GRAPH_WRITE_BLOOM_FILTERS;
+		flags |= COMMIT_GRAPH_WRITE_BLOOM_FILTERS;
+	if (git_env_bool(GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS, 0))
+		flags |= COMMIT_GRAPH_WRITE_REACHABILITY_LABELS;
+	if (git_env_bool(GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA, 0))
+		flags |= COMMIT_GRAPH_WRITE_COMMIT_METADATA;
+	if (git_env_bool(GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS, 0))
+		flags |= COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS;
 
 	if (write_commit_graph_reachable(the_repository->objects->odb,
 					 flags, NULL))
@@ -45,8 +54,17 @@ void git_test_write_commit_graph_or_die(void)
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_REACHABILITY_LABELS 0x524c4142 /* "RLAB" */
+#define GRAPH_CHUNKID_COMMIT_METADATA 0x434d4554 /* "CMET" */
+#define GRAPH_CHUNKID_COMMIT_STRINGS 0x43535452 /* "CSTR" */
+#define GRAPH_CHUNKID_CHANGED_PATH_INDEX 0x43504958 /* "CPIX" */
+#define GRAPH_CHUNKID_CHANGED_PATH_IDS 0x43504944 /* "CPID" */
+#define GRAPH_CHUNKID_CHANGED_PATH_NAMES 0x43504e4d /* "CPNM" */
 
 #define GRAPH_DATA_WIDTH (the_hash_algo->rawsz + 16)
+#define GRAPH_METADATA_WIDTH 32
+#define GRAPH_METADATA_NONE 0xffffffff
+#define GRAPH_CHANGED_PATHS_NONE 0x80000000
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -333,6 +351,86 @@ static int graph_read_bloom_data(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_commit_metadata(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	if (chunk_size != st_mult(GRAPH_METADATA_WIDTH, g->num_commits)) {
+		warning(_("commit-graph commit metadata chunk has the wrong size"));
+		return 0;
+	}
+	g->chunk_commit_metadata = chunk_start;
+	return 0;
+}
+
+static int graph_read_commit_strings(const unsigned char *chunk_start,
+				     size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	if (chunk_size && chunk_start[chunk_size - 1]) {
+		warning(_("commit-graph commit strings chunk is not terminated"));
+		return 0;
+	}
+	g->chunk_commit_strings = (const char *)chunk_start;
+	g->commit_strings_size = chunk_size;
+	return 0;
+}
+
+static int graph_read_changed_path_index(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	if (chunk_size != st_mult(4, g->num_commits)) {
+		warning(_("commit-graph changed path index chunk has the wrong size"));
+		return 0;
+	}
+	g->chunk_changed_path_index = chunk_start;
+	return 0;
+}
+
+static int graph_read_changed_path_ids(const unsigned char *chunk_start,
+				       size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	if (chunk_size % 4) {
+		warning(_("commit-graph changed path ids chunk has the wrong size"));
+		return 0;
+	}
+	g->chunk_changed_path_ids = chunk_start;
+	g->changed_path_ids_nr = chunk_size / 4;
+	return 0;
+}
+
+static int graph_read_changed_path_names(const unsigned char *chunk_start,
+					 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	uint32_t nr;
+	size_t header;
+
+	if (chunk_size < 4)
+		goto malformed;
+	nr = get_be32(chunk_start);
+	header = st_mult(4, st_add(nr, 1));
+	if (header > chunk_size ||
+	    (nr && (header == chunk_size || chunk_start[chunk_size - 1])))
+		goto malformed;
+
+	g->chunk_changed_path_names = chunk_start + 4;
+	g->changed_path_names_nr = nr;
+	g->changed_path_strings = (const char *)chunk_start + header;
+	g->changed_path_strings_size = chunk_size - header;
+	return 0;
+
+malformed:
+	warning(_("commit-graph changed path names chunk is malformed"));
+	return 0;
+}
+
 struct commit_graph *parse_commit_graph(struct repository *r,
 					void *graph_map, size_t graph_size)
 {
@@ -401,6 +499,17 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 	pair_chunk(cf, GRAPH_CHUNKID_DATA, &graph->chunk_commit_data);
 	pair_chunk(cf, GRAPH_CHUNKID_EXTRAEDGES, &graph->chunk_extra_edges);
 	pair_chunk(cf, GRAPH_CHUNKID_BASE, &graph->chunk_base_graphs);
+	pair_chunk(cf, GRAPH_CHUNKID_REACHABILITY_LABELS,
+		   &graph->chunk_reachability_labels);
+	read_chunk(cf, GRAPH_CHUNKID_COMMIT_METADATA,
+		   graph_read_commit_metadata, graph);
+	read_chunk(cf, GRAPH_CHUNKID_COMMIT_STRINGS,
+		   graph_read_commit_strings, graph);
+	if (!graph->chunk_commit_metadata || !graph->chunk_commit_strings) {
+		/* the metadata is useless without its strings */
+		graph->chunk_commit_metadata = NULL;
+		graph->chunk_commit_strings = NULL;
+	}
 
 	if (get_configured_generation_version(r) >= 2) {
 		pair_chunk(cf, GRAPH_CHUNKID_GENERATION_DATA,
@@ -416,6 +525,23 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 			   graph_read_bloom_data, graph);
 	}
 
+	if (r->settings.commit_graph_read_changed_paths) {
+		read_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_INDEX,
+			   graph_read_changed_path_index, graph);
+		read_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_IDS,
+			   graph_read_changed_path_ids, graph);
+		read_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_NAMES,
+			   graph_read_changed_path_names, graph);
+	}
+	if (!graph->chunk_changed_path_index ||
+	    !graph->chunk_changed_path_ids ||
+	    !graph->chunk_changed_path_names) {
+		/* the lists need all three chunks */
+		graph->chunk_changed_path_index = NULL;
+		graph->chunk_changed_path_ids = NULL;
+		graph->chunk_changed_path_names = NULL;
+	}
+
 	if (graph->chunk_bloom_indexes && graph->chunk_bloom_data) {
 		init_bloom_filters();
 	} else {
@@ -723,7 +849,7 @@ void close_commit_graph(struct raw_object_store *o)
 	o->commit_graph = NULL;
 }
 
-static int bsearch_graph(struct commit_graph *g, struct object_id *oid, uint32_t *pos)
+static int bsearch_graph(struct commit_graph *g, const struct object_id *oid, uint32_t *pos)
 {
 	return bsearch_hash(oid->hash, g->chunk_oid_fanout,
 			    g->chunk_oid_lookup, g->hash_len, pos);
@@ -962,6 +1088,480 @@ struct tree *get_commit_tree_in_graph(struct repository *r, const struct commit
 	return get_commit_tree_in_graph_one(r, r->objects->commit_graph, c);
 }
 
+struct reachability_label {
+	uint32_t post;
+	uint32_t tree_low;
+	uint32_t reach_low;
+};
+
+static void load_reachability_label(const struct commit_graph *g,
+				    uint32_t pos,
+				    struct reachability_label *label)
+{
+	const unsigned char *data = g->chunk_reachability_labels +
+		st_mult(sizeof(uint32_t) * 3, pos - g->num_commits_in_base);
+
+	label->post = get_be32(data);
+	label->tree_low = get_be32(data + 4);
+	label->reach_low = get_be32(data + 8);
+}
+
+/*
+ * What the labels of a layer say about whether the commit at "from_pos"
+ * can reach the one labelled "to": 1 for yes, 0 for no, -1 if they do
+ * not tell.
+ */
+static int check_reachability_label(const struct commit_graph *g,
+				    uint32_t from_pos,
+				    const struct reachability_label *to)
+{
+	struct reachability_label from;
+
+	load_reachability_label(g, from_pos, &from);
+	if (to->post > from.post || to->post < from.reach_low)
+		return 0;
+	if (to->post >= from.tree_low)
+		return 1;
+	return -1;
+}
+
+define_commit_slab(reach_seen, char);
+
+int commit_graph_can_reach(struct repository *r,
+			   const struct commit *from,
+			   const struct commit *to)
+{
+	struct commit_graph *g = r->objects->commit_graph;
+	uint32_t from_pos = commit_graph_position(from);
+	uint32_t to_pos = commit_graph_position(to);
+	struct reachability_label to_label;
+	struct commit_list *stack = NULL;
+	struct reach_seen seen;
+	int ret;
+
+	if (from == to)
+		return 1;
+	if (from_pos == COMMIT_NOT_FROM_GRAPH ||
+	    to_pos == COMMIT_NOT_FROM_GRAPH)
+		return -1;
+
+	while (g && from_pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (!g)
+		return -1;
+
+	/* base layers are closed under reachability */
+	if (to_pos >= g->num_commits_in_base + g->num_commits)
+		return 0;
+	if (to_pos < g->num_commits_in_base ||
+	    !g->chunk_reachability_labels)
+		return -1;
+
+	load_reachability_label(g, to_pos, &to_label);
+	ret = check_reachability_label(g, from_pos, &to_label);
+	if (ret >= 0)
+		return ret;
+
+	/*
+	 * The labels leave the question open. Search the parents, only
+	 * going through commits for which the labels do not tell either.
+	 * Paths that leave the layer cannot come back to "to".
+	 */
+	init_reach_seen(&seen);
+	commit_list_insert((struct commit *)from, &stack);
+	ret = 0;
+	while (stack && !ret) {
+		struct commit *c = pop_commit(&stack);
+		struct commit_list *p;
+
+		for (p = c->parents; p; p = p->next) {
+			char *p_seen = reach_seen_at(&seen, p->item);
+			uint32_t pos;
+
+			if (*p_seen)
+				continue;
+			*p_seen = 1;
+
+			if (repo_parse_commit(r, p->item)) {
+				ret = -1;
+				break;
+			}
+			pos = commit_graph_position(p->item);
+			if (pos == COMMIT_NOT_FROM_GRAPH ||
+			    pos < g->num_commits_in_base)
+				continue;
+
+			ret = check_reachability_label(g, pos, &to_label);
+			if (ret > 0)
+				break;
+			if (ret < 0)
+				commit_list_insert(p->item, &stack);
+			ret = 0;
+		}
+	}
+
+	free_commit_list(stack);
+	clear_reach_seen(&seen);
+	return ret;
+}
+
+/*
+ * The parts of a commit that the commit metadata chunk stores. The
+ * strings point into the commit buffer or into the commit-graph and
+ * are not NUL-terminated.
+ */
+struct commit_metadata {
+	const char *author, *committer, *subject;
+	size_t author_len, committer_len, subject_len;
+	timestamp_t author_date, committer_date;
+	int author_tz, committer_tz;
+};
+
+static void format_metadata_ident(struct strbuf *sb, const char *what,
+				  const char *ident, size_t len,
+				  timestamp_t date, int tz)
+{
+	strbuf_addf(sb, "%s %.*s %"PRItime" %c%04d\n", what, (int)len, ident,
+		    date, tz < 0 ? '-' : '+', abs(tz));
+}
+
+/*
+ * Give back what read_commit_metadata_from_graph() returns: the
+ * "author" and "committer" headers, an empty line and the message up
+ * to the end of its first paragraph.
+ */
+static void format_commit_metadata(struct strbuf *sb,
+				   const struct commit_metadata *m)
+{
+	format_metadata_ident(sb, "author", m->author, m->author_len,
+			      m->author_date, m->author_tz);
+	format_metadata_ident(sb, "committer", m->committer, m->committer_len,
+			      m->committer_date, m->committer_tz);
+	strbuf_addch(sb, '\n');
+	strbuf_add(sb, m->subject, m->subject_len);
+}
+
+/*
+ * Split the value of an "author" or "committer" header, i.e. "Name
+ * <email> <date> <tz>", but only if format_metadata_ident() would
+ * give back the very same line.
+ */
+static int parse_metadata_ident(const char *line, size_t len,
+				const char **ident, size_t *ident_len,
+				timestamp_t *date, int *tz)
+{
+	const char *tz_begin, *date_begin;
+	char buf[64];
+	int i;
+
+	if (len < 8)
+		return -1;
+	tz_begin = line + len - 5;
+	if (tz_begin[-1] != ' ' || (*tz_begin != '+' && *tz_begin != '-'))
+		return -1;
+	for (i = 1; i < 5; i++)
+		if (!isdigit(tz_begin[i]))
+			return -1;
+
+	date_begin = tz_begin - 1;
+	while (date_begin > line && isdigit(date_begin[-1]))
+		date_begin--;
+	if (date_begin == tz_begin - 1 || date_begin - 1 <= line ||
+	    date_begin[-1] != ' ')
+		return -1;
+
+	*ident = line;
+	*ident_len = date_begin - 1 - line;
+	if (memchr(line, '\0', *ident_len))
+		return -1;
+
+	*date = parse_timestamp(date_begin, NULL, 10);
+	*tz = atoi(tz_begin + 1);
+	if (*tz_begin == '-')
+		*tz = -*tz;
+
+	/* catch leading zeroes, "-0000", overflows and the like */
+	xsnprintf(buf, sizeof(buf), "%"PRItime" %c%04d",
+		  *date, *tz < 0 ? '-' : '+', abs(*tz));
+	if (strlen(buf) != line + len - date_begin ||
+	    memcmp(buf, date_begin, line + len - date_begin))
+		return -1;
+	return 0;
+}
+
+/*
+ * Find what the commit metadata chunk would store for the commit
+ * object in "buf". Returns -1 when we cannot store it such that the
+ * buffer format_commit_metadata() gives back shows the same idents,
+ * dates and subject as the commit itself, e.g. when the commit has an
+ * "encoding" header or a subject with CRs or whitespace-only lines.
+ */
+static int parse_commit_metadata(const char *buf, size_t size,
+				 struct commit_metadata *m)
+{
+	const char *p = buf, *end = buf + size, *eol, *first, *subject_end;
+	int authors = 0, committers = 0;
+
+	if (memchr(buf, '\0', size))
+		return -1;
+
+	while (p < end && *p != '\n') {
+		const char *v;
+
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			return -1;
+		if (skip_prefix(p, "author ", &v)) {
+			if (authors++ ||
+			    parse_metadata_ident(v, eol - v,
+						 &m->author, &m->author_len,
+						 &m->author_date, &m->author_tz))
+				return -1;
+		} else if (skip_prefix(p, "committer ", &v)) {
+			if (committers++ ||
+			    parse_metadata_ident(v, eol - v,
+						 &m->committer, &m->committer_len,
+						 &m->committer_date, &m->committer_tz))
+				return -1;
+		} else if (starts_with(p, "encoding ")) {
+			return -1;
+		}
+		p = eol + 1;
+	}
+	if (p == end || authors != 1 || committers != 1)
+		return -1;
+
+	/*
+	 * Keep the message up to the end of its first paragraph,
+	 * including the empty lines before it.
+	 */
+	m->subject = ++p;
+	first = p;
+	while (first < end && *first == '\n')
+		first++;
+	eol = strstr(first, "\n\n");
+	subject_end = eol ? eol + 1 : end;
+	m->subject_len = subject_end - m->subject;
+
+	if (memchr(first, '\r', subject_end - first))
+		return -1;
+	for (p = first; p < subject_end; p = eol) {
+		const char *q;
+
+		eol = memchr(p, '\n', subject_end - p);
+		eol = eol ? eol + 1 : subject_end;
+		for (q = p; q < eol && isspace(*q); q++)
+			; /* nothing */
+		if (q == eol || starts_with(p, "-----BEGIN "))
+			return -1;
+	}
+	return 0;
+}
+
+static const char *commit_metadata_string(const struct commit_graph *g,
+					  uint32_t offset, size_t *len)
+{
+	const char *str;
+
+	if (offset >= g->commit_strings_size)
+		return NULL;
+	str = g->chunk_commit_strings + offset;
+	*len = strlen(str);
+	return str;
+}
+
+static int load_commit_metadata(const struct commit_graph *g, uint32_t pos,
+				struct commit_metadata *m)
+{
+	const unsigned char *data = g->chunk_commit_metadata +
+		st_mult(GRAPH_METADATA_WIDTH, pos - g->num_commits_in_base);
+	uint32_t tz;
+
+	if (get_be32(data) == GRAPH_METADATA_NONE)
+		return -1;
+
+	m->author = commit_metadata_string(g, get_be32(data), &m->author_len);
+	m->committer = commit_metadata_string(g, get_be32(data + 4),
+					      &m->committer_len);
+	m->subject = commit_metadata_string(g, get_be32(data + 8),
+					    &m->subject_len);
+	if (!m->author || !m->committer || !m->subject)
+		return -1;
+
+	tz = get_be32(data + 12);
+	m->author_tz = (int16_t)(tz >> 16);
+	m->committer_tz = (int16_t)(tz & 0xffff);
+	m->author_date = get_be64(data + 16);
+	m->committer_date = get_be64(data + 24);
+	return 0;
+}
+
+char *read_commit_metadata_from_graph(struct repository *r,
+				      const struct object_id *oid)
+{
+	struct commit_graph *g;
+	struct commit_metadata m;
+	struct strbuf sb = STRBUF_INIT;
+	uint32_t lex_index;
+
+	if (!prepare_commit_graph(r))
+		return NULL;
+
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (bsearch_graph(g, oid, &lex_index))
+			break;
+	if (!g || !g->chunk_commit_metadata ||
+	    load_commit_metadata(g, lex_index + g->num_commits_in_base, &m))
+		return NULL;
+
+	format_commit_metadata(&sb, &m);
+	return strbuf_detach(&sb, NULL);
+}
+
+int commit_graph_has_changed_path_lists(struct repository *r)
+{
+	struct commit_graph *g;
+
+	if (!prepare_commit_graph(r))
+		return 0;
+	for (g = r->objects->commit_graph; g; g = g->base_graph)
+		if (g->chunk_changed_path_index)
+			return 1;
+	return 0;
+}
+
+static const char *changed_path_name(const struct commit_graph *g,
+				     uint32_t id)
+{
+	uint32_t offset;
+
+	if (id >= g->changed_path_names_nr)
+		return NULL;
+	offset = get_be32(g->chunk_changed_path_names + st_mult(4, id));
+	if (offset >= g->changed_path_strings_size)
+		return NULL;
+	return g->changed_path_strings + offset;
+}
+
+/*
+ * Look up the id of "path" in the changed path names of "g", which are
+ * sorted. Returns 1 if it is there, 0 if it is not, i.e. no commit of
+ * "g" changed it, and -1 if the names are corrupt.
+ */
+static int find_changed_path_id(const struct commit_graph *g,
+				const char *path, uint32_t *id)
+{
+	uint32_t lo = 0, hi = g->changed_path_names_nr;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const char *name = changed_path_name(g, mi);
+		int cmp;
+
+		if (!name)
+			return -1;
+		cmp = strcmp(path, name);
+		if (!cmp) {
+			*id = mi;
+			return 1;
+		}
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+/*
+ * Find where the ids of the paths changed by the commit at "pos" of
+ * "g" start and end in its CPID chunk. Returns -1 if there is no list
+ * for that commit.
+ */
+static int changed_path_list_range(const struct commit_graph *g,
+				   uint32_t pos, size_t *start, size_t *end)
+{
+	uint32_t lex_index = pos - g->num_commits_in_base;
+	uint32_t value;
+
+	if (!g->chunk_changed_path_index)
+		return -1;
+	value = get_be32(g->chunk_changed_path_index + st_mult(4, lex_index));
+	if (value & GRAPH_CHANGED_PATHS_NONE)
+		return -1;
+
+	*end = value;
+	*start = lex_index ?
+		get_be32(g->chunk_changed_path_index +
+			 st_mult(4, lex_index - 1)) & ~GRAPH_CHANGED_PATHS_NONE :
+		0;
+	if (*start > *end || *end > g->changed_path_ids_nr)
+		return -1;
+	return 0;
+}
+
+int commit_graph_changed_path(struct repository *r, struct commit *c,
+			      const char *path)
+{
+	struct commit_graph *g;
+	uint32_t pos = commit_graph_position(c);
+	uint32_t id;
+	size_t lo, hi;
+	int found;
+
+	if (pos == COMMIT_NOT_FROM_GRAPH || !prepare_commit_graph(r))
+		return -1;
+
+	g = r->objects->commit_graph;
+	while (pos < g->num_commits_in_base)
+		g = g->base_graph;
+
+	if (changed_path_list_range(g, pos, &lo, &hi))
+		return -1;
+
+	found = find_changed_path_id(g, path, &id);
+	if (found <= 0)
+		return found;
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		uint32_t v = get_be32(g->chunk_changed_path_ids + st_mult(4, mi));
+
+		if (v == id)
+			return 1;
+		if (v < id)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return 0;
+}
+
+/*
+ * Add the paths the commit at "pos" of "g" changed to "paths", in
+ * sorted order. Returns -1 if there is no list for that commit.
+ */
+static int load_changed_path_list(const struct commit_graph *g, uint32_t pos,
+				  struct string_list *paths)
+{
+	size_t i, start, end;
+
+	if (changed_path_list_range(g, pos, &start, &end))
+		return -1;
+
+	for (i = start; i < end; i++) {
+		const char *name = changed_path_name(g,
+			get_be32(g->chunk_changed_path_ids + st_mult(4, i)));
+
+		if (!name) {
+			string_list_clear(paths, 0);
+			return -1;
+		}
+		string_list_append(paths, name);
+	}
+	return 0;
+}
+
 struct packed_commit_list {
 	struct commit **list;
 	size_t nr;
@@ -994,6 +1594,9 @@ struct write_commit_graph_context {
 		 report_progress:1,
 		 split:1,
 		 changed_paths:1,
+		 reachability_labels:1,
+		 commit_metadata:1,
+		 changed_path_lists:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
 		 trust_generation_numbers:1;
@@ -1007,6 +1610,21 @@ struct write_commit_graph_context {
 	int count_bloom_filter_not_computed;
 	int count_bloom_filter_trunc_empty;
 	int count_bloom_filter_trunc_large;
+	int count_bloom_filter_threads;
+
+	/* three words per commit, see compute_reachability_labels() */
+	uint32_t *labels;
+
+	/* see compute_commit_metadata() */
+	unsigned char *metadata;
+	struct strbuf metadata_strings;
+
+	/* see compute_changed_path_lists() */
+	uint32_t *changed_path_index;
+	uint32_t *changed_path_ids;
+	size_t changed_path_ids_nr, changed_path_ids_alloc;
+	struct string_list changed_path_names;
+	size_t changed_path_strings_size;
 };
 
 static int write_graph_chunk_fanout(struct hashfile *f,
@@ -1319,6 +1937,91 @@ static int write_graph_chunk_bloom_data(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_reachability_labels(struct hashfile *f,
+						 void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < st_mult(ctx->commits.nr, 3); i++) {
+		if (!(i % 3))
+			display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, ctx->labels[i]);
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_commit_metadata(struct hashfile *f,
+					     void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite(f, ctx->metadata + st_mult(GRAPH_METADATA_WIDTH, i),
+			  GRAPH_METADATA_WIDTH);
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_commit_strings(struct hashfile *f,
+					    void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+
+	hashwrite(f, ctx->metadata_strings.buf, ctx->metadata_strings.len);
+	return 0;
+}
+
+static int write_graph_chunk_changed_path_index(struct hashfile *f,
+						void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, ctx->changed_path_index[i]);
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_changed_path_ids(struct hashfile *f,
+					      void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->changed_path_ids_nr; i++)
+		hashwrite_be32(f, ctx->changed_path_ids[i]);
+
+	return 0;
+}
+
+static int write_graph_chunk_changed_path_names(struct hashfile *f,
+						void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	struct string_list *names = &ctx->changed_path_names;
+	uint32_t offset = 0;
+	size_t i;
+
+	hashwrite_be32(f, names->nr);
+	for (i = 0; i < names->nr; i++) {
+		hashwrite_be32(f, offset);
+		offset += strlen(names->items[i].string) + 1;
+	}
+	for (i = 0; i < names->nr; i++)
+		hashwrite(f, names->items[i].string,
+			  strlen(names->items[i].string) + 1);
+
+	return 0;
+}
+
 static int add_packed_commits(const struct object_id *oid,
 			      struct packed_git *pack,
 			      uint32_t pos,
@@ -1532,6 +2235,344 @@ static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 	stop_progress(&ctx->progress);
 }
 
+define_commit_slab(label_index, uint32_t);
+
+struct label_order {
+	uint32_t level;
+	uint32_t index;
+};
+
+static int label_order_cmp(const void *va, const void *vb)
+{
+	const struct label_order *a = va, *b = vb;
+
+	if (a->level != b->level)
+		return a->level > b->level ? -1 : 1;
+	return a->index < b->index ? -1 : a->index > b->index;
+}
+
+/*
+ * Return the position in ctx->commits of a parent that is in the layer
+ * we are writing and that the DFS has not entered yet, or -1.
+ */
+static int64_t next_label_parent(struct label_index *index,
+				 struct commit *c, const uint32_t *labels)
+{
+	struct commit_list *p;
+
+	for (p = c->parents; p; p = p->next) {
+		uint32_t *pos = label_index_peek(index, p->item);
+
+		if (pos && *pos && !labels[3 * (*pos - 1) + 2])
+			return *pos - 1;
+	}
+	return -1;
+}
+
+/*
+ * Label the commits of the layer we are writing with a depth-first
+ * search that follows parents, first parents first, starting from the
+ * commits with the highest topological levels. Each commit gets three
+ * numbers, stored one past their value so that zero means "not yet":
+ *
+ *  - "post", its position in the post-order of the search. A commit
+ *    cannot reach any commit with a larger post-order position.
+ *
+ *  - "tree low", the smallest post-order position in its subtree of
+ *    the search. Commits whose position lies between "tree low" and
+ *    "post" are reachable.
+ *
+ *  - "reach low", the smallest post-order position among all the
+ *    commits it can reach in this layer. Commits whose position is
+ *    below it are not reachable.
+ *
+ * A commit cannot reach back into the layer once a path leaves it for
+ * a base layer, so the labels answer queries between two commits of
+ * the same layer.
+ */
+static void compute_reachability_labels(struct write_commit_graph_context *ctx)
+{
+	struct label_index index;
+	struct label_order *order;
+	struct commit_list *stack = NULL;
+	uint32_t *labels, next_post = 1;
+	size_t i;
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					_("Computing commit reachability labels"),
+					ctx->commits.nr);
+
+	init_label_index(&index);
+	ALLOC_ARRAY(order, ctx->commits.nr);
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit *c = ctx->commits.list[i];
+
+		*label_index_at(&index, c) = i + 1;
+		order[i].level = *topo_level_slab_at(ctx->topo_levels, c);
+		order[i].index = i;
+	}
+	QSORT(order, ctx->commits.nr, label_order_cmp);
+
+	CALLOC_ARRAY(labels, st_mult(ctx->commits.nr, 3));
+	for (i = 0; i < ctx->commits.nr; i++) {
+		uint32_t *label = &labels[3 * order[i].index];
+
+		if (label[2])
+			continue;
+
+		label[1] = next_post;
+		label[2] = next_post;
+		commit_list_insert(ctx->commits.list[order[i].index], &stack);
+
+		while (stack) {
+			struct commit *c = stack->item;
+			uint32_t *cur = &labels[3 * (*label_index_at(&index, c) - 1)];
+			struct commit_list *p;
+			int64_t next = next_label_parent(&index, c, labels);
+
+			if (next >= 0) {
+				labels[3 * next + 1] = next_post;
+				labels[3 * next + 2] = next_post;
+				commit_list_insert(ctx->commits.list[next], &stack);
+				continue;
+			}
+
+			/* all parents in this layer are done */
+			cur[0] = next_post++;
+			for (p = c->parents; p; p = p->next) {
+				uint32_t *pos = label_index_peek(&index, p->item);
+				uint32_t reach_low;
+
+				if (!pos || !*pos)
+					continue;
+				reach_low = labels[3 * (*pos - 1) + 2];
+				if (reach_low < cur[2])
+					cur[2] = reach_low;
+			}
+			pop_commit(&stack);
+			display_progress(ctx->progress, next_post - 1);
+		}
+	}
+
+	/* store the positions themselves */
+	for (i = 0; i < st_mult(ctx->commits.nr, 3); i++)
+		labels[i]--;
+
+	ctx->labels = labels;
+	free(order);
+	clear_label_index(&index);
+	stop_progress(&ctx->progress);
+}
+
+/*
+ * Add "str" to the strings of the commit metadata chunk unless it is
+ * already there, and return its offset.
+ */
+static uint32_t intern_metadata_string(struct write_commit_graph_context *ctx,
+				       struct strintmap *offsets,
+				       struct strbuf *key,
+				       const char *str, size_t len)
+{
+	int offset;
+
+	strbuf_reset(key);
+	strbuf_add(key, str, len);
+	offset = strintmap_get(offsets, key->buf);
+	if (offset >= 0)
+		return offset;
+
+	if (unsigned_add_overflows(ctx->metadata_strings.len, len + 1) ||
+	    ctx->metadata_strings.len + len + 1 > maximum_signed_value_of_type(int))
+		return GRAPH_METADATA_NONE;
+	offset = ctx->metadata_strings.len;
+	strbuf_add(&ctx->metadata_strings, key->buf, len + 1);
+	strintmap_set(offsets, key->buf, offset);
+	return offset;
+}
+
+/*
+ * Collect the idents, dates and subjects of the commits. Each commit
+ * gets a GRAPH_METADATA_WIDTH-byte record in "ctx->metadata", whose
+ * strings are interned in "ctx->metadata_strings", so that the many
+ * commits by the same people share their idents.
+ */
+static void compute_commit_metadata(struct write_commit_graph_context *ctx)
+{
+	struct strintmap offsets;
+	struct strbuf key = STRBUF_INIT;
+	size_t i;
+	int count_stored = 0;
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					_("Collecting commit metadata"),
+					ctx->commits.nr);
+
+	strintmap_init_with_options(&offsets, -1, NULL, 1);
+	CALLOC_ARRAY(ctx->metadata,
+		     st_mult(GRAPH_METADATA_WIDTH, ctx->commits.nr));
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit *c = ctx->commits.list[i];
+		unsigned char *data = ctx->metadata +
+				      st_mult(GRAPH_METADATA_WIDTH, i);
+		struct commit_metadata m;
+		unsigned long size;
+		const char *buf = repo_get_commit_buffer(ctx->r, c, &size);
+		uint32_t author, committer, subject;
+
+		put_be32(data, GRAPH_METADATA_NONE);
+		if (!parse_commit_metadata(buf, size, &m) &&
+		    (author = intern_metadata_string(ctx, &offsets, &key,
+						     m.author, m.author_len)) != GRAPH_METADATA_NONE &&
+		    (committer = intern_metadata_string(ctx, &offsets, &key,
+							m.committer, m.committer_len)) != GRAPH_METADATA_NONE &&
+		    (subject = intern_metadata_string(ctx, &offsets, &key,
+						      m.subject, m.subject_len)) != GRAPH_METADATA_NONE) {
+			put_be32(data, author);
+			put_be32(data + 4, committer);
+			put_be32(data + 8, subject);
+			put_be32(data + 12,
+				 ((uint32_t)(uint16_t)m.author_tz << 16) |
+				 (uint16_t)m.committer_tz);
+			put_be64(data + 16, m.author_date);
+			put_be64(data + 24, m.committer_date);
+			count_stored++;
+		}
+
+		repo_unuse_commit_buffer(ctx->r, c, buf);
+		display_progress(ctx->progress, i + 1);
+	}
+
+	trace2_data_intmax("commit-graph", ctx->r, "metadata-stored",
+			   count_stored);
+	strbuf_release(&key);
+	strintmap_clear(&offsets);
+	stop_progress(&ctx->progress);
+}
+
+/*
+ * Add the "paths" one commit changed to the lists, giving each path
+ * that is new to the lists the next id. Returns -1 if the offsets in
+ * the CPNM chunk or the positions in the CPID chunk would overflow.
+ */
+static int add_changed_path_list(struct write_commit_graph_context *ctx,
+				 struct strintmap *ids,
+				 const struct string_list *paths)
+{
+	size_t i, nr = ctx->changed_path_ids_nr;
+
+	if (paths->nr >= GRAPH_CHANGED_PATHS_NONE - nr)
+		return -1;
+
+	ALLOC_GROW(ctx->changed_path_ids, nr + paths->nr,
+		   ctx->changed_path_ids_alloc);
+	for (i = 0; i < paths->nr; i++) {
+		const char *path = paths->items[i].string;
+		int id = strintmap_get(ids, path);
+
+		if (id < 0) {
+			size_t len = strlen(path) + 1;
+			struct string_list_item *item;
+
+			if (ctx->changed_path_strings_size + len > UINT32_MAX ||
+			    ctx->changed_path_names.nr >= INT_MAX)
+				return -1;
+			id = ctx->changed_path_names.nr;
+			item = string_list_append(&ctx->changed_path_names, path);
+			item->util = (void *)(intptr_t)id;
+			strintmap_set(ids, item->string, id);
+			ctx->changed_path_strings_size += len;
+		}
+		ctx->changed_path_ids[nr++] = id;
+	}
+
+	ctx->changed_path_ids_nr = nr;
+	return 0;
+}
+
+/*
+ * Collect the exact list of the paths each commit changed compared to
+ * its first parent, with the same leading directories and the same
+ * limit on their number as the changed-path Bloom filters. Lists the
+ * commit-graph we replace already has are reused instead of diffing
+ * the trees again.
+ *
+ * Paths are numbered by the order we first see them in and then
+ * renumbered in sorted order. As each list is sorted, renumbering
+ * keeps it sorted, so lookups can bisect both the names and the lists.
+ */
+static void compute_changed_path_lists(struct write_commit_graph_context *ctx)
+{
+	struct strintmap ids;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	uint32_t *renumber;
+	size_t i;
+	int count_computed = 0, count_reused = 0, count_too_large = 0;
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					_("Collecting changed path lists"),
+					ctx->commits.nr);
+
+	strintmap_init_with_options(&ids, -1, NULL, 0);
+	ALLOC_ARRAY(ctx->changed_path_index, ctx->commits.nr);
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit *c = ctx->commits.list[i];
+		struct commit_graph *g = ctx->r->objects->commit_graph;
+		uint32_t pos;
+		int ret;
+
+		load_commit_graph_info(ctx->r, c);
+		pos = commit_graph_position(c);
+		if (pos != COMMIT_NOT_FROM_GRAPH)
+			while (pos < g->num_commits_in_base)
+				g = g->base_graph;
+
+		if (pos != COMMIT_NOT_FROM_GRAPH && g->chunk_changed_path_index) {
+			ret = load_changed_path_list(g, pos, &paths);
+			count_reused++;
+		} else {
+			/* ensure commit is parsed so we have parent information */
+			repo_parse_commit(ctx->r, c);
+			ret = collect_changed_path_list(ctx->r,
+				c->parents ? &c->parents->item->object.oid : NULL,
+				&c->object.oid,
+				ctx->bloom_settings->max_changed_paths, &paths);
+			count_computed++;
+		}
+
+		if (!ret)
+			ret = add_changed_path_list(ctx, &ids, &paths);
+		if (ret) {
+			ctx->changed_path_index[i] = GRAPH_CHANGED_PATHS_NONE |
+				(i ? ctx->changed_path_index[i - 1] : 0);
+			count_too_large++;
+		} else
+			ctx->changed_path_index[i] = ctx->changed_path_ids_nr;
+
+		string_list_clear(&paths, 0);
+		display_progress(ctx->progress, i + 1);
+	}
+
+	ALLOC_ARRAY(renumber, ctx->changed_path_names.nr);
+	string_list_sort(&ctx->changed_path_names);
+	for (i = 0; i < ctx->changed_path_names.nr; i++)
+		renumber[(intptr_t)ctx->changed_path_names.items[i].util] = i;
+	for (i = 0; i < ctx->changed_path_ids_nr; i++)
+		ctx->changed_path_ids[i] = renumber[ctx->changed_path_ids[i]];
+	free(renumber);
+
+	trace2_data_intmax("commit-graph", ctx->r, "path-lists-computed",
+			   count_computed);
+	trace2_data_intmax("commit-graph", ctx->r, "path-lists-reused",
+			   count_reused);
+	trace2_data_intmax("commit-graph", ctx->r, "path-lists-too-large",
+			   count_too_large);
+	strintmap_clear(&ids);
+	stop_progress(&ctx->progress);
+}
+
 static void trace2_bloom_filter_write_statistics(struct write_commit_graph_context *ctx)
 {
 	trace2_data_intmax("commit-graph", ctx->r, "filter-computed",
@@ -1542,6 +2583,116 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_trunc_empty);
 	trace2_data_intmax("commit-graph", ctx->r, "filter-trunc-large",
 			   ctx->count_bloom_filter_trunc_large);
+	trace2_data_intmax("commit-graph", ctx->r, "filter-threads",
+			   ctx->count_bloom_filter_threads);
+}
+
+/*
+ * Threads take this many commits at a time from the list of filters
+ * to compute.
+ */
+#define BLOOM_JOBS_CHUNK 64
+
+struct bloom_job {
+	struct bloom_filter *filter;
+	const struct object_id *parent, *commit;
+	enum bloom_filter_computed computed;
+};
+
+struct bloom_jobs {
+	struct repository *r;
+	const struct bloom_filter_settings *settings;
+	struct bloom_job *job;
+	size_t nr, alloc;
+
+	/* protected by "mutex" */
+	size_t next;
+	uint64_t progress_nr;
+	struct progress *progress;
+	pthread_mutex_t mutex;
+};
+
+static void *run_bloom_jobs(void *data)
+{
+	struct bloom_jobs *jobs = data;
+
+	for (;;) {
+		size_t i, end;
+
+		pthread_mutex_lock(&jobs->mutex);
+		i = jobs->next;
+		end = jobs->next = i + BLOOM_JOBS_CHUNK < jobs->nr ?
+			i + BLOOM_JOBS_CHUNK : jobs->nr;
+		jobs->progress_nr += end - i;
+		display_progress(jobs->progress, jobs->progress_nr);
+		pthread_mutex_unlock(&jobs->mutex);
+
+		if (i == end)
+			break;
+		for (; i < end; i++) {
+			struct bloom_job *job = &jobs->job[i];
+
+			job->computed = compute_bloom_filter(jobs->r,
+							     job->filter,
+							     job->parent,
+							     job->commit,
+							     jobs->settings);
+		}
+	}
+	return NULL;
+}
+
+static int get_bloom_threads(struct write_commit_graph_context *ctx,
+			     size_t nr_jobs)
+{
+	int nr_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (repo_config_get_int(ctx->r, "commitgraph.threads", &nr_threads) ||
+	    nr_threads <= 0)
+		nr_threads = online_cpus();
+	if (nr_threads > DIV_ROUND_UP(nr_jobs, BLOOM_JOBS_CHUNK))
+		nr_threads = DIV_ROUND_UP(nr_jobs, BLOOM_JOBS_CHUNK);
+	return nr_threads < 1 ? 1 : nr_threads;
+}
+
+/*
+ * Compute the filters collected in "jobs", in several threads when
+ * there are enough of them. Each filter only depends on its commit, so
+ * the result does not depend on the order in which they are computed.
+ */
+static void run_bloom_jobs_in_threads(struct write_commit_graph_context *ctx,
+				      struct bloom_jobs *jobs)
+{
+	int i, nr_threads = get_bloom_threads(ctx, jobs->nr);
+	pthread_t *threads;
+
+	ctx->count_bloom_filter_threads = nr_threads;
+	pthread_mutex_init(&jobs->mutex, NULL);
+	if (nr_threads < 2) {
+		run_bloom_jobs(jobs);
+		pthread_mutex_destroy(&jobs->mutex);
+		return;
+	}
+
+	/* initialize lazily loaded state before starting the threads */
+	has_promisor_remote();
+
+	enable_obj_read_lock();
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, run_bloom_jobs, jobs);
+		if (err)
+			die(_("unable to create Bloom filter thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die(_("unable to join Bloom filter thread"));
+	free(threads);
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&jobs->mutex);
 }
 
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
@@ -1550,6 +2701,7 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	struct progress *progress = NULL;
 	struct commit **sorted_commits;
 	int max_new_filters;
+	struct bloom_jobs jobs;
 
 	init_bloom_filters();
 
@@ -1569,28 +2721,57 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	/*
+	 * Decide in commit order which filters to compute, so that
+	 * --max-new-filters picks the same commits however many threads
+	 * compute them.
+	 */
+	memset(&jobs, 0, sizeof(jobs));
+	jobs.r = ctx->r;
+	jobs.settings = ctx->bloom_settings;
+	jobs.progress = progress;
 	for (i = 0; i < ctx->commits.nr; i++) {
-		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
-			ctx->r,
-			c,
-			ctx->count_bloom_filter_computed < max_new_filters,
-			ctx->bloom_settings,
-			&computed);
-		if (computed & BLOOM_COMPUTED) {
+		struct bloom_filter *filter;
+
+		filter = get_or_compute_bloom_filter(ctx->r, c, 0,
+						     ctx->bloom_settings, NULL);
+		if (!filter &&
+		    ctx->count_bloom_filter_computed < max_new_filters) {
+			struct bloom_job *job;
+
+			/* ensure commit is parsed so we have parent information */
+			repo_parse_commit(ctx->r, c);
+
+			ALLOC_GROW(jobs.job, jobs.nr + 1, jobs.alloc);
+			job = &jobs.job[jobs.nr++];
+			job->filter = bloom_filter_at(c);
+			job->parent = c->parents ?
+				&c->parents->item->object.oid : NULL;
+			job->commit = &c->object.oid;
 			ctx->count_bloom_filter_computed++;
-			if (computed & BLOOM_TRUNC_EMPTY)
-				ctx->count_bloom_filter_trunc_empty++;
-			if (computed & BLOOM_TRUNC_LARGE)
-				ctx->count_bloom_filter_trunc_large++;
-		} else if (computed & BLOOM_NOT_COMPUTED)
+		} else {
 			ctx->count_bloom_filter_not_computed++;
-		ctx->total_bloom_filter_data_size += filter
-			? sizeof(unsigned char) * filter->len : 0;
-		display_progress(progress, i + 1);
+			ctx->total_bloom_filter_data_size += filter ? filter->len : 0;
+			display_progress(progress, ++jobs.progress_nr);
+		}
 	}
 
+	trace2_region_enter("commit-graph", "compute-bloom-filters", ctx->r);
+	run_bloom_jobs_in_threads(ctx, &jobs);
+	trace2_region_leave("commit-graph", "compute-bloom-filters", ctx->r);
+
+	for (i = 0; i < jobs.nr; i++) {
+		struct bloom_job *job = &jobs.job[i];
+
+		if (job->computed & BLOOM_TRUNC_EMPTY)
+			ctx->count_bloom_filter_trunc_empty++;
+		if (job->computed & BLOOM_TRUNC_LARGE)
+			ctx->count_bloom_filter_trunc_large++;
+		ctx->total_bloom_filter_data_size += job->filter->len;
+	}
+	free(jobs.job);
+
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
@@ -1870,6 +3051,30 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 				+ ctx->total_bloom_filter_data_size,
 			  write_graph_chunk_bloom_data);
 	}
+	if (ctx->reachability_labels)
+		add_chunk(cf, GRAPH_CHUNKID_REACHABILITY_LABELS,
+			  st_mult(sizeof(uint32_t) * 3, ctx->commits.nr),
+			  write_graph_chunk_reachability_labels);
+	if (ctx->commit_metadata) {
+		add_chunk(cf, GRAPH_CHUNKID_COMMIT_METADATA,
+			  st_mult(GRAPH_METADATA_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_commit_metadata);
+		add_chunk(cf, GRAPH_CHUNKID_COMMIT_STRINGS,
+			  ctx->metadata_strings.len,
+			  write_graph_chunk_commit_strings);
+	}
+	if (ctx->changed_path_lists) {
+		add_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_INDEX,
+			  st_mult(4, ctx->commits.nr),
+			  write_graph_chunk_changed_path_index);
+		add_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_IDS,
+			  st_mult(4, ctx->changed_path_ids_nr),
+			  write_graph_chunk_changed_path_ids);
+		add_chunk(cf, GRAPH_CHUNKID_CHANGED_PATH_NAMES,
+			  st_add(st_mult(4, st_add(ctx->changed_path_names.nr, 1)),
+				 ctx->changed_path_strings_size),
+			  write_graph_chunk_changed_path_names);
+	}
 	if (ctx->num_commit_graphs_after > 1)
 		add_chunk(cf, GRAPH_CHUNKID_BASE,
 			  hashsz * (ctx->num_commit_graphs_after - 1),
@@ -2225,6 +3430,21 @@ static void expire_commit_graphs(struct write_commit_graph_context *ctx)
 	strbuf_release(&path);
 }
 
+/*
+ * Whether to write an optional chunk: either "flags" ask for it with
+ * "write_flag", or the graph we replace has it ("old_chunk" is not
+ * NULL) and "flags" do not drop it with "no_write_flag".
+ */
+static int want_optional_chunk(enum commit_graph_write_flags flags,
+			       enum commit_graph_write_flags write_flag,
+			       enum commit_graph_write_flags no_write_flag,
+			       const unsigned char *old_chunk)
+{
+	if (flags & write_flag)
+		return 1;
+	return old_chunk && !(flags & no_write_flag);
+}
+
 int write_commit_graph(struct object_directory *odb,
 		       struct string_list *pack_indexes,
 		       struct oidset *commits,
@@ -2238,6 +3458,7 @@ int write_commit_graph(struct object_directory *odb,
 	int replace = 0;
 	struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 	struct topo_level_slab topo_levels;
+	struct commit_graph *old_graph;
 
 	prepare_repo_settings(r);
 	if (!r->settings.core_commit_graph) {
@@ -2255,6 +3476,8 @@ int write_commit_graph(struct object_directory *odb,
 	ctx->split = flags & COMMIT_GRAPH_WRITE_SPLIT ? 1 : 0;
 	ctx->opts = opts;
 	ctx->total_bloom_filter_data_size = 0;
+	strbuf_init(&ctx->metadata_strings, 0);
+	string_list_init(&ctx->changed_path_names, 1);
 	ctx->write_generation_data = (get_configured_generation_version(r) == 2);
 	ctx->num_generation_data_overflows = 0;
 
@@ -2293,6 +3516,23 @@ int write_commit_graph(struct object_directory *odb,
 		}
 	}
 
+	old_graph = ctx->r->objects->commit_graph;
+	ctx->reachability_labels =
+		want_optional_chunk(flags,
+				    COMMIT_GRAPH_WRITE_REACHABILITY_LABELS,
+				    COMMIT_GRAPH_NO_WRITE_REACHABILITY_LABELS,
+				    old_graph ? old_graph->chunk_reachability_labels : NULL);
+	ctx->commit_metadata =
+		want_optional_chunk(flags,
+				    COMMIT_GRAPH_WRITE_COMMIT_METADATA,
+				    COMMIT_GRAPH_NO_WRITE_COMMIT_METADATA,
+				    old_graph ? old_graph->chunk_commit_metadata : NULL);
+	ctx->changed_path_lists =
+		want_optional_chunk(flags,
+				    COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS,
+				    COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS,
+				    old_graph ? old_graph->chunk_changed_path_index : NULL);
+
 	if (ctx->split) {
 		struct commit_graph *g = ctx->r->objects->commit_graph;
 
@@ -2373,6 +3613,15 @@ int write_commit_graph(struct object_directory *odb,
 	if (ctx->changed_paths)
 		compute_bloom_filters(ctx);
 
+	if (ctx->reachability_labels)
+		compute_reachability_labels(ctx);
+
+	if (ctx->commit_metadata)
+		compute_commit_metadata(ctx);
+
+	if (ctx->changed_path_lists)
+		compute_changed_path_lists(ctx);
+
 	res = write_commit_graph_file(ctx);
 
 	if (ctx->split)
@@ -2383,6 +3632,12 @@ int write_commit_graph(struct object_directory *odb,
 cleanup:
 	free(ctx->graph_name);
 	free(ctx->commits.list);
+	free(ctx->labels);
+	free(ctx->metadata);
+	strbuf_release(&ctx->metadata_strings);
+	free(ctx->changed_path_index);
+	free(ctx->changed_path_ids);
+	string_list_clear(&ctx->changed_path_names, 0);
 	oid_array_clear(&ctx->oids);
 	clear_topo_level_slab(&topo_levels);
 
@@ -2419,6 +3674,106 @@ static void graph_report(const char *fmt, ...)
 	va_end(ap);
 }
 
+/*
+ * The metadata of a commit may be missing, but if it is there it has
+ * to show what the commit object does.
+ */
+static void verify_commit_metadata(struct repository *r,
+				   struct commit_graph *g, uint32_t pos,
+				   struct commit *odb_commit)
+{
+	const unsigned char *data = g->chunk_commit_metadata +
+		st_mult(GRAPH_METADATA_WIDTH, pos - g->num_commits_in_base);
+	struct commit_metadata graph_m, odb_m;
+	struct strbuf graph_buf = STRBUF_INIT, odb_buf = STRBUF_INIT;
+	unsigned long size;
+	const char *buf;
+
+	if (get_be32(data) == GRAPH_METADATA_NONE)
+		return;
+
+	buf = repo_get_commit_buffer(r, odb_commit, &size);
+	if (load_commit_metadata(g, pos, &graph_m))
+		graph_report(_("commit-graph has invalid metadata for commit %s"),
+			     oid_to_hex(&odb_commit->object.oid));
+	else if (parse_commit_metadata(buf, size, &odb_m))
+		graph_report(_("commit-graph has metadata for commit %s, which cannot have any"),
+			     oid_to_hex(&odb_commit->object.oid));
+	else {
+		format_commit_metadata(&graph_buf, &graph_m);
+		format_commit_metadata(&odb_buf, &odb_m);
+		if (strcmp(graph_buf.buf, odb_buf.buf))
+			graph_report(_("commit-graph metadata for commit %s does not match the commit"),
+				     oid_to_hex(&odb_commit->object.oid));
+	}
+
+	repo_unuse_commit_buffer(r, odb_commit, buf);
+	strbuf_release(&graph_buf);
+	strbuf_release(&odb_buf);
+}
+
+/*
+ * The names of the changed paths have to be sorted for lookups to find
+ * them.
+ */
+static void verify_changed_path_names(struct commit_graph *g)
+{
+	const char *prev = NULL;
+	uint32_t i;
+
+	for (i = 0; i < g->changed_path_names_nr; i++) {
+		const char *name = changed_path_name(g, i);
+
+		if (!name || (prev && strcmp(prev, name) >= 0)) {
+			graph_report(_("commit-graph has invalid changed path names"));
+			return;
+		}
+		prev = name;
+	}
+}
+
+/*
+ * The list of changed paths of a commit may be missing, but if it is
+ * there it has to be exactly what the commit changed.
+ */
+static void verify_changed_path_list(struct repository *r,
+				     struct commit_graph *g, uint32_t pos,
+				     struct commit *odb_commit)
+{
+	struct string_list graph_paths = STRING_LIST_INIT_DUP;
+	struct string_list odb_paths = STRING_LIST_INIT_DUP;
+	const unsigned char *index = g->chunk_changed_path_index +
+		st_mult(4, pos - g->num_commits_in_base);
+	size_t i;
+
+	if (get_be32(index) & GRAPH_CHANGED_PATHS_NONE)
+		return;
+
+	if (load_changed_path_list(g, pos, &graph_paths)) {
+		graph_report(_("commit-graph has an invalid changed path list for commit %s"),
+			     oid_to_hex(&odb_commit->object.oid));
+		return;
+	}
+
+	if (collect_changed_path_list(r,
+			odb_commit->parents ?
+			&odb_commit->parents->item->object.oid : NULL,
+			&odb_commit->object.oid, graph_paths.nr, &odb_paths) ||
+	    odb_paths.nr != graph_paths.nr)
+		goto mismatch;
+	for (i = 0; i < graph_paths.nr; i++)
+		if (strcmp(graph_paths.items[i].string, odb_paths.items[i].string))
+			goto mismatch;
+	goto cleanup;
+
+mismatch:
+	graph_report(_("commit-graph changed path list for commit %s does not match the commit"),
+		     oid_to_hex(&odb_commit->object.oid));
+cleanup:
+	string_list_clear(&graph_paths, 0);
+	string_list_clear(&odb_paths, 0);
+}
+
 #define GENERATION_ZERO_EXISTS 1
 #define GENERATION_NUMBER_EXISTS 2
 
@@ -2491,6 +3846,9 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 	if (verify_commit_graph_error & ~VERIFY_COMMIT_GRAPH_ERROR_HASH)
 		return verify_commit_graph_error;
 
+	if (g->chunk_changed_path_index)
+		verify_changed_path_names(g);
+
 	if (flags & COMMIT_GRAPH_WRITE_PROGRESS)
 		progress = start_progress(_("Verifying commits in commit graph"),
 					g->num_commits);
@@ -2500,6 +3858,7 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 		struct commit_list *graph_parents, *odb_parents;
 		timestamp_t max_generation = 0;
 		timestamp_t generation;
+		struct reachability_label label;
 
 		display_progress(progress, i + 1);
 		oidread(&cur_oid, g->chunk_oid_lookup + g->hash_len * i);
@@ -2519,6 +3878,24 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 				     oid_to_hex(get_commit_tree_oid(graph_commit)),
 				     oid_to_hex(get_commit_tree_oid(odb_commit)));
 
+		if (g->chunk_reachability_labels) {
+			load_reachability_label(g, i + g->num_commits_in_base,
+						&label);
+			if (label.post >= g->num_commits ||
+			    label.tree_low > label.post ||
+			    label.reach_low > label.tree_low)
+				graph_report(_("commit-graph has invalid reachability label for commit %s"),
+					     oid_to_hex(&cur_oid));
+		}
+
+		if (g->chunk_commit_metadata)
+			verify_commit_metadata(r, g, i + g->num_commits_in_base,
+					       odb_commit);
+
+		if (g->chunk_changed_path_index)
+			verify_changed_path_list(r, g, i + g->num_commits_in_base,
+						 odb_commit);
+
 		graph_parents = graph_commit->parents;
 		odb_parents = odb_commit->parents;
 
@@ -2542,6 +3919,19 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g, int flags)
 			if (generation > max_generation)
 				max_generation = generation;
 
+			if (g->chunk_reachability_labels &&
+			    commit_graph_position(graph_parents->item) >= g->num_commits_in_base) {
+				struct reachability_label parent_label;
+
+				load_reachability_label(g, commit_graph_position(graph_parents->item),
+							&parent_label);
+				if (parent_label.post >= label.post ||
+				    parent_label.reach_low < label.reach_low)
+					graph_report(_("commit-graph reachability label for commit %s does not cover its parent %s"),
+						     oid_to_hex(&cur_oid),
+						     oid_to_hex(&graph_parents->item->object.oid));
+			}
+
 			graph_parents = graph_parents->next;
 			odb_parents = odb_parents->next;
 		}
@@ -8,12 +8,18 @@
 #define GIT_TEST_COMMIT_GRAPH "GIT_TEST_COMMIT_GRAPH"
 #define GIT_TEST_COMMIT_GRAPH_DIE_ON_PARSE "GIT_TEST_COMMIT_GRAPH_DIE_ON_PARSE"
 #define GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS "GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS"
+#define GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS "GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS"
+#define GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA "GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA"
+#define GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS "GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS"
 
 /*
  * This method is only used to enhance coverage of the commit-graph
- * feature in the test suite with the GIT_TEST_COMMIT_GRAPH and
- * GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS environment variables. Do not
- * call this method oustide of a builtin, and only if you know what
+ * feature in the test suite with the GIT_TEST_COMMIT_GRAPH,
+ * GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS,
+ * GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS,
+ * GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA and
+ * GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS environment variables. Do
+ * not call this method oustide of a builtin, and only if you know what
  * you are doing!
  */
 void git_test_write_commit_graph_or_die(void);
@@ -51,6 +57,51 @@ void load_commit_graph_info(struct repository *r, struct commit *item);
 struct tree *get_commit_tree_in_graph(struct repository *r,
 				      const struct commit *c);
 
+/*
+ * Use the reachability labels of the commit-graph to tell whether
+ * "from" can reach "to". Both commits should be parsed. Most answers
+ * come from the labels alone; otherwise we only walk through the
+ * commits whose labels cannot rule them out.
+ *
+ * Returns 1 if it can, 0 if it cannot, and -1 if the commit-graph
+ * cannot tell, i.e. when one of the commits is not in it, or they are
+ * in different layers the labels do not cover, in which case the
+ * caller has to walk.
+ */
+int commit_graph_can_reach(struct repository *r,
+			   const struct commit *from,
+			   const struct commit *to);
+
+/*
+ * If the commit-graph stores the metadata of the commit "oid", return
+ * a buffer that looks like that commit object, but only has its
+ * "author" and "committer" headers and the first paragraph of its
+ * message. That is enough to show the idents, dates and subject of
+ * the commit without reading the object. The caller must free() it.
+ *
+ * Returns NULL if the commit-graph does not have the metadata.
+ */
+char *read_commit_metadata_from_graph(struct repository *r,
+				      const struct object_id *oid);
+
+/*
+ * Return 1 if the commit-graph has exact lists of changed paths for
+ * at least some of its commits.
+ */
+int commit_graph_has_changed_path_lists(struct repository *r);
+
+/*
+ * Use the exact list of changed paths of the commit-graph to tell
+ * whether "path", or anything below it if it is a directory, differs
+ * between "c" and its first parent (or the empty tree for a root
+ * commit). "path" has no trailing slash.
+ *
+ * Returns 1 if it does, 0 if it does not, and -1 if the commit-graph
+ * has no list for "c", e.g. because it changed too many paths.
+ */
+int commit_graph_changed_path(struct repository *r, struct commit *c,
+			      const char *path);
+
 struct commit_graph {
 	const unsigned char *data;
 	size_t data_len;
@@ -75,6 +126,17 @@ struct commit_graph {
 	const unsigned char *chunk_base_graphs;
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
+	const unsigned char *chunk_reachability_labels;
+	const unsigned char *chunk_commit_metadata;
+	const char *chunk_commit_strings;
+	size_t commit_strings_size;
+	const unsigned char *chunk_changed_path_index;
+	const unsigned char *chunk_changed_path_ids;
+	size_t changed_path_ids_nr;
+	const unsigned char *chunk_changed_path_names;
+	uint32_t changed_path_names_nr;
+	const char *changed_path_strings;
+	size_t changed_path_strings_size;
 
 	struct topo_level_slab *topo_levels;
 	struct bloom_filter_settings *bloom_filter_settings;
@@ -108,6 +170,12 @@ enum commit_graph_write_flags {
 	COMMIT_GRAPH_WRITE_SPLIT      = (1 << 2),
 	COMMIT_GRAPH_WRITE_BLOOM_FILTERS = (1 << 3),
 	COMMIT_GRAPH_NO_WRITE_BLOOM_FILTERS = (1 << 4),
+	COMMIT_GRAPH_WRITE_REACHABILITY_LABELS = (1 << 5),
+	COMMIT_GRAPH_NO_WRITE_REACHABILITY_LABELS = (1 << 6),
+	COMMIT_GRAPH_WRITE_COMMIT_METADATA = (1 << 7),
+	COMMIT_GRAPH_NO_WRITE_COMMIT_METADATA = (1 << 8),
+	COMMIT_GRAPH_WRITE_CHANGED_PATH_LISTS = (1 << 9),
+	COMMIT_GRAPH_NO_WRITE_CHANGED_PATH_LISTS = (1 << 10),
 };
 
 enum commit_graph_split_flags {
@@ -3,6 +3,7 @@
 #include "commit-graph.h"
 #include "decorate.h"
 #include "prio-queue.h"
+#include "ewah/ewok.h"
 #include "tree.h"
 #include "ref-filter.h"
 #include "revision.h"
@@ -493,6 +494,17 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 	if (generation > max_generation)
 		return ret;
 
+	for (i = 0; i < nr_reference; i++) {
+		int reach = commit_graph_can_reach(r, reference[i], commit);
+
+		if (reach > 0)
+			return 1;
+		if (reach < 0)
+			break;
+	}
+	if (i == nr_reference)
+		return 0;
+
 	bases = paint_down_to_common(r, commit,
 				     nr_reference, reference,
 				     generation);
@@ -618,6 +630,27 @@ static int in_commit_list(const struct commit_list *want, struct commit *c)
 	return 0;
 }
 
+/*
+ * Ask the commit-graph whether "from" can reach one of the commits in
+ * "to": 1 if it can, 0 if it cannot, and -1 if we need to walk.
+ */
+static int graph_can_reach_any(struct commit *from,
+			       const struct commit_list *to)
+{
+	int ret = 0;
+
+	for (; to; to = to->next) {
+		int reach = commit_graph_can_reach(the_repository, from,
+						   to->item);
+
+		if (reach > 0)
+			return 1;
+		if (reach < 0)
+			ret = -1;
+	}
+	return ret;
+}
+
 /*
  * Test whether the candidate is contained in the list.
  * Do not recurse to find out, though, but return -1 if inconclusive.
@@ -645,6 +678,15 @@ static enum contains_result contains_test(struct commit *candidate,
 	if (commit_graph_generation(candidate) < cutoff)
 		return CONTAINS_NO;
 
+	switch (graph_can_reach_any(candidate, want)) {
+	case 1:
+		*cached = CONTAINS_YES;
+		return CONTAINS_YES;
+	case 0:
+		*cached = CONTAINS_NO;
+		return CONTAINS_NO;
+	}
+
 	return CONTAINS_UNKNOWN;
 }
 
@@ -824,8 +866,6 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 
 	while (from_iter) {
-		add_object_array(&from_iter->item->object, NULL, &from_objs);
-
 		if (!parse_commit(from_iter->item)) {
 			timestamp_t generation;
 			if (from_iter->item->date < min_commit_date)
@@ -855,8 +895,25 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 		to_iter = to_iter->next;
 	}
 
-	result = can_all_from_reach_with_flag(&from_objs, PARENT2, PARENT1,
-					      min_commit_date, min_generation);
+	/*
+	 * Only walk from the commits for which the reachability labels
+	 * of the commit-graph do not tell, and stop early if one of them
+	 * cannot reach any "to" commit.
+	 */
+	result = 1;
+	for (from_iter = from; from_iter; from_iter = from_iter->next) {
+		int reach = graph_can_reach_any(from_iter->item, to);
+
+		if (!reach)
+			result = 0;
+		else if (reach < 0)
+			add_object_array(&from_iter->item->object, NULL,
+					 &from_objs);
+	}
+
+	if (result && from_objs.nr)
+		result = can_all_from_reach_with_flag(&from_objs, PARENT2, PARENT1,
+						      min_commit_date, min_generation);
 
 	while (from) {
 		clear_commit_marks(from->item, PARENT1);
@@ -942,3 +999,169 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 
 	return found_commits;
 }
+
+define_commit_slab(ahead_behind_generation, timestamp_t);
+define_commit_slab(ahead_behind_bits, struct bitmap *);
+
+/*
+ * Give the commits a generation number that is larger than those of
+ * their parents: the one from the commit-graph when there is one, and
+ * otherwise one more than the largest generation among the parents, so
+ * that popping the highest generation first visits every commit after
+ * all of its descendants in the walk. Parents that are in the
+ * commit-graph are left alone; call this again before queueing them.
+ */
+static void compute_ahead_behind_generations(struct repository *r,
+					     struct commit **commits,
+					     size_t commits_nr,
+					     struct ahead_behind_generation *gens)
+{
+	struct commit_list *stack = NULL;
+	size_t i;
+
+	for (i = 0; i < commits_nr; i++)
+		commit_list_insert(commits[i], &stack);
+
+	while (stack) {
+		struct commit *c = stack->item;
+		timestamp_t *gen = ahead_behind_generation_at(gens, c);
+		timestamp_t max_parent = 0;
+		struct commit_list *p;
+		int ready = 1;
+
+		if (*gen) {
+			pop_commit(&stack);
+			continue;
+		}
+
+		repo_parse_commit(r, c);
+		*gen = commit_graph_generation(c);
+		if (*gen != GENERATION_NUMBER_INFINITY &&
+		    *gen != GENERATION_NUMBER_ZERO) {
+			pop_commit(&stack);
+			continue;
+		}
+		*gen = 0;
+
+		for (p = c->parents; p; p = p->next) {
+			timestamp_t pgen = *ahead_behind_generation_at(gens, p->item);
+
+			if (!pgen) {
+				commit_list_insert(p->item, &stack);
+				ready = 0;
+			} else if (pgen > max_parent) {
+				max_parent = pgen;
+			}
+		}
+		if (ready) {
+			*gen = max_parent + 1;
+			pop_commit(&stack);
+		}
+	}
+}
+
+static int compare_by_ahead_behind_generation(const void *a_, const void *b_,
+					      void *cb_data)
+{
+	const struct commit *a = a_, *b = b_;
+	struct ahead_behind_generation *gens = cb_data;
+	timestamp_t gen_a = *ahead_behind_generation_at(gens, a);
+	timestamp_t gen_b = *ahead_behind_generation_at(gens, b);
+
+	if (gen_a != gen_b)
+		return gen_a > gen_b ? -1 : 1;
+	if (a->date != b->date)
+		return a->date > b->date ? -1 : 1;
+	return 0;
+}
+
+static struct bitmap *get_ahead_behind_bits(struct ahead_behind_bits *bits,
+					    struct commit *c, size_t width)
+{
+	struct bitmap **b = ahead_behind_bits_at(bits, c);
+
+	if (!*b)
+		*b = bitmap_word_alloc(width);
+	return *b;
+}
+
+void ahead_behind(struct repository *r,
+		  struct commit **commits, size_t commits_nr,
+		  struct ahead_behind_count *counts, size_t counts_nr)
+{
+	struct ahead_behind_generation gens;
+	struct ahead_behind_bits bits;
+	struct prio_queue queue = { compare_by_ahead_behind_generation };
+	size_t width = DIV_ROUND_UP(commits_nr, BITS_IN_EWORD);
+	size_t i;
+
+	for (i = 0; i < counts_nr; i++)
+		counts[i].ahead = counts[i].behind = 0;
+	if (!commits_nr || !counts_nr)
+		return;
+
+	init_ahead_behind_generation(&gens);
+	init_ahead_behind_bits(&bits);
+	compute_ahead_behind_generations(r, commits, commits_nr, &gens);
+	queue.cb_data = &gens;
+
+	for (i = 0; i < commits_nr; i++) {
+		struct commit *c = commits[i];
+
+		bitmap_set(get_ahead_behind_bits(&bits, c, width), i);
+		if (!(c->object.flags & PARENT2)) {
+			c->object.flags |= PARENT2;
+			prio_queue_put(&queue, c);
+		}
+	}
+
+	/*
+	 * Every commit is popped after all of its descendants that the
+	 * walk reaches, so its bitmap then tells exactly which of the
+	 * given commits can reach it. Commits that all of them reach do
+	 * not count for any pair, and neither do their ancestors, so we
+	 * can stop once nothing else is left in the queue.
+	 */
+	while (queue_has_nonstale(&queue)) {
+		struct commit *c = prio_queue_get(&queue);
+		struct bitmap *bits_c = get_ahead_behind_bits(&bits, c, width);
+		struct commit_list *p;
+
+		for (i = 0; i < counts_nr; i++) {
+			int from_tip = bitmap_get(bits_c, counts[i].tip_index);
+			int from_base = bitmap_get(bits_c, counts[i].base_index);
+
+			if (from_tip && !from_base)
+				counts[i].ahead++;
+			else if (from_base && !from_tip)
+				counts[i].behind++;
+		}
+
+		for (p = c->parents; p; p = p->next) {
+			struct bitmap *bits_p;
+
+			bits_p = get_ahead_behind_bits(&bits, p->item, width);
+			bitmap_or(bits_p, bits_c);
+			if (bitmap_popcount(bits_p) == commits_nr)
+				p->item->object.flags |= STALE;
+			if (!(p->item->object.flags & PARENT2)) {
+				p->item->object.flags |= PARENT2;
+				compute_ahead_behind_generations(r, &p->item, 1,
+								 &gens);
+				prio_queue_put(&queue, p->item);
+			}
+		}
+
+		bitmap_free(bits_c);
+		*ahead_behind_bits_at(&bits, c) = NULL;
+	}
+
+	for (i = 0; i < queue.nr; i++) {
+		struct commit *c = queue.array[i].data;
+		bitmap_free(*ahead_behind_bits_at(&bits, c));
+	}
+	clear_commit_marks_many(commits_nr, commits, PARENT2 | STALE);
+	clear_prio_queue(&queue);
+	clear_ahead_behind_bits(&bits);
+	clear_ahead_behind_generation(&gens);
+}
@@ -104,4 +104,35 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 					 struct commit **to, int nr_to,
 					 unsigned int reachable_flag);
 
+struct ahead_behind_count {
+	/*
+	 * As input, the *_index members indicate which positions in
+	 * the 'commits' array of ahead_behind() correspond to the tip
+	 * and base of this comparison.
+	 */
+	size_t tip_index;
+	size_t base_index;
+
+	/*
+	 * These values store the computed counts for each side of the
+	 * symmetric difference, like "git rev-list --count --left-right
+	 * tip...base" would: 'ahead' counts the commits reachable from
+	 * the tip but not from the base, 'behind' the opposite.
+	 */
+	unsigned int ahead;
+	unsigned int behind;
+};
+
+/*
+ * Fill in the ahead/behind counts of every pair in 'counts' with a
+ * single walk, visiting each commit at most once however many pairs
+ * it counts for. The commits need not be distinct.
+ *
+ * This method uses the PARENT2 and STALE flags during its operation,
+ * so be sure these flags are not set before calling the method.
+ */
+void ahead_behind(struct repository *r,
+		  struct commit **commits, size_t commits_nr,
+		  struct ahead_behind_count *counts, size_t counts_nr);
+
 #endif
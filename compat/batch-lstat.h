@@ -0,0 +1,41 @@
+#ifndef COMPAT_BATCH_LSTAT_H
+#define COMPAT_BATCH_LSTAT_H
+
+/*
+ * Stat many paths with a few system calls instead of one lstat() each.
+ * Each thread needs its own "struct batch_lstat".
+ *
+ * batch_lstat_init() returns NULL when the platform or the running
+ * kernel cannot do this, in which case callers should lstat() the paths
+ * one by one as before.
+ *
+ * batch_lstat() fills st[i] for paths[i] and sets err[i] to 0, or to
+ * the errno lstat() would have set. It returns 0 on success, and -1 if
+ * the batch could not be submitted, in which case the caller should
+ * fall back to lstat() for these paths.
+ */
+struct batch_lstat;
+
+#ifdef HAVE_IO_URING
+struct batch_lstat *batch_lstat_init(unsigned int nr);
+int batch_lstat(struct batch_lstat *b, unsigned int nr, const char **paths,
+		struct stat *st, int *err);
+void batch_lstat_release(struct batch_lstat *b);
+#else
+static inline struct batch_lstat *batch_lstat_init(unsigned int nr)
+{
+	return NULL;
+}
+
+static inline int batch_lstat(struct batch_lstat *b, unsigned int nr,
+			      const char **paths, struct stat *st, int *err)
+{
+	return -1;
+}
+
+static inline void batch_lstat_release(struct batch_lstat *b)
+{
+}
+#endif
+
+#endif /* COMPAT_BATCH_LSTAT_H */
@@ -0,0 +1,353 @@
+#include "cache.h"
+#include "fsmonitor.h"
+#include "dir.h"
+#include "fsm-listen.h"
+#include "fsmonitor--daemon.h"
+#include "simple-ipc.h"
+#include "string-list.h"
+#include <sys/inotify.h>
+
+/*
+ * inotify only watches single directories, so we put a watch on
+ * every directory of the worktree (but not on .git) and on the
+ * cookie directory, and add watches for new directories as they
+ * appear.
+ */
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+		    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | \
+		    IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+struct fsm_listen_data {
+	int fd_inotify;
+	int fd_stop[2];
+
+	/*
+	 * Path of the directory behind each watch descriptor, relative
+	 * to the root of the worktree and with a trailing slash (the
+	 * root itself is ""), or NULL if the descriptor is unused.
+	 */
+	char **wd_path;
+	int wd_alloc;
+
+	int wd_root;
+	int wd_cookies;
+};
+
+static void set_wd_path(struct fsm_listen_data *data, int wd, const char *rel)
+{
+	if (wd >= data->wd_alloc) {
+		int old_alloc = data->wd_alloc;
+
+		ALLOC_GROW(data->wd_path, wd + 1, data->wd_alloc);
+		memset(data->wd_path + old_alloc, 0,
+		       sizeof(*data->wd_path) * (data->wd_alloc - old_alloc));
+	}
+	free(data->wd_path[wd]);
+	data->wd_path[wd] = rel ? xstrdup(rel) : NULL;
+}
+
+static const char *get_wd_path(struct fsm_listen_data *data, int wd)
+{
+	if (wd < 0 || wd >= data->wd_alloc)
+		return NULL;
+	return data->wd_path[wd];
+}
+
+/*
+ * Watch the directory "rel" (relative to the worktree, with a trailing
+ * slash) and everything below it. Directories that vanish while we
+ * walk them are silently skipped; running out of watches is an error.
+ */
+static int watch_subtree(struct fsmonitor_daemon_state *state,
+			 struct strbuf *rel)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct strbuf path = STRBUF_INIT;
+	size_t rel_len = rel->len;
+	DIR *dir;
+	struct dirent *de;
+	int wd, ret = 0;
+
+	strbuf_addf(&path, "%s/%s", state->path_worktree_watch.buf, rel->buf);
+
+	wd = inotify_add_watch(data->fd_inotify, path.buf, WATCH_MASK);
+	if (wd < 0) {
+		if (errno == ENOENT || errno == ENOTDIR || errno == EACCES)
+			goto cleanup;
+		if (errno == ENOSPC)
+			ret = error(_("inotify watch limit reached; see "
+				      "/proc/sys/fs/inotify/max_user_watches"));
+		else
+			ret = error_errno(_("could not watch '%s'"), path.buf);
+		goto cleanup;
+	}
+	set_wd_path(data, wd, rel->buf);
+	if (!rel_len)
+		data->wd_root = wd;
+
+	dir = opendir(path.buf);
+	if (!dir)
+		goto cleanup;
+
+	while (!ret && (de = readdir(dir))) {
+		int dtype;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		if (!rel_len && !strcmp(de->d_name, ".git"))
+			continue;
+
+		strbuf_addstr(rel, de->d_name);
+		dtype = DTYPE(de);
+		if (dtype == DT_UNKNOWN) {
+			struct stat st;
+			size_t path_len = path.len;
+
+			strbuf_addstr(&path, de->d_name);
+			if (!lstat(path.buf, &st) && S_ISDIR(st.st_mode))
+				dtype = DT_DIR;
+			strbuf_setlen(&path, path_len);
+		}
+		if (dtype == DT_DIR) {
+			strbuf_addch(rel, '/');
+			ret = watch_subtree(state, rel);
+		}
+		strbuf_setlen(rel, rel_len);
+	}
+	closedir(dir);
+
+cleanup:
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Drop the watches on a directory that was moved away, and on
+ * everything below it; the paths we have for them are stale now.
+ */
+static void unwatch_subtree(struct fsm_listen_data *data, const char *rel)
+{
+	int wd;
+
+	for (wd = 0; wd < data->wd_alloc; wd++) {
+		if (!data->wd_path[wd] || !starts_with(data->wd_path[wd], rel))
+			continue;
+		inotify_rm_watch(data->fd_inotify, wd);
+		FREE_AND_NULL(data->wd_path[wd]);
+	}
+}
+
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct strbuf rel = STRBUF_INIT;
+	struct strbuf cookie_dir = STRBUF_INIT;
+
+	CALLOC_ARRAY(data, 1);
+	state->listen_data = data;
+	data->fd_stop[0] = data->fd_stop[1] = -1;
+	data->wd_root = -1;
+
+	data->fd_inotify = inotify_init1(IN_CLOEXEC);
+	if (data->fd_inotify < 0) {
+		error_errno(_("inotify_init1 failed"));
+		goto failed;
+	}
+	if (pipe(data->fd_stop) < 0) {
+		error_errno(_("could not create pipe"));
+		goto failed;
+	}
+
+	if (watch_subtree(state, &rel))
+		goto failed;
+	if (data->wd_root < 0) {
+		error(_("could not watch '%s'"), state->path_worktree_watch.buf);
+		goto failed;
+	}
+
+	strbuf_addbuf(&cookie_dir, &state->path_cookie_prefix);
+	strbuf_strip_suffix(&cookie_dir, "/");
+	data->wd_cookies = inotify_add_watch(data->fd_inotify, cookie_dir.buf,
+					     IN_CREATE | IN_DELETE_SELF |
+					     IN_MOVE_SELF | IN_ONLYDIR);
+	if (data->wd_cookies < 0) {
+		error_errno(_("could not watch '%s'"), cookie_dir.buf);
+		goto failed;
+	}
+
+	strbuf_release(&cookie_dir);
+	return 0;
+
+failed:
+	strbuf_release(&cookie_dir);
+	fsm_listen__dtor(state);
+	return -1;
+}
+
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	int wd;
+
+	if (!data)
+		return;
+
+	if (data->fd_inotify >= 0)
+		close(data->fd_inotify);
+	if (data->fd_stop[0] >= 0)
+		close(data->fd_stop[0]);
+	if (data->fd_stop[1] >= 0)
+		close(data->fd_stop[1]);
+	for (wd = 0; wd < data->wd_alloc; wd++)
+		free(data->wd_path[wd]);
+	free(data->wd_path);
+	FREE_AND_NULL(state->listen_data);
+}
+
+void fsm_listen__stop_async(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+
+	if (write_in_full(data->fd_stop[1], "q", 1) < 0)
+		warning_errno(_("could not stop the fsmonitor listener"));
+}
+
+enum event_result {
+	EVENT_OK = 0,
+	EVENT_SHUTDOWN,
+	EVENT_ERROR,
+};
+
+static enum event_result handle_event(struct fsmonitor_daemon_state *state,
+				      const struct inotify_event *ev,
+				      struct string_list *paths,
+				      struct string_list *cookies)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct strbuf path = STRBUF_INIT;
+	enum event_result ret = EVENT_OK;
+	const char *rel;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		/*
+		 * We lost events, possibly including the creation of
+		 * directories we now do not watch. Tell clients to
+		 * rescan, and refresh our own watches.
+		 */
+		trace2_data_string("fsm_listen", NULL, "event", "overflow");
+		fsmonitor_force_resync(state);
+		if (watch_subtree(state, &path))
+			ret = EVENT_ERROR;
+		goto done;
+	}
+
+	if (ev->wd == data->wd_cookies) {
+		if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+			ret = EVENT_SHUTDOWN; /* .git went away */
+		else if ((ev->mask & IN_CREATE) && ev->len)
+			string_list_append(cookies, ev->name);
+		goto done;
+	}
+
+	rel = get_wd_path(data, ev->wd);
+	if (!rel)
+		goto done;
+
+	if (ev->mask & IN_IGNORED) {
+		if (ev->wd == data->wd_root)
+			ret = EVENT_SHUTDOWN; /* the worktree went away */
+		set_wd_path(data, ev->wd, NULL);
+		goto done;
+	}
+
+	/*
+	 * Events on a watched directory itself are also reported, with
+	 * a name, by the watch on its parent.
+	 */
+	if (!ev->len)
+		goto done;
+	if (!*rel && !strcmp(ev->name, ".git"))
+		goto done;
+
+	strbuf_addf(&path, "%s%s", rel, ev->name);
+	if (ev->mask & IN_ISDIR) {
+		strbuf_addch(&path, '/');
+		if (ev->mask & IN_MOVED_FROM)
+			unwatch_subtree(data, path.buf);
+		if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) &&
+		    watch_subtree(state, &path))
+			ret = EVENT_ERROR;
+	}
+	string_list_append(paths, path.buf);
+
+done:
+	strbuf_release(&path);
+	return ret;
+}
+
+void fsm_listen__loop(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	struct string_list cookies = STRING_LIST_INIT_DUP;
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	enum event_result result = EVENT_OK;
+
+	while (result == EVENT_OK) {
+		struct pollfd pfd[2];
+		ssize_t len;
+		char *p;
+
+		pfd[0].fd = data->fd_inotify;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = data->fd_stop[0];
+		pfd[1].events = POLLIN;
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_errno(_("poll failed"));
+			result = EVENT_ERROR;
+			break;
+		}
+		if (pfd[1].revents)
+			goto shutdown; /* asked to stop by the IPC layer */
+		if (!pfd[0].revents)
+			continue;
+
+		len = read(data->fd_inotify, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			error_errno(_("could not read inotify events"));
+			result = EVENT_ERROR;
+			break;
+		}
+
+		for (p = buf; p < buf + len && result == EVENT_OK; ) {
+			const struct inotify_event *ev =
+				(const struct inotify_event *)p;
+
+			result = handle_event(state, ev, &paths, &cookies);
+			p += sizeof(*ev) + ev->len;
+		}
+
+		/*
+		 * Publish the whole buffer at once; cookies must not be
+		 * reported before the events that came before them.
+		 */
+		if (paths.nr || cookies.nr)
+			fsmonitor_publish(state, &paths, &cookies);
+		string_list_clear(&paths, 0);
+		string_list_clear(&cookies, 0);
+	}
+
+	if (result == EVENT_ERROR)
+		state->error_code = -1;
+	ipc_server_stop_async(state->ipc_server_data);
+
+shutdown:
+	string_list_clear(&paths, 0);
+	string_list_clear(&cookies, 0);
+}
@@ -0,0 +1,257 @@
+#include "git-compat-util.h"
+#include "compat/batch-lstat.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+/*
+ * lstat() many paths through io_uring, submitting one IORING_OP_STATX
+ * request per path and waiting for the whole batch with a single
+ * io_uring_enter(). This talks to the kernel directly so that we do
+ * not need liburing.
+ */
+struct batch_lstat {
+	int fd;
+	unsigned int entries;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct statx *stx;
+
+	/* set when the ring is left in an unknown state */
+	unsigned int failed : 1;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg,
+				 unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* IORING_OP_STATX is newer than io_uring itself; ask before using it. */
+static int supports_statx(int fd)
+{
+	struct io_uring_probe *probe;
+	size_t len = st_add(sizeof(*probe),
+			    st_mult(sizeof(probe->ops[0]), IORING_OP_LAST));
+	int ret = 0;
+
+	probe = xcalloc(1, len);
+	if (!sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe,
+				   IORING_OP_LAST) &&
+	    probe->last_op >= IORING_OP_STATX &&
+	    (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		ret = 1;
+	free(probe);
+	return ret;
+}
+
+void batch_lstat_release(struct batch_lstat *b)
+{
+	if (!b)
+		return;
+	if (b->sqes)
+		munmap(b->sqes, b->sqes_size);
+	if (b->cq_ring && b->cq_ring != b->sq_ring)
+		munmap(b->cq_ring, b->cq_ring_size);
+	if (b->sq_ring)
+		munmap(b->sq_ring, b->sq_ring_size);
+	close(b->fd);
+	free(b->stx);
+	free(b);
+}
+
+struct batch_lstat *batch_lstat_init(unsigned int nr)
+{
+	struct io_uring_params p;
+	struct batch_lstat *b;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = sys_io_uring_setup(nr, &p);
+	if (fd < 0)
+		return NULL;
+
+	CALLOC_ARRAY(b, 1);
+	b->fd = fd;
+	if (!supports_statx(fd))
+		goto fail;
+
+	b->entries = p.sq_entries;
+	b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	b->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (b->cq_ring_size > b->sq_ring_size)
+			b->sq_ring_size = b->cq_ring_size;
+		b->cq_ring_size = b->sq_ring_size;
+	}
+
+	b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (b->sq_ring == MAP_FAILED) {
+		b->sq_ring = NULL;
+		goto fail;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		b->cq_ring = b->sq_ring;
+	} else {
+		b->cq_ring = mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, fd,
+				  IORING_OFF_CQ_RING);
+		if (b->cq_ring == MAP_FAILED) {
+			b->cq_ring = NULL;
+			goto fail;
+		}
+	}
+	b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (b->sqes == MAP_FAILED) {
+		b->sqes = NULL;
+		goto fail;
+	}
+
+	b->sq_tail = (unsigned int *)((char *)b->sq_ring + p.sq_off.tail);
+	b->sq_mask = (unsigned int *)((char *)b->sq_ring + p.sq_off.ring_mask);
+	b->sq_array = (unsigned int *)((char *)b->sq_ring + p.sq_off.array);
+	b->cq_head = (unsigned int *)((char *)b->cq_ring + p.cq_off.head);
+	b->cq_tail = (unsigned int *)((char *)b->cq_ring + p.cq_off.tail);
+	b->cq_mask = (unsigned int *)((char *)b->cq_ring + p.cq_off.ring_mask);
+	b->cqes = (struct io_uring_cqe *)((char *)b->cq_ring + p.cq_off.cqes);
+
+	ALLOC_ARRAY(b->stx, b->entries);
+	return b;
+
+fail:
+	batch_lstat_release(b);
+	return NULL;
+}
+
+/* The fields of "struct stat" that Git's stat data is made of. */
+#define STATX_NEEDED (STATX_TYPE | STATX_MODE | STATX_INO | STATX_UID | \
+		      STATX_GID | STATX_SIZE | STATX_MTIME | STATX_CTIME)
+
+/*
+ * Fill "st" from "stx", unless the filesystem did not give us all the
+ * fields we need, in which case return -1.
+ */
+static int statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	if ((stx->stx_mask & STATX_NEEDED) != STATX_NEEDED)
+		return -1;
+
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_size = stx->stx_size;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+	return 0;
+}
+
+/* Stat up to b->entries paths; the ring is empty when we are called. */
+static int stat_chunk(struct batch_lstat *b, unsigned int nr,
+		      const char **paths, struct stat *st, int *err)
+{
+	unsigned int mask = *b->sq_mask, tail = *b->sq_tail;
+	unsigned int i, submitted = 0, completed = 0;
+
+	for (i = 0; i < nr; i++) {
+		unsigned int idx = tail++ & mask;
+		struct io_uring_sqe *sqe = &b->sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)paths[i];
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&b->stx[i];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		sqe->user_data = i;
+		b->sq_array[idx] = idx;
+	}
+	__atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (completed < nr) {
+		unsigned int head, cq_tail;
+		int ret = sys_io_uring_enter(b->fd, nr - submitted, 1,
+					     IORING_ENTER_GETEVENTS);
+
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			/*
+			 * The kernel may still write into b->stx for the
+			 * requests it accepted, so we cannot give up on
+			 * them and let the caller reuse the buffers.
+			 */
+			if (submitted != completed)
+				die_errno("io_uring_enter");
+			b->failed = 1;
+			return -1;
+		}
+		submitted += ret;
+
+		head = *b->cq_head;
+		cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != cq_tail; head++) {
+			struct io_uring_cqe *cqe = &b->cqes[head & *b->cq_mask];
+			unsigned int j = cqe->user_data;
+
+			if (cqe->res < 0)
+				err[j] = -cqe->res;
+			else if (statx_to_stat(&b->stx[j], &st[j]))
+				err[j] = lstat(paths[j], &st[j]) ? errno : 0;
+			else
+				err[j] = 0;
+			completed++;
+		}
+		__atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+int batch_lstat(struct batch_lstat *b, unsigned int nr, const char **paths,
+		struct stat *st, int *err)
+{
+	unsigned int done = 0;
+
+	if (b->failed)
+		return -1;
+	while (done < nr) {
+		unsigned int chunk = nr - done;
+
+		if (chunk > b->entries)
+			chunk = b->entries;
+		if (stat_chunk(b, chunk, paths + done, st + done, err + done))
+			return -1;
+		done += chunk;
+	}
+	return 0;
+}
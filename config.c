@@ -1509,7 +1509,12 @@ static int git_default_core_config(const char *var, const char *value, void *cb)
 	}
 
 	if (!strcmp(var, "core.fsyncobjectfiles")) {
-		fsync_object_files = git_config_bool(var, value);
+		if (value && !strcasecmp(value, "batch"))
+			fsync_object_files = FSYNC_OBJECT_FILES_BATCH;
+		else if (git_config_bool(var, value))
+			fsync_object_files = FSYNC_OBJECT_FILES_ON;
+		else
+			fsync_object_files = FSYNC_OBJECT_FILES_OFF;
 		return 0;
 	}
 
@@ -2516,6 +2521,31 @@ int git_config_get_max_percent_split_change(void)
 	return -1; /* default value */
 }
 
+int git_config_get_index_journal(void)
+{
+	int val;
+
+	if (!git_config_get_maybe_bool("index.journal", &val))
+		return val;
+
+	return git_env_bool("GIT_TEST_INDEX_JOURNAL", 0);
+}
+
+int git_config_get_max_percent_journal(void)
+{
+	int val = -1;
+
+	if (!git_config_get_int("index.journalmaxpercent", &val)) {
+		if (0 <= val && val <= 100)
+			return val;
+
+		return error(_("index.journalMaxPercent value '%d' "
+			       "should be between 0 and 100"), val);
+	}
+
+	return -1; /* default value */
+}
+
 int git_config_get_fsmonitor(void)
 {
 	if (git_config_get_pathname("core.fsmonitor", &core_fsmonitor))
@@ -2524,6 +2554,10 @@ int git_config_get_fsmonitor(void)
 	if (core_fsmonitor && !*core_fsmonitor)
 		core_fsmonitor = NULL;
 
+	/* "false" disables it; "true" selects the builtin daemon */
+	if (core_fsmonitor && !git_parse_maybe_bool(core_fsmonitor))
+		core_fsmonitor = NULL;
+
 	if (core_fsmonitor)
 		return 1;
 
@@ -609,6 +609,8 @@ int git_config_get_index_threads(int *dest);
 int git_config_get_untracked_cache(void);
 int git_config_get_split_index(void);
 int git_config_get_max_percent_split_change(void);
+int git_config_get_index_journal(void);
+int git_config_get_max_percent_journal(void);
 int git_config_get_fsmonitor(void);
 
 /* This dies if the configured or default date is in the future */
@@ -0,0 +1,180 @@
+#include "cache.h"
+#include "csum-file.h"
+#include "delta-hints.h"
+#include "hash-lookup.h"
+#include "object-store.h"
+#include "packfile.h"
+
+#define DHNT_HEADER_SIZE (16)
+#define DHNT_FANOUT_SIZE (256 * 4)
+
+struct delta_hints {
+	const unsigned char *map;
+	size_t map_size;
+	uint32_t nr;
+	const uint32_t *fanout;
+	const unsigned char *targets;
+	const unsigned char *bases;
+	const unsigned char *sizes;
+};
+
+static uint32_t delta_hints_hash_id(void)
+{
+	switch (hash_algo_by_ptr(the_hash_algo)) {
+	case GIT_HASH_SHA1:
+		return 1;
+	case GIT_HASH_SHA256:
+		return 2;
+	default:
+		die("delta_hints_hash_id: unknown hash version");
+	}
+}
+
+static int delta_hint_cmp(const void *va, const void *vb)
+{
+	const struct delta_hint *a = va, *b = vb;
+	return oidcmp(&a->target, &b->target);
+}
+
+void write_delta_hints_file(const char *filename,
+			    struct delta_hint *hints, uint32_t nr,
+			    const unsigned char *pack_hash)
+{
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct hashfile *f;
+	uint32_t i, j;
+	int fd;
+
+	QSORT(hints, nr, delta_hint_cmp);
+
+	fd = odb_mkstemp(&tmp_file, "pack/tmp_hints_XXXXXX");
+	f = hashfd(fd, tmp_file.buf);
+
+	hashwrite_be32(f, DHNT_SIGNATURE);
+	hashwrite_be32(f, DHNT_VERSION);
+	hashwrite_be32(f, delta_hints_hash_id());
+	hashwrite_be32(f, nr);
+
+	for (i = j = 0; i < 256; i++) {
+		while (j < nr && hints[j].target.hash[0] <= i)
+			j++;
+		hashwrite_be32(f, j);
+	}
+	for (i = 0; i < nr; i++)
+		hashwrite(f, hints[i].target.hash, the_hash_algo->rawsz);
+	for (i = 0; i < nr; i++)
+		hashwrite(f, hints[i].base.hash, the_hash_algo->rawsz);
+	for (i = 0; i < nr; i++)
+		hashwrite_be32(f, hints[i].delta_size);
+
+	hashwrite(f, pack_hash, the_hash_algo->rawsz);
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM | CSUM_FSYNC | CSUM_CLOSE);
+
+	if (adjust_shared_perm(tmp_file.buf))
+		die_errno("unable to make temporary delta hints file readable");
+
+	if (rename(tmp_file.buf, filename))
+		die_errno("unable to rename temporary delta hints file to '%s'",
+			  filename);
+
+	strbuf_release(&tmp_file);
+}
+
+static char *pack_delta_hints_filename(struct packed_git *p)
+{
+	size_t len;
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		BUG("pack_name does not end in .pack");
+	return xstrfmt("%.*s.hints", (int)len, p->pack_name);
+}
+
+struct delta_hints *load_delta_hints(struct packed_git *p)
+{
+	struct delta_hints *hints = NULL;
+	char *name = pack_delta_hints_filename(p);
+	const unsigned char *data = NULL;
+	size_t size = 0, rawsz = the_hash_algo->rawsz;
+	struct stat st;
+	uint32_t nr;
+	int fd;
+
+	fd = git_open(name);
+	if (fd < 0)
+		goto cleanup;
+	if (fstat(fd, &st)) {
+		error_errno(_("failed to read %s"), name);
+		goto cleanup;
+	}
+
+	size = xsize_t(st.st_size);
+	if (size < DHNT_HEADER_SIZE + DHNT_FANOUT_SIZE + 2 * rawsz) {
+		error(_("delta hints file %s is too small"), name);
+		goto cleanup;
+	}
+
+	data = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (get_be32(data) != DHNT_SIGNATURE) {
+		error(_("delta hints file %s has unknown signature"), name);
+		goto cleanup;
+	}
+	if (get_be32(data + 4) != DHNT_VERSION) {
+		error(_("delta hints file %s has unsupported version %"PRIu32),
+		      name, get_be32(data + 4));
+		goto cleanup;
+	}
+	if (get_be32(data + 8) != delta_hints_hash_id())
+		goto cleanup; /* written for a different hash function */
+
+	nr = get_be32(data + 12);
+	if (size - DHNT_HEADER_SIZE - DHNT_FANOUT_SIZE - 2 * rawsz !=
+	    st_mult(nr, 2 * rawsz + 4) ||
+	    get_be32(data + DHNT_HEADER_SIZE + DHNT_FANOUT_SIZE - 4) != nr) {
+		error(_("delta hints file %s is corrupt"), name);
+		goto cleanup;
+	}
+
+	/* hints left behind by a pack that has since been rewritten */
+	if (!hasheq(data + size - 2 * rawsz, p->hash))
+		goto cleanup;
+
+	CALLOC_ARRAY(hints, 1);
+	hints->map = data;
+	hints->map_size = size;
+	hints->nr = nr;
+	hints->fanout = (const uint32_t *)(data + DHNT_HEADER_SIZE);
+	hints->targets = data + DHNT_HEADER_SIZE + DHNT_FANOUT_SIZE;
+	hints->bases = hints->targets + st_mult(nr, rawsz);
+	hints->sizes = hints->bases + st_mult(nr, rawsz);
+
+cleanup:
+	if (!hints && data)
+		munmap((void *)data, size);
+	if (fd >= 0)
+		close(fd);
+	free(name);
+	return hints;
+}
+
+int delta_hints_lookup(struct delta_hints *hints,
+		       const struct object_id *target,
+		       struct object_id *base, unsigned long *delta_size)
+{
+	uint32_t pos;
+
+	if (!bsearch_hash(target->hash, hints->fanout, hints->targets,
+			  the_hash_algo->rawsz, &pos))
+		return 0;
+
+	oidread(base, hints->bases + st_mult(pos, the_hash_algo->rawsz));
+	*delta_size = get_be32(hints->sizes + st_mult(pos, 4));
+	return 1;
+}
+
+void free_delta_hints(struct delta_hints *hints)
+{
+	if (!hints)
+		return;
+	munmap((void *)hints->map, hints->map_size);
+	free(hints);
+}
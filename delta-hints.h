@@ -0,0 +1,52 @@
+#ifndef DELTA_HINTS_H
+#define DELTA_HINTS_H
+
+#include "hash.h"
+
+/*
+ * A delta hints file (pack-*.hints) records which base pack-objects
+ * picked for each object it stored as a delta, and how large the delta
+ * was. When objects are repacked with "--no-reuse-delta", the recorded
+ * pairs are used instead of searching the delta window again, so only
+ * objects without a hint go through find_deltas(). The format is
+ * described in Documentation/technical/pack-format.txt.
+ */
+
+#define DHNT_SIGNATURE 0x44484e54 /* "DHNT" */
+#define DHNT_VERSION 1
+
+struct packed_git;
+
+struct delta_hint {
+	struct object_id target;
+	struct object_id base;
+	uint32_t delta_size;
+};
+
+struct delta_hints;
+
+/*
+ * Write the given hints, which need not be sorted, to "filename" for
+ * the pack whose checksum is "pack_hash".
+ */
+void write_delta_hints_file(const char *filename,
+			    struct delta_hint *hints, uint32_t nr,
+			    const unsigned char *pack_hash);
+
+/*
+ * Map the hints file belonging to "p". Returns NULL if there is none,
+ * or if it does not describe "p".
+ */
+struct delta_hints *load_delta_hints(struct packed_git *p);
+
+/*
+ * Look up the hint recorded for "target"; returns 1 and fills in
+ * "base" and "delta_size" if there is one, 0 otherwise.
+ */
+int delta_hints_lookup(struct delta_hints *hints,
+		       const struct object_id *target,
+		       struct object_id *base, unsigned long *delta_size);
+
+void free_delta_hints(struct delta_hints *hints);
+
+#endif /* DELTA_HINTS_H */
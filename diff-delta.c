@@ -308,6 +308,49 @@ unsigned long sizeof_delta_index(struct delta_index *index)
 		return 0;
 }
 
+/*
+ * Match extension compares a machine word at a time and only falls
+ * back to single bytes to locate the first mismatch.  Only equality of
+ * words is tested, so the result does not depend on byte order.
+ */
+typedef uint64_t match_word_t;
+
+static inline int match_word_eq(const unsigned char *a, const unsigned char *b)
+{
+	match_word_t x, y;
+	memcpy(&x, a, sizeof(x));
+	memcpy(&y, b, sizeof(y));
+	return x == y;
+}
+
+/* number of leading bytes equal in a and b, looking at no more than max */
+static inline size_t match_forward(const unsigned char *a,
+				   const unsigned char *b, size_t max)
+{
+	size_t n = 0;
+
+	while (max - n >= sizeof(match_word_t) && match_word_eq(a + n, b + n))
+		n += sizeof(match_word_t);
+	while (n < max && a[n] == b[n])
+		n++;
+	return n;
+}
+
+/* number of bytes equal right before a and b, looking at no more than max */
+static inline size_t match_backward(const unsigned char *a,
+				    const unsigned char *b, size_t max)
+{
+	size_t n = 0;
+
+	while (max - n >= sizeof(match_word_t) &&
+	       match_word_eq(a - n - sizeof(match_word_t),
+			     b - n - sizeof(match_word_t)))
+		n += sizeof(match_word_t);
+	while (n < max && a[-(ssize_t)n - 1] == b[-(ssize_t)n - 1])
+		n++;
+	return n;
+}
+
 /*
  * The maximum size for any opcode sequence, including the initial header
  * plus Rabin window plus biggest copy.
@@ -378,19 +421,18 @@ create_delta(const struct delta_index *index,
 			i = val & index->hash_mask;
 			for (entry = index->hash[i]; entry < index->hash[i+1]; entry++) {
 				const unsigned char *ref = entry->ptr;
-				const unsigned char *src = data;
 				unsigned int ref_size = ref_top - ref;
+				size_t len;
 				if (entry->val != val)
 					continue;
-				if (ref_size > top - src)
-					ref_size = top - src;
+				if (ref_size > top - data)
+					ref_size = top - data;
 				if (ref_size <= msize)
 					break;
-				while (ref_size-- && *src++ == *ref)
-					ref++;
-				if (msize < ref - entry->ptr) {
+				len = match_forward(ref, data, ref_size);
+				if (msize < len) {
 					/* this is our best match so far */
-					msize = ref - entry->ptr;
+					msize = len;
 					moff = entry->ptr - ref_data;
 					if (msize >= 4096) /* good enough */
 						break;
@@ -413,17 +455,18 @@ create_delta(const struct delta_index *index,
 			unsigned char *op;
 
 			if (inscnt) {
-				while (moff && ref_data[moff-1] == data[-1]) {
-					/* we can match one byte back */
-					msize++;
-					moff--;
-					data--;
-					outpos--;
-					if (--inscnt)
-						continue;
+				/* see how many inserted bytes we can match back */
+				size_t max = moff < inscnt ? moff : inscnt;
+				size_t back = match_backward(ref_data + moff,
+							     data, max);
+				msize += back;
+				moff -= back;
+				data -= back;
+				outpos -= back;
+				inscnt -= back;
+				if (!inscnt) {
 					outpos--;  /* remove count slot */
 					inscnt--;  /* make it -1 */
-					break;
 				}
 				out[outpos - inscnt - 1] = inscnt;
 				inscnt = 0;
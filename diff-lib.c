@@ -316,6 +316,23 @@ static int get_stat_data(const struct index_state *istate,
 	return 0;
 }
 
+/*
+ * A sparse directory entry of the index stands for all the files in
+ * the directory. A recursive diff shows those that differ between the
+ * trees "old_oid" and "new_oid", the former of which may be NULL; any other
+ * diff shows the directory itself, like diff-tree without "-r".
+ */
+static int diff_sparse_directory(struct rev_info *revs,
+				 const struct object_id *old_oid,
+				 const struct object_id *new_oid,
+				 const char *base)
+{
+	if (!revs->diffopt.flags.recursive)
+		return 0;
+	diff_tree_oid(old_oid, new_oid, base, &revs->diffopt);
+	return 1;
+}
+
 static void show_new_file(struct rev_info *revs,
 			  const struct cache_entry *new_file,
 			  int cached, int match_missing)
@@ -325,6 +342,10 @@ static void show_new_file(struct rev_info *revs,
 	unsigned dirty_submodule = 0;
 	struct index_state *istate = revs->diffopt.repo->index;
 
+	if (S_ISSPARSEDIR(new_file->ce_mode) &&
+	    diff_sparse_directory(revs, NULL, &new_file->oid, new_file->name))
+		return;
+
 	/*
 	 * New file in the index: it might actually be different in
 	 * the working tree.
@@ -385,6 +406,10 @@ static int show_modified(struct rev_info *revs,
 	    !revs->diffopt.flags.find_copies_harder)
 		return 0;
 
+	if (S_ISSPARSEDIR(new_entry->ce_mode) && S_ISSPARSEDIR(oldmode) &&
+	    diff_sparse_directory(revs, &old_entry->oid, oid, new_entry->name))
+		return 0;
+
 	diff_change(&revs->diffopt, oldmode, mode,
 		    &old_entry->oid, oid, 1, !is_null_oid(oid),
 		    old_entry->name, 0, dirty_submodule);
@@ -509,6 +534,9 @@ static int diff_cache(struct rev_info *revs,
 	if (!tree)
 		return error("bad tree object %s",
 			     tree_name ? tree_name : oid_to_hex(tree_oid));
+	if (pathspec_needs_expanded_index(revs->diffopt.repo->index,
+					  &revs->diffopt.pathspec))
+		ensure_full_index(revs->diffopt.repo->index);
 	memset(&opts, 0, sizeof(opts));
 	opts.head_idx = 1;
 	opts.index_only = cached;
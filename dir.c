@@ -18,6 +18,8 @@
 #include "ewah/ewok.h"
 #include "fsmonitor.h"
 #include "submodule-config.h"
+#include "strmap.h"
+#include "thread-utils.h"
 
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
@@ -37,6 +39,8 @@ enum path_treatment {
  */
 struct cached_dir {
 	DIR *fdir;
+	struct dir_listing *listing;
+	size_t listing_pos;
 	struct untracked_cache_dir *untracked;
 	int nr_files;
 	int nr_dirs;
@@ -920,6 +924,8 @@ static int read_skip_worktree_file_from_index(struct index_state *istate,
 	return do_read_blob(&istate->cache[pos]->oid, oid_stat, size_out, data_out);
 }
 
+static void free_pattern_matcher(struct pattern_matcher *m);
+
 /*
  * Frees memory within pl which was allocated for exclude patterns and
  * the file buffer.  Does not free pl itself.
@@ -934,6 +940,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->filebuf);
 	hashmap_clear_and_free(&pl->recursive_hashmap, struct pattern_entry, ent);
 	hashmap_clear_and_free(&pl->parent_hashmap, struct pattern_entry, ent);
+	free_pattern_matcher(pl->matcher);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1306,6 +1313,298 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+/*
+ * Check a single pattern against pathname, without regard to the
+ * other patterns in its list.
+ */
+static int path_pattern_matches(struct path_pattern *pattern,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      pattern->pattern, pattern->nowildcardlen,
+				      pattern->patternlen, pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      pattern->pattern, pattern->nowildcardlen,
+			      pattern->patternlen, pattern->flags);
+}
+
+/*
+ * Lists with fewer patterns than this are scanned linearly; indexing
+ * them would cost more than it saves.
+ */
+#define PATTERN_MATCHER_MIN_PATTERNS 16
+
+/*
+ * The patterns whose literal part is "key", in ascending order of
+ * their position in the list.
+ */
+struct matcher_entry {
+	struct hashmap_entry ent;
+	const char *key;
+	int keylen;
+	int nr, alloc;
+	int *pos;
+};
+
+/*
+ * A set of literal keys, together with the distinct lengths of the
+ * keys so that lookups only need to try the substrings of a path
+ * that may be in the map.
+ */
+struct matcher_table {
+	struct hashmap map;
+	int nr_lens, alloc_lens;
+	int *lens;
+};
+
+/*
+ * Every pattern of the list is in exactly one of these:
+ *
+ *  - "exact": patterns without a slash or a wildcard, keyed by the
+ *    basename they match ("foo.txt");
+ *
+ *  - "suffix": patterns without a slash of the form "*<literal>",
+ *    keyed by the end of the basenames they match ("*.o");
+ *
+ *  - "prefix": other patterns without a slash that start with a
+ *    literal, keyed by the start of the basenames they match ("foo*");
+ *
+ *  - "path": patterns with a slash that have a base directory or a
+ *    literal prefix, keyed by the start of the paths they match, with
+ *    the base in front ("/build/", "doc/api-*");
+ *
+ *  - "rest": everything else, which has to be tried on every path
+ *    ("*.py[co]", "[Bb]uild").
+ */
+struct pattern_matcher {
+	/* how many of the list's patterns have been added */
+	int nr;
+	int ignore_case;
+	struct matcher_table exact, suffix, prefix, path;
+	int nr_rest, alloc_rest;
+	int *rest;
+};
+
+static unsigned int matcher_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static int matcher_entry_cmp(const void *unused_cmp_data,
+			     const struct hashmap_entry *eptr,
+			     const struct hashmap_entry *entry_or_key,
+			     const void *unused_keydata)
+{
+	const struct matcher_entry *a, *b;
+
+	a = container_of(eptr, const struct matcher_entry, ent);
+	b = container_of(entry_or_key, const struct matcher_entry, ent);
+
+	return a->keylen != b->keylen || fspathncmp(a->key, b->key, a->keylen);
+}
+
+static void matcher_table_init(struct matcher_table *t)
+{
+	hashmap_init(&t->map, matcher_entry_cmp, NULL, 0);
+}
+
+static void matcher_table_clear(struct matcher_table *t)
+{
+	struct hashmap_iter iter;
+	struct matcher_entry *e;
+
+	hashmap_for_each_entry(&t->map, &iter, e, ent) {
+		free((char *)e->key);
+		free(e->pos);
+	}
+	hashmap_clear_and_free(&t->map, struct matcher_entry, ent);
+	free(t->lens);
+}
+
+static void matcher_table_add(struct matcher_table *t,
+			      const char *key, int keylen, int pos)
+{
+	struct matcher_entry k, *e;
+	int i;
+
+	hashmap_entry_init(&k.ent, matcher_hash(key, keylen));
+	k.key = key;
+	k.keylen = keylen;
+	e = hashmap_get_entry(&t->map, &k, ent, NULL);
+	if (!e) {
+		CALLOC_ARRAY(e, 1);
+		hashmap_entry_init(&e->ent, k.ent.hash);
+		e->key = xmemdupz(key, keylen);
+		e->keylen = keylen;
+		hashmap_add(&t->map, &e->ent);
+
+		for (i = 0; i < t->nr_lens; i++)
+			if (t->lens[i] == keylen)
+				break;
+		if (i == t->nr_lens) {
+			ALLOC_GROW(t->lens, t->nr_lens + 1, t->alloc_lens);
+			t->lens[t->nr_lens++] = keylen;
+		}
+	}
+	ALLOC_GROW(e->pos, e->nr + 1, e->alloc);
+	e->pos[e->nr++] = pos;
+}
+
+static const struct matcher_entry *matcher_table_get(struct matcher_table *t,
+						     const char *key,
+						     int keylen)
+{
+	struct matcher_entry k;
+
+	hashmap_entry_init(&k.ent, matcher_hash(key, keylen));
+	k.key = key;
+	k.keylen = keylen;
+	return hashmap_get_entry(&t->map, &k, ent, NULL);
+}
+
+static void pattern_matcher_add(struct pattern_matcher *m,
+				struct path_pattern *pattern, int pos)
+{
+	const char *p = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_NODIR) {
+		if (prefix == pattern->patternlen)
+			matcher_table_add(&m->exact, p, prefix, pos);
+		else if (pattern->flags & PATTERN_FLAG_ENDSWITH)
+			matcher_table_add(&m->suffix, p + 1,
+					  pattern->patternlen - 1, pos);
+		else if (prefix)
+			matcher_table_add(&m->prefix, p, prefix, pos);
+		else {
+			ALLOC_GROW(m->rest, m->nr_rest + 1, m->alloc_rest);
+			m->rest[m->nr_rest++] = pos;
+		}
+		return;
+	}
+
+	/* see match_pathname() */
+	if (*p == '/') {
+		p++;
+		prefix--;
+	}
+	if (pattern->baselen || prefix) {
+		struct strbuf key = STRBUF_INIT;
+
+		strbuf_add(&key, pattern->base, pattern->baselen);
+		strbuf_add(&key, p, prefix);
+		matcher_table_add(&m->path, key.buf, key.len, pos);
+		strbuf_release(&key);
+	} else {
+		ALLOC_GROW(m->rest, m->nr_rest + 1, m->alloc_rest);
+		m->rest[m->nr_rest++] = pos;
+	}
+}
+
+static void free_pattern_matcher(struct pattern_matcher *m)
+{
+	if (!m)
+		return;
+	matcher_table_clear(&m->exact);
+	matcher_table_clear(&m->suffix);
+	matcher_table_clear(&m->prefix);
+	matcher_table_clear(&m->path);
+	free(m->rest);
+	free(m);
+}
+
+static int use_pattern_matcher(struct pattern_list *pl)
+{
+	static int force = -1;
+
+	if (force < 0)
+		force = git_env_bool("GIT_TEST_PATTERN_MATCHER", -1) + 1;
+	if (force)
+		return force - 1;
+	return pl->nr >= PATTERN_MATCHER_MIN_PATTERNS;
+}
+
+static struct pattern_matcher *get_pattern_matcher(struct pattern_list *pl)
+{
+	struct pattern_matcher *m = pl->matcher;
+
+	if (m && m->ignore_case != ignore_case) {
+		free_pattern_matcher(m);
+		m = pl->matcher = NULL;
+	}
+	if (!m) {
+		if (!use_pattern_matcher(pl))
+			return NULL;
+		CALLOC_ARRAY(m, 1);
+		m->ignore_case = ignore_case;
+		matcher_table_init(&m->exact);
+		matcher_table_init(&m->suffix);
+		matcher_table_init(&m->prefix);
+		matcher_table_init(&m->path);
+		pl->matcher = m;
+	}
+	for (; m->nr < pl->nr; m->nr++)
+		pattern_matcher_add(m, pl->patterns[m->nr], m->nr);
+	return m;
+}
+
+/*
+ * Try the patterns at "pos" that come after "best" in the list, last
+ * one first, and return the position of the last one that matches,
+ * or "best" if none does.
+ */
+static int match_candidates(struct pattern_list *pl, int best,
+			    const int *pos, int nr,
+			    const char *pathname, int pathlen,
+			    const char *basename, int *dtype,
+			    struct index_state *istate)
+{
+	while (nr-- && pos[nr] > best)
+		if (path_pattern_matches(pl->patterns[pos[nr]], pathname,
+					 pathlen, basename, dtype, istate))
+			return pos[nr];
+	return best;
+}
+
+static int match_table(struct pattern_list *pl, int best,
+		       struct matcher_table *t, int at_end,
+		       const char *key, int keylen,
+		       const char *pathname, int pathlen,
+		       const char *basename, int *dtype,
+		       struct index_state *istate)
+{
+	int i;
+
+	for (i = 0; i < t->nr_lens; i++) {
+		const struct matcher_entry *e;
+		int len = t->lens[i];
+
+		if (len > keylen)
+			continue;
+		e = matcher_table_get(t, at_end ? key + keylen - len : key, len);
+		if (e)
+			best = match_candidates(pl, best, e->pos, e->nr,
+						pathname, pathlen, basename,
+						dtype, istate);
+	}
+	return best;
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1319,46 +1618,40 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
+	struct pattern_matcher *m;
+	int basenamelen = pathlen - (basename - pathname);
+	int best = -1;
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
-	for (i = pl->nr - 1; 0 <= i; i--) {
-		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
-
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen,
-				   pattern->flags)) {
-			res = pattern;
-			break;
-		}
+	m = get_pattern_matcher(pl);
+	if (!m) {
+		for (i = pl->nr - 1; 0 <= i; i--)
+			if (path_pattern_matches(pl->patterns[i], pathname,
+						 pathlen, basename, dtype,
+						 istate))
+				return pl->patterns[i];
+		return NULL;
 	}
-	return res;
+
+	/*
+	 * Only the last matching pattern counts, so once one is found,
+	 * only the patterns after it still need to be tried.
+	 */
+	best = match_table(pl, best, &m->exact, 0, basename, basenamelen,
+			   pathname, pathlen, basename, dtype, istate);
+	best = match_table(pl, best, &m->suffix, 1, basename, basenamelen,
+			   pathname, pathlen, basename, dtype, istate);
+	best = match_table(pl, best, &m->prefix, 0, basename, basenamelen,
+			   pathname, pathlen, basename, dtype, istate);
+	best = match_table(pl, best, &m->path, 0, pathname, pathlen,
+			   pathname, pathlen, basename, dtype, istate);
+	best = match_candidates(pl, best, m->rest, m->nr_rest,
+				pathname, pathlen, basename, dtype, istate);
+
+	return best < 0 ? NULL : pl->patterns[best];
 }
 
 /*
@@ -2321,6 +2614,313 @@ static int valid_cached_dir(struct dir_struct *dir,
 	return untracked->valid;
 }
 
+/*
+ * When looking for untracked files without a valid untracked cache,
+ * most of the time goes to waiting for opendir() and readdir(). Helper
+ * threads read the subdirectories of each directory the traversal
+ * enters ahead of it, so that by the time read_directory_recursive()
+ * gets to them their listings are already in memory. The traversal
+ * itself, with the exclude stack and the untracked cache it maintains,
+ * stays serial and sees the same entries in the same order.
+ *
+ * Same limits as for preload-index.c: no more than 20 threads, and
+ * one thread per 500 index entries, which we take as a rough measure
+ * of the size of the worktree.
+ */
+#define PREFETCH_MAX_THREADS (20)
+#define PREFETCH_THREAD_COST (500)
+
+enum dir_listing_state {
+	LISTING_QUEUED = 0,
+	LISTING_READING,
+	LISTING_DONE
+};
+
+struct dir_listing {
+	enum dir_listing_state state;
+	/* errno from lstat() or opendir(), if either failed */
+	int saved_errno;
+	unsigned have_st : 1;
+	/* the directory as seen by lstat() before it was read */
+	struct stat st;
+	/* the d_type and the NUL-terminated name of each entry */
+	struct strbuf entries;
+	/* as passed to open_cached_dir(), i.e. with a trailing slash */
+	char path[FLEX_ARRAY];
+};
+
+struct dir_prefetch {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int stop;
+
+	/* whether to lstat() directories for the untracked cache */
+	int want_stat;
+
+	/* listings not yet taken by the traversal, by path */
+	struct strmap listings;
+
+	/* listings not yet read, the next one to read last */
+	struct dir_listing **queue;
+	int queue_nr, queue_alloc;
+
+	pthread_t *threads;
+	int nr_threads;
+
+	/* statistics, for trace2 */
+	int nr_used, nr_wasted;
+};
+
+static void read_dir_listing(struct dir_listing *listing, int want_stat)
+{
+	const char *path = *listing->path ? listing->path : ".";
+	struct dirent *de;
+	DIR *fdir;
+
+	if (want_stat)
+		listing->have_st = !lstat(path, &listing->st);
+	fdir = opendir(path);
+	if (!fdir) {
+		listing->saved_errno = errno;
+		return;
+	}
+	while ((de = readdir_skip_dot_and_dotdot(fdir))) {
+		strbuf_addch(&listing->entries, DTYPE(de));
+		strbuf_add(&listing->entries, de->d_name,
+			   strlen(de->d_name) + 1);
+	}
+	closedir(fdir);
+}
+
+static void free_dir_listing(struct dir_listing *listing)
+{
+	strbuf_release(&listing->entries);
+	free(listing);
+}
+
+static void *prefetch_thread(void *data)
+{
+	struct dir_prefetch *p = data;
+
+	pthread_mutex_lock(&p->mutex);
+	for (;;) {
+		struct dir_listing *listing;
+
+		while (!p->stop && !p->queue_nr)
+			pthread_cond_wait(&p->work_cond, &p->mutex);
+		if (p->stop)
+			break;
+		listing = p->queue[--p->queue_nr];
+		listing->state = LISTING_READING;
+		pthread_mutex_unlock(&p->mutex);
+
+		read_dir_listing(listing, p->want_stat);
+
+		pthread_mutex_lock(&p->mutex);
+		listing->state = LISTING_DONE;
+		pthread_cond_broadcast(&p->done_cond);
+	}
+	pthread_mutex_unlock(&p->mutex);
+	return NULL;
+}
+
+/*
+ * Queue the subdirectories in "listing" to be read by the helper
+ * threads. The traversal enters them in the order they are listed,
+ * which is the order they are taken off the end of the queue.
+ */
+static void queue_subdirectories(struct dir_prefetch *p,
+				 struct dir_listing *listing)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf *entries = &listing->entries;
+	size_t pos, first = p->queue_nr;
+	int i, j;
+
+	pthread_mutex_lock(&p->mutex);
+	for (pos = 0; pos < entries->len; ) {
+		int d_type = (unsigned char)entries->buf[pos];
+		const char *name = entries->buf + pos + 1;
+		struct dir_listing *subdir;
+
+		pos += strlen(name) + 2;
+		if (d_type != DT_DIR || !fspathcmp(name, ".git"))
+			continue;
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s%s/", listing->path, name);
+		if (strmap_contains(&p->listings, path.buf))
+			continue;
+		FLEX_ALLOC_MEM(subdir, path, path.buf, path.len);
+		strbuf_init(&subdir->entries, 0);
+		strmap_put(&p->listings, subdir->path, subdir);
+		ALLOC_GROW(p->queue, p->queue_nr + 1, p->queue_alloc);
+		p->queue[p->queue_nr++] = subdir;
+	}
+	for (i = first, j = p->queue_nr - 1; i < j; i++, j--)
+		SWAP(p->queue[i], p->queue[j]);
+	if (p->queue_nr != first)
+		pthread_cond_broadcast(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+	strbuf_release(&path);
+}
+
+/*
+ * Take the listing of "path" (with a trailing slash, or empty for the
+ * top-level directory) off the helper threads, waiting for the one
+ * that is reading it if needed. Returns NULL if no helper thread has
+ * started reading it.
+ */
+static struct dir_listing *take_dir_listing(struct dir_prefetch *p,
+					    const char *path)
+{
+	struct dir_listing *listing;
+	int i;
+
+	pthread_mutex_lock(&p->mutex);
+	listing = strmap_get(&p->listings, path);
+	if (listing) {
+		strmap_remove(&p->listings, path, 0);
+		if (listing->state == LISTING_QUEUED) {
+			for (i = p->queue_nr - 1; i >= 0; i--)
+				if (p->queue[i] == listing)
+					break;
+			if (i < 0)
+				BUG("queued directory listing '%s' not in queue",
+				    path);
+			MOVE_ARRAY(p->queue + i, p->queue + i + 1,
+				   p->queue_nr - i - 1);
+			p->queue_nr--;
+			free_dir_listing(listing);
+			listing = NULL;
+		}
+	}
+	while (listing && listing->state != LISTING_DONE)
+		pthread_cond_wait(&p->done_cond, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+	return listing;
+}
+
+/*
+ * Return the listing of the directory "path" for open_cached_dir(),
+ * reading it now if the helper threads have not, or NULL with errno
+ * set if it cannot be read.
+ */
+static struct dir_listing *get_dir_listing(struct dir_prefetch *p,
+					   struct untracked_cache_dir *untracked,
+					   const char *path)
+{
+	struct dir_listing *listing = take_dir_listing(p, path);
+
+	/*
+	 * The untracked cache records the stat data of the directory
+	 * as seen right before valid_cached_dir() decided to read it;
+	 * a listing read before that is only good if the directory
+	 * looked the same then.
+	 */
+	if (listing && untracked &&
+	    (!listing->have_st ||
+	     match_stat_data(&untracked->stat_data, &listing->st))) {
+		free_dir_listing(listing);
+		listing = NULL;
+		p->nr_wasted++;
+	}
+
+	if (listing) {
+		p->nr_used++;
+	} else {
+		FLEX_ALLOC_STR(listing, path, path);
+		strbuf_init(&listing->entries, 0);
+		read_dir_listing(listing, 0);
+	}
+
+	if (listing->saved_errno) {
+		errno = listing->saved_errno;
+		free_dir_listing(listing);
+		return NULL;
+	}
+	queue_subdirectories(p, listing);
+	return listing;
+}
+
+static void start_prefetch(struct dir_struct *dir, struct index_state *istate)
+{
+	struct dir_prefetch *p;
+	int i, threads;
+
+	if (!HAVE_THREADS || !core_preload_index)
+		return;
+
+	threads = istate->cache_nr / PREFETCH_THREAD_COST;
+	if (threads < 2 && git_env_bool("GIT_TEST_PRELOAD_INDEX", 0))
+		threads = 2;
+	if (threads < 2)
+		return;
+	if (threads > PREFETCH_MAX_THREADS)
+		threads = PREFETCH_MAX_THREADS;
+
+	CALLOC_ARRAY(p, 1);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->work_cond, NULL);
+	pthread_cond_init(&p->done_cond, NULL);
+	strmap_init_with_options(&p->listings, NULL, 0);
+	p->want_stat = !!dir->untracked;
+	CALLOC_ARRAY(p->threads, threads);
+	for (i = 0; i < threads; i++) {
+		int err = pthread_create(&p->threads[i], NULL,
+					 prefetch_thread, p);
+		if (err) {
+			warning(_("unable to create directory reading thread: %s"),
+				strerror(err));
+			break;
+		}
+	}
+	p->nr_threads = i;
+	dir->prefetch = p;
+}
+
+static void stop_prefetch(struct dir_struct *dir, struct repository *repo)
+{
+	struct dir_prefetch *p = dir->prefetch;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	int i;
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+	for (i = 0; i < p->nr_threads; i++)
+		if (pthread_join(p->threads[i], NULL))
+			die("unable to join directory reading thread");
+
+	strmap_for_each_entry(&p->listings, &iter, e) {
+		struct dir_listing *listing = e->value;
+
+		if (listing->state == LISTING_DONE)
+			p->nr_wasted++;
+		free_dir_listing(listing);
+	}
+	strmap_clear(&p->listings, 0);
+
+	trace2_data_intmax("read_directory", repo, "prefetch/threads",
+			   p->nr_threads);
+	trace2_data_intmax("read_directory", repo, "prefetch/used",
+			   p->nr_used);
+	trace2_data_intmax("read_directory", repo, "prefetch/wasted",
+			   p->nr_wasted);
+
+	free(p->queue);
+	free(p->threads);
+	pthread_cond_destroy(&p->work_cond);
+	pthread_cond_destroy(&p->done_cond);
+	pthread_mutex_destroy(&p->mutex);
+	FREE_AND_NULL(dir->prefetch);
+}
+
 static int open_cached_dir(struct cached_dir *cdir,
 			   struct dir_struct *dir,
 			   struct untracked_cache_dir *untracked,
@@ -2335,14 +2935,18 @@ static int open_cached_dir(struct cached_dir *cdir,
 	if (valid_cached_dir(dir, untracked, istate, path, check_only))
 		return 0;
 	c_path = path->len ? path->buf : ".";
-	cdir->fdir = opendir(c_path);
-	if (!cdir->fdir)
+	if (dir->prefetch)
+		cdir->listing = get_dir_listing(dir->prefetch, untracked,
+						path->buf);
+	else
+		cdir->fdir = opendir(c_path);
+	if (!cdir->fdir && !cdir->listing)
 		warning_errno(_("could not open directory '%s'"), c_path);
 	if (dir->untracked) {
 		invalidate_directory(dir->untracked, untracked);
 		dir->untracked->dir_opened++;
 	}
-	if (!cdir->fdir)
+	if (!cdir->fdir && !cdir->listing)
 		return -1;
 	return 0;
 }
@@ -2351,6 +2955,19 @@ static int read_cached_dir(struct cached_dir *cdir)
 {
 	struct dirent *de;
 
+	if (cdir->listing) {
+		struct strbuf *entries = &cdir->listing->entries;
+
+		if (cdir->listing_pos >= entries->len) {
+			cdir->d_name = NULL;
+			cdir->d_type = DT_UNKNOWN;
+			return -1;
+		}
+		cdir->d_type = (unsigned char)entries->buf[cdir->listing_pos];
+		cdir->d_name = entries->buf + cdir->listing_pos + 1;
+		cdir->listing_pos += strlen(cdir->d_name) + 2;
+		return 0;
+	}
 	if (cdir->fdir) {
 		de = readdir_skip_dot_and_dotdot(cdir->fdir);
 		if (!de) {
@@ -2385,6 +3002,8 @@ static void close_cached_dir(struct cached_dir *cdir)
 {
 	if (cdir->fdir)
 		closedir(cdir->fdir);
+	if (cdir->listing)
+		free_dir_listing(cdir->listing);
 	/*
 	 * We have gone through this directory and found no untracked
 	 * entries. Mark it valid.
@@ -2420,7 +3039,7 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 		if (dir->flags & DIR_SHOW_IGNORED)
 			break;
 		dir_add_name(dir, istate, path->buf, path->len);
-		if (cdir->fdir)
+		if (cdir->fdir || cdir->listing)
 			add_untracked(untracked, path->buf + baselen);
 		break;
 
@@ -2525,7 +3144,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 			/* abort early if maximum state has been reached */
 			if (dir_state == path_untracked) {
-				if (cdir.fdir)
+				if (cdir.fdir || cdir.listing)
 					add_untracked(untracked, path.buf + baselen);
 				break;
 			}
@@ -2845,8 +3464,11 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		start_prefetch(dir, istate);
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+		stop_prefetch(dir, istate->repo);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
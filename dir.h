@@ -115,6 +115,14 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Non-cone lists with many patterns are indexed by their literal
+	 * parts, so that a path is only checked against the patterns that
+	 * can match it (see last_matching_pattern_from_list()). Built
+	 * lazily on the first match and extended as patterns are added.
+	 */
+	struct pattern_matcher *matcher;
 };
 
 /*
@@ -337,6 +345,12 @@ struct dir_struct {
 	struct oid_stat ss_excludes_file;
 	unsigned unmanaged_exclude_files;
 
+	/*
+	 * Helper threads reading directories ahead of the traversal in
+	 * read_directory(), if any.
+	 */
+	struct dir_prefetch *prefetch;
+
 	/* Stats about the traversal */
 	unsigned visited_paths;
 	unsigned visited_directories;
@@ -0,0 +1,64 @@
+#ifndef FSMONITOR_DAEMON_H
+#define FSMONITOR_DAEMON_H
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+
+#include "cache.h"
+#include "strmap.h"
+#include "thread-utils.h"
+
+struct ipc_server_data;
+struct fsm_listen_data;
+
+/*
+ * State shared between the IPC threads of "git fsmonitor--daemon",
+ * which answer queries, and the platform-specific listener thread in
+ * compat/fsmonitor/, which feeds it filesystem events.
+ *
+ * Every batch of events the listener publishes gets the next sequence
+ * number, and "changed" maps each path, relative to the root of the
+ * worktree, to the sequence number of the last batch that touched
+ * it. Directories are recorded with a trailing slash. Tokens handed
+ * to clients have the form "builtin:<token_id>:<seq>"; a client whose
+ * token names another token_id, or a sequence number older than
+ * "min_seq", has to rescan everything.
+ */
+struct fsmonitor_daemon_state {
+	pthread_t listener_thread;
+	pthread_mutex_t main_lock;
+	pthread_cond_t cookies_cond;
+
+	struct strbuf path_worktree_watch;
+	struct strbuf path_cookie_prefix;
+
+	struct strbuf token_id;
+	uint64_t seq;
+	uint64_t min_seq;
+	struct strmap changed;
+
+	/* cookie files whose creation the listener has not seen yet */
+	struct strset pending_cookies;
+	int cookie_seq;
+
+	int error_code;
+	struct fsm_listen_data *listen_data;
+	struct ipc_server_data *ipc_server_data;
+};
+
+/*
+ * Record that the given paths changed, and that the given cookie
+ * files have been seen; either list may be empty. Called by the
+ * listener with no locks held.
+ */
+void fsmonitor_publish(struct fsmonitor_daemon_state *state,
+		       const struct string_list *paths,
+		       const struct string_list *cookie_names);
+
+/*
+ * Forget everything we know, e.g. after the kernel dropped events;
+ * every client will have to rescan the worktree once.
+ */
+void fsmonitor_force_resync(struct fsmonitor_daemon_state *state);
+
+#endif /* HAVE_FSMONITOR_DAEMON_BACKEND */
+#endif /* FSMONITOR_DAEMON_H */
@@ -0,0 +1,52 @@
+#ifndef FSMONITOR_IPC_H
+#define FSMONITOR_IPC_H
+
+#include "simple-ipc.h"
+
+/*
+ * Client side of the protocol spoken with "git fsmonitor--daemon",
+ * the builtin filesystem monitor that is used when core.fsmonitor is
+ * set to "true". The daemon listens on a Unix domain socket in the
+ * repository's $GIT_DIR.
+ */
+
+/*
+ * Returns true if the builtin daemon is available on this platform.
+ */
+int fsmonitor_ipc__is_supported(void);
+
+/*
+ * Returns the pathname of the daemon's socket for the current
+ * repository.
+ */
+const char *fsmonitor_ipc__get_path(void);
+
+#ifdef SUPPORTS_SIMPLE_IPC
+/*
+ * Try to determine whether there is a daemon listening for the
+ * current repository.
+ */
+enum ipc_active_state fsmonitor_ipc__get_state(void);
+#endif
+
+/*
+ * Ask the daemon for the paths changed since "since_token", starting
+ * it first if it is not running. On success, "answer" holds a
+ * response in the same format as an fsmonitor hook of version 2: the
+ * new token, followed by the changed paths, each NUL-terminated.
+ *
+ * Returns -1 on error.
+ */
+int fsmonitor_ipc__send_query(const char *since_token,
+			      struct strbuf *answer);
+
+/*
+ * Send a control command (e.g. "quit") to a running daemon without
+ * trying to start one.
+ *
+ * Returns -1 on error.
+ */
+int fsmonitor_ipc__send_command(const char *command,
+				struct strbuf *answer);
+
+#endif /* FSMONITOR_IPC_H */
@@ -3,6 +3,7 @@
 #include "dir.h"
 #include "ewah/ewok.h"
 #include "fsmonitor.h"
+#include "fsmonitor-ipc.h"
 #include "run-command.h"
 #include "strbuf.h"
 
@@ -31,10 +32,22 @@ static void fsmonitor_ewah_callback(size_t pos, void *is)
 	ce->ce_flags &= ~CE_FSMONITOR_VALID;
 }
 
+/*
+ * core.fsmonitor=true asks for the builtin daemon instead of a hook.
+ */
+static int fsmonitor_is_builtin(void)
+{
+	return core_fsmonitor && git_parse_maybe_bool(core_fsmonitor) == 1;
+}
+
 static int fsmonitor_hook_version(void)
 {
 	int hook_version;
 
+	/* the daemon speaks the same protocol as a version 2 hook */
+	if (fsmonitor_is_builtin())
+		return HOOK_INTERFACE_VERSION2;
+
 	if (git_config_get_int("core.fsmonitorhookversion", &hook_version))
 		return -1;
 
@@ -87,7 +100,8 @@ int read_fsmonitor_extension(struct index_state *istate, const void *data,
 	}
 	istate->fsmonitor_dirty = fsmonitor_dirty;
 
-	if (!istate->split_index)
+	/* a partially read index only holds some of the entries */
+	if (!istate->split_index && !istate->partial_prefix)
 		assert_index_minimum(istate, istate->fsmonitor_dirty->bit_size);
 
 	trace2_data_string("index", NULL, "extension/fsmn/read/token",
@@ -156,6 +170,14 @@ static int query_fsmonitor(int version, const char *last_update, struct strbuf *
 	if (!core_fsmonitor)
 		return -1;
 
+	if (fsmonitor_is_builtin()) {
+		if (!fsmonitor_ipc__is_supported()) {
+			warning(_("core.fsmonitor=true is not supported on this platform"));
+			return -1;
+		}
+		return fsmonitor_ipc__send_query(last_update, query_result);
+	}
+
 	strvec_push(&cp.args, core_fsmonitor);
 	strvec_pushf(&cp.args, "%d", version);
 	strvec_pushf(&cp.args, "%s", last_update);
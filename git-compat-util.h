@@ -890,6 +890,20 @@ char *xgetcwd(void);
 FILE *fopen_for_writing(const char *path);
 FILE *fopen_or_warn(const char *path, const char *mode);
 
+enum fsync_action {
+	FSYNC_WRITEOUT_ONLY,
+	FSYNC_HARDWARE_FLUSH
+};
+
+/*
+ * Flush "fd" to disk. FSYNC_WRITEOUT_ONLY asks the kernel to start
+ * writing back the page cache for the file without waiting for the
+ * storage device to make it durable; it fails with ENOSYS where the
+ * platform has no way to do that. FSYNC_HARDWARE_FLUSH is a full
+ * fsync(), retried on EINTR.
+ */
+int git_fsync(int fd, enum fsync_action action);
+
 /*
  * Like strncmp, but only return zero if s is NUL-terminated and exactly len
  * characters long.  If it is not, consider it greater than t.
@@ -0,0 +1,647 @@
+#include "cache.h"
+#include "config.h"
+#include "dir.h"
+#include "cache-tree.h"
+#include "lockfile.h"
+#include "index-journal.h"
+#include "ewah/ewok.h"
+
+#define JOURNAL_SIGNATURE 0x4a524e4c /* "JRNL" */
+#define JOURNAL_VERSION 1
+
+/* changes that can be recorded in the journal */
+#define JOURNAL_CHANGES (CE_ENTRY_CHANGED | CE_ENTRY_REMOVED | \
+			 CE_ENTRY_ADDED | CACHE_TREE_CHANGED)
+
+static const int default_max_percent_journal = 10;
+
+/* ctime, mtime, dev, ino, mode, uid, gid and size, as 32-bit values */
+#define JOURNAL_STAT_FIELDS 10
+
+/* flags that are stored in the journal, as in the index */
+#define JOURNAL_FLAGS (CE_STAGEMASK | CE_VALID | CE_EXTENDED_FLAGS)
+
+struct index_journal *init_index_journal(struct index_state *istate)
+{
+	if (!istate->journal) {
+		CALLOC_ARRAY(istate->journal, 1);
+		string_list_init(&istate->journal->removed, 1);
+	}
+	return istate->journal;
+}
+
+void write_journal_extension(struct strbuf *sb)
+{
+	uint64_t nonce[2];
+
+	nonce[0] = htonll(getnanotime());
+	nonce[1] = htonll(getpid());
+	strbuf_add(sb, nonce, sizeof(nonce));
+}
+
+void discard_index_journal(struct index_state *istate)
+{
+	struct index_journal *j = istate->journal;
+
+	if (!j)
+		return;
+	free(j->index_path);
+	string_list_clear(&j->removed, 0);
+	FREE_AND_NULL(istate->journal);
+}
+
+static char *journal_path(const char *index_path)
+{
+	return xstrfmt("%s.journal", index_path);
+}
+
+static size_t journal_header_size(void)
+{
+	return 8 + the_hash_algo->rawsz;
+}
+
+/*
+ * Mark all entries as stored on disk, see the comment above
+ * struct index_journal.
+ */
+static void mark_journal_base(struct index_state *istate)
+{
+	unsigned int i;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE) {
+			ce->index = 0;
+			continue;
+		}
+		ce->index = 1;
+		ce->ce_flags &= ~CE_UPDATE_IN_BASE;
+	}
+}
+
+void record_index_journal_removal(struct index_state *istate,
+				  const struct cache_entry *ce)
+{
+	if (!istate->journal || !ce->index)
+		return;
+	string_list_append(&istate->journal->removed, ce->name)->util =
+		(void *)(uintptr_t)ce_stage(ce);
+}
+
+void replace_index_entry_in_journal(struct index_state *istate,
+				    const struct cache_entry *old_entry,
+				    struct cache_entry *new_entry)
+{
+	if (istate->journal)
+		new_entry->index = old_entry->index;
+}
+
+struct journal_op {
+	const char *name;
+	int namelen;
+	int stage;
+	unsigned int seq;
+	struct cache_entry *ce; /* NULL for removals */
+};
+
+static int journal_op_cmp(const void *a_, const void *b_)
+{
+	const struct journal_op *a = a_, *b = b_;
+	int cmp = cache_name_stage_compare(a->name, a->namelen, a->stage,
+					   b->name, b->namelen, b->stage);
+
+	if (cmp)
+		return cmp;
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static int same_path_and_stage(const struct journal_op *a,
+			       const struct journal_op *b)
+{
+	return a->namelen == b->namelen && a->stage == b->stage &&
+		!memcmp(a->name, b->name, a->namelen);
+}
+
+/*
+ * Return the length of the NUL-terminated name at "p", or -1 if there
+ * is none before "end".
+ */
+static int journal_name_len(const unsigned char *p, const unsigned char *end)
+{
+	const unsigned char *nul = memchr(p, '\0', end - p);
+
+	if (!nul || nul == p || nul - p > INT_MAX)
+		return -1;
+	return nul - p;
+}
+
+/*
+ * Check the batch at "p" and return the offset just past it, or 0 if
+ * it is incomplete or corrupt. A writer that died while appending
+ * leaves such a batch at the end of the journal; it, and everything
+ * after it, is ignored.
+ */
+static size_t check_journal_batch(const unsigned char *p, size_t avail)
+{
+	const unsigned rawsz = the_hash_algo->rawsz;
+	const size_t entry_size = JOURNAL_STAT_FIELDS * 4 + rawsz + 4;
+	const unsigned char *cur = p + 8, *end = p + avail;
+	uint32_t nr_removed, nr_entries, i;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx c;
+	int len;
+
+	if (avail < 8)
+		return 0;
+	nr_removed = get_be32(p);
+	nr_entries = get_be32(p + 4);
+
+	for (i = 0; i < nr_removed; i++) {
+		if (end - cur < 4 ||
+		    (len = journal_name_len(cur + 4, end)) < 0)
+			return 0;
+		cur += 4 + len + 1;
+	}
+	for (i = 0; i < nr_entries; i++) {
+		if (end - cur < entry_size ||
+		    (len = journal_name_len(cur + entry_size, end)) < 0)
+			return 0;
+		cur += entry_size + len + 1;
+	}
+	if (end - cur < rawsz)
+		return 0;
+
+	the_hash_algo->init_fn(&c);
+	the_hash_algo->update_fn(&c, p, cur - p);
+	the_hash_algo->final_fn(hash, &c);
+	if (!hasheq(hash, cur))
+		return 0;
+	return cur + rawsz - p;
+}
+
+static void parse_journal_batch(struct index_state *istate,
+				const unsigned char *p,
+				struct journal_op **ops, size_t *nr, size_t *alloc)
+{
+	const unsigned rawsz = the_hash_algo->rawsz;
+	uint32_t nr_removed = get_be32(p), nr_entries = get_be32(p + 4), i;
+
+	p += 8;
+	ALLOC_GROW(*ops, *nr + nr_removed + nr_entries, *alloc);
+
+	for (i = 0; i < nr_removed; i++) {
+		struct journal_op *op = &(*ops)[*nr];
+
+		op->stage = (get_be32(p) & CE_STAGEMASK) >> CE_STAGESHIFT;
+		op->name = (const char *)p + 4;
+		op->namelen = strlen(op->name);
+		op->seq = *nr;
+		op->ce = NULL;
+		p += 4 + op->namelen + 1;
+		(*nr)++;
+	}
+
+	for (i = 0; i < nr_entries; i++) {
+		struct journal_op *op = &(*ops)[*nr];
+		const char *name = (const char *)p + JOURNAL_STAT_FIELDS * 4 + rawsz + 4;
+		int namelen = strlen(name);
+		struct cache_entry *ce = make_empty_cache_entry(istate, namelen);
+
+		ce->ce_stat_data.sd_ctime.sec = get_be32(p);
+		ce->ce_stat_data.sd_ctime.nsec = get_be32(p + 4);
+		ce->ce_stat_data.sd_mtime.sec = get_be32(p + 8);
+		ce->ce_stat_data.sd_mtime.nsec = get_be32(p + 12);
+		ce->ce_stat_data.sd_dev = get_be32(p + 16);
+		ce->ce_stat_data.sd_ino = get_be32(p + 20);
+		ce->ce_mode = get_be32(p + 24);
+		ce->ce_stat_data.sd_uid = get_be32(p + 28);
+		ce->ce_stat_data.sd_gid = get_be32(p + 32);
+		ce->ce_stat_data.sd_size = get_be32(p + 36);
+		p += JOURNAL_STAT_FIELDS * 4;
+		oidread(&ce->oid, p);
+		p += rawsz;
+		ce->ce_flags = get_be32(p) & JOURNAL_FLAGS;
+		ce->ce_namelen = namelen;
+		ce->index = 1;
+		memcpy(ce->name, name, namelen);
+		p += 4 + namelen + 1;
+
+		op->name = ce->name;
+		op->namelen = namelen;
+		op->stage = ce_stage(ce);
+		op->seq = *nr;
+		op->ce = ce;
+		(*nr)++;
+	}
+}
+
+/*
+ * Merge the (sorted) operations into istate->cache[]; when there are
+ * several for the same path and stage, the last one wins.
+ */
+static void apply_journal_ops(struct index_state *istate,
+			      struct journal_op *ops, size_t nr)
+{
+	struct cache_entry **cache;
+	unsigned int i = 0, cache_nr = 0, cache_alloc;
+	size_t k;
+
+	cache_alloc = alloc_nr(istate->cache_nr + nr);
+	ALLOC_ARRAY(cache, cache_alloc);
+
+	for (k = 0; k < nr; k++) {
+		struct journal_op *op = &ops[k];
+		int cmp = 1;
+
+		if (k + 1 < nr && same_path_and_stage(op, &ops[k + 1])) {
+			/* superseded by a later operation */
+			if (op->ce)
+				discard_cache_entry(op->ce);
+			continue;
+		}
+
+		while (i < istate->cache_nr) {
+			struct cache_entry *ce = istate->cache[i];
+
+			cmp = cache_name_stage_compare(ce->name, ce_namelen(ce),
+						       ce_stage(ce), op->name,
+						       op->namelen, op->stage);
+			if (cmp >= 0)
+				break;
+			cache[cache_nr++] = ce;
+			i++;
+		}
+		if (!cmp) {
+			discard_cache_entry(istate->cache[i]);
+			i++;
+		}
+		if (op->ce)
+			cache[cache_nr++] = op->ce;
+
+		cache_tree_invalidate_path(istate, op->name);
+		untracked_cache_invalidate_path(istate, op->name, 1);
+	}
+	while (i < istate->cache_nr)
+		cache[cache_nr++] = istate->cache[i++];
+
+	free(istate->cache);
+	istate->cache = cache;
+	istate->cache_nr = cache_nr;
+	istate->cache_alloc = cache_alloc;
+}
+
+void read_index_journal(struct index_state *istate, const char *index_path)
+{
+	struct index_journal *j = init_index_journal(istate);
+	char *path = journal_path(index_path);
+	struct journal_op *ops = NULL;
+	size_t nr_ops = 0, alloc_ops = 0, mmap_size, offset;
+	unsigned int nr_batches = 0;
+	const unsigned char *mmap;
+	struct stat st;
+	int fd;
+
+	free(j->index_path);
+	j->index_path = xstrdup(index_path);
+	oidcpy(&j->base_oid, &istate->oid);
+	j->size = 0;
+	j->nr_records = 0;
+	string_list_clear(&j->removed, 0);
+	mark_journal_base(istate);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			warning_errno(_("could not open '%s'"), path);
+		goto done;
+	}
+	if (fstat(fd, &st)) {
+		warning_errno(_("could not stat '%s'"), path);
+		close(fd);
+		goto done;
+	}
+	mmap_size = xsize_t(st.st_size);
+	if (mmap_size < journal_header_size()) {
+		close(fd);
+		goto done;
+	}
+	mmap = xmmap(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	/* a journal left over from an older index is ignored */
+	if (get_be32(mmap) != JOURNAL_SIGNATURE ||
+	    get_be32(mmap + 4) != JOURNAL_VERSION ||
+	    !hasheq(mmap + 8, istate->oid.hash))
+		goto unmap;
+
+	offset = journal_header_size();
+	while (offset < mmap_size) {
+		size_t len = check_journal_batch(mmap + offset,
+						 mmap_size - offset);
+		if (!len)
+			break;
+		parse_journal_batch(istate, mmap + offset,
+				    &ops, &nr_ops, &alloc_ops);
+		offset += len;
+		nr_batches++;
+	}
+	if (!nr_batches)
+		goto unmap;
+
+	QSORT(ops, nr_ops, journal_op_cmp);
+	apply_journal_ops(istate, ops, nr_ops);
+
+	/*
+	 * The fsmonitor bitmap refers to positions in the index file,
+	 * which the journal may have shifted.
+	 */
+	if (istate->fsmonitor_last_update) {
+		FREE_AND_NULL(istate->fsmonitor_last_update);
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+	}
+
+	j->size = offset;
+	j->nr_records = nr_ops;
+	istate->timestamp.sec = st.st_mtime;
+	istate->timestamp.nsec = ST_MTIME_NSEC(st);
+
+	trace2_data_intmax("index", the_repository, "journal/batches",
+			   nr_batches);
+	trace2_data_intmax("index", the_repository, "journal/records",
+			   nr_ops);
+
+unmap:
+	munmap((void *)mmap, mmap_size);
+done:
+	free(ops);
+	free(path);
+}
+
+int verify_index_journal(const struct index_state *istate)
+{
+	struct index_journal *j = istate->journal;
+	unsigned char hdr[8 + GIT_MAX_RAWSZ];
+	struct stat st;
+	char *path;
+	int fd, ret;
+
+	if (!j || !j->index_path)
+		return 1;
+
+	path = journal_path(j->index_path);
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return errno == ENOENT && !j->size;
+
+	if (fstat(fd, &st) ||
+	    pread_in_full(fd, hdr, journal_header_size(), 0) != journal_header_size() ||
+	    get_be32(hdr) != JOURNAL_SIGNATURE ||
+	    get_be32(hdr + 4) != JOURNAL_VERSION ||
+	    !hasheq(hdr + 8, j->base_oid.hash))
+		ret = !j->size; /* not ours; it will be replaced */
+	else
+		ret = st.st_size == j->size;
+
+	close(fd);
+	return ret;
+}
+
+static int use_index_journal(struct index_state *istate)
+{
+	struct repository *r = istate->repo ? istate->repo : the_repository;
+
+	prepare_repo_settings(r);
+	if (r->settings.sparse_index || istate->sparse_index)
+		return 0;
+	return git_config_get_index_journal() > 0;
+}
+
+void prepare_index_journal(struct index_state *istate, struct lock_file *lock,
+			   unsigned flags, int alternate_output)
+{
+	char *path;
+
+	if (alternate_output || !(flags & COMMIT_LOCK) ||
+	    istate->split_index || !use_index_journal(istate)) {
+		if (istate->journal)
+			istate->journal->active = 0;
+		return;
+	}
+
+	/*
+	 * If the lock is not for the index we read, its checksum or
+	 * journal will not match and verify_index_journal() declines.
+	 */
+	path = get_locked_file_path(lock);
+	init_index_journal(istate);
+	free(istate->journal->index_path);
+	istate->journal->index_path = path;
+	istate->journal->active = 1;
+}
+
+static int too_many_journal_records(struct index_state *istate,
+				    unsigned int nr_new)
+{
+	int max_percent = git_config_get_max_percent_journal();
+
+	if (max_percent < 0)
+		max_percent = default_max_percent_journal;
+
+	return (uint64_t)(istate->journal->nr_records + nr_new) * 100 >
+		(uint64_t)istate->cache_nr * max_percent;
+}
+
+static void add_journal_entry(struct strbuf *sb, struct cache_entry *ce)
+{
+	const struct stat_data *sd = &ce->ce_stat_data;
+	uint32_t fields[JOURNAL_STAT_FIELDS + 1];
+	int i = 0;
+
+	fields[i++] = htonl(sd->sd_ctime.sec);
+	fields[i++] = htonl(sd->sd_ctime.nsec);
+	fields[i++] = htonl(sd->sd_mtime.sec);
+	fields[i++] = htonl(sd->sd_mtime.nsec);
+	fields[i++] = htonl(sd->sd_dev);
+	fields[i++] = htonl(sd->sd_ino);
+	fields[i++] = htonl(ce->ce_mode);
+	fields[i++] = htonl(sd->sd_uid);
+	fields[i++] = htonl(sd->sd_gid);
+	fields[i++] = htonl(sd->sd_size);
+	strbuf_add(sb, fields, JOURNAL_STAT_FIELDS * 4);
+	strbuf_add(sb, ce->oid.hash, the_hash_algo->rawsz);
+	fields[0] = htonl(ce->ce_flags & JOURNAL_FLAGS);
+	strbuf_add(sb, fields, 4);
+	strbuf_add(sb, ce->name, ce_namelen(ce) + 1);
+}
+
+static int append_journal_batch(struct index_journal *j,
+				const struct strbuf *batch, struct stat *st)
+{
+	char *path = journal_path(j->index_path);
+	int fd, ret = 0;
+
+	if (!j->size) {
+		/* start a new journal, replacing any stale one */
+		struct lock_file lock = LOCK_INIT;
+		uint32_t hdr[2];
+
+		fd = hold_lock_file_for_update(&lock, path, 0);
+		if (fd < 0) {
+			ret = error_errno(_("could not lock '%s'"), path);
+			goto out;
+		}
+		hdr[0] = htonl(JOURNAL_SIGNATURE);
+		hdr[1] = htonl(JOURNAL_VERSION);
+		if (write_in_full(fd, hdr, sizeof(hdr)) < 0 ||
+		    write_in_full(fd, j->base_oid.hash,
+				  the_hash_algo->rawsz) < 0 ||
+		    write_in_full(fd, batch->buf, batch->len) < 0 ||
+		    fstat(fd, st)) {
+			ret = error_errno(_("could not write '%s'"), path);
+			rollback_lock_file(&lock);
+			goto out;
+		}
+		if (commit_lock_file(&lock))
+			ret = error_errno(_("could not commit '%s'"), path);
+		goto out;
+	}
+
+	fd = open(path, O_WRONLY | O_APPEND);
+	if (fd < 0) {
+		ret = error_errno(_("could not open '%s'"), path);
+		goto out;
+	}
+	if (write_in_full(fd, batch->buf, batch->len) < 0 || fstat(fd, st))
+		ret = error_errno(_("could not write '%s'"), path);
+	if (close(fd) && !ret)
+		ret = error_errno(_("could not close '%s'"), path);
+
+out:
+	free(path);
+	return ret;
+}
+
+int write_index_journal(struct index_state *istate)
+{
+	struct index_journal *j = istate->journal;
+	struct cache_entry **entries = NULL;
+	unsigned int i, nr_entries = 0, alloc_entries = 0;
+	struct strbuf sb = STRBUF_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx c;
+	struct stat st;
+	uint32_t counts[2];
+	int ret = 1;
+
+	if (!j || !j->active || is_null_oid(&j->base_oid) ||
+	    (istate->cache_changed & ~JOURNAL_CHANGES) ||
+	    istate->fsmonitor_last_update || istate->sparse_index ||
+	    !verify_index_journal(istate))
+		return 1;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE) {
+			record_index_journal_removal(istate, ce);
+			continue;
+		}
+		if (!ce_uptodate(ce) && is_racy_timestamp(istate, ce)) {
+			unsigned int size = ce->ce_stat_data.sd_size;
+
+			/*
+			 * An entry on disk only has to be written out again
+			 * if it had to be smudged, as the journal moves the
+			 * index timestamp forward.
+			 */
+			ce_smudge_racily_clean_entry(istate, ce);
+			if (ce->ce_stat_data.sd_size != size)
+				ce->ce_flags |= CE_UPDATE_IN_BASE;
+		}
+		if (ce->index && !(ce->ce_flags & CE_UPDATE_IN_BASE))
+			continue;
+		if (is_null_oid(&ce->oid))
+			goto out; /* let do_write_index() complain */
+		ALLOC_GROW(entries, nr_entries + 1, alloc_entries);
+		entries[nr_entries++] = ce;
+	}
+
+	/* nothing but e.g. the cache tree changed; write it out */
+	if (!nr_entries && !j->removed.nr)
+		goto out;
+	if (too_many_journal_records(istate, nr_entries + j->removed.nr))
+		goto out;
+
+	counts[0] = htonl(j->removed.nr);
+	counts[1] = htonl(nr_entries);
+	strbuf_add(&sb, counts, sizeof(counts));
+	for (i = 0; i < j->removed.nr; i++) {
+		uint32_t flags = htonl((uintptr_t)j->removed.items[i].util
+				       << CE_STAGESHIFT);
+
+		strbuf_add(&sb, &flags, sizeof(flags));
+		strbuf_addstr(&sb, j->removed.items[i].string);
+		strbuf_addch(&sb, '\0');
+	}
+	for (i = 0; i < nr_entries; i++)
+		add_journal_entry(&sb, entries[i]);
+	the_hash_algo->init_fn(&c);
+	the_hash_algo->update_fn(&c, sb.buf, sb.len);
+	the_hash_algo->final_fn(hash, &c);
+	strbuf_add(&sb, hash, the_hash_algo->rawsz);
+
+	ret = append_journal_batch(j, &sb, &st);
+	if (ret)
+		goto out;
+
+	trace2_data_intmax("index", the_repository, "journal/write/entries",
+			   nr_entries);
+	trace2_data_intmax("index", the_repository, "journal/write/removals",
+			   j->removed.nr);
+
+	j->size = st.st_size;
+	j->nr_records += nr_entries + j->removed.nr;
+	string_list_clear(&j->removed, 0);
+	mark_journal_base(istate);
+	istate->timestamp.sec = (unsigned int)st.st_mtime;
+	istate->timestamp.nsec = ST_MTIME_NSEC(st);
+
+out:
+	free(entries);
+	strbuf_release(&sb);
+	return ret;
+}
+
+void finish_writing_index_journal(struct index_state *istate)
+{
+	struct index_journal *j = istate->journal;
+
+	if (!j)
+		return;
+
+	if (!j->active) {
+		/* the index no longer uses a journal */
+		if (j->index_path) {
+			char *path = journal_path(j->index_path);
+			if (unlink(path) && errno != ENOENT)
+				warning_errno(_("could not remove '%s'"), path);
+			free(path);
+		}
+		discard_index_journal(istate);
+		return;
+	}
+
+	/*
+	 * The journal on disk, if any, is left for readers that still
+	 * have the old index open; it no longer matches the new index
+	 * and will be replaced by the next append.
+	 */
+	oidcpy(&j->base_oid, &istate->oid);
+	j->size = 0;
+	j->nr_records = 0;
+	string_list_clear(&j->removed, 0);
+	mark_journal_base(istate);
+}
@@ -0,0 +1,100 @@
+#ifndef INDEX_JOURNAL_H
+#define INDEX_JOURNAL_H
+
+#include "cache.h"
+#include "string-list.h"
+
+struct lock_file;
+
+/*
+ * An index journal is an append-only file next to the index
+ * ("$GIT_DIR/index.journal") that records the entries added, changed
+ * and removed since the index file itself was last written. Readers
+ * replay it on top of the index; writers that only changed a few
+ * entries append them to it instead of rewriting the whole index,
+ * until the journal grows past index.journalMaxPercent of the index
+ * and the next write compacts it into a new index file.
+ *
+ * Entries that are stored on disk, either in the index or in the
+ * journal, have a non-zero "index" field (see mark_journal_base());
+ * entries created since have it zero. Entries modified in place have
+ * CE_UPDATE_IN_BASE set, as with the split index, which is never used
+ * together with a journal.
+ */
+struct index_journal {
+	/* the index file this journal belongs to */
+	char *index_path;
+
+	/*
+	 * Checksum of the index file the journal applies to, or the null
+	 * oid when the index on disk does not use a journal yet.
+	 */
+	struct object_id base_oid;
+
+	/* size of the valid part of the journal, 0 if there is none */
+	off_t size;
+
+	/* number of entries and removals recorded in the journal */
+	unsigned int nr_records;
+
+	/* whether the next full write should set up a journal */
+	unsigned int active : 1;
+
+	/* entries on disk that have been removed, with their stage as util */
+	struct string_list removed;
+};
+
+struct index_journal *init_index_journal(struct index_state *istate);
+
+/*
+ * The journal extension only holds a value that is different each
+ * time the index is written, so that a journal can never be mistaken
+ * for one that belongs to an earlier index file with the same
+ * contents.
+ */
+void write_journal_extension(struct strbuf *sb);
+void discard_index_journal(struct index_state *istate);
+
+/*
+ * Replay "<index_path>.journal" on top of the entries read from
+ * index_path. Called by do_read_index() when the index has a journal
+ * extension.
+ */
+void read_index_journal(struct index_state *istate, const char *index_path);
+
+/*
+ * Check that neither the index nor its journal changed on disk since
+ * they were read. Returns 1 when they did not.
+ */
+int verify_index_journal(const struct index_state *istate);
+
+/*
+ * Decide, before writing the index through "lock", whether the index
+ * journal can be used; the journal extension is only written when it
+ * can.
+ */
+void prepare_index_journal(struct index_state *istate, struct lock_file *lock,
+			   unsigned flags, int alternate_output);
+
+/*
+ * Append the changes since the index was read or last written to the
+ * journal. Returns 0 on success, a negative value on error, and 1 if
+ * the caller should write the whole index instead, e.g. because the
+ * journal would grow too large or something else than index entries
+ * changed.
+ */
+int write_index_journal(struct index_state *istate);
+
+/*
+ * Called after the whole index has been written and committed; starts
+ * a new, empty journal or removes the old one.
+ */
+void finish_writing_index_journal(struct index_state *istate);
+
+void record_index_journal_removal(struct index_state *istate,
+				  const struct cache_entry *ce);
+void replace_index_entry_in_journal(struct index_state *istate,
+				    const struct cache_entry *old_entry,
+				    struct cache_entry *new_entry);
+
+#endif
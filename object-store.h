@@ -50,6 +50,22 @@ void add_to_alternates_file(const char *dir);
  */
 void add_to_alternates_memory(const char *dir);
 
+/*
+ * Replace the current writable object directory with the specified temporary
+ * object directory; returns the former primary object directory, which
+ * stays in the list of object directories behind the new one.
+ */
+struct object_directory *set_temporary_primary_odb(const char *dir);
+
+/*
+ * Restore a previous object directory as the primary object directory, and
+ * free the temporary one at "old_path" that set_temporary_primary_odb()
+ * installed.
+ */
+void restore_primary_odb(struct object_directory *restore_odb, const char *old_path);
+
+void free_object_directory(struct object_directory *odb);
+
 /*
  * Populate and return the loose object cache array corresponding to the
  * given object ID.
@@ -221,6 +237,25 @@ int hash_object_file_literally(const void *buf, unsigned long len,
 			       const char *type, struct object_id *oid,
 			       unsigned flags);
 
+/*
+ * A source of object contents for stream_loose_object(). read() is
+ * called repeatedly and returns the next chunk of data, storing its
+ * length in "len"; it sets is_finished along with the last chunk.
+ */
+struct input_stream {
+	const void *(*read)(struct input_stream *, unsigned long *len);
+	void *data;
+	int is_finished;
+};
+
+/*
+ * Write a blob of "len" bytes read from "in_stream" as a loose object,
+ * deflating and hashing it chunk by chunk so that it never has to be
+ * held in memory, and store its name in "oid".
+ */
+int stream_loose_object(struct input_stream *in_stream, size_t len,
+			struct object_id *oid);
+
 /*
  * Add an object file to the in-memory object store, without writing it
  * to disk.
@@ -300,8 +335,8 @@ void assert_oid_type(const struct object_id *oid, enum object_type expect);
  * obj_read_lock() and obj_read_unlock() may also be used to protect other
  * section which cannot execute in parallel with object reading. Since the used
  * lock is a recursive mutex, these sections can even contain calls to object
- * reading functions. However, beware that in these cases zlib inflation won't
- * be performed in parallel, losing performance.
+ * reading functions. However, beware that in these cases zlib inflation and
+ * delta application won't be performed in parallel, losing performance.
  *
  * TODO: oid_object_info_extended()'s call stack has a recursive behavior. If
  * any of its callees end up calling it, this recursive call won't benefit from
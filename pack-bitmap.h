@@ -25,10 +25,17 @@ struct bitmap_disk_header {
 #define NEEDS_BITMAP (1u<<22)
 
 enum pack_bitmap_opts {
-	BITMAP_OPT_FULL_DAG = 1,
-	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_FULL_DAG = 0x1,
+	BITMAP_OPT_HASH_CACHE = 0x4,
+	BITMAP_OPT_LOOKUP_TABLE = 0x10,
 };
 
+/*
+ * Each entry of the optional lookup table is a (commit position, bitmap
+ * offset, xor row) triplet; see Documentation/technical/bitmap-format.txt.
+ */
+#define BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+
 enum pack_bitmap_flags {
 	BITMAP_FLAG_REUSE = 0x1
 };
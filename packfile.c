@@ -361,7 +361,8 @@ void close_object_store(struct raw_object_store *o)
 
 void unlink_pack_path(const char *pack_name, int force_delete)
 {
-	static const char *exts[] = {".pack", ".idx", ".rev", ".keep", ".bitmap", ".promisor"};
+	static const char *exts[] = {".pack", ".idx", ".rev", ".keep",
+				     ".bitmap", ".promisor", ".hints"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -867,7 +868,8 @@ static void prepare_pack(const char *full_name, size_t full_name_len,
 	    ends_with(file_name, ".pack") ||
 	    ends_with(file_name, ".bitmap") ||
 	    ends_with(file_name, ".keep") ||
-	    ends_with(file_name, ".promisor"))
+	    ends_with(file_name, ".promisor") ||
+	    ends_with(file_name, ".hints"))
 		string_list_append(data->garbage, full_name);
 	else
 		report_garbage(PACKDIR_FILE_GARBAGE, full_name);
@@ -1366,6 +1368,15 @@ struct delta_base_cache_entry {
 	void *data;
 	unsigned long size;
 	enum object_type type;
+
+	/*
+	 * Number of readers currently using "data" without holding the
+	 * obj_read_mutex. An entry that is evicted while still in use
+	 * is only removed from the cache and "orphaned"; the last
+	 * reader frees it.
+	 */
+	unsigned int refcnt;
+	unsigned orphaned : 1;
 };
 
 static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
@@ -1434,11 +1445,44 @@ static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
 	free(ent);
 }
 
+static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
+{
+	if (ent->refcnt) {
+		hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
+		list_del(&ent->lru);
+		delta_base_cached -= ent->size;
+		ent->orphaned = 1;
+		return;
+	}
+	free(ent->data);
+	detach_delta_base_cache_entry(ent);
+}
+
+/*
+ * Pin a cache entry so that its data can be used after dropping the
+ * obj_read_mutex, and mark it as recently used.
+ */
+static void ref_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+{
+	ent->refcnt++;
+	list_del(&ent->lru);
+	list_add_tail(&ent->lru, &delta_base_cache_lru);
+}
+
+static void unref_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+{
+	if (--ent->refcnt || !ent->orphaned)
+		return;
+	free(ent->data);
+	free(ent);
+}
+
 static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 				   off_t base_offset, unsigned long *base_size,
 				   enum object_type *type)
 {
 	struct delta_base_cache_entry *ent;
+	void *data;
 
 	ent = get_delta_base_cache_entry(p, base_offset);
 	if (!ent)
@@ -1448,13 +1492,13 @@ static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 		*type = ent->type;
 	if (base_size)
 		*base_size = ent->size;
-	return xmemdupz(ent->data, ent->size);
-}
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
-{
-	free(ent->data);
-	detach_delta_base_cache_entry(ent);
+	ref_delta_base_cache_entry(ent);
+	obj_read_unlock();
+	data = xmemdupz(ent->data, ent->size);
+	obj_read_lock();
+	unref_delta_base_cache_entry(ent);
+	return data;
 }
 
 void clear_delta_base_cache(void)
@@ -1493,7 +1537,7 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 		release_delta_base_cache(f);
 	}
 
-	ent = xmalloc(sizeof(*ent));
+	CALLOC_ARRAY(ent, 1);
 	ent->key.p = p;
 	ent->key.base_offset = base_offset;
 	ent->type = type;
@@ -1685,6 +1729,7 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	struct unpack_entry_stack_ent *delta_stack = small_delta_stack;
 	int delta_stack_nr = 0, delta_stack_alloc = UNPACK_ENTRY_STACK_PREALLOC;
 	int base_from_cache = 0;
+	struct delta_base_cache_entry *base_ent = NULL;
 
 	write_pack_access_log(p, obj_offset);
 
@@ -1697,9 +1742,22 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		ent = get_delta_base_cache_entry(p, curpos);
 		if (ent) {
 			type = ent->type;
-			data = ent->data;
 			size = ent->size;
-			detach_delta_base_cache_entry(ent);
+			if (delta_stack_nr) {
+				/*
+				 * Leave the base in the cache for other
+				 * readers; we only need it read-only
+				 * while applying the first delta.
+				 */
+				ref_delta_base_cache_entry(ent);
+				base_ent = ent;
+				data = ent->data;
+			} else if (!ent->refcnt) {
+				data = ent->data;
+				detach_delta_base_cache_entry(ent);
+			} else {
+				data = xmemdupz(ent->data, ent->size);
+			}
 			base_from_cache = 1;
 			break;
 		}
@@ -1833,8 +1891,15 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			      (uintmax_t)curpos, p->pack_name);
 			data = NULL;
 		} else {
+			/*
+			 * Both buffers are ours (or, for "base_ent", pinned
+			 * in the cache), so there is no need to hold the
+			 * obj_read_mutex while applying the delta.
+			 */
+			obj_read_unlock();
 			data = patch_delta(base, base_size, delta_data,
 					   delta_size, &size);
+			obj_read_lock();
 
 			/*
 			 * We could not apply the delta; warn the user, but
@@ -1857,7 +1922,10 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		 * thread could free() it (e.g. to make space for another entry)
 		 * before we are done using it.
 		 */
-		if (!external_base)
+		if (base_ent) {
+			unref_delta_base_cache_entry(base_ent);
+			base_ent = NULL;
+		} else if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size, type);
 
 		free(delta_data);
@@ -670,3 +670,310 @@ int run_parallel_checkout(struct checkout *state, int num_workers, int threshold
 	finish_parallel_checkout();
 	return ret;
 }
+
+/*
+ * Removing and creating paths does not need the object store or the
+ * conversion machinery, so unlike writing files it is done by threads
+ * in this process, each with its own lstat cache and its own slice of
+ * the index. Both are kept serial on Windows, where unlink() and
+ * rmdir() may ask the user whether to retry.
+ */
+#ifdef GIT_WINDOWS_NATIVE
+#define PARALLEL_WORKTREE_UPDATES 0
+#else
+#define PARALLEL_WORKTREE_UPDATES HAVE_THREADS
+#endif
+
+struct removal_worker {
+	pthread_t thread;
+	const struct cache_entry **entries;
+	int nr;
+	struct cache_def cache;
+	struct strbuf dirs;
+	/* the first and last entries that were removed, or -1 */
+	int first_removed, last_removed;
+};
+
+static void *removal_worker_thread(void *data)
+{
+	struct removal_worker *w = data;
+	int i;
+
+	for (i = 0; i < w->nr; i++) {
+		const struct cache_entry *ce = w->entries[i];
+
+		/* see unlink_entry() */
+		if (threaded_check_leading_path(&w->cache, ce->name,
+						ce_namelen(ce), 1) >= 0)
+			continue;
+		if (remove_or_warn(ce->ce_mode, ce->name))
+			continue;
+		threaded_schedule_dir_for_removal(&w->cache, &w->dirs,
+						  ce->name, ce_namelen(ce));
+		if (w->first_removed < 0)
+			w->first_removed = i;
+		w->last_removed = i;
+	}
+	threaded_remove_scheduled_dirs(&w->cache, &w->dirs);
+	return NULL;
+}
+
+/*
+ * A directory with entries from more than one worker may have been
+ * left behind by all of them, as each tries to remove it while the
+ * others may still have files in it. Such directories are leading
+ * directories of the first or last entry a worker removed, so try
+ * those again once all workers are done.
+ */
+static void remove_shared_leading_dirs(const char *name)
+{
+	struct strbuf path = STRBUF_INIT;
+	const char *slash;
+
+	strbuf_addstr(&path, name);
+	while ((slash = strrchr(path.buf, '/'))) {
+		strbuf_setlen(&path, slash - path.buf);
+		if (rmdir(path.buf) && errno != ENOENT)
+			break;
+	}
+	strbuf_release(&path);
+}
+
+void unlink_marked_entries(struct index_state *istate,
+			   int num_workers, int threshold,
+			   struct progress *progress,
+			   unsigned int *progress_cnt)
+{
+	const struct cache_entry **entries;
+	struct removal_worker *workers;
+	int i, nr = 0, per_worker;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if ((ce->ce_flags & CE_WT_REMOVE) && !S_ISGITLINK(ce->ce_mode))
+			nr++;
+	}
+	if (nr < num_workers)
+		num_workers = nr;
+
+	if (!PARALLEL_WORKTREE_UPDATES || num_workers <= 1 || nr < threshold) {
+		for (i = 0; i < istate->cache_nr; i++) {
+			const struct cache_entry *ce = istate->cache[i];
+
+			if (ce->ce_flags & CE_WT_REMOVE) {
+				display_progress(progress, ++*progress_cnt);
+				unlink_entry(ce);
+			}
+		}
+		remove_scheduled_dirs();
+		return;
+	}
+
+	trace2_region_enter("checkout", "parallel removal", NULL);
+
+	ALLOC_ARRAY(entries, nr);
+	nr = 0;
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (!(ce->ce_flags & CE_WT_REMOVE))
+			continue;
+		if (S_ISGITLINK(ce->ce_mode)) {
+			/* submodules may need to run commands */
+			display_progress(progress, ++*progress_cnt);
+			unlink_entry(ce);
+			continue;
+		}
+		entries[nr++] = ce;
+	}
+	remove_scheduled_dirs();
+
+	per_worker = DIV_ROUND_UP(nr, num_workers);
+	num_workers = DIV_ROUND_UP(nr, per_worker);
+	trace2_data_intmax("checkout", NULL, "parallel_removal/workers",
+			   num_workers);
+
+	CALLOC_ARRAY(workers, num_workers);
+	for (i = 0; i < num_workers; i++) {
+		struct removal_worker *w = &workers[i];
+		int err;
+
+		w->entries = entries + i * per_worker;
+		w->nr = i == num_workers - 1 ? nr - i * per_worker : per_worker;
+		w->cache = (struct cache_def)CACHE_DEF_INIT;
+		strbuf_init(&w->dirs, 0);
+		w->first_removed = w->last_removed = -1;
+
+		err = pthread_create(&w->thread, NULL, removal_worker_thread, w);
+		if (err)
+			die(_("unable to create threaded removal: %s"),
+			    strerror(err));
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		struct removal_worker *w = &workers[i];
+
+		if (pthread_join(w->thread, NULL))
+			die("unable to join threaded removal");
+		*progress_cnt += w->nr;
+		display_progress(progress, *progress_cnt);
+	}
+
+	/* the workers changed the working tree behind our lstat cache */
+	invalidate_lstat_cache();
+
+	for (i = 0; i < num_workers; i++) {
+		struct removal_worker *w = &workers[i];
+
+		if (w->first_removed >= 0) {
+			if (i > 0)
+				remove_shared_leading_dirs(
+					w->entries[w->first_removed]->name);
+			if (i < num_workers - 1)
+				remove_shared_leading_dirs(
+					w->entries[w->last_removed]->name);
+		}
+		cache_def_clear(&w->cache);
+		strbuf_release(&w->dirs);
+	}
+
+	trace2_region_leave("checkout", "parallel removal", NULL);
+	free(workers);
+	free(entries);
+}
+
+struct mkdir_worker {
+	pthread_t thread;
+	/* leading directories to create, as a path and a length into it */
+	const char **paths;
+	int *lens;
+	int nr;
+	struct cache_def cache;
+};
+
+/*
+ * Returns 0 if "path" is now a directory. Another worker may have
+ * created it first; anything else in the way is left for
+ * checkout_entry(), which knows whether it may be removed.
+ */
+static int mkdir_if_missing(const char *path)
+{
+	struct stat st;
+
+	if (!mkdir(path, 0777))
+		return 0;
+	if (errno == EEXIST && !lstat(path, &st) && S_ISDIR(st.st_mode))
+		return 0;
+	return -1;
+}
+
+static void *mkdir_worker_thread(void *data)
+{
+	struct mkdir_worker *w = data;
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	for (i = 0; i < w->nr; i++) {
+		const char *path = w->paths[i];
+		int path_len = w->lens[i], len = 0;
+
+		strbuf_reset(&buf);
+		strbuf_add(&buf, path, path_len);
+
+		/* see create_directories() */
+		while (len < path_len) {
+			do {
+				len++;
+			} while (len < path_len && path[len] != '/');
+			buf.buf[len] = '\0';
+
+			if (!threaded_has_dirs_only_path(&w->cache, buf.buf,
+							 len, 0) &&
+			    mkdir_if_missing(buf.buf))
+				break;
+			if (len < path_len)
+				buf.buf[len] = '/';
+		}
+	}
+	strbuf_release(&buf);
+	return NULL;
+}
+
+void create_leading_directories_ahead(struct index_state *istate,
+				      int num_workers, int threshold)
+{
+	const char **paths;
+	int *lens;
+	struct mkdir_worker *workers;
+	const char *last = NULL;
+	int i, nr = 0, last_len = 0, nr_updates = 0, per_worker;
+
+	/*
+	 * On a case-insensitive file system, which of "A/" and "a/" gets
+	 * created would depend on the order in which the workers get to
+	 * them.
+	 */
+	if (!PARALLEL_WORKTREE_UPDATES || num_workers <= 1 || ignore_case)
+		return;
+
+	ALLOC_ARRAY(paths, istate->cache_nr);
+	ALLOC_ARRAY(lens, istate->cache_nr);
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+		const char *slash;
+		int len;
+
+		if (!(ce->ce_flags & CE_UPDATE))
+			continue;
+		nr_updates++;
+		slash = strrchr(ce->name, '/');
+		if (!slash)
+			continue;
+		len = slash - ce->name;
+		if (last && len == last_len && !memcmp(last, ce->name, len))
+			continue;
+		paths[nr] = last = ce->name;
+		lens[nr++] = last_len = len;
+	}
+
+	if (nr < num_workers)
+		num_workers = nr;
+	if (num_workers <= 1 || nr_updates < threshold) {
+		free(paths);
+		free(lens);
+		return;
+	}
+
+	trace2_region_enter("checkout", "create leading directories", NULL);
+
+	per_worker = DIV_ROUND_UP(nr, num_workers);
+	num_workers = DIV_ROUND_UP(nr, per_worker);
+	CALLOC_ARRAY(workers, num_workers);
+	for (i = 0; i < num_workers; i++) {
+		struct mkdir_worker *w = &workers[i];
+		int err;
+
+		w->paths = paths + i * per_worker;
+		w->lens = lens + i * per_worker;
+		w->nr = i == num_workers - 1 ? nr - i * per_worker : per_worker;
+		w->cache = (struct cache_def)CACHE_DEF_INIT;
+
+		err = pthread_create(&w->thread, NULL, mkdir_worker_thread, w);
+		if (err)
+			die(_("unable to create threaded mkdir: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < num_workers; i++) {
+		if (pthread_join(workers[i].thread, NULL))
+			die("unable to join threaded mkdir");
+		cache_def_clear(&workers[i].cache);
+	}
+
+	invalidate_lstat_cache();
+	trace2_region_leave("checkout", "create leading directories", NULL);
+
+	free(workers);
+	free(paths);
+	free(lens);
+}
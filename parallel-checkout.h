@@ -5,6 +5,7 @@
 
 struct cache_entry;
 struct checkout;
+struct index_state;
 struct progress;
 
 /****************************************************************
@@ -42,6 +43,28 @@ size_t pc_queue_size(void);
 int run_parallel_checkout(struct checkout *state, int num_workers, int threshold,
 			  struct progress *progress, unsigned int *progress_cnt);
 
+/*
+ * Remove the working tree files of the entries in istate marked with
+ * CE_WT_REMOVE and the directories this leaves empty, as calling
+ * unlink_entry() on each of them followed by remove_scheduled_dirs()
+ * would. If there are at least "threshold" such entries, up to
+ * "num_workers" threads share them; submodules are always handled by
+ * the calling thread.
+ */
+void unlink_marked_entries(struct index_state *istate,
+			   int num_workers, int threshold,
+			   struct progress *progress,
+			   unsigned int *progress_cnt);
+
+/*
+ * Create the leading directories of the entries in istate marked with
+ * CE_UPDATE using up to "num_workers" threads, if there are at least
+ * "threshold" such entries. Directories that cannot simply be created,
+ * e.g. because a file is in the way, are left for checkout_entry().
+ */
+void create_leading_directories_ahead(struct index_state *istate,
+				      int num_workers, int threshold);
+
 /****************************************************************
  * Interface with checkout--worker
  ****************************************************************/
@@ -5,6 +5,37 @@
 #include "attr.h"
 #include "strvec.h"
 #include "quote.h"
+#include "sparse-index.h"
+
+/*
+ * Returns 1 if matching "pathspec" against the entries of "istate"
+ * could give a different result with the sparse directories of the
+ * index expanded, i.e. if it has magic or wildcards, or one of its
+ * paths lies within a sparse directory. A pathspec that names a sparse
+ * directory, or one of its leading directories, matches the sparse
+ * directory entry as a whole.
+ */
+int pathspec_needs_expanded_index(struct index_state *istate,
+				  const struct pathspec *pathspec)
+{
+	int i;
+
+	if (!istate->sparse_index || !pathspec)
+		return 0;
+
+	if (pathspec->magic & ~(PATHSPEC_FROMTOP | PATHSPEC_LITERAL))
+		return 1;
+
+	for (i = 0; i < pathspec->nr; i++) {
+		const struct pathspec_item *item = &pathspec->items[i];
+
+		if (item->nowildcard_len < item->len)
+			return 1;
+		if (path_in_sparse_directory(istate, item->match, item->len))
+			return 1;
+	}
+	return 0;
+}
 
 /*
  * Finds which of the given pathspecs match items in the index.
@@ -37,8 +68,8 @@ void add_pathspec_matches_against_index(const struct pathspec *pathspec,
 			num_unmatched++;
 	if (!num_unmatched)
 		return;
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(istate);
+	if (pathspec_needs_expanded_index(istate, pathspec))
+		ensure_full_index(istate);
 	for (i = 0; i < istate->cache_nr; i++) {
 		const struct cache_entry *ce = istate->cache[i];
 		if (sw_action == PS_IGNORE_SKIP_WORKTREE && ce_skip_worktree(ce))
@@ -70,6 +101,8 @@ char *find_pathspecs_matching_skip_worktree(const struct pathspec *pathspec)
 	char *seen = xcalloc(pathspec->nr, 1);
 	int i;
 
+	if (pathspec_needs_expanded_index(istate, pathspec))
+		ensure_full_index(istate);
 	for (i = 0; i < istate->cache_nr; i++) {
 		struct cache_entry *ce = istate->cache[i];
 		if (ce_skip_worktree(ce))
@@ -149,6 +149,9 @@ static inline int ps_strcmp(const struct pathspec_item *item,
 		return strcmp(s1, s2);
 }
 
+int pathspec_needs_expanded_index(struct index_state *istate,
+				  const struct pathspec *pathspec);
+
 enum ps_skip_worktree_action {
   PS_HEED_SKIP_WORKTREE = 0,
   PS_IGNORE_SKIP_WORKTREE = 1
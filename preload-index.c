@@ -9,6 +9,7 @@
 #include "progress.h"
 #include "thread-utils.h"
 #include "repository.h"
+#include "compat/batch-lstat.h"
 
 /*
  * Mostly randomly chosen maximum thread counts: we
@@ -19,6 +20,12 @@
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
+/*
+ * Number of paths each thread hands to batch_lstat() at once, when the
+ * platform lets us stat many paths with a single system call.
+ */
+#define LSTAT_BATCH (256)
+
 struct progress_data {
 	unsigned long n;
 	struct progress *progress;
@@ -31,9 +38,50 @@ struct thread_data {
 	struct pathspec pathspec;
 	struct progress_data *progress;
 	int offset, nr;
+	int use_batch_lstat;
 	int t2_nr_lstat;
+	int t2_nr_batch_lstat;
 };
 
+static void preload_entry(struct index_state *index, struct cache_entry *ce,
+			  struct stat *st)
+{
+	if (ie_match_stat(index, ce, st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		return;
+	ce_mark_uptodate(ce);
+	mark_fsmonitor_valid(index, ce);
+}
+
+struct preload_batch {
+	struct batch_lstat *b;
+	unsigned int nr;
+	struct cache_entry *ce[LSTAT_BATCH];
+	const char *paths[LSTAT_BATCH];
+	struct stat st[LSTAT_BATCH];
+	int err[LSTAT_BATCH];
+};
+
+static void flush_preload_batch(struct thread_data *p,
+				struct preload_batch *batch)
+{
+	unsigned int i;
+
+	if (!batch->nr)
+		return;
+	if (!batch_lstat(batch->b, batch->nr, batch->paths,
+			 batch->st, batch->err)) {
+		p->t2_nr_batch_lstat += batch->nr;
+	} else {
+		for (i = 0; i < batch->nr; i++)
+			batch->err[i] = lstat(batch->paths[i], &batch->st[i]) ?
+					errno : 0;
+	}
+	for (i = 0; i < batch->nr; i++)
+		if (!batch->err[i])
+			preload_entry(p->index, batch->ce[i], &batch->st[i]);
+	batch->nr = 0;
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -41,12 +89,19 @@ static void *preload_thread(void *_data)
 	struct index_state *index = p->index;
 	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	struct preload_batch *batch = NULL;
+	struct batch_lstat *b;
 
 	nr = p->nr;
 	if (nr + p->offset > index->cache_nr)
 		nr = index->cache_nr - p->offset;
 	last_nr = nr;
 
+	if (p->use_batch_lstat && (b = batch_lstat_init(LSTAT_BATCH))) {
+		CALLOC_ARRAY(batch, 1);
+		batch->b = b;
+	}
+
 	do {
 		struct cache_entry *ce = *cep++;
 		struct stat st;
@@ -75,13 +130,22 @@ static void *preload_thread(void *_data)
 		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
 			continue;
 		p->t2_nr_lstat++;
-		if (lstat(ce->name, &st))
+		if (batch) {
+			batch->ce[batch->nr] = ce;
+			batch->paths[batch->nr] = ce->name;
+			if (++batch->nr == LSTAT_BATCH)
+				flush_preload_batch(p, batch);
 			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		}
+		if (lstat(ce->name, &st))
 			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		preload_entry(index, ce, &st);
 	} while (--nr > 0);
+	if (batch) {
+		flush_preload_batch(p, batch);
+		batch_lstat_release(batch->b);
+		free(batch);
+	}
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
@@ -101,6 +165,8 @@ void preload_index(struct index_state *index,
 	struct thread_data data[MAX_PARALLEL];
 	struct progress_data pd;
 	int t2_sum_lstat = 0;
+	int t2_sum_batch_lstat = 0;
+	int use_batch_lstat;
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
@@ -112,6 +178,7 @@ void preload_index(struct index_state *index,
 		return;
 
 	trace2_region_enter("index", "preload", NULL);
+	use_batch_lstat = git_env_bool("GIT_TEST_BATCH_LSTAT", 1);
 
 	trace_performance_enter();
 	if (threads > MAX_PARALLEL)
@@ -135,6 +202,7 @@ void preload_index(struct index_state *index,
 			copy_pathspec(&p->pathspec, pathspec);
 		p->offset = offset;
 		p->nr = work;
+		p->use_batch_lstat = use_batch_lstat;
 		if (pd.progress)
 			p->progress = &pd;
 		offset += work;
@@ -148,12 +216,15 @@ void preload_index(struct index_state *index,
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
 		t2_sum_lstat += p->t2_nr_lstat;
+		t2_sum_batch_lstat += p->t2_nr_batch_lstat;
 	}
 	stop_progress(&pd.progress);
 
 	trace_performance_leave("preload index");
 
 	trace2_data_intmax("index", NULL, "preload/sum_lstat", t2_sum_lstat);
+	trace2_data_intmax("index", NULL, "preload/sum_batch_lstat",
+			   t2_sum_batch_lstat);
 	trace2_region_leave("index", "preload", NULL);
 }
 
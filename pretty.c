@@ -13,6 +13,7 @@
 #include "gpg-interface.h"
 #include "trailer.h"
 #include "run-command.h"
+#include "commit-graph.h"
 
 static char *user_format;
 static struct cmt_fmt_map {
@@ -792,6 +793,7 @@ struct format_commit_context {
 	const struct pretty_print_context *pretty_ctx;
 	unsigned commit_header_parsed:1;
 	unsigned commit_message_parsed:1;
+	unsigned use_graph_metadata:1;
 	struct signature_check signature_check;
 	enum flush_type flush_type;
 	enum trunc_type truncate;
@@ -1500,9 +1502,21 @@ static size_t format_commit_one(struct strbuf *sb, /* in UTF-8 */
 
 	/* For the rest we have to parse the commit header. */
 	if (!c->commit_header_parsed) {
-		msg = c->message =
-			repo_logmsg_reencode(c->repository, commit,
-					     &c->commit_encoding, "UTF-8");
+		/*
+		 * The commit-graph may know all we need without
+		 * inflating the commit; no need to ask if we already
+		 * have the object in memory.
+		 */
+		msg = c->message = NULL;
+		if (c->use_graph_metadata &&
+		    !get_cached_commit_buffer(c->repository, commit, NULL))
+			msg = c->message =
+				read_commit_metadata_from_graph(c->repository,
+								&commit->object.oid);
+		if (!msg)
+			msg = c->message =
+				repo_logmsg_reencode(c->repository, commit,
+						     &c->commit_encoding, "UTF-8");
 		parse_commit_header(c);
 	}
 
@@ -1735,6 +1749,15 @@ static size_t userformat_want_item(struct strbuf *sb, const char *placeholder,
 	case 'S':
 		w->source = 1;
 		break;
+	case 'b':
+	case 'B':
+	case 'e':
+		w->message = 1;
+		break;
+	case '(':
+		if (starts_with(placeholder, "(trailers"))
+			w->message = 1;
+		break;
 	}
 	return 0;
 }
@@ -1752,6 +1775,28 @@ void userformat_find_requirements(const char *fmt, struct userformat_want *w)
 	strbuf_release(&dummy);
 }
 
+/*
+ * Whether "format" needs no more of the commit than the commit
+ * metadata in the commit-graph has, i.e. the idents, dates and
+ * subject. We are usually called with the same format for many
+ * commits in a row, so remember the last answer.
+ */
+static int userformat_wants_only_metadata(const char *format)
+{
+	static char *last_format;
+	static int last_answer;
+	struct userformat_want w = { 0 };
+
+	if (last_format && !strcmp(last_format, format))
+		return last_answer;
+
+	userformat_find_requirements(format, &w);
+	free(last_format);
+	last_format = xstrdup(format);
+	last_answer = !w.message;
+	return last_answer;
+}
+
 void repo_format_commit_message(struct repository *r,
 				const struct commit *commit,
 				const char *format, struct strbuf *sb,
@@ -1766,6 +1811,7 @@ void repo_format_commit_message(struct repository *r,
 	const char *output_enc = pretty_ctx->output_encoding;
 	const char *utf8 = "UTF-8";
 
+	context.use_graph_metadata = userformat_wants_only_metadata(format);
 	strbuf_expand(sb, format, format_commit_item, &context);
 	rewrap_message_tail(sb, &context, 0, 0, 0);
 
@@ -68,9 +68,13 @@ static inline int cmit_fmt_is_mail(enum cmit_fmt fmt)
 struct userformat_want {
 	unsigned notes:1;
 	unsigned source:1;
+	unsigned message:1;
 };
 
-/* Set the flag "w->notes" if there is placeholder %N in "fmt". */
+/*
+ * Set the flag "w->notes" if there is placeholder %N in "fmt", and
+ * "w->message" if it needs more of the commit message than the subject.
+ */
 void userformat_find_requirements(const char *fmt, struct userformat_want *w);
 
 /*
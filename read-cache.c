@@ -21,12 +21,14 @@
 #include "strbuf.h"
 #include "varint.h"
 #include "split-index.h"
+#include "index-journal.h"
 #include "utf8.h"
 #include "fsmonitor.h"
 #include "thread-utils.h"
 #include "progress.h"
 #include "sparse-index.h"
 #include "csum-file.h"
+#include "ewah/ewok.h"
 
 /* Mask for the name length in ce_flags in the on-disk index */
 
@@ -50,6 +52,7 @@
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
 #define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
+#define CACHE_EXT_JOURNAL 0x6a726e6c	  /* "jrnl" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -116,6 +119,7 @@ static void replace_index_entry(struct index_state *istate, int nr, struct cache
 	struct cache_entry *old = istate->cache[nr];
 
 	replace_index_entry_in_base(istate, old, ce);
+	replace_index_entry_in_journal(istate, old, ce);
 	remove_name_hash(istate, old);
 	discard_cache_entry(old);
 	ce->ce_flags &= ~CE_HASHED;
@@ -550,7 +554,15 @@ int cache_name_stage_compare(const char *name1, int len1, int stage1, const char
 	return 0;
 }
 
-static int index_name_stage_pos(struct index_state *istate, const char *name, int namelen, int stage)
+enum index_search_mode {
+	NO_EXPAND_SPARSE = 0,
+	EXPAND_SPARSE = 1
+};
+
+static int index_name_stage_pos(struct index_state *istate,
+				const char *name, int namelen,
+				int stage,
+				enum index_search_mode search_mode)
 {
 	int first, last;
 
@@ -569,7 +581,7 @@ static int index_name_stage_pos(struct index_state *istate, const char *name, in
 		first = next+1;
 	}
 
-	if (istate->sparse_index &&
+	if (search_mode == EXPAND_SPARSE && istate->sparse_index &&
 	    first > 0) {
 		/* Note: first <= istate->cache_nr */
 		struct cache_entry *ce = istate->cache[first - 1];
@@ -585,7 +597,7 @@ static int index_name_stage_pos(struct index_state *istate, const char *name, in
 		    ce_namelen(ce) < namelen &&
 		    !strncmp(name, ce->name, ce_namelen(ce))) {
 			ensure_full_index(istate);
-			return index_name_stage_pos(istate, name, namelen, stage);
+			return index_name_stage_pos(istate, name, namelen, stage, search_mode);
 		}
 	}
 
@@ -594,7 +606,17 @@ static int index_name_stage_pos(struct index_state *istate, const char *name, in
 
 int index_name_pos(struct index_state *istate, const char *name, int namelen)
 {
-	return index_name_stage_pos(istate, name, namelen, 0);
+	return index_name_stage_pos(istate, name, namelen, 0, EXPAND_SPARSE);
+}
+
+int index_name_pos_sparse(struct index_state *istate, const char *name, int namelen)
+{
+	return index_name_stage_pos(istate, name, namelen, 0, NO_EXPAND_SPARSE);
+}
+
+int index_entry_exists(struct index_state *istate, const char *name, int namelen)
+{
+	return index_name_stage_pos(istate, name, namelen, 0, NO_EXPAND_SPARSE) >= 0;
 }
 
 int remove_index_entry_at(struct index_state *istate, int pos)
@@ -603,6 +625,7 @@ int remove_index_entry_at(struct index_state *istate, int pos)
 
 	record_resolve_undo(istate, ce);
 	remove_name_hash(istate, ce);
+	record_index_journal_removal(istate, ce);
 	save_or_free_index_entry(istate, ce);
 	istate->cache_changed |= CE_ENTRY_REMOVED;
 	istate->cache_nr--;
@@ -632,6 +655,7 @@ void remove_marked_cache_entries(struct index_state *istate, int invalidate)
 								  ce_array[i]->name);
 			}
 			remove_name_hash(istate, ce_array[i]);
+			record_index_journal_removal(istate, ce_array[i]);
 			save_or_free_index_entry(istate, ce_array[i]);
 		}
 		else
@@ -1221,7 +1245,7 @@ static int has_dir_name(struct index_state *istate,
 			 */
 		}
 
-		pos = index_name_stage_pos(istate, name, len, stage);
+		pos = index_name_stage_pos(istate, name, len, stage, EXPAND_SPARSE);
 		if (pos >= 0) {
 			/*
 			 * Found one, but not so fast.  This could
@@ -1321,7 +1345,7 @@ static int add_index_entry_with_check(struct index_state *istate, struct cache_e
 		strcmp(ce->name, istate->cache[istate->cache_nr - 1]->name) > 0)
 		pos = index_pos_to_insert_pos(istate->cache_nr);
 	else
-		pos = index_name_stage_pos(istate, ce->name, ce_namelen(ce), ce_stage(ce));
+		pos = index_name_stage_pos(istate, ce->name, ce_namelen(ce), ce_stage(ce), EXPAND_SPARSE);
 
 	/* existing match? Just replace it. */
 	if (pos >= 0) {
@@ -1356,7 +1380,7 @@ static int add_index_entry_with_check(struct index_state *istate, struct cache_e
 		if (!ok_to_replace)
 			return error(_("'%s' appears as both a file and as a directory"),
 				     ce->name);
-		pos = index_name_stage_pos(istate, ce->name, ce_namelen(ce), ce_stage(ce));
+		pos = index_name_stage_pos(istate, ce->name, ce_namelen(ce), ce_stage(ce), EXPAND_SPARSE);
 		pos = -pos-1;
 	}
 	return pos + 1;
@@ -1585,8 +1609,8 @@ int refresh_index(struct index_state *istate, unsigned int flags,
 	 */
 	preload_index(istate, pathspec, 0);
 	trace2_region_enter("index", "refresh", NULL);
-	/* TODO: audit for interaction with sparse-index. */
-	ensure_full_index(istate);
+	if (pathspec_needs_expanded_index(istate, pathspec))
+		ensure_full_index(istate);
 	for (i = 0; i < istate->cache_nr; i++) {
 		struct cache_entry *ce, *new_entry;
 		int cache_errno = 0;
@@ -1808,6 +1832,10 @@ static int read_index_extension(struct index_state *istate,
 		/* no content, only an indicator */
 		istate->sparse_index = 1;
 		break;
+	case CACHE_EXT_JOURNAL:
+		/* the journal itself is replayed by do_read_index() */
+		init_index_journal(istate);
+		break;
 	default:
 		if (*ext < 'A' || 'Z' < *ext)
 			return error(_("index uses %.4s extension, which we do not understand"),
@@ -2088,6 +2116,141 @@ static unsigned long load_all_cache_entries(struct index_state *istate,
 	return consumed;
 }
 
+/*
+ * Find the name of the on-disk entry at "ondisk" without converting
+ * the entry, and return the size of the entry. With index v4, names
+ * are relative to the name of the previous entry "prev", unless
+ * "first" is set for the first entry of a block.
+ */
+static unsigned long read_ondisk_ce_name(unsigned int version,
+					 const struct ondisk_cache_entry *ondisk,
+					 const struct strbuf *prev,
+					 struct strbuf *name, int first)
+{
+	const uint16_t *flagsp = (const uint16_t *)(ondisk->data + the_hash_algo->rawsz);
+	unsigned int flags = get_be16(flagsp);
+	const char *p = (const char *)(flagsp + ((flags & CE_EXTENDED) ? 2 : 1));
+	size_t len;
+
+	strbuf_reset(name);
+	if (version == 4) {
+		const unsigned char *cp = (const unsigned char *)p;
+		size_t strip_len = decode_varint(&cp);
+
+		if (!first) {
+			if (prev->len < strip_len)
+				die(_("malformed name field in the index, near path '%s'"),
+				    prev->buf);
+			strbuf_add(name, prev->buf, prev->len - strip_len);
+		}
+		p = (const char *)cp;
+		len = strlen(p);
+		strbuf_add(name, p, len);
+		return p + len + 1 - (const char *)ondisk;
+	}
+
+	len = flags & CE_NAMEMASK;
+	if (len == CE_NAMEMASK)
+		len = strlen(p);
+	strbuf_add(name, p, len);
+	return ondisk_cache_entry_size(ondisk_data_size(flags, len));
+}
+
+/*
+ * Load only the "nr" on-disk entries whose name starts with
+ * istate->partial_prefix. The entries are sorted, so those are
+ * contiguous; the entries before them are skipped over without being
+ * converted, and those after them are not looked at when the EOIE
+ * extension tells where the extensions start. With an IEOT extension,
+ * the blocks before the one the prefix starts in are skipped as well.
+ *
+ * Returns the offset of the extensions and stores the position of the
+ * first loaded entry in "*first".
+ */
+static unsigned long load_cache_entries_in_prefix(struct index_state *istate,
+			const char *mmap, unsigned long src_offset,
+			unsigned int nr, size_t extension_offset,
+			struct index_entry_offset_table *ieot,
+			unsigned int *first)
+{
+	const char *prefix = istate->partial_prefix;
+	struct strbuf name = STRBUF_INIT, prev = STRBUF_INIT;
+	struct cache_entry *previous_ce = NULL;
+	unsigned int i = 0, start = 0;
+
+	istate->ce_mem_pool = xmalloc(sizeof(*istate->ce_mem_pool));
+	mem_pool_init(istate->ce_mem_pool, 0);
+	*first = nr;
+
+	/* start at the last block whose first entry sorts before the prefix */
+	if (ieot) {
+		int b, block = 0;
+
+		for (b = 0; b < ieot->nr; b++) {
+			const void *ondisk = mmap + ieot->entries[b].offset;
+
+			read_ondisk_ce_name(istate->version, ondisk, NULL,
+					    &name, 1);
+			if (strcmp(name.buf, prefix) >= 0)
+				break;
+			block = b;
+			start = i;
+			i += ieot->entries[b].nr;
+		}
+		src_offset = ieot->entries[block].offset;
+	}
+
+	for (i = start; i < nr; i++) {
+		const struct ondisk_cache_entry *ondisk = (const void *)(mmap + src_offset);
+		unsigned long consumed;
+		struct cache_entry *ce;
+
+		if (*first == nr) {
+			consumed = read_ondisk_ce_name(istate->version, ondisk,
+						       &prev, &name, i == start);
+			if (!starts_with(name.buf, prefix)) {
+				if (strcmp(name.buf, prefix) > 0)
+					break;
+				strbuf_swap(&name, &prev);
+				src_offset += consumed;
+				continue;
+			}
+			*first = i;
+
+			/* v4 names are relative to the previous entry's */
+			if (istate->version == 4 && i != start) {
+				previous_ce = mem_pool__ce_alloc(istate->ce_mem_pool,
+								 prev.len);
+				memcpy(previous_ce->name, prev.buf, prev.len + 1);
+				previous_ce->ce_namelen = prev.len;
+			}
+		}
+
+		ce = create_from_disk(istate->ce_mem_pool, istate->version,
+				      (struct ondisk_cache_entry *)ondisk,
+				      &consumed, previous_ce);
+		if (!starts_with(ce->name, prefix))
+			break;
+		ALLOC_GROW(istate->cache, istate->cache_nr + 1,
+			   istate->cache_alloc);
+		set_index_entry(istate, istate->cache_nr++, ce);
+		src_offset += consumed;
+		previous_ce = ce;
+	}
+
+	/* without EOIE, walk the remaining entries to find the extensions */
+	for (; !extension_offset && i < nr; i++)
+		src_offset += read_ondisk_ce_name(istate->version,
+						  (const void *)(mmap + src_offset),
+						  NULL, &name, 1);
+	if (!extension_offset)
+		extension_offset = src_offset;
+
+	strbuf_release(&name);
+	strbuf_release(&prev);
+	return extension_offset;
+}
+
 /*
  * Mostly randomly chosen maximum thread counts: we
  * cap the parallelism to online_cpus() threads, and we want
@@ -2201,6 +2364,92 @@ static unsigned long load_cache_entries_threaded(struct index_state *istate, con
 	return consumed;
 }
 
+static int finish_read_index(struct index_state *istate)
+{
+	/*
+	 * TODO trace2: replace "the_repository" with the actual repo instance
+	 * that is associated with the given "istate".
+	 */
+	trace2_data_intmax("index", the_repository, "read/version",
+			   istate->version);
+	trace2_data_intmax("index", the_repository, "read/cache_nr",
+			   istate->cache_nr);
+
+	if (!istate->repo)
+		istate->repo = the_repository;
+	prepare_repo_settings(istate->repo);
+	if (istate->repo->settings.command_requires_full_index)
+		ensure_full_index(istate);
+
+	return istate->cache_nr;
+}
+
+struct shift_fsmonitor_data {
+	struct ewah_bitmap *dirty;
+	size_t first, nr;
+};
+
+static void shift_fsmonitor_dirty(size_t pos, void *data_)
+{
+	struct shift_fsmonitor_data *data = data_;
+
+	if (pos >= data->first && pos < data->first + data->nr)
+		ewah_set(data->dirty, pos - data->first);
+}
+
+/*
+ * Turn the entries and extensions read by load_cache_entries_in_prefix()
+ * into a consistent, if partial, index. "first" is the position of the
+ * first loaded entry in the index file.
+ */
+static int finish_partial_read(struct index_state *istate, const char *path,
+			       int must_exist, unsigned int first)
+{
+	/*
+	 * The split index refers to entries of the shared index by their
+	 * position, and sparse directories would be expanded using the
+	 * cache tree; read those indexes in full.
+	 */
+	if (istate->split_index || istate->sparse_index) {
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+		discard_index(istate);
+		return do_read_index(istate, path, must_exist);
+	}
+
+	/* the fsmonitor bitmap is indexed by position in the index file */
+	if (istate->fsmonitor_dirty) {
+		struct shift_fsmonitor_data data;
+
+		data.dirty = ewah_new();
+		data.first = first;
+		data.nr = istate->cache_nr;
+		ewah_each_bit(istate->fsmonitor_dirty, shift_fsmonitor_dirty, &data);
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = data.dirty;
+	}
+
+	if (istate->journal) {
+		unsigned int i, nr = 0;
+
+		read_index_journal(istate, path);
+		for (i = 0; i < istate->cache_nr; i++) {
+			struct cache_entry *ce = istate->cache[i];
+
+			if (starts_with(ce->name, istate->partial_prefix))
+				istate->cache[nr++] = ce;
+			else
+				discard_cache_entry(ce);
+		}
+		istate->cache_nr = nr;
+	}
+
+	/* the cache tree describes the whole index */
+	cache_tree_free(&istate->cache_tree);
+
+	return finish_read_index(istate);
+}
+
 /* remember to discard_cache() before reading a different cache! */
 int do_read_index(struct index_state *istate, const char *path, int must_exist)
 {
@@ -2245,9 +2494,6 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 
 	oidread(&istate->oid, (const unsigned char *)hdr + mmap_size - the_hash_algo->rawsz);
 	istate->version = ntohl(hdr->hdr_version);
-	istate->cache_nr = ntohl(hdr->hdr_entries);
-	istate->cache_alloc = alloc_nr(istate->cache_nr);
-	CALLOC_ARRAY(istate->cache, istate->cache_alloc);
 	istate->initialized = 1;
 
 	p.istate = istate;
@@ -2256,6 +2502,29 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 
 	src_offset = sizeof(*hdr);
 
+	if (istate->partial_prefix) {
+		unsigned int first;
+
+		extension_offset = read_eoie_extension(mmap, mmap_size);
+		if (extension_offset)
+			ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
+		p.src_offset = load_cache_entries_in_prefix(istate, mmap, src_offset,
+							    ntohl(hdr->hdr_entries),
+							    extension_offset,
+							    ieot, &first);
+		free(ieot);
+		load_index_extensions(&p);
+		munmap((void *)mmap, mmap_size);
+
+		istate->timestamp.sec = st.st_mtime;
+		istate->timestamp.nsec = ST_MTIME_NSEC(st);
+		return finish_partial_read(istate, path, must_exist, first);
+	}
+
+	istate->cache_nr = ntohl(hdr->hdr_entries);
+	istate->cache_alloc = alloc_nr(istate->cache_nr);
+	CALLOC_ARRAY(istate->cache, istate->cache_alloc);
+
 	if (git_config_get_index_threads(&nr_threads))
 		nr_threads = 1;
 
@@ -2312,22 +2581,10 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	}
 	munmap((void *)mmap, mmap_size);
 
-	/*
-	 * TODO trace2: replace "the_repository" with the actual repo instance
-	 * that is associated with the given "istate".
-	 */
-	trace2_data_intmax("index", the_repository, "read/version",
-			   istate->version);
-	trace2_data_intmax("index", the_repository, "read/cache_nr",
-			   istate->cache_nr);
-
-	if (!istate->repo)
-		istate->repo = the_repository;
-	prepare_repo_settings(istate->repo);
-	if (istate->repo->settings.command_requires_full_index)
-		ensure_full_index(istate);
+	if (istate->journal)
+		read_index_journal(istate, path);
 
-	return istate->cache_nr;
+	return finish_read_index(istate);
 
 unmap:
 	munmap((void *)mmap, mmap_size);
@@ -2431,6 +2688,8 @@ int discard_index(struct index_state *istate)
 	FREE_AND_NULL(istate->cache);
 	istate->cache_alloc = 0;
 	discard_split_index(istate);
+	discard_index_journal(istate);
+	FREE_AND_NULL(istate->partial_prefix);
 	free_untracked_cache(istate->untracked);
 	istate->untracked = NULL;
 
@@ -2539,8 +2798,8 @@ static int write_index_ext_header(struct hashfile *f,
 	return 0;
 }
 
-static void ce_smudge_racily_clean_entry(struct index_state *istate,
-					 struct cache_entry *ce)
+void ce_smudge_racily_clean_entry(struct index_state *istate,
+				  struct cache_entry *ce)
 {
 	/*
 	 * The only thing we care about in this function is to smudge the
@@ -2700,7 +2959,7 @@ static int verify_index_from(const struct index_state *istate, const char *path)
 		goto out;
 
 	close(fd);
-	return 1;
+	return verify_index_journal(istate);
 
 out:
 	close(fd);
@@ -3003,6 +3262,18 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		if (write_index_ext_header(f, eoie_c, CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0)
 			return -1;
 	}
+	if (!strip_extensions && istate->journal && istate->journal->active &&
+	    !istate->split_index) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_journal_extension(&sb);
+		err = write_index_ext_header(f, eoie_c, CACHE_EXT_JOURNAL,
+					     sb.len) < 0;
+		hashwrite(f, sb.buf, sb.len);
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
 
 	/*
 	 * CACHE_EXT_ENDOFINDEXENTRIES must be written as the last entry before the SHA1
@@ -3057,6 +3328,15 @@ static int commit_locked_index(struct lock_file *lk)
 		return commit_lock_file(lk);
 }
 
+static void run_post_index_change_hook(struct index_state *istate)
+{
+	run_hook_le(NULL, "post-index-change",
+			istate->updated_workdir ? "1" : "0",
+			istate->updated_skipworktree ? "1" : "0", NULL);
+	istate->updated_workdir = 0;
+	istate->updated_skipworktree = 0;
+}
+
 static int do_write_locked_index(struct index_state *istate, struct lock_file *lock,
 				 unsigned flags)
 {
@@ -3090,12 +3370,7 @@ static int do_write_locked_index(struct index_state *istate, struct lock_file *l
 	else
 		ret = close_lock_file_gently(lock);
 
-	run_hook_le(NULL, "post-index-change",
-			istate->updated_workdir ? "1" : "0",
-			istate->updated_skipworktree ? "1" : "0", NULL);
-	istate->updated_workdir = 0;
-	istate->updated_skipworktree = 0;
-
+	run_post_index_change_hook(istate);
 	return ret;
 }
 
@@ -3240,6 +3515,9 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	int new_shared_index, ret;
 	struct split_index *si = istate->split_index;
 
+	if (istate->partial_prefix)
+		BUG("cannot write a partially read index");
+
 	if (git_env_bool("GIT_TEST_CHECK_CACHE_TREE", 0))
 		cache_tree_verify(the_repository, istate);
 
@@ -3252,6 +3530,18 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	if (istate->fsmonitor_last_update)
 		fill_fsmonitor_bitmap(istate);
 
+	prepare_index_journal(istate, lock, flags, !!alternate_index_output);
+	if (!si && istate->journal && istate->journal->active &&
+	    verify_index_from(istate, istate->journal->index_path)) {
+		ret = write_index_journal(istate);
+		if (ret <= 0) {
+			if (!ret)
+				run_post_index_change_hook(istate);
+			rollback_lock_file(lock);
+			return ret;
+		}
+	}
+
 	if (!si || alternate_index_output ||
 	    (istate->cache_changed & ~EXTMASK)) {
 		if (si)
@@ -3302,6 +3592,8 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	}
 
 out:
+	if (!ret && (flags & COMMIT_LOCK) && !alternate_index_output)
+		finish_writing_index_journal(istate);
 	if (flags & COMMIT_LOCK)
 		rollback_lock_file(lock);
 	return ret;
@@ -156,6 +156,7 @@ enum atom_type {
 	ATOM_IF,
 	ATOM_THEN,
 	ATOM_ELSE,
+	ATOM_AHEADBEHIND,
 };
 
 /*
@@ -205,6 +206,10 @@ static struct used_atom {
 		} email_option;
 		struct refname_atom refname;
 		char *head;
+		struct {
+			const char *name;
+			struct commit *commit;
+		} ahead_behind_base;
 	} u;
 } *used_atom;
 static int used_atom_cnt, need_tagged, need_symref;
@@ -550,6 +555,16 @@ static int head_atom_parser(const struct ref_format *format, struct used_atom *a
 	return 0;
 }
 
+static int ahead_behind_atom_parser(const struct ref_format *format,
+				    struct used_atom *atom,
+				    const char *arg, struct strbuf *err)
+{
+	if (!arg)
+		return strbuf_addf_ret(err, -1, _("expected format: %%(ahead-behind:<committish>)"));
+	atom->u.ahead_behind_base.name = arg;
+	return 0;
+}
+
 static struct {
 	const char *name;
 	info_source source;
@@ -598,6 +613,7 @@ static struct {
 	[ATOM_IF] = { "if", SOURCE_NONE, FIELD_STR, if_atom_parser },
 	[ATOM_THEN] = { "then", SOURCE_NONE },
 	[ATOM_ELSE] = { "else", SOURCE_NONE },
+	[ATOM_AHEADBEHIND] = { "ahead-behind", SOURCE_OTHER, FIELD_STR, ahead_behind_atom_parser },
 	/*
 	 * Please update $__git_ref_fieldlist in git-completion.bash
 	 * when you add new atoms
@@ -1553,16 +1569,34 @@ static const char *show_ref(struct refname_atom *atom, const char *refname)
 		return xstrdup(refname);
 }
 
+/*
+ * Like stat_tracking_info(), but use the counts filter_ahead_behind()
+ * found if there are any.
+ */
+static int get_tracking_info(struct used_atom *atom, struct branch *branch,
+			     const struct ahead_behind_count *counts,
+			     int *num_ours, int *num_theirs)
+{
+	if (!counts)
+		return stat_tracking_info(branch, num_ours, num_theirs,
+					  NULL, atom->u.remote_ref.push,
+					  AHEAD_BEHIND_FULL);
+	*num_ours = counts->ahead;
+	*num_theirs = counts->behind;
+	return *num_ours || *num_theirs;
+}
+
 static void fill_remote_ref_details(struct used_atom *atom, const char *refname,
-				    struct branch *branch, const char **s)
+				    struct branch *branch,
+				    const struct ahead_behind_count *counts,
+				    const char **s)
 {
 	int num_ours, num_theirs;
 	if (atom->u.remote_ref.option == RR_REF)
 		*s = show_ref(&atom->u.remote_ref.refname, refname);
 	else if (atom->u.remote_ref.option == RR_TRACK) {
-		if (stat_tracking_info(branch, &num_ours, &num_theirs,
-				       NULL, atom->u.remote_ref.push,
-				       AHEAD_BEHIND_FULL) < 0) {
+		if (get_tracking_info(atom, branch, counts,
+				      &num_ours, &num_theirs) < 0) {
 			*s = xstrdup(msgs.gone);
 		} else if (!num_ours && !num_theirs)
 			*s = xstrdup("");
@@ -1579,9 +1613,8 @@ static void fill_remote_ref_details(struct used_atom *atom, const char *refname,
 			free((void *)to_free);
 		}
 	} else if (atom->u.remote_ref.option == RR_TRACKSHORT) {
-		if (stat_tracking_info(branch, &num_ours, &num_theirs,
-				       NULL, atom->u.remote_ref.push,
-				       AHEAD_BEHIND_FULL) < 0) {
+		if (get_tracking_info(atom, branch, counts,
+				      &num_ours, &num_theirs) < 0) {
 			*s = xstrdup("");
 			return;
 		}
@@ -1653,11 +1686,79 @@ static const char *get_refname(struct used_atom *atom, struct ref_array_item *re
 	return show_ref(&atom->u.refname, ref->refname);
 }
 
+/*
+ * Whether the atoms that look into the object, or with "deref" into the
+ * object a tag points at, only want what the commit metadata in the
+ * commit-graph has, should the object be a commit.
+ */
+static int atoms_want_only_commit_metadata(int deref)
+{
+	int i;
+
+	for (i = 0; i < used_atom_cnt; i++) {
+		struct used_atom *atom = &used_atom[i];
+
+		if (!!deref != (*atom->name == '*'))
+			continue;
+		switch (atom->atom_type) {
+		case ATOM_OBJECTSIZE:
+		case ATOM_DELTABASE:
+			return 0;
+		case ATOM_SUBJECT:
+		case ATOM_BODY:
+		case ATOM_TRAILERS:
+		case ATOM_CONTENTS:
+			if (atom->u.contents.option != C_SUB &&
+			    atom->u.contents.option != C_SUB_SANITIZE)
+				return 0;
+			break;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Fill the values from the commit metadata in the commit-graph instead
+ * of reading the object. Returns -1 if we cannot, e.g. when the object
+ * is not a commit in the commit-graph.
+ */
+static int get_object_from_commit_metadata(struct ref_array_item *ref,
+					   int deref, struct object **obj,
+					   struct expand_data *oi)
+{
+	struct commit *commit;
+	char *buf;
+
+	if (!oi->info.contentp || !atoms_want_only_commit_metadata(deref))
+		return -1;
+	buf = read_commit_metadata_from_graph(the_repository, &oi->oid);
+	if (!buf)
+		return -1;
+
+	commit = lookup_commit(the_repository, &oi->oid);
+	if (!commit || parse_commit(commit)) {
+		free(buf);
+		return -1;
+	}
+	oi->type = OBJ_COMMIT;
+	*obj = &commit->object;
+	grab_values(ref->value, deref, *obj, buf);
+	grab_common_values(ref->value, deref, oi);
+	free(buf);
+	return 0;
+}
+
 static int get_object(struct ref_array_item *ref, int deref, struct object **obj,
 		      struct expand_data *oi, struct strbuf *err)
 {
 	/* parse_object_buffer() will set eaten to 0 if free() will be needed */
 	int eaten = 1;
+
+	if (!get_object_from_commit_metadata(ref, deref, obj, oi))
+		return 0;
+
 	if (oi->info.contentp) {
 		/* We need to know that to use parse_object_buffer properly */
 		oi->info.sizep = &oi->size;
@@ -1732,6 +1833,38 @@ static char *get_worktree_path(const struct used_atom *atom, const struct ref_ar
 	return xstrdup(lookup_result->wt->path);
 }
 
+static struct commit *get_ahead_behind_base(struct used_atom *atom)
+{
+	const char *name = atom->u.ahead_behind_base.name;
+
+	if (!atom->u.ahead_behind_base.commit) {
+		atom->u.ahead_behind_base.commit =
+			lookup_commit_reference_by_name(name);
+		if (!atom->u.ahead_behind_base.commit)
+			die(_("failed to find '%s'"), name);
+	}
+	return atom->u.ahead_behind_base.commit;
+}
+
+static const char *get_ahead_behind(struct used_atom *atom,
+				    struct ref_array_item *ref,
+				    const struct ahead_behind_count *counts)
+{
+	struct ahead_behind_count count = { 0, 1 };
+	struct commit *commits[2];
+
+	if (!counts) {
+		commits[0] = lookup_commit_reference_gently(the_repository,
+							    &ref->objectname, 1);
+		if (!commits[0])
+			return xstrdup("");
+		commits[1] = get_ahead_behind_base(atom);
+		ahead_behind(the_repository, commits, 2, &count, 1);
+		counts = &count;
+	}
+	return xstrfmt("%u %u", counts->ahead, counts->behind);
+}
+
 /*
  * Parse the object referred by ref, and grab needed value.
  */
@@ -1791,7 +1924,9 @@ static int populate_value(struct ref_array_item *ref, struct strbuf *err)
 
 			refname = branch_get_upstream(branch, NULL);
 			if (refname)
-				fill_remote_ref_details(atom, refname, branch, &v->s);
+				fill_remote_ref_details(atom, refname, branch,
+							ref->counts ? ref->counts[i] : NULL,
+							&v->s);
 			else
 				v->s = xstrdup("");
 			continue;
@@ -1812,7 +1947,9 @@ static int populate_value(struct ref_array_item *ref, struct strbuf *err)
 			}
 			/* We will definitely re-init v->s on the next line. */
 			free((char *)v->s);
-			fill_remote_ref_details(atom, refname, branch, &v->s);
+			fill_remote_ref_details(atom, refname, branch,
+						ref->counts ? ref->counts[i] : NULL,
+						&v->s);
 			continue;
 		} else if (atom_type == ATOM_COLOR) {
 			v->s = xstrdup(atom->u.color);
@@ -1863,6 +2000,10 @@ static int populate_value(struct ref_array_item *ref, struct strbuf *err)
 			v->handler = else_atom_handler;
 			v->s = xstrdup("");
 			continue;
+		} else if (atom_type == ATOM_AHEADBEHIND) {
+			v->s = get_ahead_behind(atom, ref,
+						ref->counts ? ref->counts[i] : NULL);
+			continue;
 		} else
 			continue;
 
@@ -2206,6 +2347,7 @@ static int ref_filter_handler(const char *refname, const struct object_id *oid,
 static void free_array_item(struct ref_array_item *item)
 {
 	free((char *)item->symref);
+	free(item->counts);
 	if (item->value) {
 		int i;
 		for (i = 0; i < used_atom_cnt; i++)
@@ -2224,6 +2366,8 @@ void ref_array_clear(struct ref_array *array)
 		free_array_item(array->items[i]);
 	FREE_AND_NULL(array->items);
 	array->nr = array->alloc = 0;
+	FREE_AND_NULL(array->counts);
+	array->counts_nr = 0;
 
 	for (i = 0; i < used_atom_cnt; i++)
 		free((char *)used_atom[i].name);
@@ -2351,6 +2495,117 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 	return ret;
 }
 
+define_commit_slab(commit_pos, size_t);
+
+static int needs_ahead_behind(struct used_atom *atom)
+{
+	if (atom->atom_type == ATOM_AHEADBEHIND)
+		return 1;
+	if (atom->atom_type != ATOM_UPSTREAM && atom->atom_type != ATOM_PUSH)
+		return 0;
+	return atom->u.remote_ref.option == RR_TRACK ||
+	       atom->u.remote_ref.option == RR_TRACKSHORT;
+}
+
+/*
+ * Find the commit that the ":track" variant of "atom" compares the
+ * branch "refname" with, as stat_tracking_info() would.
+ */
+static struct commit *get_tracking_base(struct repository *r,
+					struct used_atom *atom,
+					const char *refname)
+{
+	const char *branch_name, *base;
+	struct branch *branch;
+	struct object_id oid;
+
+	if (!skip_prefix(refname, "refs/heads/", &branch_name))
+		return NULL;
+	branch = branch_get(branch_name);
+	base = atom->u.remote_ref.push ? branch_get_push(branch, NULL) :
+		branch_get_upstream(branch, NULL);
+	if (!base || read_ref(base, &oid))
+		return NULL;
+	return lookup_commit_reference_gently(r, &oid, 1);
+}
+
+/* Return the position of "c" in "commits", adding it if needed. */
+static size_t add_ahead_behind_commit(struct commit_pos *pos,
+				      struct commit **commits,
+				      size_t *commits_nr, struct commit *c)
+{
+	size_t *p = commit_pos_at(pos, c);
+
+	if (!*p) {
+		commits[*commits_nr] = c;
+		*p = ++*commits_nr;
+	}
+	return *p - 1;
+}
+
+void filter_ahead_behind(struct repository *r,
+			 struct ref_format *format,
+			 struct ref_array *array)
+{
+	struct commit **commits;
+	struct commit_pos pos;
+	size_t commits_nr = 0, nr_atoms = 0, i;
+	int j;
+
+	for (j = 0; j < used_atom_cnt; j++)
+		if (needs_ahead_behind(&used_atom[j]))
+			nr_atoms++;
+	if (!nr_atoms || !array->nr)
+		return;
+
+	init_commit_pos(&pos);
+	ALLOC_ARRAY(commits, st_mult(array->nr, st_add(nr_atoms, 1)));
+	FREE_AND_NULL(array->counts);
+	CALLOC_ARRAY(array->counts, st_mult(array->nr, nr_atoms));
+	array->counts_nr = 0;
+
+	for (i = 0; i < array->nr; i++) {
+		struct ref_array_item *item = array->items[i];
+		struct commit *tip;
+		size_t tip_index;
+
+		tip = lookup_commit_reference_gently(r, &item->objectname, 1);
+		if (!tip)
+			continue;
+		tip_index = add_ahead_behind_commit(&pos, commits,
+						    &commits_nr, tip);
+
+		FREE_AND_NULL(item->counts);
+		CALLOC_ARRAY(item->counts, used_atom_cnt);
+		for (j = 0; j < used_atom_cnt; j++) {
+			struct used_atom *atom = &used_atom[j];
+			struct ahead_behind_count *count;
+			struct commit *base;
+
+			if (!needs_ahead_behind(atom))
+				continue;
+			if (atom->atom_type == ATOM_AHEADBEHIND)
+				base = get_ahead_behind_base(atom);
+			else
+				base = get_tracking_base(r, atom, item->refname);
+			if (!base)
+				continue;
+
+			count = &array->counts[array->counts_nr++];
+			count->tip_index = tip_index;
+			count->base_index = add_ahead_behind_commit(&pos, commits,
+								    &commits_nr,
+								    base);
+			item->counts[j] = count;
+		}
+	}
+
+	ahead_behind(r, commits, commits_nr, array->counts, array->counts_nr);
+
+	free(commits);
+	clear_commit_pos(&pos);
+}
+
 static int compare_detached_head(struct ref_array_item *a, struct ref_array_item *b)
 {
 	if (!(a->kind ^ b->kind))
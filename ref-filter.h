@@ -24,6 +24,7 @@
 #define FILTER_REFS_KIND_MASK      (FILTER_REFS_ALL | FILTER_REFS_DETACHED_HEAD)
 
 struct atom_value;
+struct ahead_behind_count;
 
 struct ref_sorting {
 	struct ref_sorting *next;
@@ -43,6 +44,8 @@ struct ref_array_item {
 	const char *symref;
 	struct commit *commit;
 	struct atom_value *value;
+	/* indexed like the used atoms, filled by filter_ahead_behind() */
+	struct ahead_behind_count **counts;
 	char refname[FLEX_ARRAY];
 };
 
@@ -50,6 +53,9 @@ struct ref_array {
 	int nr, alloc;
 	struct ref_array_item **items;
 	struct rev_info *revs;
+
+	struct ahead_behind_count *counts;
+	size_t counts_nr;
 };
 
 struct ref_filter {
@@ -110,6 +116,16 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 void ref_array_clear(struct ref_array *array);
 /*  Used to verify if the given format is correct and to parse out the used atoms */
 int verify_ref_format(struct ref_format *format);
+/*
+ * Compute the ahead/behind counts needed by the format, i.e. those of
+ * %(ahead-behind:<committish>) and the ":track" and ":trackshort"
+ * variants of %(upstream) and %(push), for all refs in the array in a
+ * single walk. Call it after verify_ref_format() and before sorting
+ * or formatting the refs; without it each ref is walked separately.
+ */
+void filter_ahead_behind(struct repository *r,
+			 struct ref_format *format,
+			 struct ref_array *array);
 /*  Sort the given ref_array as per the ref_sorting provided */
 void ref_array_sort(struct ref_sorting *sort, struct ref_array *array);
 /*  Set REF_SORTING_* sort_flags for all elements of a sorting list */
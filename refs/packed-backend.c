@@ -6,6 +6,7 @@
 #include "../iterator.h"
 #include "../lockfile.h"
 #include "../chdir-notify.h"
+#include "../csum-file.h"
 
 enum mmap_strategy {
 	/*
@@ -37,6 +38,7 @@ static enum mmap_strategy mmap_strategy = MMAP_OK;
 #endif
 
 struct packed_ref_store;
+struct packed_refs_index;
 
 /*
  * A `snapshot` represents one snapshot of a `packed-refs` file.
@@ -92,6 +94,13 @@ struct snapshot {
 	 */
 	enum { PEELED_NONE, PEELED_TAGS, PEELED_FULLY } peeled;
 
+	/*
+	 * The `packed-refs.idx` file describing the records between
+	 * `start` and `eof`, if one was found that matches the
+	 * `packed-refs` file; otherwise, NULL.
+	 */
+	struct packed_refs_index *index;
+
 	/*
 	 * Count of references to this instance, including the pointer
 	 * from `packed_ref_store::snapshot`, if any. The instance
@@ -149,6 +158,12 @@ struct packed_ref_store {
 	 * `packed_ref_store`) must not be freed.
 	 */
 	struct tempfile *tempfile;
+
+	/*
+	 * The records written to `tempfile`, if a `packed-refs.idx`
+	 * file is to be written alongside it; otherwise, NULL.
+	 */
+	struct packed_refs_index_builder *index_builder;
 };
 
 /*
@@ -164,6 +179,8 @@ static void acquire_snapshot(struct snapshot *snapshot)
  * memory and close the file, or free the memory. Then set the buffer
  * pointers to NULL.
  */
+static void free_packed_refs_index(struct packed_refs_index *index);
+
 static void clear_snapshot_buffer(struct snapshot *snapshot)
 {
 	if (snapshot->mmapped) {
@@ -175,6 +192,8 @@ static void clear_snapshot_buffer(struct snapshot *snapshot)
 		free(snapshot->buf);
 	}
 	snapshot->buf = snapshot->start = snapshot->eof = NULL;
+	free_packed_refs_index(snapshot->index);
+	snapshot->index = NULL;
 }
 
 /*
@@ -466,14 +485,13 @@ static void verify_buffer_safe(struct snapshot *snapshot)
 
 /*
  * Depending on `mmap_strategy`, either mmap or read the contents of
- * the `packed-refs` file into the snapshot. Return 1 if the file
- * existed and was read, or 0 if the file was absent or empty. Die on
- * errors.
+ * the `packed-refs` file into the snapshot, and store the file's
+ * metadata in `st`. Return 1 if the file existed and was read, or 0
+ * if the file was absent or empty. Die on errors.
  */
-static int load_contents(struct snapshot *snapshot)
+static int load_contents(struct snapshot *snapshot, struct stat *st)
 {
 	int fd;
-	struct stat st;
 	size_t size;
 	ssize_t bytes_read;
 
@@ -495,9 +513,9 @@ static int load_contents(struct snapshot *snapshot)
 
 	stat_validity_update(&snapshot->validity, fd);
 
-	if (fstat(fd, &st) < 0)
+	if (fstat(fd, st) < 0)
 		die_errno("couldn't stat %s", snapshot->refs->path);
-	size = xsize_t(st.st_size);
+	size = xsize_t(st->st_size);
 
 	if (!size) {
 		close(fd);
@@ -581,6 +599,303 @@ static const char *find_reference_location(struct snapshot *snapshot,
 		return lo;
 }
 
+/*
+ * A `packed-refs.idx` file lets us look up references in a sorted
+ * `packed-refs` file without parsing its text. It is written next to
+ * `packed-refs` whenever `core.packedRefsIndex` is set, and consists
+ * of the following, with all numbers in network byte order:
+ *
+ *   - A 4-byte signature ("PRIX"), a 4-byte version (1) and a 4-byte
+ *     hash function identifier (1 for SHA-1, 2 for SHA-256).
+ *
+ *   - The 4-byte numbers of records, of peeled values and of
+ *     prefixes in the tables below.
+ *
+ *   - The 8-byte size of the `packed-refs` file, followed by the hash
+ *     of its contents as of when the index was written. An index
+ *     whose size or hash doesn't match the `packed-refs` file is
+ *     ignored; stat data would not notice another program rewriting
+ *     the file with the same size within the same second.
+ *
+ *   - A table of fixed-width records, one for each reference in the
+ *     order of the `packed-refs` file: the 8-byte offset of the
+ *     refname relative to the first record of `packed-refs`, its
+ *     4-byte length, 4 bytes of flags and the reference's object ID.
+ *     The low 31 bits of the flags hold one plus the position of the
+ *     reference's peeled value, or zero if it has none; the high bit
+ *     is set if the refname fails check_refname_format().
+ *
+ *   - A table of peeled object IDs.
+ *
+ *   - A table of prefixes, sorted: for each distinct "refs/<x>/"
+ *     that starts at least one refname, the 4-byte position of the
+ *     first record starting with it, the 4-byte number of such
+ *     records and the 4-byte length of the prefix, which is read
+ *     from the first record's refname.
+ *
+ *   - A checksum of all of the above.
+ */
+#define PACKED_REFS_INDEX_SIGNATURE 0x50524958 /* "PRIX" */
+#define PACKED_REFS_INDEX_VERSION 1
+#define PACKED_REFS_INDEX_HEADER_SIZE(rawsz) (6 * 4 + 8 + (rawsz))
+#define PACKED_REFS_INDEX_PREFIX_SIZE (3 * 4)
+
+#define INDEX_REF_BAD_NAME (1U << 31)
+#define INDEX_REF_PEELED_MASK (~INDEX_REF_BAD_NAME)
+
+struct packed_refs_index {
+	const unsigned char *data;
+	size_t size;
+	int mmapped;
+
+	uint32_t nr, nr_peeled, nr_prefixes;
+	size_t record_size;
+	const unsigned char *records, *peeled, *prefixes;
+};
+
+static void free_packed_refs_index(struct packed_refs_index *index)
+{
+	if (!index)
+		return;
+	if (index->mmapped)
+		munmap((void *)index->data, index->size);
+	else
+		free((void *)index->data);
+	free(index);
+}
+
+static uint32_t packed_refs_index_hash_id(void)
+{
+	return hash_algo_by_ptr(the_hash_algo) == GIT_HASH_SHA256 ? 2 : 1;
+}
+
+/*
+ * Load the `packed-refs.idx` file for the `packed-refs` file whose
+ * contents are in `snapshot` into `snapshot->index`, provided that it
+ * exists and was written for these very contents. Any problem with
+ * the index file only means that we fall back to reading the text.
+ */
+static void load_packed_refs_index(struct snapshot *snapshot)
+{
+	struct packed_refs_index *index;
+	char *path = xstrfmt("%s.idx", snapshot->refs->path);
+	const unsigned char *p;
+	struct stat idx_st;
+	git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	size_t size, rawsz = the_hash_algo->rawsz;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			warning_errno("couldn't read %s", path);
+		free(path);
+		return;
+	}
+	if (fstat(fd, &idx_st) < 0) {
+		warning_errno("couldn't stat %s", path);
+		close(fd);
+		free(path);
+		return;
+	}
+
+	CALLOC_ARRAY(index, 1);
+	size = index->size = xsize_t(idx_st.st_size);
+	if (size < PACKED_REFS_INDEX_HEADER_SIZE(rawsz) + rawsz) {
+		warning("%s is too small", path);
+		goto fail;
+	}
+	if (mmap_strategy == MMAP_OK) {
+		index->data = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		index->mmapped = 1;
+	} else {
+		unsigned char *buf = xmalloc(size);
+
+		index->data = buf;
+		if (read_in_full(fd, buf, size) != size) {
+			warning_errno("couldn't read %s", path);
+			goto fail;
+		}
+	}
+
+	p = index->data;
+	if (get_be32(p) != PACKED_REFS_INDEX_SIGNATURE ||
+	    get_be32(p + 4) != PACKED_REFS_INDEX_VERSION) {
+		warning("%s has an unknown format", path);
+		goto fail;
+	}
+	if (get_be32(p + 8) != packed_refs_index_hash_id())
+		goto fail;
+
+	/* Written for a different `packed-refs` file? */
+	if (get_be64(p + 24) != (uint64_t)(snapshot->eof - snapshot->buf))
+		goto stale;
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, snapshot->buf,
+				 snapshot->eof - snapshot->buf);
+	the_hash_algo->final_fn(hash, &ctx);
+	if (!hasheq(hash, p + 32))
+		goto stale;
+
+	index->nr = get_be32(p + 12);
+	index->nr_peeled = get_be32(p + 16);
+	index->nr_prefixes = get_be32(p + 20);
+	index->record_size = 16 + rawsz;
+	if (size - PACKED_REFS_INDEX_HEADER_SIZE(rawsz) - rawsz !=
+	    st_add3(st_mult(index->nr, index->record_size),
+		    st_mult(index->nr_peeled, rawsz),
+		    st_mult(index->nr_prefixes, PACKED_REFS_INDEX_PREFIX_SIZE))) {
+		warning("%s is corrupt", path);
+		goto fail;
+	}
+
+	index->records = p + PACKED_REFS_INDEX_HEADER_SIZE(rawsz);
+	index->peeled = index->records + st_mult(index->nr, index->record_size);
+	index->prefixes = index->peeled + st_mult(index->nr_peeled, rawsz);
+
+	snapshot->index = index;
+	trace2_data_string("refs", NULL, "packed-refs-index", "used");
+	close(fd);
+	free(path);
+	return;
+
+stale:
+	trace2_data_string("refs", NULL, "packed-refs-index", "stale");
+fail:
+	free_packed_refs_index(index);
+	close(fd);
+	free(path);
+}
+
+static const unsigned char *index_record(struct snapshot *snapshot,
+					 uint32_t pos)
+{
+	return snapshot->index->records +
+		st_mult(pos, snapshot->index->record_size);
+}
+
+/*
+ * Return a pointer to the refname of the `pos`th record in the
+ * index, which is not NUL-terminated, and store its length in `len`.
+ */
+static const char *index_refname(struct snapshot *snapshot, uint32_t pos,
+				 size_t *len)
+{
+	const unsigned char *rec = index_record(snapshot, pos);
+	uint64_t offset = get_be64(rec);
+	size_t size = snapshot->eof - snapshot->start;
+
+	*len = get_be32(rec + 8);
+	if (offset > size || *len > size - offset)
+		die("corrupt packed-refs index %s.idx", snapshot->refs->path);
+	return snapshot->start + offset;
+}
+
+/*
+ * Compare the `len` bytes at `name` to the NUL-terminated `refname`.
+ */
+static int cmp_index_refname(const char *name, size_t len,
+			     const char *refname)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!refname[i])
+			return 1;
+		if (name[i] != refname[i])
+			return (unsigned char)name[i] < (unsigned char)refname[i] ? -1 : +1;
+	}
+	return refname[i] ? -1 : 0;
+}
+
+/*
+ * Return the length of the "refs/<x>/" prefix of `refname`, or zero
+ * if it has none.
+ */
+static size_t refname_prefix_len(const char *refname, size_t len)
+{
+	const char *slash = memchr(refname, '/', len);
+
+	if (!slash)
+		return 0;
+	slash = memchr(slash + 1, '/', len - (slash + 1 - refname));
+	return slash ? slash + 1 - refname : 0;
+}
+
+/*
+ * The index counterpart of find_reference_location(): return the
+ * position of the record for `refname`, or if there is none, -1 if
+ * `mustexist` is set and the position where it would be inserted
+ * otherwise. The search is limited to the records sharing the
+ * "refs/<x>/" prefix of `refname`, if it has one that is listed in
+ * the prefix table.
+ */
+static int64_t find_index_location(struct snapshot *snapshot,
+				   const char *refname, int mustexist)
+{
+	struct packed_refs_index *index = snapshot->index;
+	uint32_t lo = 0, hi = index->nr;
+	size_t prefix_len = refname_prefix_len(refname, strlen(refname));
+
+	if (prefix_len) {
+		uint32_t plo = 0, phi = index->nr_prefixes;
+
+		while (plo < phi) {
+			uint32_t mid = plo + (phi - plo) / 2;
+			const unsigned char *prefix = index->prefixes +
+				st_mult(mid, PACKED_REFS_INDEX_PREFIX_SIZE);
+			uint32_t first = get_be32(prefix);
+			size_t len, plen = get_be32(prefix + 8);
+			const char *name;
+			int cmp;
+
+			if (first >= index->nr)
+				die("corrupt packed-refs index %s.idx",
+				    snapshot->refs->path);
+			name = index_refname(snapshot, first, &len);
+			if (plen > len)
+				die("corrupt packed-refs index %s.idx",
+				    snapshot->refs->path);
+			cmp = memcmp(name, refname,
+				     plen < prefix_len ? plen : prefix_len);
+			if (!cmp)
+				cmp = plen < prefix_len ? -1 :
+				      plen > prefix_len ? +1 : 0;
+			if (cmp < 0) {
+				plo = mid + 1;
+			} else if (cmp > 0) {
+				phi = mid;
+			} else {
+				lo = first;
+				hi = first + get_be32(prefix + 4);
+				if (hi < lo || hi > index->nr)
+					die("corrupt packed-refs index %s.idx",
+					    snapshot->refs->path);
+				break;
+			}
+		}
+	}
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		size_t len;
+		const char *name = index_refname(snapshot, mid, &len);
+		int cmp = cmp_index_refname(name, len, refname);
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return mid;
+	}
+
+	if (mustexist)
+		return -1;
+	return lo;
+}
+
 /*
  * Create a newly-allocated `snapshot` of the `packed-refs` file in
  * its current state and return it. The return value will already have
@@ -617,13 +932,14 @@ static const char *find_reference_location(struct snapshot *snapshot,
 static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 {
 	struct snapshot *snapshot = xcalloc(1, sizeof(*snapshot));
+	struct stat st;
 	int sorted = 0;
 
 	snapshot->refs = refs;
 	acquire_snapshot(snapshot);
 	snapshot->peeled = PEELED_NONE;
 
-	if (!load_contents(snapshot))
+	if (!load_contents(snapshot, &st))
 		return snapshot;
 
 	/* If the file has a header line, process it: */
@@ -676,6 +992,14 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 		verify_buffer_safe(snapshot);
 	}
 
+	/*
+	 * An index can only describe a file that was written sorted.
+	 * Check it against the whole file before it might be copied
+	 * without its header line below.
+	 */
+	if (sorted)
+		load_packed_refs_index(snapshot);
+
 	if (mmap_strategy != MMAP_OK && snapshot->mmapped) {
 		/*
 		 * We don't want to leave the file mmapped, so we are
@@ -735,6 +1059,18 @@ static int packed_read_raw_ref(struct ref_store *ref_store,
 
 	*type = 0;
 
+	if (snapshot->index) {
+		int64_t pos = find_index_location(snapshot, refname, 1);
+
+		if (pos < 0) {
+			errno = ENOENT;
+			return -1;
+		}
+		oidread(oid, index_record(snapshot, pos) + 16);
+		*type = REF_ISPACKED;
+		return 0;
+	}
+
 	rec = find_reference_location(snapshot, refname, 1);
 
 	if (!rec) {
@@ -772,6 +1108,12 @@ struct packed_ref_iterator {
 	/* The end of the part of the buffer that will be iterated over: */
 	const char *eof;
 
+	/*
+	 * If the snapshot has an index, the current and end positions
+	 * in its record table, used instead of `pos` and `eof`:
+	 */
+	uint32_t index_pos, index_end;
+
 	/* Scratch space for current values: */
 	struct object_id oid, peeled;
 	struct strbuf refname_buf;
@@ -786,10 +1128,71 @@ struct packed_ref_iterator {
  * `ITER_DONE`. This function does not free the iterator in the case
  * of `ITER_DONE`.
  */
+static int next_index_record(struct packed_ref_iterator *iter)
+{
+	struct snapshot *snapshot = iter->snapshot;
+	const unsigned char *rec;
+	const char *name;
+	size_t len;
+	uint32_t flags;
+
+	strbuf_reset(&iter->refname_buf);
+
+	if (iter->index_pos == iter->index_end)
+		return ITER_DONE;
+
+	iter->base.flags = REF_ISPACKED;
+
+	rec = index_record(snapshot, iter->index_pos);
+	name = index_refname(snapshot, iter->index_pos, &len);
+	flags = get_be32(rec + 12);
+	iter->index_pos++;
+
+	strbuf_add(&iter->refname_buf, name, len);
+	iter->base.refname = iter->refname_buf.buf;
+	oidread(&iter->oid, rec + 16);
+
+	if (flags & INDEX_REF_BAD_NAME) {
+		if (!refname_is_safe(iter->base.refname))
+			die("packed refname is dangerous: %s",
+			    iter->base.refname);
+		oidclr(&iter->oid);
+		iter->base.flags |= REF_BAD_NAME | REF_ISBROKEN;
+	}
+	if (snapshot->peeled == PEELED_FULLY ||
+	    (snapshot->peeled == PEELED_TAGS &&
+	     starts_with(iter->base.refname, "refs/tags/")))
+		iter->base.flags |= REF_KNOWS_PEELED;
+
+	flags &= INDEX_REF_PEELED_MASK;
+	if (flags) {
+		if (flags > snapshot->index->nr_peeled)
+			die("corrupt packed-refs index %s.idx",
+			    snapshot->refs->path);
+		oidread(&iter->peeled, snapshot->index->peeled +
+			st_mult(flags - 1, the_hash_algo->rawsz));
+
+		/* See the corresponding comment in next_record(). */
+		if ((iter->base.flags & REF_ISBROKEN)) {
+			oidclr(&iter->peeled);
+			iter->base.flags &= ~REF_KNOWS_PEELED;
+		} else {
+			iter->base.flags |= REF_KNOWS_PEELED;
+		}
+	} else {
+		oidclr(&iter->peeled);
+	}
+
+	return ITER_OK;
+}
+
 static int next_record(struct packed_ref_iterator *iter)
 {
 	const char *p = iter->pos, *eol;
 
+	if (iter->snapshot->index)
+		return next_index_record(iter);
+
 	strbuf_reset(&iter->refname_buf);
 
 	if (iter->pos == iter->eof)
@@ -918,6 +1321,7 @@ static struct ref_iterator *packed_ref_iterator_begin(
 	struct packed_ref_store *refs;
 	struct snapshot *snapshot;
 	const char *start;
+	uint32_t index_start = 0;
 	struct packed_ref_iterator *iter;
 	struct ref_iterator *ref_iterator;
 	unsigned int required_flags = REF_STORE_READ;
@@ -933,13 +1337,21 @@ static struct ref_iterator *packed_ref_iterator_begin(
 	 */
 	snapshot = get_snapshot(refs);
 
-	if (prefix && *prefix)
-		start = find_reference_location(snapshot, prefix, 0);
-	else
-		start = snapshot->start;
+	if (snapshot->index) {
+		if (prefix && *prefix)
+			index_start = find_index_location(snapshot, prefix, 0);
+		if (index_start == snapshot->index->nr)
+			return empty_ref_iterator_begin();
+		start = NULL;
+	} else {
+		if (prefix && *prefix)
+			start = find_reference_location(snapshot, prefix, 0);
+		else
+			start = snapshot->start;
 
-	if (start == snapshot->eof)
-		return empty_ref_iterator_begin();
+		if (start == snapshot->eof)
+			return empty_ref_iterator_begin();
+	}
 
 	CALLOC_ARRAY(iter, 1);
 	ref_iterator = &iter->base;
@@ -950,6 +1362,10 @@ static struct ref_iterator *packed_ref_iterator_begin(
 
 	iter->pos = start;
 	iter->eof = snapshot->eof;
+	if (snapshot->index) {
+		iter->index_pos = index_start;
+		iter->index_end = snapshot->index->nr;
+	}
 	strbuf_init(&iter->refname_buf, 0);
 
 	iter->base.oid = &iter->oid;
@@ -963,20 +1379,205 @@ static struct ref_iterator *packed_ref_iterator_begin(
 	return ref_iterator;
 }
 
+struct packed_refs_index_record {
+	uint64_t offset;
+	uint32_t len;
+	uint32_t flags;
+	struct object_id oid;
+};
+
+struct packed_refs_index_prefix {
+	uint32_t first, nr, len;
+};
+
+/*
+ * The contents of a `packed-refs.idx` file, collected while the
+ * corresponding `packed-refs` file is written.
+ */
+struct packed_refs_index_builder {
+	/* The offset of the next record after the header line: */
+	uint64_t pos;
+
+	struct packed_refs_index_record *records;
+	size_t nr, alloc;
+
+	struct object_id *peeled;
+	size_t nr_peeled, alloc_peeled;
+
+	struct packed_refs_index_prefix *prefixes;
+	size_t nr_prefixes, alloc_prefixes;
+	struct strbuf last_prefix;
+};
+
+static int packed_refs_index_enabled(void)
+{
+	int enabled;
+
+	if (git_config_get_bool("core.packedrefsindex", &enabled))
+		enabled = git_env_bool("GIT_TEST_PACKED_REFS_INDEX", 0);
+	return enabled;
+}
+
+static void free_packed_refs_index_builder(struct packed_refs_index_builder *b)
+{
+	if (!b)
+		return;
+	free(b->records);
+	free(b->peeled);
+	free(b->prefixes);
+	strbuf_release(&b->last_prefix);
+	free(b);
+}
+
+static void add_index_record(struct packed_refs_index_builder *b,
+			     const char *refname,
+			     const struct object_id *oid,
+			     const struct object_id *peeled)
+{
+	struct packed_refs_index_record *rec;
+	size_t len = strlen(refname);
+	size_t prefix_len = refname_prefix_len(refname, len);
+
+	ALLOC_GROW(b->records, b->nr + 1, b->alloc);
+	rec = &b->records[b->nr++];
+	rec->offset = b->pos + the_hash_algo->hexsz + 1;
+	rec->len = len;
+	rec->flags = 0;
+	if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL))
+		rec->flags |= INDEX_REF_BAD_NAME;
+	oidcpy(&rec->oid, oid);
+	b->pos += the_hash_algo->hexsz + 1 + len + 1;
+
+	if (peeled) {
+		ALLOC_GROW(b->peeled, b->nr_peeled + 1, b->alloc_peeled);
+		oidcpy(&b->peeled[b->nr_peeled++], peeled);
+		rec->flags |= b->nr_peeled;
+		b->pos += 1 + the_hash_algo->hexsz + 1;
+	}
+
+	if (!prefix_len)
+		return;
+	if (b->nr_prefixes && b->last_prefix.len == prefix_len &&
+	    !memcmp(b->last_prefix.buf, refname, prefix_len)) {
+		b->prefixes[b->nr_prefixes - 1].nr++;
+	} else {
+		struct packed_refs_index_prefix *prefix;
+
+		ALLOC_GROW(b->prefixes, b->nr_prefixes + 1, b->alloc_prefixes);
+		prefix = &b->prefixes[b->nr_prefixes++];
+		prefix->first = b->nr - 1;
+		prefix->nr = 1;
+		prefix->len = prefix_len;
+		strbuf_reset(&b->last_prefix);
+		strbuf_add(&b->last_prefix, refname, prefix_len);
+	}
+}
+
+/*
+ * Hash the contents of the file at `path`, and store its size in
+ * `size`. Returns -1 if it cannot be read.
+ */
+static int hash_packed_refs_file(const char *path, unsigned char *hash,
+				 uint64_t *size)
+{
+	git_hash_ctx ctx;
+	char buf[65536];
+	ssize_t len;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	*size = 0;
+	the_hash_algo->init_fn(&ctx);
+	while ((len = xread(fd, buf, sizeof(buf))) > 0) {
+		the_hash_algo->update_fn(&ctx, buf, len);
+		*size += len;
+	}
+	close(fd);
+	if (len < 0)
+		return -1;
+	the_hash_algo->final_fn(hash, &ctx);
+	return 0;
+}
+
+/*
+ * Write `refs->index_builder` to `packed-refs.idx`, for the
+ * `packed-refs` file that has just been renamed into place, and which
+ * we still hold the lock for. If that fails, make sure that no stale
+ * index is left behind; readers would ignore it anyway, but there is
+ * no point in keeping it.
+ */
+static void write_packed_refs_index(struct packed_ref_store *refs)
+{
+	struct packed_refs_index_builder *b = refs->index_builder;
+	struct lock_file lock = LOCK_INIT;
+	char *path = xstrfmt("%s.idx", refs->path);
+	unsigned char hash[GIT_MAX_RAWSZ];
+	uint64_t size;
+	struct hashfile *f;
+	size_t i;
+
+	if (b->nr > INDEX_REF_PEELED_MASK ||
+	    hash_packed_refs_file(refs->path, hash, &size) < 0 ||
+	    hold_lock_file_for_update(&lock, path, 0) < 0) {
+		unlink_or_warn(path);
+		goto out;
+	}
+
+	f = hashfd(get_lock_file_fd(&lock), get_lock_file_path(&lock));
+	hashwrite_be32(f, PACKED_REFS_INDEX_SIGNATURE);
+	hashwrite_be32(f, PACKED_REFS_INDEX_VERSION);
+	hashwrite_be32(f, packed_refs_index_hash_id());
+	hashwrite_be32(f, b->nr);
+	hashwrite_be32(f, b->nr_peeled);
+	hashwrite_be32(f, b->nr_prefixes);
+	hashwrite_be64(f, size);
+	hashwrite(f, hash, the_hash_algo->rawsz);
+
+	for (i = 0; i < b->nr; i++) {
+		hashwrite_be64(f, b->records[i].offset);
+		hashwrite_be32(f, b->records[i].len);
+		hashwrite_be32(f, b->records[i].flags);
+		hashwrite(f, b->records[i].oid.hash, the_hash_algo->rawsz);
+	}
+	for (i = 0; i < b->nr_peeled; i++)
+		hashwrite(f, b->peeled[i].hash, the_hash_algo->rawsz);
+	for (i = 0; i < b->nr_prefixes; i++) {
+		hashwrite_be32(f, b->prefixes[i].first);
+		hashwrite_be32(f, b->prefixes[i].nr);
+		hashwrite_be32(f, b->prefixes[i].len);
+	}
+
+	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM);
+	if (commit_lock_file(&lock)) {
+		warning_errno("unable to write %s", path);
+		unlink_or_warn(path);
+	}
+
+out:
+	free(path);
+	free_packed_refs_index_builder(b);
+	refs->index_builder = NULL;
+}
+
 /*
  * Write an entry to the packed-refs file for the specified refname.
- * If peeled is non-NULL, write it as the entry's peeled value. On
- * error, return a nonzero value and leave errno set at the value left
- * by the failing call to `fprintf()`.
+ * If peeled is non-NULL, write it as the entry's peeled value. If
+ * builder is non-NULL, also add the entry to it. On error, return a
+ * nonzero value and leave errno set at the value left by the failing
+ * call to `fprintf()`.
  */
 static int write_packed_entry(FILE *fh, const char *refname,
 			      const struct object_id *oid,
-			      const struct object_id *peeled)
+			      const struct object_id *peeled,
+			      struct packed_refs_index_builder *builder)
 {
 	if (fprintf(fh, "%s %s\n", oid_to_hex(oid), refname) < 0 ||
 	    (peeled && fprintf(fh, "^%s\n", oid_to_hex(peeled)) < 0))
 		return -1;
 
+	if (builder)
+		add_index_record(builder, refname, oid, peeled);
 	return 0;
 }
 
@@ -1126,6 +1727,11 @@ static int write_with_updates(struct packed_ref_store *refs,
 		goto error;
 	}
 
+	if (packed_refs_index_enabled()) {
+		CALLOC_ARRAY(refs->index_builder, 1);
+		strbuf_init(&refs->index_builder->last_prefix, 0);
+	}
+
 	if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
 		goto write_error;
 
@@ -1222,7 +1828,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 
 			if (write_packed_entry(out, iter->refname,
 					       iter->oid,
-					       peel_error ? NULL : &peeled))
+					       peel_error ? NULL : &peeled,
+					       refs->index_builder))
 				goto write_error;
 
 			if ((ok = ref_iterator_advance(iter)) != ITER_OK)
@@ -1243,7 +1850,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 
 			if (write_packed_entry(out, update->refname,
 					       &update->new_oid,
-					       peel_error ? NULL : &peeled))
+					       peel_error ? NULL : &peeled,
+					       refs->index_builder))
 				goto write_error;
 
 			i++;
@@ -1276,6 +1884,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 		ref_iterator_abort(iter);
 
 	delete_tempfile(&refs->tempfile);
+	free_packed_refs_index_builder(refs->index_builder);
+	refs->index_builder = NULL;
 	return -1;
 }
 
@@ -1390,6 +2000,8 @@ static void packed_transaction_cleanup(struct packed_ref_store *refs,
 
 		if (is_tempfile_active(refs->tempfile))
 			delete_tempfile(&refs->tempfile);
+		free_packed_refs_index_builder(refs->index_builder);
+		refs->index_builder = NULL;
 
 		if (data->own_lock && is_lock_file_locked(&refs->lock)) {
 			packed_refs_unlock(&refs->base);
@@ -1496,6 +2108,15 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	if (refs->index_builder) {
+		write_packed_refs_index(refs);
+	} else {
+		char *index_path = xstrfmt("%s.idx", refs->path);
+
+		unlink_or_warn(index_path);
+		free(index_path);
+	}
+
 	ret = 0;
 
 cleanup:
@@ -282,6 +282,19 @@ int repo_read_index(struct repository *repo)
 	return res;
 }
 
+int repo_read_index_prefix(struct repository *repo,
+			   const char *prefix, size_t prefix_len)
+{
+	if (!repo->index)
+		CALLOC_ARRAY(repo->index, 1);
+
+	if (prefix_len && !repo->index->initialized) {
+		free(repo->index->partial_prefix);
+		repo->index->partial_prefix = xmemdupz(prefix, prefix_len);
+	}
+	return repo_read_index(repo);
+}
+
 int repo_hold_locked_index(struct repository *repo,
 			   struct lock_file *lf,
 			   int flags)
@@ -187,6 +187,17 @@ void repo_clear(struct repository *repo);
  * populated then the number of entries will simply be returned.
  */
 int repo_read_index(struct repository *repo);
+/*
+ * Like repo_read_index(), but only read the index entries whose name
+ * starts with the first "prefix_len" bytes of "prefix", as if the
+ * others were removed right after reading the whole index; the cost of
+ * reading is then mostly proportional to the number of those entries.
+ * The resulting index must not be written. Without a prefix, or if the
+ * index has already been populated, this is the same as
+ * repo_read_index().
+ */
+int repo_read_index_prefix(struct repository *repo,
+			   const char *prefix, size_t prefix_len);
 int repo_hold_locked_index(struct repository *repo,
 			   struct lock_file *lf,
 			   int flags);
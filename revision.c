@@ -767,6 +767,79 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 	return result;
 }
 
+static int changed_path_list_atexit_registered;
+static unsigned int count_changed_path_list_same;
+static unsigned int count_changed_path_list_different;
+static unsigned int count_changed_path_list_not_present;
+
+static void trace2_changed_path_list_statistics_atexit(void)
+{
+	struct json_writer jw = JSON_WRITER_INIT;
+
+	jw_object_begin(&jw, 0);
+	jw_object_intmax(&jw, "list_not_present", count_changed_path_list_not_present);
+	jw_object_intmax(&jw, "same", count_changed_path_list_same);
+	jw_object_intmax(&jw, "different", count_changed_path_list_different);
+	jw_end(&jw);
+
+	trace2_data_json("changed-path-lists", the_repository, "statistics", &jw);
+
+	jw_release(&jw);
+}
+
+/*
+ * The exact lists of changed paths in the commit-graph answer the same
+ * questions as the Bloom filters, without false positives.
+ */
+static void prepare_to_use_changed_path_lists(struct rev_info *revs)
+{
+	struct pathspec_item *pi;
+
+	if (!revs->commits || !revs->pruning.pathspec.nr)
+		return;
+
+	if (forbid_bloom_filters(&revs->prune_data))
+		return;
+
+	if (!commit_graph_has_changed_path_lists(revs->repo))
+		return;
+
+	pi = &revs->pruning.pathspec.items[0];
+
+	free(revs->changed_path_list_path);
+	/* remove single trailing slash from path, if needed */
+	if (pi->len > 0 && pi->match[pi->len - 1] == '/')
+		revs->changed_path_list_path = xmemdupz(pi->match, pi->len - 1);
+	else
+		revs->changed_path_list_path = xstrdup(pi->match);
+
+	if (!*revs->changed_path_list_path) {
+		FREE_AND_NULL(revs->changed_path_list_path);
+		return;
+	}
+
+	if (trace2_is_enabled() && !changed_path_list_atexit_registered) {
+		atexit(trace2_changed_path_list_statistics_atexit);
+		changed_path_list_atexit_registered = 1;
+	}
+}
+
+static int check_changed_path_list(struct rev_info *revs,
+				   struct commit *commit)
+{
+	int result = commit_graph_changed_path(revs->repo, commit,
+					       revs->changed_path_list_path);
+
+	if (result < 0)
+		count_changed_path_list_not_present++;
+	else if (result)
+		count_changed_path_list_different++;
+	else
+		count_changed_path_list_same++;
+
+	return result;
+}
+
 static int rev_compare_tree(struct rev_info *revs,
 			    struct commit *parent, struct commit *commit, int nth_parent)
 {
@@ -797,6 +870,19 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	if (revs->changed_path_list_path && !nth_parent) {
+		int list_ret = check_changed_path_list(revs, commit);
+
+		if (list_ret == 0)
+			return REV_TREE_SAME;
+		/*
+		 * Only "remove_empty_trees" cares whether the paths
+		 * were all added, which needs the diff.
+		 */
+		if (list_ret == 1 && !revs->remove_empty_trees)
+			return REV_TREE_DIFFERENT;
+	}
+
 	if (revs->bloom_keys_nr && !nth_parent) {
 		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
 
@@ -3581,8 +3667,10 @@ int prepare_revision_walk(struct rev_info *revs)
 				       FOR_EACH_OBJECT_PROMISOR_ONLY);
 	}
 
-	if (!revs->reflog_info)
+	if (!revs->reflog_info) {
+		prepare_to_use_changed_path_lists(revs);
 		prepare_to_use_bloom_filter(revs);
+	}
 	if (revs->no_walk != REVISION_WALK_NO_WALK_UNSORTED)
 		commit_list_sort_by_date(&revs->commits);
 	if (revs->no_walk)
@@ -4194,6 +4282,7 @@ struct commit *get_revision(struct rev_info *revs)
 		graph_update(revs->graph, c);
 	if (!c) {
 		free_saved_parents(revs);
+		FREE_AND_NULL(revs->changed_path_list_path);
 		if (revs->previous_parents) {
 			free_commit_list(revs->previous_parents);
 			revs->previous_parents = NULL;
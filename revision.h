@@ -316,6 +316,12 @@ struct rev_info {
 	 */
 	struct bloom_filter_settings *bloom_filter_settings;
 
+	/*
+	 * The path to look up in the exact lists of changed paths of
+	 * the commit-graph, if it has them and the pathspec allows it.
+	 */
+	char *changed_path_list_path;
+
 	/* misc. flags related to '--no-kept-objects' */
 	unsigned keep_pack_cache_flags;
 };
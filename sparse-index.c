@@ -275,6 +275,32 @@ void ensure_full_index(struct index_state *istate)
 	trace2_region_leave("index", "ensure_full_index", istate->repo);
 }
 
+int path_in_sparse_directory(struct index_state *istate,
+			     const char *path, int pathlen)
+{
+	const struct cache_entry *ce;
+	int pos;
+
+	if (!istate->sparse_index)
+		return 0;
+
+	pos = index_name_pos_sparse(istate, path, pathlen);
+	if (pos >= 0)
+		return 0;
+
+	/*
+	 * Only the entries below a sparse directory sort between it and
+	 * 'path', and a sparse index does not have any.
+	 */
+	pos = -pos - 1;
+	if (!pos)
+		return 0;
+	ce = istate->cache[pos - 1];
+	return S_ISSPARSEDIR(ce->ce_mode) &&
+	       ce_namelen(ce) < pathlen &&
+	       !strncmp(path, ce->name, ce_namelen(ce));
+}
+
 /*
  * This static global helps avoid infinite recursion between
  * expand_to_path() and index_file_exists().
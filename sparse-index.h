@@ -17,6 +17,15 @@ int convert_to_sparse(struct index_state *istate);
 void expand_to_path(struct index_state *istate,
 		    const char *path, size_t pathlen, int icase);
 
+/*
+ * Return 1 if 'path' lies strictly within one of the sparse directory
+ * entries of 'istate', i.e. if looking it up would require expanding
+ * the index, without expanding it. Return 0 otherwise, including when
+ * the index is not sparse.
+ */
+int path_in_sparse_directory(struct index_state *istate,
+			     const char *path, int pathlen);
+
 struct repository;
 int set_sparse_index_config(struct repository *repo, int enable);
 
@@ -1,8 +1,6 @@
 #include "cache.h"
 
-static int threaded_check_leading_path(struct cache_def *cache, const char *name,
-				       int len, int warn_on_lstat_err);
-static int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len);
+static int threaded_rmdir(struct cache_def *cache, const char *path);
 
 /*
  * Returns the length (on a path component basis) of the longest
@@ -226,8 +224,8 @@ int check_leading_path(const char *name, int len, int warn_on_lstat_err)
  * directory, or if we were unable to lstat() it. If warn_on_lstat_err is true,
  * also emit a warning for this error.
  */
-static int threaded_check_leading_path(struct cache_def *cache, const char *name,
-				       int len, int warn_on_lstat_err)
+int threaded_check_leading_path(struct cache_def *cache, const char *name,
+				int len, int warn_on_lstat_err)
 {
 	int flags;
 	int match_len = lstat_cache_matchlen(cache, name, len, &flags,
@@ -259,7 +257,7 @@ int has_dirs_only_path(const char *name, int len, int prefix_len)
  * 'prefix_len', thus we then allow for symlinks in the prefix part as
  * long as those points to real existing directories.
  */
-static int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len)
+int threaded_has_dirs_only_path(struct cache_def *cache, const char *name, int len, int prefix_len)
 {
 	/*
 	 * Note: this function is used by the checkout machinery, which also
@@ -275,26 +273,36 @@ static int threaded_has_dirs_only_path(struct cache_def *cache, const char *name
 
 static struct strbuf removal = STRBUF_INIT;
 
-static void do_remove_scheduled_dirs(int new_len)
+static int remove_dir(struct cache_def *cache, const char *path)
 {
-	while (removal.len > new_len) {
-		removal.buf[removal.len] = '\0';
-		if (rmdir(removal.buf))
+	if (cache == &default_cache)
+		return rmdir(path);
+	return threaded_rmdir(cache, path);
+}
+
+static void do_remove_scheduled_dirs(struct cache_def *cache,
+				     struct strbuf *removal, int new_len)
+{
+	while (removal->len > new_len) {
+		removal->buf[removal->len] = '\0';
+		if (remove_dir(cache, removal->buf))
 			break;
 		do {
-			removal.len--;
-		} while (removal.len > new_len &&
-			 removal.buf[removal.len] != '/');
+			removal->len--;
+		} while (removal->len > new_len &&
+			 removal->buf[removal->len] != '/');
 	}
-	removal.len = new_len;
+	removal->len = new_len;
 }
 
-void schedule_dir_for_removal(const char *name, int len)
+void threaded_schedule_dir_for_removal(struct cache_def *cache,
+				       struct strbuf *removal,
+				       const char *name, int len)
 {
 	int match_len, last_slash, i, previous_slash;
 
 	match_len = last_slash = i =
-		longest_path_match(name, len, removal.buf, removal.len,
+		longest_path_match(name, len, removal->buf, removal->len,
 				   &previous_slash);
 	/* Find last slash inside 'name' */
 	while (i < len) {
@@ -308,19 +316,30 @@ void schedule_dir_for_removal(const char *name, int len)
 	 * we must first go upwards the tree, such that we then can
 	 * remove possible empty directories as we go upwards.
 	 */
-	if (match_len < last_slash && match_len < removal.len)
-		do_remove_scheduled_dirs(match_len);
+	if (match_len < last_slash && match_len < removal->len)
+		do_remove_scheduled_dirs(cache, removal, match_len);
 	/*
 	 * If we go deeper down the directory tree, we only need to
 	 * save the new path components as we go down.
 	 */
 	if (match_len < last_slash)
-		strbuf_add(&removal, &name[match_len], last_slash - match_len);
+		strbuf_add(removal, &name[match_len], last_slash - match_len);
+}
+
+void threaded_remove_scheduled_dirs(struct cache_def *cache,
+				    struct strbuf *removal)
+{
+	do_remove_scheduled_dirs(cache, removal, 0);
+}
+
+void schedule_dir_for_removal(const char *name, int len)
+{
+	threaded_schedule_dir_for_removal(&default_cache, &removal, name, len);
 }
 
 void remove_scheduled_dirs(void)
 {
-	do_remove_scheduled_dirs(0);
+	threaded_remove_scheduled_dirs(&default_cache, &removal);
 }
 
 void invalidate_lstat_cache(void)
@@ -339,3 +358,20 @@ int lstat_cache_aware_rmdir(const char *path)
 
 	return ret;
 }
+
+/*
+ * Like lstat_cache_aware_rmdir(), but for a cache that belongs to
+ * another thread than the main one: it only invalidates that cache,
+ * and never uses the platform's rmdir() wrapper, which may prompt the
+ * user. Callers that run it in threads must not be compiled for
+ * Windows.
+ */
+static int threaded_rmdir(struct cache_def *cache, const char *path)
+{
+	int ret = rmdir(path);
+
+	if (!ret)
+		reset_lstat_cache(cache);
+
+	return ret;
+}
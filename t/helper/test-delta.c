@@ -12,9 +12,85 @@
 #include "git-compat-util.h"
 #include "delta.h"
 #include "cache.h"
+#include "object-store.h"
 
 static const char usage_str[] =
-	"test-tool delta (-d|-p) <from_file> <data_file> <out_file>";
+	"test-tool delta (-d|-p) <from_file> <data_file> <out_file>\n"
+	"   or: test-tool delta --bench [<rounds>] < <pairs>";
+
+static void *read_blob(const char *hex, unsigned long *size)
+{
+	struct object_id oid;
+	enum object_type type;
+	void *buf;
+
+	if (get_oid_hex(hex, &oid))
+		die("not an object name: %s", hex);
+	buf = read_object_file(&oid, &type, size);
+	if (!buf || type != OBJ_BLOB)
+		die("unable to read blob %s", hex);
+	return buf;
+}
+
+/*
+ * Read "<from-oid> <data-oid>" pairs of blobs from stdin and time
+ * diff_delta() on each of them, "rounds" times in a row.
+ */
+static int bench_delta(int rounds)
+{
+	struct strbuf line = STRBUF_INIT;
+	uint64_t total = 0;
+	uintmax_t pairs = 0, in_bytes = 0, out_bytes = 0;
+	git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+
+	setup_git_directory();
+	the_hash_algo->init_fn(&ctx);
+
+	while (strbuf_getline(&line, stdin) != EOF) {
+		const char *data_hex;
+		void *from_buf, *data_buf, *out_buf = NULL;
+		unsigned long from_size, data_size, out_size = 0;
+		uint64_t start;
+		int i;
+
+		data_hex = strchr(line.buf, ' ');
+		if (!data_hex)
+			die("malformed input: %s", line.buf);
+		*(char *)data_hex++ = '\0';
+
+		from_buf = read_blob(line.buf, &from_size);
+		data_buf = read_blob(data_hex, &data_size);
+
+		start = getnanotime();
+		for (i = 0; i < rounds; i++) {
+			free(out_buf);
+			out_buf = diff_delta(from_buf, from_size,
+					     data_buf, data_size, &out_size, 0);
+		}
+		total += getnanotime() - start;
+
+		/* lets different builds check that they agree on the output */
+		if (out_buf)
+			the_hash_algo->update_fn(&ctx, out_buf, out_size);
+
+		pairs++;
+		in_bytes += data_size;
+		out_bytes += out_size;
+		free(from_buf);
+		free(data_buf);
+		free(out_buf);
+	}
+	strbuf_release(&line);
+	the_hash_algo->final_fn(hash, &ctx);
+
+	printf("pairs %"PRIuMAX"\n", pairs);
+	printf("target bytes %"PRIuMAX"\n", in_bytes);
+	printf("delta bytes %"PRIuMAX"\n", out_bytes);
+	printf("delta hash %s\n", hash_to_hex(hash));
+	printf("time %.6f s\n", (double)total / 1000000000 / rounds);
+	return 0;
+}
 
 int cmd__delta(int argc, const char **argv)
 {
@@ -23,6 +99,13 @@ int cmd__delta(int argc, const char **argv)
 	void *from_buf, *data_buf, *out_buf;
 	unsigned long from_size, data_size, out_size;
 
+	if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "--bench")) {
+		int rounds = argc == 3 ? atoi(argv[2]) : 1;
+		if (rounds < 1)
+			die("invalid number of rounds: %s", argv[2]);
+		return bench_delta(rounds);
+	}
+
 	if (argc != 5 || (strcmp(argv[1], "-d") && strcmp(argv[1], "-p"))) {
 		fprintf(stderr, "usage: %s\n", usage_str);
 		return 1;
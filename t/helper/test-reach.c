@@ -1,6 +1,7 @@
 #include "test-tool.h"
 #include "cache.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "commit-reach.h"
 #include "config.h"
 #include "parse-options.h"
@@ -107,6 +108,8 @@ int cmd__reach(int ac, const char **av)
 		printf("%s(A,B):%d\n", av[1], ref_newer(&oid_A, &oid_B));
 	else if (!strcmp(av[1], "in_merge_bases"))
 		printf("%s(A,B):%d\n", av[1], in_merge_bases(A, B));
+	else if (!strcmp(av[1], "commit_graph_can_reach"))
+		printf("%s(A,B):%d\n", av[1], commit_graph_can_reach(r, A, B));
 	else if (!strcmp(av[1], "in_merge_bases_many"))
 		printf("%s(A,X):%d\n", av[1], in_merge_bases_many(A, X_nr, X_array));
 	else if (!strcmp(av[1], "is_descendant_of"))
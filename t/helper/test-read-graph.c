@@ -43,6 +43,12 @@ int cmd__read_graph(int argc, const char **argv)
 		printf(" bloom_indexes");
 	if (graph->chunk_bloom_data)
 		printf(" bloom_data");
+	if (graph->chunk_reachability_labels)
+		printf(" reachability_labels");
+	if (graph->chunk_commit_metadata)
+		printf(" commit_idents_subjects");
+	if (graph->chunk_changed_path_index)
+		printf(" changed_path_lists");
 	printf("\n");
 
 	UNLEAK(graph);
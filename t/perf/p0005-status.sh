@@ -46,4 +46,25 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+# Compare preloading the index with one lstat() per file and with the
+# lstat() calls batched through io_uring (when Git was built with
+# HAVE_IO_URING). The difference mostly shows on a cold cache, so set
+# GIT_PERF_0005_DROP_CACHE to drop the OS caches before each of these
+# tests; as with p7519, GIT_PERF_REPEAT_COUNT should then be 1.
+test_perf_w_drop_caches () {
+	if test -n "$GIT_PERF_0005_DROP_CACHE"
+	then
+		test-tool drop-caches
+	fi
+
+	test_perf "$@"
+}
+
+for batch in false true
+do
+	test_perf_w_drop_caches "status, batch_lstat=$batch ($nr_files)" "
+		GIT_TEST_BATCH_LSTAT=$batch git -c core.preloadIndex=true status
+	"
+done
+
 test_done
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+test_description="Tests performance of building trees after mass modification"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'change one file in every directory' '
+	blob=$(echo p0008 | git hash-object -w --stdin) &&
+	git ls-files -s |
+	awk -v blob=$blob "{
+		split(\$0, f, \"\t\");
+		dir = f[2];
+		sub(\"/[^/]*\$\", \"\", dir);
+		if (dir != f[2] && !(dir in seen)) {
+			seen[dir] = 1;
+			print \$1, blob, \$3 \"\t\" f[2];
+		}
+	}" >changes &&
+	git read-tree HEAD &&
+	cp .git/index index.orig &&
+	nr_dirs=$(wc -l <changes)
+'
+
+for threads in 1 true
+do
+	test_perf "write-tree ($nr_dirs directories, index.threads=$threads)" "
+		cp index.orig .git/index &&
+		git update-index --index-info <changes &&
+		git -c index.threads=$threads write-tree
+	"
+done
+
+test_done
@@ -4,6 +4,7 @@ test_description="Tests pathological globbing performance
 
 Shows how Git's globbing performance performs when given the sort of
 pathological patterns described in at https://research.swtch.com/glob
+and when matching many paths against an ignore file with many patterns.
 "
 
 . ./perf-lib.sh
@@ -40,4 +41,38 @@ do
 	'
 done
 
+test_expect_success 'setup many ignore patterns' '
+	for i in $(test_seq 1 1000)
+	do
+		echo "generated-$i.out" &&
+		echo "*.gen$i" &&
+		echo "/build-$i/" &&
+		echo "cache-$i-*" &&
+		echo "!keep-$i.gen$i" || return 1
+	done >.gitignore &&
+	for d in $(test_seq 1 50)
+	do
+		mkdir dir$d &&
+		for f in $(test_seq 1 40)
+		do
+			>dir$d/file$f.c &&
+			>dir$d/file$f.gen$f &&
+			>dir$d/generated-$f.out || return 1
+		done
+	done &&
+	find dir* -type f >all-paths
+'
+
+for matcher in false true
+do
+	test_perf "status --ignored, 5000 patterns (matcher=$matcher)" "
+		GIT_TEST_PATTERN_MATCHER=$matcher git status --ignored -uall
+	"
+
+	test_perf "check-ignore, 5000 patterns (matcher=$matcher)" "
+		GIT_TEST_PATTERN_MATCHER=$matcher \
+			git check-ignore --stdin <all-paths >/dev/null
+	"
+done
+
 test_done
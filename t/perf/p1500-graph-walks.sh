@@ -0,0 +1,48 @@
+#!/bin/sh
+
+test_description='Commit walk performance tests'
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'setup' '
+	git for-each-ref --format="%(refname)" "refs/heads/*" "refs/tags/*" >allrefs &&
+	sort -r allrefs | head -n 50 >refs &&
+	git rev-list --first-parent HEAD >first-parent &&
+	old=$(sed -n "$(($(wc -l <first-parent) / 2))p" first-parent) &&
+	echo $old >old &&
+	git commit-graph write --reachable
+'
+
+test_perf 'ahead-behind counts: git for-each-ref' '
+	git for-each-ref --format="%(ahead-behind:HEAD)" $(cat refs)
+'
+
+test_perf 'ahead-behind counts: git rev-list' '
+	for r in $(cat refs)
+	do
+		git rev-list --count --left-right "HEAD...$r" || return 1
+	done
+'
+
+test_perf 'contains: git tag --contains' '
+	git tag --contains $(cat old) >/dev/null
+'
+
+test_perf 'contains: git branch --contains' '
+	git branch --contains $(cat old) >/dev/null
+'
+
+test_expect_success 'write reachability labels' '
+	git commit-graph write --reachable --reachability-labels
+'
+
+test_perf 'contains: git tag --contains, reachability labels' '
+	git tag --contains $(cat old) >/dev/null
+'
+
+test_perf 'contains: git branch --contains, reachability labels' '
+	git branch --contains $(cat old) >/dev/null
+'
+
+test_done
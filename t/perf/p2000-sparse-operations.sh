@@ -97,5 +97,13 @@ test_perf_on_all git status
 test_perf_on_all git add -A
 test_perf_on_all git add .
 test_perf_on_all git commit -a -m A
+test_perf_on_all "git checkout -f HEAD~1 && git checkout -f -"
+test_perf_on_all "git switch -f --detach HEAD~1 && git switch -f -"
+test_perf_on_all git reset
+test_perf_on_all git reset --hard
+test_perf_on_all git reset --soft HEAD
+test_perf_on_all git diff
+test_perf_on_all git diff --cached
+test_perf_on_all git diff HEAD~1
 
 test_done
@@ -13,4 +13,19 @@ do
 	"
 done
 
+test_expect_success 'write commit-graph with commit metadata' '
+	git commit-graph write --reachable --commit-metadata
+'
+
+for format in %an-%ae-%s "%h %an %ad %cn %cd %s"
+do
+	test_perf "log with $format, commit metadata" "
+		git log --format=\"$format\" >/dev/null
+	"
+done
+
+test_perf 'for-each-ref with subjects, commit metadata' '
+	git for-each-ref --format="%(authorname) %(authordate) %(subject)" >/dev/null
+'
+
 test_done
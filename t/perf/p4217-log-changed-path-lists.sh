@@ -0,0 +1,53 @@
+#!/bin/sh
+
+test_description='Tests git log and git blame for a path with changed-path lists'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+# Pick a file to log pseudo-randomly.  The sort key is the blob hash,
+# so it is stable.
+test_expect_success 'select a file and a directory' '
+	git ls-tree -r HEAD | grep ^100644 | grep / |
+	sort -k 3 | head -1 | cut -f 2 >file &&
+	sed "s,/[^/]*$,," file >dir
+'
+
+file=$(cat file)
+dir=$(cat dir)
+export file dir
+
+test_expect_success 'write commit-graph with Bloom filters' '
+	git commit-graph write --reachable --changed-paths --no-changed-path-lists
+'
+
+test_perf 'git log -- <file>, Bloom filters' '
+	git log --format=%H -- "$file" >/dev/null
+'
+
+test_perf 'git log -- <dir>, Bloom filters' '
+	git log --format=%H -- "$dir" >/dev/null
+'
+
+test_perf 'git blame <file>, Bloom filters' '
+	git blame "$file" >/dev/null
+'
+
+test_expect_success 'write commit-graph with changed-path lists' '
+	git commit-graph write --reachable --no-changed-paths --changed-path-lists
+'
+
+test_perf 'git log -- <file>, changed-path lists' '
+	git log --format=%H -- "$file" >/dev/null
+'
+
+test_perf 'git log -- <dir>, changed-path lists' '
+	git log --format=%H -- "$dir" >/dev/null
+'
+
+test_perf 'git blame <file>, changed-path lists' '
+	git blame "$file" >/dev/null
+'
+
+test_done
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="Tests diff_delta() performance on real blob pairs
+
+Each pair is the old and the new version of a file modified by one of
+the last GIT_PERF_5305_COMMITS commits (default 2000). The reported
+delta hash lets two builds check that they produce identical deltas.
+"
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'collect blob pairs' '
+	git log --raw --no-abbrev --no-renames --format= \
+		-n ${GIT_PERF_5305_COMMITS:-2000} HEAD |
+	awk "\$5 == \"M\" { print \$3, \$4 }" >pairs &&
+	test_file_not_empty pairs
+'
+
+test_perf 'diff_delta on blob pairs' '
+	test-tool delta --bench <pairs >out
+'
+
+test_expect_success 'report delta output' '
+	cat out
+'
+
+test_done
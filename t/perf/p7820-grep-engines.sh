@@ -15,6 +15,11 @@ e.g. GIT_PERF_7820_GREP_OPTS=' -i'. Some options to try:
 
 If GIT_PERF_GREP_THREADS is set to a list of threads (e.g. '1 4 8'
 etc.) we will test the patterns under those numbers of threads.
+
+If GIT_PERF_7820_GREP_REV is set to a revision (e.g. 'HEAD~100'), the
+tree of that revision is searched instead of the worktree. This reads
+every blob from the object store, so combined with
+GIT_PERF_GREP_THREADS it measures how well object reading scales.
 "
 
 . ./perf-lib.sh
@@ -27,6 +32,13 @@ then
 	test_set_prereq PERF_GREP_ENGINES_THREADS
 fi
 
+if test -n "$GIT_PERF_7820_GREP_REV"
+then
+	rev=" $GIT_PERF_7820_GREP_REV"
+else
+	rev=
+fi
+
 for pattern in \
 	'how.to' \
 	'^how to' \
@@ -49,14 +61,14 @@ do
 		fi
 		if ! test_have_prereq PERF_GREP_ENGINES_THREADS
 		then
-			test_perf $prereq "$engine grep$GIT_PERF_7820_GREP_OPTS '$pattern'" "
-				git -c grep.patternType=$engine grep$GIT_PERF_7820_GREP_OPTS -- '$pattern' >'out.$engine' || :
+			test_perf $prereq "$engine grep$GIT_PERF_7820_GREP_OPTS '$pattern'$rev" "
+				git -c grep.patternType=$engine grep$GIT_PERF_7820_GREP_OPTS -e '$pattern'$rev >'out.$engine' || :
 			"
 		else
 			for threads in $GIT_PERF_GREP_THREADS
 			do
-				test_perf PTHREADS,$prereq "$engine grep$GIT_PERF_7820_GREP_OPTS '$pattern' with $threads threads" "
-					git -c grep.patternType=$engine -c grep.threads=$threads grep$GIT_PERF_7820_GREP_OPTS -- '$pattern' >'out.$engine.$threads' || :
+				test_perf PTHREADS,$prereq "$engine grep$GIT_PERF_7820_GREP_OPTS '$pattern'$rev with $threads threads" "
+					git -c grep.patternType=$engine -c grep.threads=$threads grep$GIT_PERF_7820_GREP_OPTS -e '$pattern'$rev >'out.$engine.$threads' || :
 				"
 			done
 		fi
@@ -342,6 +342,68 @@ test_expect_success 'query binary macro directly' '
 	test_cmp expect actual
 '
 
+test_expect_success 'setup many rules' '
+	git init many &&
+	(
+		cd many &&
+		echo "[attr]lfs filter=lfs -text" >.gitattributes &&
+		for i in $(test_seq 20)
+		do
+			echo "file$i test=lit$i" &&
+			echo "*.ext$i test=ext$i" || return 1
+		done >>.gitattributes &&
+		cat >>.gitattributes <<-\EOF &&
+		*.bin lfs
+		[Mm]akefile test=glob
+		dir/*.ext3 test=dir3
+		dir/ test=dir
+		file7 -test
+		EOF
+		mkdir -p sub/deeper dir &&
+		for i in $(test_seq 20)
+		do
+			echo "*.ext$i test=sub$i" || return 1
+		done >sub/.gitattributes &&
+		echo "file2 test=sub-lit2" >>sub/.gitattributes &&
+		echo "*.bin -lfs" >>sub/.gitattributes
+	)
+'
+
+test_expect_success 'check-attr with many rules' '
+	cat >many/expect <<-\EOF &&
+	file1: test: lit1
+	file1: filter: unspecified
+	file7: test: unset
+	x.ext2: test: ext2
+	x.ext2: filter: unspecified
+	x.ext20: test: ext20
+	x.ext: test: unspecified
+	file2.ext12: test: ext12
+	dir/x.ext3: test: dir3
+	dir/x.ext4: test: ext4
+	Makefile: test: glob
+	makefile: test: glob
+	a.bin: filter: lfs
+	sub/a.bin: filter: unspecified
+	sub/file1: test: lit1
+	sub/file2: test: sub-lit2
+	sub/x.ext5: test: sub5
+	sub/deeper/x.ext5: test: sub5
+	sub/deeper/file2: test: sub-lit2
+	EOF
+	(
+		cd many &&
+		sed -e "s/: .*//" expect | uniq >paths &&
+		git check-attr --stdin test filter <paths >stdin &&
+		git check-attr test filter -- $(cat paths) >actual &&
+		test_cmp stdin actual &&
+		while read line
+		do
+			grep -x -F "$line" actual || return 1
+		done <expect
+	)
+'
+
 test_expect_success SYMLINKS 'set up symlink tests' '
 	echo "* test" >attr &&
 	rm -f .gitattributes
@@ -865,6 +865,150 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	test_cmp expect actual
 '
 
+############################################################################
+#
+# test the indexed pattern matcher against trying the patterns one by one
+
+test_expect_success 'setup many patterns' '
+	git init matcher &&
+	(
+		cd matcher &&
+		mkdir -p a/b/c build doc/api src/gen Sub &&
+		for i in $(test_seq 40)
+		do
+			echo "lit$i" &&
+			echo "*.ext$i" &&
+			echo "pre$i*" &&
+			echo "/top$i" &&
+			echo "a/b/deep$i" || return 1
+		done >.gitignore &&
+		cat >>.gitignore <<-\EOF &&
+		*.o
+		!keep.o
+		!src/gen/*.o
+		build/
+		!/build/
+		doc/api-*
+		!doc/api-keep*
+		[Ss]ub/
+		*.py[co]
+		**/c/x*
+		lit7/
+		!pre3*.txt
+		*~
+		\!bang
+		EOF
+		mkdir -p src/deeper &&
+		echo "*.ext3" >src/.gitignore &&
+		echo "!lit9" >>src/.gitignore &&
+		echo "/gen/keep*" >>src/.gitignore &&
+		cat >paths <<-\EOF
+		lit1
+		lit40
+		lit41
+		a/lit2
+		LIT2
+		lit7
+		lit7/file
+		x.ext3
+		src/x.ext3
+		src/deeper/x.ext3
+		x.ext30
+		x.ext
+		pre3
+		pre3.txt
+		pre30.txt
+		a/pre5x
+		top1
+		a/top1
+		top1/file
+		a/b/deep3
+		a/b/deep3/file
+		b/deep3
+		file.o
+		keep.o
+		a/keep.o
+		src/gen/file.o
+		src/gen/keep.o
+		src/gen/keeper
+		build
+		build/file
+		a/build
+		doc/api-x
+		doc/api-keep1
+		doc/api-keep1/file
+		sub
+		Sub
+		a/Sub
+		x.pyc
+		x.pyd
+		a/b/c/xy
+		c/xy
+		file~
+		!bang
+		bang
+		src/lit9
+		lit9
+		EOF
+	)
+'
+
+test_expect_success 'check-ignore with many patterns' '
+	(
+		cd matcher &&
+		GIT_TEST_PATTERN_MATCHER=false \
+			git check-ignore -v -n --stdin <paths >expect &&
+		GIT_TEST_PATTERN_MATCHER=true \
+			git check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual &&
+		git check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual &&
+		grep "^.gitignore:.*	lit40$" expect &&
+		grep "^::	LIT2$" expect &&
+		grep "^.gitignore:.*:!keep.o	keep.o$" expect &&
+		grep "^src/.gitignore:.*:!lit9	src/lit9$" expect
+	)
+'
+
+test_expect_success 'check-ignore with many patterns, ignoring case' '
+	(
+		cd matcher &&
+		GIT_TEST_PATTERN_MATCHER=false git -c core.ignorecase=true \
+			check-ignore -v -n --stdin <paths >expect &&
+		GIT_TEST_PATTERN_MATCHER=true git -c core.ignorecase=true \
+			check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual &&
+		grep "^.gitignore:.*	LIT2$" expect
+	)
+'
+
+test_expect_success 'status with many patterns' '
+	(
+		cd matcher &&
+		for path in lit1 lit40 a/lit2 LIT2 lit7/file x.ext3 src/x.ext3 \
+			src/deeper/x.ext3 x.ext30 pre3.txt pre30.txt a/pre5x \
+			top1/file a/top1 a/b/deep3/file b/deep3 file.o keep.o \
+			a/keep.o src/gen/file.o src/gen/keep.o src/gen/keeper \
+			build/file a/build/file doc/api-x doc/api-keep1/file \
+			Sub/file a/Sub/file x.pyc x.pyd a/b/c/xy c/xy file~ \
+			bang src/lit9 lit9
+		do
+			mkdir -p "$(dirname "$path")" &&
+			>"$path" || return 1
+		done &&
+		GIT_TEST_PATTERN_MATCHER=false \
+			git status --porcelain --ignored -uall >expect &&
+		GIT_TEST_PATTERN_MATCHER=true \
+			git status --porcelain --ignored -uall >actual &&
+		test_cmp expect actual &&
+		GIT_TEST_PATTERN_MATCHER=false \
+			git status --porcelain --ignored=matching >expect &&
+		GIT_TEST_PATTERN_MATCHER=true \
+			git status --porcelain --ignored=matching >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success SYMLINKS 'set up ignore file for symlink tests' '
 	echo "*" >ignore &&
 	rm -f .gitignore .git/info/exclude
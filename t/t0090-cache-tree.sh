@@ -276,4 +276,60 @@ test_expect_success 'switching trees does not invalidate shared index' '
 	)
 '
 
+test_expect_success 'setup repository for threaded cache-tree update' '
+	git init threaded &&
+	(
+		cd threaded &&
+		for i in 1 2 3 4 5 6 7 8
+		do
+			mkdir -p dir$i/sub dir$i/empty-ish &&
+			echo $i >dir$i/file &&
+			echo $i >dir$i/sub/one &&
+			echo $i$i >dir$i/sub/two || return 1
+		done &&
+		echo top >top &&
+		git add . &&
+		git commit -q -m initial
+	)
+'
+
+test_expect_success 'threaded cache-tree update builds the same trees' '
+	(
+		cd threaded &&
+		for i in 2 3 5 8
+		do
+			echo changed >dir$i/sub/one &&
+			echo new >dir$i/empty-ish/new || return 1
+		done &&
+		echo changed >dir1/file &&
+		git add . &&
+		echo ita >dir4/sub/ita &&
+		git add -N dir4/sub/ita &&
+		cp .git/index index.orig &&
+
+		git -c index.threads=1 write-tree >expect &&
+		test-tool dump-cache-tree >expect.cache-tree &&
+		cp index.orig .git/index &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git -c index.threads=4 write-tree >actual &&
+		test-tool dump-cache-tree >actual.cache-tree &&
+		grep "\"key\":\"update/jobs\"" trace.event &&
+		test_cmp expect actual &&
+		test_cmp expect.cache-tree actual.cache-tree
+	)
+'
+
+test_expect_success 'threaded cache-tree update reports missing objects once' '
+	(
+		cd threaded &&
+		git update-index --add --cacheinfo \
+			100644,$(test_oid deadbeef),dir6/sub/missing &&
+		cp .git/index index.orig &&
+		test_must_fail git -c index.threads=1 write-tree 2>expect &&
+		cp index.orig .git/index &&
+		test_must_fail git -c index.threads=4 write-tree 2>actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -191,6 +191,18 @@ test_expect_success 'pack-objects with large loose object' '
 	test_cmp huge actual
 '
 
+test_expect_success 'unpack-objects streams large blobs' '
+	test_create_repo stream &&
+	huge=$(git hash-object huge) &&
+	git hash-object huge large1 >blobs &&
+	git pack-objects --stdout <blobs >blobs.pack &&
+	GIT_DIR=stream/.git git unpack-objects --strict <blobs.pack &&
+	test_path_is_file stream/.git/objects/$(test_oid_to_path $huge) &&
+	GIT_DIR=stream/.git git cat-file blob $huge >actual &&
+	test_cmp huge actual &&
+	GIT_DIR=stream/.git git fsck
+'
+
 test_expect_success 'tar archiving' '
 	git archive --format=tar HEAD >/dev/null
 '
@@ -330,6 +330,29 @@ test_expect_success 'checkout and reset (mixed) [sparse]' '
 	test_sparse_match git reset update-folder2
 '
 
+test_expect_success 'staged changes outside the sparse definition' '
+	init_repos &&
+
+	test_all_match git checkout -b soft-reset-test update-folder1 &&
+	test_all_match git reset --soft base &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git diff --cached --name-status &&
+	test_all_match git diff --cached HEAD -- folder1 &&
+	test_all_match git diff --stat update-deep &&
+	test_all_match git commit -m "update folder1 again" &&
+	test_all_match git rev-parse HEAD^{tree} &&
+
+	test_sparse_match git reset base &&
+	test_sparse_match git status --porcelain=v2 &&
+	test_sparse_match git reset update-folder2 -- folder2 &&
+	test_sparse_match git diff --cached --name-status &&
+	test_sparse_match git reset &&
+	test_sparse_match git diff --cached --name-status &&
+
+	test_sparse_match git checkout --orphan orphan-test &&
+	test_sparse_match git status --porcelain=v2
+'
+
 test_expect_success 'merge' '
 	init_repos &&
 
@@ -403,14 +426,56 @@ test_expect_success 'sparse-index is expanded and converted back' '
 	init_repos &&
 
 	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
-		git -C sparse-index -c core.fsmonitor="" reset --hard &&
+		git -C sparse-index -c core.fsmonitor="" reset -- folder1/a &&
 	test_region index convert_to_sparse trace2.txt &&
-	test_region index ensure_full_index trace2.txt &&
+	test_region index ensure_full_index trace2.txt
+'
 
-	rm trace2.txt &&
+ensure_not_expanded () {
+	rm -f trace2.txt &&
+	echo >>sparse-index/untracked.txt &&
 	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
-		git -C sparse-index -c core.fsmonitor="" status -uno &&
-	test_region index ensure_full_index trace2.txt
+		git -C sparse-index "$@" &&
+	test_region ! index ensure_full_index trace2.txt
+}
+
+test_expect_success 'sparse-index is not expanded' '
+	init_repos &&
+
+	ensure_not_expanded status &&
+	ensure_not_expanded status -uno &&
+	ensure_not_expanded status --porcelain=v2 -- deep &&
+	ensure_not_expanded commit --allow-empty -m empty &&
+	echo >>sparse-index/a &&
+	ensure_not_expanded commit -a -m a &&
+	echo >>sparse-index/a &&
+	ensure_not_expanded commit --include a -m a &&
+	echo >>sparse-index/deep/deeper1/a &&
+	ensure_not_expanded commit --include deep/deeper1/a -m deeper &&
+	ensure_not_expanded checkout rename-out-to-out &&
+	ensure_not_expanded checkout - &&
+	ensure_not_expanded switch rename-out-to-out &&
+	ensure_not_expanded switch - &&
+
+	echo >>sparse-index/README.md &&
+	ensure_not_expanded add -A &&
+	echo >>sparse-index/extra.txt &&
+	ensure_not_expanded add extra.txt &&
+	echo >>sparse-index/untracked.txt &&
+	ensure_not_expanded add . &&
+
+	ensure_not_expanded diff &&
+	ensure_not_expanded diff --cached &&
+	ensure_not_expanded diff HEAD &&
+	ensure_not_expanded diff --stat update-folder1 &&
+	ensure_not_expanded diff --cached -- deep &&
+
+	ensure_not_expanded reset --soft update-deep &&
+	ensure_not_expanded reset update-folder1 &&
+	ensure_not_expanded reset --hard update-deep &&
+	ensure_not_expanded reset --keep base &&
+	ensure_not_expanded reset --merge update-deep &&
+	ensure_not_expanded reset --hard
 '
 
 test_done
@@ -0,0 +1,168 @@
+#!/bin/sh
+
+test_description='index journal'
+
+. ./test-lib.sh
+
+# We need total control over the index format here
+sane_unset GIT_TEST_INDEX_JOURNAL
+sane_unset GIT_TEST_SPLIT_INDEX
+sane_unset GIT_TEST_FSMONITOR
+
+# Run a git command both here, where the index uses a journal, and in
+# "plain", where it does not.
+both () {
+	git "$@" &&
+	git -C plain "$@"
+}
+
+# Write a file both here and in "plain".
+write_both () {
+	echo "$2" >"$1" &&
+	echo "$2" >"plain/$1"
+}
+
+compare_indexes () {
+	git ls-files -s >actual &&
+	git -C plain ls-files -s >expect &&
+	test_cmp expect actual &&
+	git diff --cached --name-status >actual &&
+	git -C plain diff --cached --name-status >expect &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo $i >file$i || return 1
+	done &&
+	mkdir dir other &&
+	echo sub >dir/sub &&
+	for i in $(test_seq 20)
+	do
+		echo $i >other/$i || return 1
+	done &&
+	cat >.gitignore <<-\EOF &&
+	/plain
+	/expect
+	/actual
+	/index.*
+	/journal.*
+	EOF
+	git add . &&
+	git commit -m initial &&
+
+	git clone -q . plain &&
+	git -C plain config index.journal false &&
+
+	git config index.journal true &&
+	git config index.journalMaxPercent 100 &&
+	git update-index --force-write-index &&
+	test_path_is_missing .git/index.journal &&
+	compare_indexes
+'
+
+test_expect_success 'small updates are appended to the journal' '
+	cp .git/index index.orig &&
+
+	write_both file1 changed &&
+	both add file1 &&
+	write_both new new &&
+	both add new &&
+	both rm --cached -q file2 &&
+	both update-index --chmod=+x file3 &&
+	both mv file4 dir/file4 &&
+
+	test_cmp_bin index.orig .git/index &&
+	test_path_is_file .git/index.journal &&
+	compare_indexes
+'
+
+test_expect_success 'a path can be removed and added again' '
+	cp .git/index index.orig &&
+
+	both rm --cached -q file5 &&
+	both add file5 &&
+	both rm --cached -q new &&
+	write_both new again &&
+	both add new &&
+
+	test_cmp_bin index.orig .git/index &&
+	compare_indexes
+'
+
+test_expect_success 'unmerged entries are journaled' '
+	cp .git/index index.orig &&
+	blob1=$(git rev-parse :file6) &&
+	blob2=$(git rev-parse :file7) &&
+	cat >index-info <<-EOF &&
+	0 $ZERO_OID	file6
+	100644 $blob1 1	file6
+	100644 $blob2 2	file6
+	100644 $blob1 3	file6
+	EOF
+	git update-index --index-info <index-info &&
+	git -C plain update-index --index-info <index-info &&
+	test_cmp_bin index.orig .git/index &&
+	compare_indexes &&
+
+	both update-index --add file6 &&
+	test_cmp_bin index.orig .git/index &&
+	compare_indexes
+'
+
+test_expect_success 'commit from a journaled index' '
+	both commit -q -m journaled &&
+	git diff --cached --exit-code &&
+	git -C plain rev-parse HEAD^{tree} >expect &&
+	git rev-parse HEAD^{tree} >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the journal is compacted when it grows too large' '
+	cp .git/index index.orig &&
+	write_both file8 changed &&
+	both -c index.journalMaxPercent=0 add file8 &&
+	! test_cmp_bin index.orig .git/index &&
+	compare_indexes &&
+
+	# the old journal no longer applies and is replaced
+	cp .git/index index.orig &&
+	write_both file9 changed &&
+	both add file9 &&
+	test_cmp_bin index.orig .git/index &&
+	compare_indexes
+'
+
+test_expect_success 'a journal for another index is ignored' '
+	cp .git/index.journal journal.orig &&
+	git update-index --force-write-index &&
+	cp journal.orig .git/index.journal &&
+	compare_indexes
+'
+
+test_expect_success 'a truncated journal is ignored' '
+	write_both file10 changed &&
+	both add file10 &&
+	cp .git/index.journal journal.orig &&
+	cp .git/index index.orig &&
+
+	# a writer that died in the middle of an append
+	printf "\\0\\0\\0\\0\\0\\0\\0\\1garbage" >>.git/index.journal &&
+	compare_indexes &&
+
+	# ... which the next writer does not append to
+	write_both dir/sub changed &&
+	both add dir/sub &&
+	! test_cmp_bin index.orig .git/index &&
+	compare_indexes
+'
+
+test_expect_success 'disabling the journal removes it' '
+	write_both file7 changed &&
+	both -c index.journal=false add file7 &&
+	test_path_is_missing .git/index.journal &&
+	compare_indexes
+'
+
+test_done
@@ -226,4 +226,91 @@ test_expect_success SYMLINKS 'parallel checkout checks for symlinks in leading d
 	)
 '
 
+# Removals and the creation of leading directories are done by threads, which
+# must leave the same working tree behind as doing them one by one.
+test_expect_success 'setup repo with many directories' '
+	git init many_dirs &&
+	(
+		cd many_dirs &&
+		for d in a a/b a/b/c b b/c d e/f/g
+		do
+			mkdir -p $d &&
+			for i in 1 2 3
+			do
+				echo "$d/$i" >$d/file$i || return 1
+			done
+		done &&
+		git add . &&
+		git commit -m full &&
+		git branch full &&
+		git rm -rq a/b b e &&
+		mkdir -p n/o/p q &&
+		echo new >n/o/p/new &&
+		echo new >q/new &&
+		git add n q &&
+		git commit -m removed &&
+		git branch removed &&
+		git checkout -q full
+	)
+'
+
+for mode in sequential parallel
+do
+	case $mode in
+	sequential) workers=1 threshold=0 expected_workers=0 ;;
+	parallel)   workers=3 threshold=0 expected_workers=3 ;;
+	esac
+
+	test_expect_success "$mode removal and directory creation" '
+		repo=many_dirs_$mode &&
+		cp -R -P many_dirs $repo &&
+		echo untracked >$repo/b/c/untracked &&
+		set_checkout_config $workers $threshold &&
+		GIT_TRACE2_EVENT="$(pwd)/$repo.trace" GIT_TRACE2_EVENT_NESTING=10 \
+			git -C $repo checkout -q removed &&
+		git -C $repo diff-index --exit-code HEAD &&
+		test_path_is_missing $repo/a/b &&
+		test_path_is_missing $repo/e &&
+		test_path_is_file $repo/b/c/untracked &&
+		test_path_is_missing $repo/b/c/file1 &&
+		test_path_is_file $repo/n/o/p/new &&
+		if test $expected_workers -gt 0
+		then
+			grep "\"key\":\"parallel_removal/workers\",\"value\":\"$expected_workers\"" \
+				$repo.trace
+		else
+			! grep parallel_removal $repo.trace
+		fi
+	'
+done
+
+test_expect_success 'compare the working trees after removal' '
+	rm -rf many_dirs_*/.git &&
+	git diff --no-index many_dirs_sequential many_dirs_parallel &&
+	(cd many_dirs_sequential && find . -type d | sort) >expect &&
+	(cd many_dirs_parallel && find . -type d | sort) >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success SYMLINKS 'parallel removal checks for symlinks in leading dirs' '
+	set_checkout_config 2 0 &&
+	git init removal_symlinks &&
+	(
+		cd removal_symlinks &&
+		test_commit base &&
+		mkdir D untracked &&
+		test_commit D/A &&
+		test_commit D/B &&
+		test_commit D/C &&
+		cp D/*.t untracked/ &&
+		rm -rf D &&
+		ln -s untracked D &&
+
+		git checkout -f base &&
+		test_path_is_file untracked/A.t &&
+		test_path_is_file untracked/B.t &&
+		test_path_is_file untracked/C.t
+	)
+'
+
 test_done
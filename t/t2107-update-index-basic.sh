@@ -92,4 +92,16 @@ test_expect_success '--chmod=+x and chmod=-x in the same argument list' '
 	test_cmp expect actual
 '
 
+test_expect_success '--stdin with core.fsyncObjectFiles=batch' '
+	echo one >one &&
+	echo two >two &&
+	printf "%s\n" one two |
+	git -c core.fsyncObjectFiles=batch update-index --add --stdin &&
+	git rev-parse :one :two >actual &&
+	git hash-object one two >expect &&
+	test_cmp expect actual &&
+	git cat-file -e $(git rev-parse :one) &&
+	git cat-file -e $(git rev-parse :two)
+'
+
 test_done
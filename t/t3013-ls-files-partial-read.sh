@@ -0,0 +1,134 @@
+#!/bin/sh
+
+test_description='ls-files only reads the index entries under the pathspec'
+
+. ./test-lib.sh
+
+# The split index is always read in full
+sane_unset GIT_TEST_SPLIT_INDEX
+sane_unset GIT_TEST_FSMONITOR
+
+# Compare "git ls-files $@ -- $1/" with what reading the whole index
+# gives, and check that only the entries whose name starts with "$1"
+# were read.
+check_slice () {
+	prefix=$1 &&
+	shift &&
+	git ls-files "$@" >all &&
+	grep -E "(^|[	 ])$prefix/" all >expect &&
+	nr=$(git ls-files -s | grep -c "	$prefix") &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git ls-files "$@" -- "$prefix/" >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"read/cache_nr\",\"value\":\"$nr\"" trace.event &&
+	rm trace.event
+}
+
+test_expect_success 'setup' '
+	for dir in a b b-c b/c c
+	do
+		mkdir -p $dir &&
+		for i in $(test_seq 20)
+		do
+			echo $i >$dir/file$i || return 1
+		done
+	done &&
+	echo top >b.txt &&
+	cat >.gitignore <<-\EOF &&
+	/all
+	/expect
+	/actual
+	/trace.event
+	EOF
+	git add . &&
+	git commit -q -m initial &&
+	echo 21 >b/c/file21 &&
+	git add -N b/c/file21 &&
+	git update-index --index-version 2
+'
+
+test_expect_success 'read the entries under a prefix' '
+	check_slice a -s &&
+	check_slice b -s &&
+	check_slice b/c -s &&
+	check_slice c -s
+'
+
+test_expect_success 'read the entries under the current directory' '
+	(
+		cd b &&
+		GIT_TRACE2_EVENT="$(pwd)/../trace.event" git ls-files >../actual
+	) &&
+	git ls-files b/ | sed "s|^b/||" >expect &&
+	test_cmp expect actual &&
+	nr=$(git ls-files -s | grep -c "	b") &&
+	grep "\"key\":\"read/cache_nr\",\"value\":\"$nr\"" trace.event &&
+	rm trace.event
+'
+
+test_expect_success 'a prefix without entries' '
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" git ls-files -- nothing/ >actual &&
+	test_must_be_empty actual &&
+	grep "\"key\":\"read/cache_nr\",\"value\":\"0\"" trace.event &&
+	rm trace.event
+'
+
+for version in 3 4
+do
+	test_expect_success "index v$version" "
+		git update-index --index-version $version &&
+		check_slice a -s &&
+		check_slice b/c -s &&
+		check_slice c -s
+	"
+
+	test_expect_success "index v$version with an offset table" "
+		git -c index.threads=4 update-index --force-write-index &&
+		check_slice a -s &&
+		check_slice b -s &&
+		check_slice b/c -s &&
+		check_slice c -s
+	"
+done
+
+test_expect_success 'unmerged entries' '
+	blob=$(git rev-parse :b/file1) &&
+	cat >index-info <<-EOF &&
+	0 $ZERO_OID	b/file1
+	100644 $blob 1	b/file1
+	100644 $blob 2	b/file1
+	EOF
+	git update-index --index-info <index-info &&
+	check_slice b -s &&
+	check_slice a -s &&
+	git update-index --add b/file1
+'
+
+test_expect_success 'the fsmonitor bitmap applies to the loaded entries' '
+	test_config core.fsmonitor .git/hooks/fsmonitor-test &&
+	write_script .git/hooks/fsmonitor-test <<-\EOF &&
+	printf "token\0"
+	cat .git/dirty
+	EOF
+	printf "b/file2\0b/c/file3\0c/file4\0" >.git/dirty &&
+	git update-index --fsmonitor --force-write-index &&
+	>.git/dirty &&
+	check_slice b -f &&
+	check_slice b/c -f &&
+	check_slice c -f &&
+	git update-index --no-fsmonitor
+'
+
+test_expect_success 'a split index is read in full' '
+	git update-index --split-index &&
+	git ls-files -s | grep "	c/" >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" git ls-files -s -- c/ >actual &&
+	test_cmp expect actual &&
+	git ls-files >all &&
+	grep "\"key\":\"read/cache_nr\",\"value\":\"$(wc -l <all | tr -d " ")\"" \
+		trace.event &&
+	rm trace.event &&
+	git update-index --no-split-index
+'
+
+test_done
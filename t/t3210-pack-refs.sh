@@ -256,4 +256,66 @@ test_expect_success SYMLINKS 'pack symlinked packed-refs' '
 	test "$(readlink .git/packed-refs)" = "my-deviant-packed-refs"
 '
 
+test_expect_success 'pack-refs writes packed-refs.idx when enabled' '
+	git tag -a -m annotated indexed-tag &&
+	git update-ref refs/pull/1/head refs/heads/main &&
+	git update-ref refs/pull/2/head refs/heads/main &&
+	git for-each-ref --format="%(refname) %(objectname) %(*objectname)" >expect &&
+	git -c core.packedRefsIndex=true pack-refs --all --prune &&
+	test_path_is_file .git/packed-refs.idx &&
+	git for-each-ref --format="%(refname) %(objectname) %(*objectname)" >actual &&
+	test_cmp expect actual &&
+	grep "^refs/pull/" expect >expect-pull &&
+	git for-each-ref --format="%(refname) %(objectname) %(*objectname)" \
+		refs/pull/ >actual-pull &&
+	test_cmp expect-pull actual-pull &&
+	git rev-parse refs/pull/2/head indexed-tag indexed-tag^{} &&
+	test_must_fail git show-ref --verify refs/pull/3/head &&
+	test_must_fail git show-ref --verify refs/heads/zzz
+'
+
+test_expect_success 'updates keep packed-refs.idx current' '
+	git -c core.packedRefsIndex=true update-ref -d refs/pull/1/head &&
+	test_path_is_file .git/packed-refs.idx &&
+	test_must_fail git show-ref --verify refs/pull/1/head &&
+	git show-ref --verify refs/pull/2/head
+'
+
+test_expect_success 'packed-refs.idx is consulted' '
+	test_when_finished "rm -f trace.event" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git show-ref --verify refs/pull/2/head &&
+	grep "\"key\":\"packed-refs-index\",\"value\":\"used\"" trace.event
+'
+
+test_expect_success 'packed-refs.idx is rejected after a rewrite outside git' '
+	test_when_finished "rm -f trace.event" &&
+	cp .git/packed-refs packed-refs.bak &&
+	test_when_finished "mv packed-refs.bak .git/packed-refs" &&
+	old=$(git rev-parse refs/pull/2/head) &&
+	new=$(git rev-parse HEAD^{tree}) &&
+	sed "s,^$old refs/pull/2/head\$,$new refs/pull/2/head," \
+		packed-refs.bak >.git/packed-refs &&
+	test_file_size .git/packed-refs >size &&
+	test_file_size packed-refs.bak >expect.size &&
+	test_cmp expect.size size &&
+	touch -r packed-refs.bak .git/packed-refs &&
+	echo $new >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git rev-parse refs/pull/2/head >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"packed-refs-index\",\"value\":\"stale\"" trace.event
+'
+
+test_expect_success 'stale packed-refs.idx is ignored' '
+	cp .git/packed-refs.idx idx.bak &&
+	git -c core.packedRefsIndex=false update-ref -d refs/pull/2/head &&
+	test_path_is_missing .git/packed-refs.idx &&
+	mv idx.bak .git/packed-refs.idx &&
+	test_when_finished "rm -f .git/packed-refs.idx" &&
+	test_must_fail git show-ref --verify refs/pull/2/head &&
+	git for-each-ref refs/pull/ >actual &&
+	test_must_be_empty actual
+'
+
 test_done
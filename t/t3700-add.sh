@@ -462,6 +462,26 @@ test_expect_success 'all statuses changed in folder if . is given' '
 	)
 '
 
+test_expect_success 'add and commit with core.fsyncObjectFiles=batch' '
+	test_create_repo fsync-batch &&
+	(
+		cd fsync-batch &&
+		git config core.fsyncObjectFiles batch &&
+		mkdir dir &&
+		for i in 1 2 3 4 5
+		do
+			echo $i >dir/file$i || return 1
+		done &&
+		git add dir &&
+		git commit -m batch &&
+		ls .git/objects >dirs &&
+		! grep incoming- dirs &&
+		git count-objects -v >count &&
+		grep "^count: 8$" count &&
+		git fsck
+	)
+'
+
 test_expect_success CASE_INSENSITIVE_FS 'path is case-insensitive' '
 	path="$(pwd)/BLUB" &&
 	touch "$path" &&
@@ -8,6 +8,9 @@ export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
 
 GIT_TEST_COMMIT_GRAPH=0
 GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS=0
+GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS=0
 
 test_expect_success 'setup test - repo, commits, commit graph, log outputs' '
 	git init &&
@@ -405,4 +408,83 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+test_expect_success 'setup history for threaded Bloom filters' '
+	git init threads &&
+	(
+		cd threads &&
+		for i in $(test_seq 200)
+		do
+			echo "commit refs/heads/main" &&
+			echo "committer C O Mitter <committer@example.com> $((1112912053 + i)) -0700" &&
+			echo "data <<EOF" &&
+			echo "commit $i" &&
+			echo "EOF" &&
+			echo "M 100644 inline file$((i % 7))" &&
+			echo "data <<EOF" &&
+			echo "$i" &&
+			echo "EOF" &&
+			echo "M 100644 inline dir$((i % 5))/sub$((i % 3))/file$i" &&
+			echo "data <<EOF" &&
+			echo "$i" &&
+			echo "EOF" &&
+			if test $((i % 10)) = 0
+			then
+				echo "D dir$((i % 5))/sub1"
+			fi &&
+			if test $((i % 11)) = 0
+			then
+				echo "D file$((i % 7))" &&
+				echo "M 100755 inline file$((i % 7))/x" &&
+				echo "data <<EOF" &&
+				echo "$i" &&
+				echo "EOF"
+			fi &&
+			if test $((i % 13)) = 0
+			then
+				echo "M 160000 $(test_oid deadbeef) sub$i"
+			fi &&
+			if test $i = 100
+			then
+				for j in $(test_seq 30)
+				do
+					echo "M 100644 inline large/file$j" &&
+					echo "data <<EOF" &&
+					echo "$j" &&
+					echo "EOF" || return 1
+				done
+			fi || return 1
+		done >input &&
+		git fast-import <input &&
+		git checkout -q main
+	)
+'
+
+test_expect_success 'Bloom filters do not depend on the number of threads' '
+	(
+		cd threads &&
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=20 \
+			git -c commitGraph.threads=1 commit-graph write \
+				--reachable --changed-paths &&
+		mv .git/objects/info/commit-graph expect &&
+
+		rm -f trace.event &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=20 \
+			git -c commitGraph.threads=3 commit-graph write \
+				--reachable --changed-paths &&
+		test_cmp_bin expect .git/objects/info/commit-graph &&
+		grep "\"key\":\"filter-threads\",\"value\":\"3\"" trace.event &&
+		test_filter_computed 200 trace.event &&
+		test_filter_trunc_large 1 trace.event &&
+
+		for path in file3 file4/x dir1 dir2/sub1 dir0/sub2/file5 \
+			large sub13 nothing
+		do
+			git -c core.commitGraph=false log --format=%H -- $path >expect &&
+			git log --format=%H -- $path >actual &&
+			test_cmp expect actual || return 1
+		done
+	)
+'
+
 test_done
@@ -0,0 +1,148 @@
+#!/bin/sh
+
+test_description='git log and git blame for a path with exact changed-path lists'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS=0
+
+# Turn off any inherited trace2 settings for this test.
+sane_unset GIT_TRACE2 GIT_TRACE2_PERF GIT_TRACE2_EVENT
+sane_unset GIT_TRACE2_PERF_BRIEF
+sane_unset GIT_TRACE2_CONFIG_PARAMS
+
+test_expect_success 'setup' '
+	mkdir A A/B A/B/C &&
+	test_commit c1 A/file1 &&
+	test_commit c2 A/B/file2 &&
+	test_commit c3 A/B/C/file3 &&
+	test_commit c4 A/file1 &&
+	test_commit c5 A/B/file2 &&
+	test_commit c6 A/B/C/file3 &&
+	test_commit c7 file_to_be_deleted &&
+	git checkout -b side HEAD~4 &&
+	test_commit side-1 file4 &&
+	test_commit side-2 A/B/file6 &&
+	git checkout main &&
+	git merge -m merge side &&
+	test_commit c8 file5 &&
+	git mv file5 file5_renamed &&
+	git commit -m "rename" &&
+	git rm file_to_be_deleted &&
+	git commit -m "file removed" &&
+	git rm -r A/B/C &&
+	test_commit C-is-a-file A/B/C &&
+	test_chmod +x A/file1 &&
+	git commit -m "mode change" &&
+	git commit --allow-empty -m "empty" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git commit-graph write --reachable --changed-path-lists &&
+	grep "\"key\":\"path-lists-computed\",\"value\":\"16\"" trace.event &&
+	test-tool read-graph >output &&
+	grep "^chunks: .* changed_path_lists" output &&
+	git commit-graph verify
+'
+
+setup () {
+	rm -f "$TRASH_DIRECTORY/trace.perf" &&
+	git -c core.commitGraph=false log --pretty="format:%s" $1 >log_wo_lists &&
+	GIT_TRACE2_PERF="$TRASH_DIRECTORY/trace.perf" git log --pretty="format:%s" $1 >log_w_lists
+}
+
+test_lists_used () {
+	setup "$1" &&
+	grep -q "statistics:{\"list_not_present\":${2:-0},\"same\"" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_lists log_w_lists
+}
+
+test_lists_not_used () {
+	setup "$1" &&
+	! grep -q "statistics:{\"list_not_present\":" "$TRASH_DIRECTORY/trace.perf" &&
+	test_cmp log_wo_lists log_w_lists
+}
+
+for path in A A/B A/B/C A/file1 A/B/file2 A/B/C/file3 A/B/file6 file4 file5 file5_renamed file_to_be_deleted path_does_not_exist
+do
+	for option in "" \
+		      "--full-history" \
+		      "--full-history --simplify-merges" \
+		      "--simplify-by-decoration" \
+		      "--remove-empty" \
+		      "--first-parent" \
+		      "--topo-order" \
+		      "--ancestry-path side..main"
+	do
+		test_expect_success "git log option: $option for path: $path" '
+			test_lists_used "$option -- $path" &&
+			test_config commitgraph.readChangedPaths false &&
+			test_lists_not_used "$option -- $path"
+		'
+	done
+done
+
+test_expect_success 'git log -- folder works with and without the trailing slash' '
+	test_lists_used "-- A" &&
+	test_lists_used "-- A/"
+'
+
+test_expect_success 'changed-path lists are not used for several paths or "."' '
+	test_lists_not_used "-- file4 A/file1" &&
+	test_lists_not_used "-- ." &&
+	test_lists_not_used "-- file*"
+'
+
+test_expect_success 'git blame gives the same output with changed-path lists' '
+	for path in A/file1 A/B/file2 A/B/C file5_renamed
+	do
+		git -c core.commitGraph=false blame $path >expect &&
+		GIT_TRACE2_PERF="$(pwd)/trace.perf" git blame $path >actual &&
+		test_cmp expect actual &&
+		grep "changed-path-lists/queries:[1-9]" trace.perf &&
+		rm trace.perf || return 1
+	done
+'
+
+test_expect_success 'commits with too many changed paths get no list' '
+	rm -f .git/objects/info/commit-graph &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=3 \
+		git commit-graph write --reachable --changed-path-lists &&
+	# c3, c6, the merge and C-is-a-file change more than three
+	# paths with their leading directories
+	grep "\"key\":\"path-lists-too-large\",\"value\":\"4\"" trace.event &&
+	git commit-graph verify &&
+	test_lists_used "-- A/B/file2" 4 &&
+	test_lists_used "--full-history -- A/B" 4
+'
+
+test_expect_success 'changed-path lists in a split commit-graph' '
+	# start over, as lists missing from the graph we replace stay missing
+	rm -f .git/objects/info/commit-graph &&
+	git commit-graph write --reachable --changed-path-lists &&
+	test_commit c9 A/B/file2 &&
+	git commit-graph write --reachable --split --no-changed-path-lists &&
+	test_commit c10 A/file1 &&
+	git commit-graph write --reachable --split=no-merge --changed-path-lists &&
+	test_line_count = 3 .git/objects/info/commit-graphs/commit-graph-chain &&
+	git commit-graph verify &&
+	test_lists_used "-- A/B/file2" 1 &&
+	test_lists_used "-- A" 1
+'
+
+test_expect_success 'changed-path lists are reused when merging layers' '
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git commit-graph write --reachable --split=replace &&
+	grep "\"key\":\"path-lists-computed\",\"value\":\"1\"" trace.event &&
+	grep "\"key\":\"path-lists-reused\",\"value\":\"17\"" trace.event &&
+	git commit-graph verify &&
+	test_lists_used "-- A/B/file2" &&
+	git commit-graph write --reachable --no-changed-path-lists &&
+	test-tool read-graph >output &&
+	! grep changed_path_lists output
+'
+
+test_done
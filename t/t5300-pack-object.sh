@@ -60,7 +60,7 @@ check_unpack () {
 	test_when_finished "rm -rf git2" &&
 	git init --bare git2 &&
 	git -C git2 unpack-objects -n <"$1".pack &&
-	git -C git2 unpack-objects <"$1".pack &&
+	git -C git2 $2 unpack-objects <"$1".pack &&
 	(cd .git && find objects -type f -print) |
 	while read path
 	do
@@ -84,6 +84,10 @@ test_expect_success 'unpack with REF_DELTA' '
 	check_unpack test-2-${packname_2}
 '
 
+test_expect_success 'unpack with REF_DELTA (core.fsyncObjectFiles=batch)' '
+	check_unpack test-2-${packname_2} "-c core.fsyncObjectFiles=batch"
+'
+
 test_expect_success 'pack with OFS_DELTA' '
 	packname_3=$(git pack-objects --progress --delta-base-offset test-3 \
 			<obj-list 2>stderr) &&
@@ -618,4 +622,24 @@ test_expect_success 'negative window clamps to 0' '
 	check_deltas stderr = 0
 '
 
+test_expect_success PTHREADS 'threaded compression writes identical packs' '
+	git pack-objects --threads=1 --window=0 --no-reuse-object \
+		--stdout <obj-list >single.pack &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git pack-objects --threads=4 --window=0 --no-reuse-object \
+		--stdout <obj-list >threaded.pack &&
+	grep "\"key\":\"write_pack_file/compress_threads\",\"value\":\"4\"" trace &&
+	test_cmp_bin single.pack threaded.pack
+'
+
+test_expect_success PTHREADS 'threaded compression of deltas' '
+	git pack-objects --threads=4 --no-reuse-object --stdout \
+		<obj-list >threaded.pack &&
+	git index-pack --strict -o threaded.idx threaded.pack &&
+	git show-index <threaded.idx >actual.raw &&
+	cut -d" " -f2 <actual.raw | sort >actual &&
+	sort obj-list >expect &&
+	test_cmp expect actual
+'
+
 test_done
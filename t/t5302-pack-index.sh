@@ -284,4 +284,13 @@ test_expect_success 'index-pack -v --stdin produces progress for both phases' '
 	test_i18ngrep "Resolving deltas" err
 '
 
+test_expect_success PTHREADS 'threaded index-pack produces identical results' '
+	pack=$(git pack-objects --all pack </dev/null) &&
+	git index-pack --threads=1 -o single.idx pack-$pack.pack &&
+	git index-pack --threads=4 -o threaded.idx pack-$pack.pack &&
+	test_cmp_bin single.idx threaded.idx &&
+	git index-pack --threads=4 --strict -o strict.idx pack-$pack.pack &&
+	test_cmp_bin single.idx strict.idx
+'
+
 test_done
@@ -615,4 +615,46 @@ test_expect_success 'pack.preferBitmapTips' '
 	)
 '
 
+test_expect_success 'bitmap lookup table' '
+	git init lookup &&
+	test_when_finished "rm -fr lookup" &&
+	(
+		cd lookup &&
+
+		test_commit_bulk --id=file 150 &&
+		git checkout -b side HEAD~50 &&
+		test_commit_bulk --id=side 50 &&
+		git checkout - &&
+		git merge -m merge side &&
+
+		git repack -adb &&
+		test-tool bitmap list-commits | sort >expect.commits &&
+		git rev-list --objects --all >expect.objects &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git -c pack.writeBitmapLookupTable=true repack -adb &&
+		grep "\"category\":\"pack-bitmap-write\",\"label\":\"writing_lookup_table\"" trace &&
+
+		git rev-list --test-bitmap HEAD &&
+		git rev-list --test-bitmap side &&
+		test-tool bitmap list-commits | sort >actual.commits &&
+		test_cmp expect.commits actual.commits &&
+
+		for rev in HEAD side HEAD~10 side~3..HEAD --all
+		do
+			git rev-list --objects $rev >expect &&
+			git rev-list --objects --use-bitmap-index $rev >actual &&
+			test_bitmap_traversal expect actual &&
+
+			GIT_TEST_READ_COMMIT_TABLE=0 \
+				git rev-list --objects --use-bitmap-index $rev >actual &&
+			test_bitmap_traversal expect actual || return 1
+		done &&
+
+		# reusing existing bitmaps works through the lookup table, too
+		git -c pack.writeBitmapLookupTable=true repack -adb &&
+		git rev-list --test-bitmap HEAD
+	)
+'
+
 test_done
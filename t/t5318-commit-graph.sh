@@ -4,6 +4,9 @@ test_description='commit graph'
 . ./test-lib.sh
 
 GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS=0
+GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS=0
 
 test_expect_success 'setup full repo' '
 	mkdir full &&
@@ -5,6 +5,9 @@ test_description='split commit graph'
 
 GIT_TEST_COMMIT_GRAPH=0
 GIT_TEST_COMMIT_GRAPH_CHANGED_PATHS=0
+GIT_TEST_COMMIT_GRAPH_REACHABILITY_LABELS=0
+GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA=0
+GIT_TEST_COMMIT_GRAPH_CHANGED_PATH_LISTS=0
 
 test_expect_success 'setup repo' '
 	git init &&
@@ -634,4 +637,60 @@ test_expect_success 'write generation data chunk when commit-graph chain is repl
 	)
 '
 
+# Check "git merge-base --is-ancestor" between all pairs of "commits/*"
+# branches, with and without the commit-graph.
+check_is_ancestor () {
+	git for-each-ref --format="%(refname)" refs/heads/commits/ >refs &&
+	for a in $(cat refs)
+	do
+		for b in $(cat refs)
+		do
+			if git -c core.commitGraph=false \
+				merge-base --is-ancestor $a $b
+			then
+				expect=0
+			else
+				expect=1
+			fi &&
+			test_expect_code $expect \
+				git merge-base --is-ancestor $a $b || return 1
+		done
+	done
+}
+
+test_expect_success 'reachability labels in a split commit-graph' '
+	git init labels &&
+	(
+		cd labels &&
+		git config core.commitGraph true &&
+		for i in $(test_seq 4)
+		do
+			test_commit $i &&
+			git branch commits/$i || return 1
+		done &&
+		git commit-graph write --reachable --split --reachability-labels &&
+		git checkout -b side commits/2 &&
+		for i in $(test_seq 5 7)
+		do
+			test_commit $i &&
+			git branch commits/$i || return 1
+		done &&
+		git merge -m merge commits/4 &&
+		git branch commits/merge &&
+		git checkout -b tip commits/4 &&
+		test_commit 8 &&
+		git branch commits/8 &&
+		git commit-graph write --reachable --split=no-merge &&
+		test_line_count = 2 $graphdir/commit-graph-chain &&
+		test-tool read-graph >output &&
+		grep "^chunks: .* reachability_labels" output &&
+		git commit-graph verify &&
+		check_is_ancestor &&
+		git commit-graph write --reachable --split=replace \
+			--no-reachability-labels &&
+		test-tool read-graph >output &&
+		! grep reachability_labels output
+	)
+'
+
 test_done
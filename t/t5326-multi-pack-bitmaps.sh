@@ -0,0 +1,172 @@
+#!/bin/sh
+
+test_description='exercise basic multi-pack bitmap functionality'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=master
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-bitmap.sh
+
+# We'll be writing our own midx and bitmaps, so avoid getting confused by the
+# automatic ones.
+GIT_TEST_MULTI_PACK_INDEX=0
+export GIT_TEST_MULTI_PACK_INDEX
+
+test_expect_success 'setup repo with several packs' '
+	test_commit_bulk --id=file 50 &&
+	git checkout -b other HEAD~10 &&
+	test_commit_bulk --id=side 50 &&
+	git checkout master &&
+	git merge -m merge other &&
+	test_commit_bulk --id=file 20 &&
+
+	blob=$(echo tagged-blob | git hash-object -w --stdin) &&
+	git tag tagged-blob $blob &&
+	git repack -d &&
+
+	ls .git/objects/pack/*.pack >packs &&
+	test_line_count -gt 2 packs
+'
+
+test_expect_success 'create new multi-pack bitmap' '
+	git multi-pack-index write --bitmap &&
+
+	ls .git/objects/pack/ | grep bitmap >output &&
+	test_line_count = 1 output &&
+	grep "^multi-pack-index-.*\.bitmap$" output &&
+	test_path_is_file .git/objects/pack/multi-pack-index-*.rev
+'
+
+test_expect_success 'rev-list --test-bitmap verifies multi-pack bitmaps' '
+	git rev-list --test-bitmap HEAD
+'
+
+rev_list_tests () {
+	for branch in master other
+	do
+		test_expect_success "counting commits via bitmap ($1, $branch)" '
+			git rev-list --count $branch >expect &&
+			git rev-list --use-bitmap-index --count $branch >actual &&
+			test_cmp expect actual
+		'
+
+		test_expect_success "counting partial commits via bitmap ($1, $branch)" '
+			git rev-list --count $branch~5..$branch >expect &&
+			git rev-list --use-bitmap-index --count $branch~5..$branch >actual &&
+			test_cmp expect actual
+		'
+
+		test_expect_success "counting objects via bitmap ($1, $branch)" '
+			git rev-list --count --objects $branch >expect &&
+			git rev-list --use-bitmap-index --count --objects $branch >actual &&
+			test_cmp expect actual
+		'
+
+		test_expect_success "enumerate --objects ($1, $branch)" '
+			git rev-list --objects --use-bitmap-index $branch >actual &&
+			git rev-list --objects $branch >expect &&
+			test_bitmap_traversal expect actual
+		'
+
+		test_expect_success "bitmap --objects handles non-commit objects ($1, $branch)" '
+			git rev-list --objects --use-bitmap-index $branch tagged-blob >actual &&
+			grep $blob actual
+		'
+
+		test_expect_success "disk-usage via bitmap ($1, $branch)" '
+			git rev-list --objects --disk-usage $branch >expect &&
+			git rev-list --objects --disk-usage --use-bitmap-index \
+				$branch >actual &&
+			test_cmp expect actual
+		'
+	done
+}
+
+rev_list_tests 'multi-pack bitmap'
+
+test_expect_success 'clone from bitmapped repository' '
+	git clone --no-local --bare . clone.git &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git --git-dir=clone.git fsck
+'
+
+test_expect_success 'pack-objects reuses objects from the preferred pack' '
+	git rev-list --objects --all --count >expect &&
+	git pack-objects --all --stdout --delta-base-offset --progress \
+		--use-bitmap-index </dev/null >all.pack 2>stderr &&
+	grep "pack-reused [1-9]" stderr &&
+	git index-pack --strict all.pack &&
+	git show-index <all.idx >objects &&
+	test_line_count = $(cat expect) objects
+'
+
+test_expect_success 'preferred pack wins every duplicate object' '
+	rm -f .git/objects/pack/multi-pack-index* &&
+	preferred=$(ls .git/objects/pack/*.pack | tail -n 1) &&
+	git multi-pack-index write --bitmap \
+		--preferred-pack=$(basename $preferred) &&
+	git rev-list --test-bitmap HEAD &&
+
+	# Every object in the preferred pack must be selected from it, since
+	# the leading bits of the bitmap are reserved for that pack.
+	git show-index <${preferred%.pack}.idx | cut -d" " -f2 >objects &&
+	test-tool read-midx --show-objects .git/objects >out &&
+	for oid in $(cat objects)
+	do
+		grep "^$oid " out | cut -f2 || return 1
+	done | sort -u >actual &&
+	echo "$preferred" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'writing a midx without --bitmap drops a stale bitmap' '
+	test_commit_bulk --id=new 10 &&
+
+	# the old bitmap no longer matches the midx checksum once a new
+	# multi-pack-index is written without --bitmap
+	git multi-pack-index write &&
+	ls .git/objects/pack/ >output &&
+	! grep bitmap output &&
+	git rev-list --use-bitmap-index --count --objects --all >actual &&
+	git rev-list --count --objects --all >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'incremental bitmap write covers new packs' '
+	git multi-pack-index write --bitmap &&
+	ls .git/objects/pack/ | grep bitmap >output &&
+	test_line_count = 1 output &&
+	git rev-list --test-bitmap HEAD
+'
+
+rev_list_tests 'incremental multi-pack bitmap'
+
+test_expect_success 'multi-pack bitmap with lookup table' '
+	git -c pack.writeBitmapLookupTable=true multi-pack-index write --bitmap &&
+	git rev-list --test-bitmap HEAD &&
+	git rev-list --test-bitmap other
+'
+
+rev_list_tests 'multi-pack bitmap with lookup table'
+
+test_expect_success 'multi-pack bitmap takes precedence over pack bitmaps' '
+	git repack -adb &&
+	git multi-pack-index write --bitmap &&
+	ls .git/objects/pack/*.bitmap >bitmaps &&
+	test_line_count = 2 bitmaps &&
+	git rev-list --test-bitmap HEAD 2>err &&
+	test_i18ngrep ! "ignoring extra bitmap" err
+'
+
+test_expect_success 'deleting a bitmapped pack removes the multi-pack bitmap' '
+	git multi-pack-index write --bitmap &&
+	ls .git/objects/pack/multi-pack-index-*.bitmap &&
+	git repack -ad &&
+	test_path_is_missing .git/objects/pack/multi-pack-index &&
+	ls .git/objects/pack/ >output &&
+	! grep "^multi-pack-index-" output
+'
+
+test_done
@@ -0,0 +1,166 @@
+#!/bin/sh
+
+test_description='commit idents, dates and subjects in the commit-graph'
+. ./test-lib.sh
+
+GIT_TEST_COMMIT_GRAPH=0
+GIT_TEST_COMMIT_GRAPH_COMMIT_METADATA=0
+
+# Write a commit object on top of HEAD with the headers and message
+# read from stdin, and point a branch called "$1" at it.
+raw_commit () {
+	{
+		echo "tree $(git rev-parse HEAD^{tree})" &&
+		echo "parent $(git rev-parse HEAD)" &&
+		cat
+	} >raw &&
+	oid=$(git hash-object --literally -t commit -w raw) &&
+	git update-ref HEAD $oid &&
+	git branch "$1"
+}
+
+idents () {
+	echo "author $1" &&
+	echo "committer $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> 1112912053 -0700"
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	GIT_AUTHOR_NAME="Another Author" test_commit two &&
+	git commit --allow-empty -m "$(printf "multi\nline\nsubject\n\nand a body")" &&
+	git branch multi-line &&
+	idents "A U Thor <author@example.com> 1112911993 +0530" >msg &&
+	printf "\n\n\nleading empty lines\n\nbody\n" >>msg &&
+	raw_commit leading-lines <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "\nno newline at the end" >>msg &&
+	raw_commit no-newline <msg &&
+	idents "A U Thor <author@example.com> 1112911993 -0000" >msg &&
+	printf "\nnegative zero\n" >>msg &&
+	raw_commit negative-zero <msg &&
+	idents "A U Thor <author@example.com> 01112911993 +0000" >msg &&
+	printf "\nleading zero in the date\n" >>msg &&
+	raw_commit leading-zero <msg &&
+	idents "Spaced Out  <spaced@example.com>  1112911993 -1200" >msg &&
+	printf "\nextra spaces in the ident\n" >>msg &&
+	raw_commit spaces <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "\ncarriage\r\nreturns\r\n\r\nbody\r\n" >>msg &&
+	raw_commit crlf <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "\nwhitespace\n \t\nonly line\n" >>msg &&
+	raw_commit whitespace-line <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "\nsigned\n-----BEGIN PGP SIGNATURE-----\nsig\n-----END PGP SIGNATURE-----\n" >>msg &&
+	raw_commit signature <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "encoding ISO-8859-1\n\nenc\\351\n" >>msg &&
+	raw_commit encoding <msg &&
+	idents "A U Thor <author@example.com> 1112911993 +0000" >msg &&
+	printf "\n" >>msg &&
+	raw_commit empty-message <msg &&
+	test_commit three &&
+	git tag -a -m "annotated" annotated two &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git commit-graph write --reachable --commit-metadata &&
+	# all but negative-zero and leading-zero, whose dates would not
+	# be written back the same, crlf and whitespace-line, whose
+	# subjects have CRs and a whitespace-only line, signature, whose
+	# first paragraph has a "-----BEGIN " line, and encoding, which
+	# has an "encoding" header
+	grep "\"key\":\"metadata-stored\",\"value\":\"8\"" trace.event &&
+	test-tool read-graph >output &&
+	grep "^chunks: .* commit_idents_subjects" output &&
+	git commit-graph verify
+'
+
+while read date format
+do
+	test_expect_success "log --date=$date --format=\"$format\" gives the same output" '
+		git -c core.commitGraph=false log --date=$date --format="$format" >expect &&
+		git log --date=$date --format="$format" >actual &&
+		test_cmp expect actual
+	'
+done <<\EOF
+default %H %an <%ae> %aN %aE %al %at %ad %ai %aI %as
+default %cn <%ce> %ct %cd %cD%n%s%n%f
+raw %<(12,trunc)%s|%ad|%cd
+iso-strict %ad %cd
+relative %ad %h %s%n%b%n%e
+default %s%+(trailers)
+EOF
+
+test_expect_success 'log in another output encoding gives the same output' '
+	git -c core.commitGraph=false -c i18n.logOutputEncoding=ISO-8859-1 \
+		log --format="%an %s" >expect &&
+	git -c i18n.logOutputEncoding=ISO-8859-1 log --format="%an %s" >actual &&
+	test_cmp expect actual
+'
+
+while read format
+do
+	test_expect_success "for-each-ref --format=\"$format\" gives the same output" '
+		git -c core.commitGraph=false for-each-ref --format="$format" >expect &&
+		git for-each-ref --format="$format" >actual &&
+		test_cmp expect actual
+	'
+done <<\EOF
+%(refname) %(author) %(authorname) %(authoremail:trim)
+%(authordate) %(committerdate:raw) %(creator) %(creatordate)
+%(subject)|%(subject:sanitize)|%(contents:subject)
+%(objecttype) %(tree) %(parent) %(numparent) %(*subject)
+EOF
+
+test_expect_success 'for-each-ref sorting by metadata gives the same output' '
+	git -c core.commitGraph=false for-each-ref \
+		--sort=authordate --sort=subject \
+		--format="%(refname) %(objectsize) %(body)" >expect &&
+	git for-each-ref --sort=authordate --sort=subject \
+		--format="%(refname) %(objectsize) %(body)" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'formats that only need the metadata do not read commits' '
+	git -c core.commitGraph=false log --format="%an %ad %s" >expect &&
+	git -c core.commitGraph=false for-each-ref --format="%(subject)" \
+		refs/heads/multi-line >expect.ref &&
+	cp -R .git missing.git &&
+	oid=$(git rev-parse multi-line) &&
+	rm missing.git/objects/$(test_oid_to_path $oid) &&
+	git --git-dir=missing.git log --format="%an %ad %s" >actual &&
+	test_cmp expect actual &&
+	git --git-dir=missing.git for-each-ref --format="%(subject)" \
+		refs/heads/multi-line >actual.ref &&
+	test_cmp expect.ref actual.ref &&
+	test_must_fail git --git-dir=missing.git log --format="%s%n%b"
+'
+
+test_expect_success 'commit metadata is kept and can be dropped' '
+	git commit-graph write --reachable &&
+	test-tool read-graph >output &&
+	grep "^chunks: .* commit_idents_subjects" output &&
+	git commit-graph write --reachable --no-commit-metadata &&
+	test-tool read-graph >output &&
+	! grep commit_idents_subjects output
+'
+
+test_expect_success 'commit metadata in a split commit-graph' '
+	# the base layer is the commit-graph without metadata from above
+	test_commit four &&
+	git commit-graph write --reachable --split --commit-metadata &&
+	GIT_AUTHOR_NAME="Another Author" test_commit five &&
+	git commit-graph write --reachable --split=no-merge &&
+	test_line_count = 3 .git/objects/info/commit-graphs/commit-graph-chain &&
+	test-tool read-graph >output &&
+	grep "^chunks: .* commit_idents_subjects" output &&
+	git commit-graph verify &&
+	git -c core.commitGraph=false log --format="%an <%ae> %ad %s" >expect &&
+	git log --format="%an <%ae> %ad %s" >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false for-each-ref \
+		--format="%(refname) %(authorname) %(subject)" >expect &&
+	git for-each-ref --format="%(refname) %(authorname) %(subject)" >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -58,6 +58,13 @@ test_expect_success 'setup' '
 	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
 	mv .git/objects/info/commit-graph commit-graph-no-gdat &&
 	chmod u+w commit-graph-no-gdat &&
+	git commit-graph write --reachable --reachability-labels &&
+	mv .git/objects/info/commit-graph commit-graph-labels &&
+	chmod u+w commit-graph-labels &&
+	git show-ref -s commit-5-5 |
+		git commit-graph write --stdin-commits --reachability-labels &&
+	mv .git/objects/info/commit-graph commit-graph-half-labels &&
+	chmod u+w commit-graph-half-labels &&
 	git config core.commitGraph true
 '
 
@@ -73,6 +80,12 @@ run_all_modes () {
 	test_cmp expect actual &&
 	cp commit-graph-no-gdat .git/objects/info/commit-graph &&
 	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-labels .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-half-labels .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
 	test_cmp expect actual
 }
 
@@ -146,6 +159,27 @@ test_expect_success 'in_merge_bases_many:miss-heuristic' '
 	test_all_modes in_merge_bases_many
 '
 
+test_expect_success 'commit_graph_can_reach' '
+	test_when_finished rm -rf .git/objects/info/commit-graph &&
+	cp commit-graph-labels .git/objects/info/commit-graph &&
+	for a in 1-1 1-9 3-9 5-5 7-4 9-3 10-10
+	do
+		for b in 1-1 2-8 3-2 5-5 5-6 8-2 10-10
+		do
+			printf "A:commit-%s\nB:commit-%s\n" $a $b >input &&
+			test-tool reach commit_graph_can_reach <input >actual &&
+			# (x,y) reaches (x2,y2) iff x2 <= x and y2 <= y
+			if test ${b%-*} -le ${a%-*} && test ${b#*-} -le ${a#*-}
+			then
+				echo "commit_graph_can_reach(A,B):1" >expect
+			else
+				echo "commit_graph_can_reach(A,B):0" >expect
+			fi &&
+			test_cmp expect actual || return 1
+		done
+	done
+'
+
 test_expect_success 'is_descendant_of:hit' '
 	cat >input <<-\EOF &&
 	A:commit-5-7
@@ -443,4 +477,68 @@ test_expect_success 'get_reachable_subset:none' '
 	test_all_modes get_reachable_subset
 '
 
+# The counts of %(ahead-behind:<base>) are those of
+# "git rev-list --count --left-right <ref>...<base>".
+ahead_behind_expect () {
+	base=$1 &&
+	shift &&
+	for ref in "$@"
+	do
+		echo "$ref $(git rev-list --count --left-right $ref...$base |
+			     tr "\t" " ")" || return 1
+	done
+}
+
+test_expect_success 'for-each-ref ahead-behind:one base' '
+	ahead_behind_expect commit-5-5 \
+		refs/heads/commit-1-1 \
+		refs/heads/commit-10-10 \
+		refs/heads/commit-3-9 \
+		refs/heads/commit-5-5 \
+		refs/heads/commit-9-3 >expect &&
+	run_all_modes git for-each-ref \
+		--format="%(refname) %(ahead-behind:commit-5-5)" \
+		refs/heads/commit-1-1 refs/heads/commit-5-5 \
+		refs/heads/commit-9-3 refs/heads/commit-3-9 \
+		refs/heads/commit-10-10
+'
+
+test_expect_success 'for-each-ref ahead-behind:all refs' '
+	git for-each-ref --format="%(refname)" "refs/heads/commit-*" >refs &&
+	ahead_behind_expect commit-6-4 $(cat refs) >expect &&
+	run_all_modes git for-each-ref \
+		--format="%(refname) %(ahead-behind:commit-6-4)" \
+		"refs/heads/commit-*"
+'
+
+test_expect_success 'for-each-ref ahead-behind:several bases' '
+	git for-each-ref --format="%(refname)" "refs/heads/commit-*-3" >refs &&
+	ahead_behind_expect commit-2-8 $(cat refs) >expect.1 &&
+	ahead_behind_expect tag-7-2 $(cat refs) >expect.2 &&
+	cut -d" " -f2- expect.2 | paste -d" " expect.1 - >expect &&
+	run_all_modes git for-each-ref \
+		--format="%(refname) %(ahead-behind:commit-2-8) %(ahead-behind:tag-7-2)" \
+		"refs/heads/commit-*-3"
+'
+
+test_expect_success 'for-each-ref ahead-behind on non-commits' '
+	cat >expect <<-\EOF &&
+	refs/tags/tag-2-3:5 0
+	refs/tags/tree:
+	EOF
+	test_when_finished "git tag -d tree" &&
+	git tag tree commit-1-1^{tree} &&
+	git for-each-ref --format="%(refname):%(ahead-behind:commit-1-1)" \
+		refs/tags/tag-2-3 refs/tags/tree >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'for-each-ref ahead-behind needs a valid base' '
+	test_must_fail git for-each-ref --format="%(ahead-behind)" 2>err &&
+	grep "expected format: %(ahead-behind:<committish>)" err &&
+	test_must_fail git for-each-ref \
+		--format="%(ahead-behind:missing)" 2>err &&
+	grep "failed to find .missing." err
+'
+
 test_done
@@ -66,7 +66,7 @@ get_relevant_traces () {
 	OUTPUT_FILE=$2
 	grep data.*read_directo $INPUT_FILE |
 	    cut -d "|" -f 9 |
-	    grep -v visited \
+	    grep -v -e visited -e prefetch \
 	    >"$OUTPUT_FILE"
 }
 
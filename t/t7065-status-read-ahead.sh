@@ -0,0 +1,75 @@
+#!/bin/sh
+
+test_description='reading directories ahead when looking for untracked files'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	for dir in tracked tracked/sub untracked untracked/deep/deeper \
+		ignored ignored/sub mixed mixed/sub/ignored empty
+	do
+		mkdir -p $dir &&
+		for i in 1 2 3
+		do
+			echo $i >$dir/file$i || return 1
+		done
+	done &&
+	mkdir really-empty &&
+	cat >.gitignore <<-\EOF &&
+	/expect
+	/actual
+	/*.cache
+	/ignored/
+	mixed/sub/ignored
+	*.o
+	EOF
+	>mixed/file.o &&
+	>untracked/deep/file.o &&
+	git add .gitignore tracked mixed/file1 empty &&
+	git commit -q -m initial &&
+	rm empty/* &&
+	git init -q nested &&
+	>nested/file
+'
+
+while read cmd
+do
+	test_expect_success "git $cmd gives the same output when reading ahead" '
+		GIT_TEST_PRELOAD_INDEX=0 git -c core.preloadIndex=false $cmd >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/.git/trace.event" GIT_TRACE2_EVENT_NESTING=5 \
+			GIT_TEST_PRELOAD_INDEX=1 git $cmd >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"prefetch/threads\"" .git/trace.event &&
+		rm .git/trace.event
+	'
+done <<\EOF
+status --porcelain -uall
+status --porcelain -unormal
+status --porcelain -uall --ignored
+status --porcelain --ignored=matching
+status --porcelain --ignored=no
+ls-files -o
+ls-files -o --directory
+ls-files -o -i --exclude-standard
+ls-files -o --exclude-standard -- untracked mixed
+clean -n -d
+clean -n -d -x
+EOF
+
+test_expect_success 'the untracked cache is still filled in' '
+	test_when_finished "git update-index --no-untracked-cache" &&
+	git update-index --untracked-cache &&
+	GIT_FORCE_UNTRACKED_CACHE=true GIT_TEST_PRELOAD_INDEX=1 \
+		git status --porcelain >actual &&
+	test-tool dump-untracked-cache >actual.cache &&
+	git update-index --no-untracked-cache &&
+	git update-index --untracked-cache &&
+	GIT_FORCE_UNTRACKED_CACHE=true GIT_TEST_PRELOAD_INDEX=0 \
+		git -c core.preloadIndex=false status --porcelain >expect &&
+	test-tool dump-untracked-cache >expect.cache &&
+	test_cmp expect actual &&
+	test_cmp expect.cache actual.cache &&
+	grep "^/untracked/ " actual.cache
+'
+
+test_done
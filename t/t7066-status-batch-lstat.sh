@@ -0,0 +1,154 @@
+#!/bin/sh
+
+test_description='preloading the index with batched lstat calls'
+
+. ./test-lib.sh
+
+# Whether the preload threads can batch their lstat() calls here: Git
+# must be built with HAVE_IO_URING, and the kernel must let us use it.
+test_lazy_prereq BATCH_LSTAT '
+	git init batch &&
+	>batch/file1 &&
+	>batch/file2 &&
+	git -C batch add . &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" GIT_TRACE2_EVENT_NESTING=5 \
+		GIT_TEST_PRELOAD_INDEX=1 git -C batch status &&
+	grep "\"key\":\"preload/sum_batch_lstat\",\"value\":\"[1-9]" trace.event
+'
+
+# Check that "git $@" prints the contents of "expect", both when the
+# preload threads batch their lstat() calls and when they do not.
+check_batch_lstat_output () {
+	for batch in false true
+	do
+		GIT_TEST_PRELOAD_INDEX=1 GIT_TEST_BATCH_LSTAT=$batch \
+			git "$@" >actual &&
+		test_cmp expect actual || return 1
+	done
+}
+
+# Check the number of entries refresh_index() had to lstat() again
+# because preloading did not find them up to date, and that preloading
+# batched its lstat() calls when it can. The output of the command goes
+# to "actual".
+check_refresh_lstat () {
+	nr=$1 &&
+	shift &&
+	GIT_TRACE2_EVENT="$(pwd)/.git/trace.event" GIT_TRACE2_EVENT_NESTING=5 \
+		GIT_TEST_PRELOAD_INDEX=1 git "$@" >actual &&
+	if test_have_prereq BATCH_LSTAT
+	then
+		grep "\"key\":\"preload/sum_batch_lstat\",\"value\":\"[1-9]" .git/trace.event
+	else
+		grep "\"key\":\"preload/sum_batch_lstat\",\"value\":\"0\"" .git/trace.event
+	fi &&
+	grep "\"key\":\"refresh/sum_lstat\",\"value\":\"$nr\"" .git/trace.event &&
+	rm .git/trace.event
+}
+
+test_expect_success 'setup' '
+	for dir in a b b/c d
+	do
+		mkdir -p $dir &&
+		for i in $(test_seq 300)
+		do
+			echo $i >$dir/file$i || return 1
+		done
+	done &&
+	cat >.gitignore <<-\EOF &&
+	/expect
+	/actual
+	EOF
+	# keep the entries from being racily clean
+	test-tool chmtime =-60 .gitignore */file* b/c/file* &&
+	git add . &&
+	git commit -q -m initial
+'
+
+test_expect_success 'clean entries are found up to date' '
+	git update-index --refresh &&
+	check_refresh_lstat 0 status --porcelain &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'modified and missing files' '
+	echo changed >a/file1 &&
+	echo changed >b/c/file300 &&
+	test-tool chmtime =-60 a/file1 b/c/file300 &&
+	rm d/file7 &&
+	cat >expect <<-\EOF &&
+	 M a/file1
+	 M b/c/file300
+	 D d/file7
+	EOF
+	check_batch_lstat_output status --porcelain &&
+	check_refresh_lstat 3 status --porcelain &&
+	test_cmp expect actual &&
+	cat >expect <<-\EOF &&
+	M	a/file1
+	M	b/c/file300
+	D	d/file7
+	EOF
+	check_batch_lstat_output diff-files --name-status
+'
+
+test_expect_success 'files that became directories' '
+	test_when_finished "rm -rf b/file3 && git checkout b/file3" &&
+	rm b/file3 &&
+	mkdir b/file3 &&
+	>b/file3/untracked &&
+	cat >expect <<-\EOF &&
+	 M a/file1
+	 M b/c/file300
+	 D b/file3
+	 D d/file7
+	?? b/file3/untracked
+	EOF
+	check_batch_lstat_output status --porcelain -uall &&
+	cat >expect <<-\EOF &&
+	M	a/file1
+	M	b/c/file300
+	D	b/file3
+	D	d/file7
+	EOF
+	check_batch_lstat_output diff-files --name-status
+'
+
+test_expect_success SYMLINKS 'symlinks are not followed' '
+	test_when_finished "rm -f a/file2 && git checkout a/file2" &&
+	rm a/file2 &&
+	ln -s file4 a/file2 &&
+	cat >expect <<-\EOF &&
+	 M a/file1
+	 T a/file2
+	 M b/c/file300
+	 D d/file7
+	EOF
+	check_batch_lstat_output status --porcelain &&
+	cat >expect <<-\EOF &&
+	M	a/file1
+	T	a/file2
+	M	b/c/file300
+	D	d/file7
+	EOF
+	check_batch_lstat_output diff-files --name-status
+'
+
+test_expect_success SYMLINKS 'entries behind a symlinked directory' '
+	test_when_finished "rm -f d && mv d.real d" &&
+	mv d d.real &&
+	ln -s d.real d &&
+	{
+		printf " M a/file1\n M b/c/file300\n" &&
+		git ls-files d | sed "s/^/ D /" &&
+		printf "?? d\n?? d.real/\n"
+	} >expect &&
+	check_batch_lstat_output status --porcelain &&
+	{
+		printf "M\ta/file1\nM\tb/c/file300\n" &&
+		git ls-files d | sed "s/^/D	/"
+	} >expect &&
+	check_batch_lstat_output diff-files --name-status
+'
+
+test_done
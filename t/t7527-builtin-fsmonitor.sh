@@ -0,0 +1,135 @@
+#!/bin/sh
+
+test_description='built-in file system watcher'
+
+. ./test-lib.sh
+
+if test -z "$FSMONITOR_DAEMON_BACKEND"
+then
+	skip_all="fsmonitor--daemon is not supported on this platform"
+	test_done
+fi
+
+stop_daemon_delete_repo () {
+	r=$1 &&
+	git -C $r fsmonitor--daemon stop >/dev/null 2>/dev/null
+	rm -rf $r
+	return 0
+}
+
+start_daemon () {
+	git -C "$1" fsmonitor--daemon start &&
+	git -C "$1" fsmonitor--daemon status
+}
+
+test_expect_success 'explicit daemon start and stop' '
+	test_when_finished "stop_daemon_delete_repo test_explicit" &&
+
+	git init test_explicit &&
+	start_daemon test_explicit &&
+
+	git -C test_explicit fsmonitor--daemon stop &&
+	test_must_fail git -C test_explicit fsmonitor--daemon status
+'
+
+test_expect_success 'implicit daemon start' '
+	test_when_finished "stop_daemon_delete_repo test_implicit" &&
+
+	git init test_implicit &&
+	test_must_fail git -C test_implicit fsmonitor--daemon status &&
+
+	git -C test_implicit -c core.fsmonitor=true status &&
+	git -C test_implicit fsmonitor--daemon status
+'
+
+test_expect_success 'daemon exits when the worktree is removed' '
+	git init test_removed &&
+	{ git -C test_removed fsmonitor--daemon run >/dev/null 2>&1 & } &&
+	pid=$! &&
+	test_when_finished "kill $pid 2>/dev/null; rm -rf test_removed; :" &&
+
+	for i in $(test_seq 30)
+	do
+		git -C test_removed fsmonitor--daemon status >/dev/null &&
+		break
+		sleep 1
+	done &&
+	git -C test_removed fsmonitor--daemon status &&
+
+	rm -rf test_removed &&
+	for i in $(test_seq 30)
+	do
+		kill -0 $pid 2>/dev/null || break
+		sleep 1
+	done &&
+	! kill -0 $pid 2>/dev/null
+'
+
+test_expect_success 'setup' '
+	test_atexit "git fsmonitor--daemon stop 2>/dev/null; :" &&
+	cat >.gitignore <<-\EOF &&
+	.gitignore
+	expect*
+	actual*
+	EOF
+	mkdir dir1 dir2 &&
+	for f in modified delete rename dir1/modified dir1/delete dir2/modified
+	do
+		echo 1 >$f || return 1
+	done &&
+	git add . &&
+	test_tick &&
+	git commit -m initial &&
+
+	git config core.fsmonitor true &&
+	start_daemon . &&
+	git update-index --fsmonitor &&
+	git status --porcelain >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'daemon reports changes to git status' '
+	echo 2 >modified &&
+	echo 2 >dir1/modified &&
+	rm delete dir1/delete &&
+	mv rename renamed &&
+	echo 1 >new &&
+	echo 1 >dir2/new &&
+	mkdir dir3 &&
+	echo 1 >dir3/new &&
+
+	git -c core.fsmonitor=false status --porcelain >expect &&
+	git status --porcelain >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'daemon sees changes in new directories' '
+	mkdir -p dir3/sub &&
+	echo 1 >dir3/sub/file &&
+	git add dir3 &&
+	test_tick &&
+	git commit -m dir3 &&
+
+	echo 2 >dir3/sub/file &&
+	git -c core.fsmonitor=false status --porcelain >expect &&
+	git status --porcelain >actual &&
+	test_cmp expect actual &&
+	grep "dir3/sub/file" actual
+'
+
+test_expect_success 'trivial response after a restart' '
+	git fsmonitor--daemon stop &&
+	start_daemon . &&
+	echo 3 >dir2/modified &&
+
+	git -c core.fsmonitor=false status --porcelain >expect &&
+	git status --porcelain >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cleanup' '
+	git fsmonitor--daemon stop &&
+	test_must_fail git fsmonitor--daemon status
+'
+
+test_done
@@ -228,4 +228,55 @@ test_expect_success 'auto-bitmaps do not complain if unavailable' '
 	test_must_be_empty actual
 '
 
+test_expect_success 'setup repository for delta hints' '
+	git init hints &&
+	for i in $(test_seq 1 20)
+	do
+		test_seq 1 $((i * 100)) >hints/file &&
+		git -C hints add file &&
+		git -C hints commit -q -m $i || return 1
+	done
+'
+
+delta_pairs () {
+	git verify-pack -v "$1"/objects/pack/*.idx >raw &&
+	awk "NF == 7 { print \$1, \$7 }" raw | sort
+}
+
+test_expect_success 'repack writes delta hints' '
+	git -C hints -c pack.writeDeltaHints=true repack -adf &&
+	find hints/.git/objects/pack -type f -name "*.hints" >hints-files &&
+	test_line_count = 1 hints-files &&
+	delta_pairs hints/.git >expect &&
+	test_line_count -gt 0 expect
+'
+
+test_expect_success 'repack -f seeds deltas from hints' '
+	nr=$(wc -l <expect) &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C hints -c pack.writeDeltaHints=true repack -adf &&
+	grep "\"key\":\"delta_hints/seeded\",\"value\":\"$((nr))\"" trace &&
+	find hints/.git/objects/pack -type f -name "*.hints" >hints-files &&
+	test_line_count = 1 hints-files &&
+	delta_pairs hints/.git >actual &&
+	test_cmp expect actual &&
+	git -C hints fsck
+'
+
+test_expect_success 'hinted deltas respect --depth' '
+	git -C hints -c pack.writeDeltaHints=true repack -adf --depth=2 &&
+	git verify-pack -v hints/.git/objects/pack/*.idx >raw &&
+	! grep "^chain length = [3-9]" raw &&
+	git -C hints fsck
+'
+
+test_expect_success 'pack.useDeltaHints=false ignores hints' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C hints -c pack.useDeltaHints=false repack -adf &&
+	! grep delta_hints/seeded trace &&
+	find hints/.git/objects/pack -type f -name "*.hints" >hints-files &&
+	test_must_be_empty hints-files
+'
+
 test_done
@@ -51,4 +51,12 @@ int tmp_objdir_destroy(struct tmp_objdir *);
  */
 void tmp_objdir_add_as_alternate(const struct tmp_objdir *);
 
+/*
+ * Make the temporary object directory the primary object store of the
+ * current process, so that new objects are written there; the former
+ * primary store remains available for reading. Migrating or destroying
+ * the temporary directory puts the former one back in place.
+ */
+void tmp_objdir_replace_primary_odb(struct tmp_objdir *);
+
 #endif /* TMP_OBJDIR_H */
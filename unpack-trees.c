@@ -427,17 +427,10 @@ static int check_updates(struct unpack_trees_options *o,
 	if (should_update_submodules())
 		load_gitmodules_file(index, NULL);
 
-	for (i = 0; i < index->cache_nr; i++) {
-		const struct cache_entry *ce = index->cache[i];
-
-		if (ce->ce_flags & CE_WT_REMOVE) {
-			display_progress(progress, ++cnt);
-			unlink_entry(ce);
-		}
-	}
+	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
 
+	unlink_marked_entries(index, pc_workers, pc_threshold, progress, &cnt);
 	remove_marked_cache_entries(index, 0);
-	remove_scheduled_dirs();
 
 	if (should_update_submodules())
 		load_gitmodules_file(index, &state);
@@ -465,7 +458,7 @@ static int check_updates(struct unpack_trees_options *o,
 		oid_array_clear(&to_fetch);
 	}
 
-	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	create_leading_directories_ahead(index, pc_workers, pc_threshold);
 
 	enable_delayed_checkout(&state);
 	if (pc_workers > 1)
@@ -947,6 +940,7 @@ static int do_compare_entry_piecewise(const struct cache_entry *ce,
 {
 	int pathlen, ce_len;
 	const char *ce_name;
+	unsigned ce_mode;
 
 	if (info->prev) {
 		int cmp = do_compare_entry_piecewise(ce, info->prev,
@@ -965,7 +959,9 @@ static int do_compare_entry_piecewise(const struct cache_entry *ce,
 	ce_len -= pathlen;
 	ce_name = ce->name + pathlen;
 
-	return df_name_compare(ce_name, ce_len, S_IFREG, name, namelen, mode);
+	/* a sparse directory compares as the directory it stands for */
+	ce_mode = S_ISSPARSEDIR(ce->ce_mode) ? S_IFDIR : S_IFREG;
+	return df_name_compare(ce_name, ce_len, ce_mode, name, namelen, mode);
 }
 
 static int do_compare_entry(const struct cache_entry *ce,
@@ -976,6 +972,7 @@ static int do_compare_entry(const struct cache_entry *ce,
 	int pathlen, ce_len;
 	const char *ce_name;
 	int cmp;
+	unsigned ce_mode;
 
 	/*
 	 * If we have not precomputed the traverse path, it is quicker
@@ -998,7 +995,9 @@ static int do_compare_entry(const struct cache_entry *ce,
 	ce_len -= pathlen;
 	ce_name = ce->name + pathlen;
 
-	return df_name_compare(ce_name, ce_len, S_IFREG, name, namelen, mode);
+	/* a sparse directory compares as the directory it stands for */
+	ce_mode = S_ISSPARSEDIR(ce->ce_mode) ? S_IFDIR : S_IFREG;
+	return df_name_compare(ce_name, ce_len, ce_mode, name, namelen, mode);
 }
 
 static int compare_entry(const struct cache_entry *ce, const struct traverse_info *info, const struct name_entry *n)
@@ -1007,6 +1006,14 @@ static int compare_entry(const struct cache_entry *ce, const struct traverse_inf
 	if (cmp)
 		return cmp;
 
+	/*
+	 * A sparse directory entry ("dir/") matches the tree entry of
+	 * the directory it stands for.
+	 */
+	if (S_ISSPARSEDIR(ce->ce_mode) && S_ISDIR(n->mode) &&
+	    ce_namelen(ce) == traverse_path_len(info, tree_entry_len(n)) + 1)
+		return 0;
+
 	/*
 	 * Even if the beginning compared identically, the ce should
 	 * compare as bigger than a directory leading up to it!
@@ -1033,13 +1040,15 @@ static struct cache_entry *create_ce_entry(const struct traverse_info *info,
 	const struct name_entry *n,
 	int stage,
 	struct index_state *istate,
-	int is_transient)
+	int is_transient,
+	int is_sparse_directory)
 {
 	size_t len = traverse_path_len(info, tree_entry_len(n));
+	size_t alloc_len = is_sparse_directory ? len + 1 : len;
 	struct cache_entry *ce =
 		is_transient ?
-		make_empty_transient_cache_entry(len, NULL) :
-		make_empty_cache_entry(istate, len);
+		make_empty_transient_cache_entry(alloc_len, NULL) :
+		make_empty_cache_entry(istate, alloc_len);
 
 	ce->ce_mode = create_ce_mode(n->mode);
 	ce->ce_flags = create_ce_flags(stage);
@@ -1048,6 +1057,13 @@ static struct cache_entry *create_ce_entry(const struct traverse_info *info,
 	/* len+1 because the cache_entry allocates space for NUL */
 	make_traverse_path(ce->name, len + 1, info, n->path, n->pathlen);
 
+	if (is_sparse_directory) {
+		ce->name[len] = '/';
+		ce->name[len + 1] = '\0';
+		ce->ce_namelen++;
+		ce->ce_flags |= CE_SKIP_WORKTREE;
+	}
+
 	return ce;
 }
 
@@ -1070,6 +1086,14 @@ static int unpack_nondirectories(int n, unsigned long mask,
 	if (mask == dirmask && !src[0])
 		return 0;
 
+	/*
+	 * Directories matched by a sparse directory entry in the index
+	 * are not descended into; they are unpacked as a whole, like
+	 * any other entry.
+	 */
+	if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode))
+		conflicts = info->df_conflicts;
+
 	/*
 	 * Ok, we've filled in up to any potential index entry in src[0],
 	 * now do the rest.
@@ -1099,7 +1123,9 @@ static int unpack_nondirectories(int n, unsigned long mask,
 		 * not stored in the index.  otherwise construct the
 		 * cache entry from the index aware logic.
 		 */
-		src[i + o->merge] = create_ce_entry(info, names + i, stage, &o->result, o->merge);
+		src[i + o->merge] = create_ce_entry(info, names + i, stage,
+						    &o->result, o->merge,
+						    bit & dirmask);
 	}
 
 	if (o->merge) {
@@ -1208,11 +1234,23 @@ static struct cache_entry *find_cache_entry(struct traverse_info *info,
 {
 	int pos = find_cache_pos(info, p->path, p->pathlen);
 	struct unpack_trees_options *o = info->data;
+	struct cache_entry *ce;
 
 	if (0 <= pos)
 		return o->src_index->cache[pos];
-	else
+	if (pos == -1 || !S_ISDIR(p->mode))
 		return NULL;
+
+	/*
+	 * The index has entries in the directory p; if the first one
+	 * is a sparse directory entry for p itself, it stands for the
+	 * whole directory and matches p.
+	 */
+	ce = o->src_index->cache[-2 - pos];
+	if (S_ISSPARSEDIR(ce->ce_mode) &&
+	    ce_namelen(ce) == traverse_path_len(info, p->pathlen) + 1)
+		return ce;
+	return NULL;
 }
 
 static void debug_path(struct traverse_info *info)
@@ -1315,6 +1353,10 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 
 	/* Now handle any directories.. */
 	if (dirmask) {
+		/* a sparse directory has been unpacked as a whole */
+		if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode))
+			return mask;
+
 		/* special case: "diff-index --cached" looking at a tree */
 		if (o->diff_index_cached &&
 		    n == 1 && dirmask == 1 && S_ISDIR(names->mode)) {
@@ -516,6 +516,45 @@ int git_mkstemp_mode(char *pattern, int mode)
 	return git_mkstemps_mode(pattern, 0, mode);
 }
 
+static int fsync_loop(int fd)
+{
+	int err;
+
+	do {
+		err = fsync(fd);
+	} while (err < 0 && errno == EINTR);
+	return err;
+}
+
+int git_fsync(int fd, enum fsync_action action)
+{
+	switch (action) {
+	case FSYNC_WRITEOUT_ONLY:
+#ifdef HAVE_SYNC_FILE_RANGE
+		/*
+		 * Start writeback of the dirty pages and wait for any
+		 * writeback already in flight, but do not ask the device
+		 * to flush its own cache; a later FSYNC_HARDWARE_FLUSH on
+		 * the same filesystem takes care of that.
+		 */
+		return sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE |
+						  SYNC_FILE_RANGE_WRITE);
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	case FSYNC_HARDWARE_FLUSH:
+#ifdef __APPLE__
+		/* fsync() on macOS does not flush the drive's cache */
+		if (!fcntl(fd, F_FULLFSYNC))
+			return 0;
+#endif
+		return fsync_loop(fd);
+	default:
+		BUG("unexpected git_fsync(%d) call", action);
+	}
+}
+
 int xmkstemp_mode(char *filename_template, int mode)
 {
 	int fd;
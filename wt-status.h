@@ -78,6 +78,7 @@ enum wt_status_format {
 };
 
 #define SPARSE_CHECKOUT_DISABLED -1
+#define SPARSE_CHECKOUT_SPARSE_INDEX -2
 
 struct wt_status_state {
 	int merge_in_progress;
@@ -89,7 +90,7 @@ struct wt_status_state {
 	int bisect_in_progress;
 	int revert_in_progress;
 	int detached_at;
-	int sparse_checkout_percentage; /* SPARSE_CHECKOUT_DISABLED if not sparse */
+	int sparse_checkout_percentage; /* SPARSE_CHECKOUT_* if not a percentage */
 	char *branch;
 	char *onto;
 	char *detached_from;